@@ -0,0 +1,90 @@
+//==============================================================================
+// FILE:
+//    CFGSpanningTree.h
+//
+// DESCRIPTION:
+//    Declares CFGSpanningTree - a maximum spanning tree of the CFG of a
+//    function, used to minimise the number of counters needed for block and
+//    edge profiling (Knuth, "Optimal measurement points for program frequency
+//    counts", and Ball & Larus, "Optimally profiling and tracing programs").
+//
+//    The CFG is first extended with a virtual node that has an edge to the
+//    entry block and an edge from every exit block (i.e. a block without
+//    successors). In the resulting graph the flow is conserved at every node:
+//    the sum of the counts of the incoming edges equals the sum of the counts
+//    of the outgoing edges. Hence, it is sufficient to count the edges that
+//    are _not_ in a spanning tree - the counts of the tree edges can be
+//    reconstructed from these. Edges that are expected to execute frequently
+//    (as estimated by BlockFrequencyInfo) are added to the tree first, so that
+//    the counters end up on the cold edges.
+//
+//    This is not a plugin - it is compiled into the plugins that need it (see
+//    lib/CMakeLists.txt).
+//
+// License: MIT
+//==============================================================================
+#ifndef LLVM_TUTOR_CFG_SPANNING_TREE_H
+#define LLVM_TUTOR_CFG_SPANNING_TREE_H
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/BasicBlock.h"
+
+#include <cstdint>
+
+namespace llvm {
+class BlockFrequencyInfo;
+} // namespace llvm
+
+// An edge of the extended CFG. The virtual node is represented with nullptr.
+struct CFGEdge {
+  // nullptr for the edge from the virtual node to the entry block
+  llvm::BasicBlock *Src = nullptr;
+  // nullptr for the edges from the exit blocks to the virtual node
+  llvm::BasicBlock *Dst = nullptr;
+  // The index of this edge in the successor list of Src (CFG edges only)
+  unsigned SuccNum = 0;
+  // The estimated execution frequency of this edge
+  uint64_t Weight = 0;
+  // True if this edge is part of the spanning tree (i.e. doesn't need a
+  // counter)
+  bool InTree = false;
+};
+
+class CFGSpanningTree {
+public:
+  // Builds the spanning tree for F. If BFI is null, all edges are treated as
+  // equally hot. If AllEdges is true, the tree is left empty, i.e. every edge
+  // needs a counter (this is only useful as a baseline).
+  CFGSpanningTree(llvm::Function &F, llvm::BlockFrequencyInfo *BFI,
+                  bool AllEdges = false);
+
+  // The edges of the extended CFG: the edge from the virtual node first, then
+  // the successor edges of every block (in layout and successor order), each
+  // block followed by its edge to the virtual node (exit blocks only).
+  llvm::ArrayRef<CFGEdge> edges() const { return Edges; }
+
+  // The index of BB in the layout order of the function. The virtual node is
+  // numBlocks().
+  uint64_t getBlockIndex(const llvm::BasicBlock *BB) const {
+    return BB ? BlockIndices.lookup(BB) : NumBlocks;
+  }
+  uint64_t numBlocks() const { return NumBlocks; }
+
+  // Returns true if a counter can be placed on Edge, i.e. it can be split or
+  // it is the only edge out of its source or into its destination
+  static bool canInstrument(const CFGEdge &Edge);
+
+  // Returns the instruction before which the counter for Edge should be
+  // inserted. Splits Edge if it's critical. Splitting an edge doesn't change
+  // the number of successors or predecessors of any block, so the insertion
+  // points for the edges of a function can be computed in any order.
+  static llvm::Instruction *getInsertionPoint(const CFGEdge &Edge);
+
+private:
+  llvm::SmallVector<CFGEdge, 32> Edges;
+  llvm::DenseMap<const llvm::BasicBlock *, uint64_t> BlockIndices;
+  uint64_t NumBlocks = 0;
+};
+
+#endif // LLVM_TUTOR_CFG_SPANNING_TREE_H
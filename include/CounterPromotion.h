@@ -0,0 +1,65 @@
+//==============================================================================
+// FILE:
+//    CounterPromotion.h
+//
+// DESCRIPTION:
+//    Declares utilities for promoting the counters injected by instrumentation
+//    passes out of loops. A counter that is updated inside a loop costs a
+//    load/add/store on every iteration and, as the counter might alias with
+//    the memory accessed by the loop, blocks optimisations like
+//    vectorisation. Instead, the updates can be accumulated in a register
+//    (i.e. an SSA value) and written back once on every exit from the loop:
+//    ```
+//      for (...) {                      uint64_t Delta = 0;
+//        Counter++;                     for (...) {
+//        ...                      =>      Delta++;
+//      }                                  ...
+//                                       }
+//                                       Counter += Delta;
+//    ```
+//    This is the same transformation that LLVM applies to its own PGO
+//    counters (see InstrProfiling.cpp).
+//
+//    This is not a plugin - it is compiled into the plugins that need it (see
+//    lib/CMakeLists.txt).
+//
+// License: MIT
+//==============================================================================
+#ifndef LLVM_TUTOR_COUNTER_PROMOTION_H
+#define LLVM_TUTOR_COUNTER_PROMOTION_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/IR/IRBuilder.h"
+
+// A counter update injected by an instrumentation pass, i.e.
+// ```
+//    %old = load i64, ptr %counter
+//    %new = add i64 %inc, %old
+//    store i64 %new, ptr %counter
+// ```
+struct CounterUpdate {
+  llvm::LoadInst *Load = nullptr;
+  llvm::Instruction *Add = nullptr;
+  llvm::StoreInst *Store = nullptr;
+};
+
+// Injects `*Counter += Inc` at the insertion point of Builder
+CounterUpdate injectCounterUpdate(llvm::IRBuilder<> &Builder,
+                                  llvm::Value *Counter, llvm::Value *Inc);
+
+// Promotes the counters updated by Updates (all of these have to be in F)
+// out of the loops in F. Every loop with a preheader (one is inserted if
+// needed), dedicated exit blocks (ditto) and at least one exit is considered,
+// innermost loops first. The updates inside the loop are replaced with
+// updates of an SSA value and the counter is updated once in every exit
+// block. These write-backs are then promoted out of the enclosing loop (if
+// any), and so on. Returns the number of counters promoted.
+//
+// Note that the updates accumulated in registers are lost if the loop is left
+// without passing through an exit block (e.g. when a callee calls `exit` or
+// `longjmp`) and that they are not visible to other threads (e.g. the lt_rt
+// flusher) until the loop exits.
+unsigned promoteCounterUpdates(llvm::Function &F,
+                               llvm::ArrayRef<CounterUpdate> Updates);
+
+#endif // LLVM_TUTOR_COUNTER_PROMOTION_H
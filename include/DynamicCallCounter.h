@@ -11,22 +11,111 @@
 #ifndef LLVM_TUTOR_INSTRUMENT_BASIC_H
 #define LLVM_TUTOR_INSTRUMENT_BASIC_H
 
+#include "FunctionFilter.h"
+
+#include "llvm/Analysis/BlockFrequencyInfo.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/PassManager.h"
 #include "llvm/Pass.h"
 
+//------------------------------------------------------------------------------
+// Pass options, i.e. `-passes="dynamic-cc<option1;option2>"`
+//------------------------------------------------------------------------------
+struct DynamicCallCounterOptions {
+  // `tls` - every thread increments its own (thread-local) copy of the
+  // counters. The per-thread copies are merged into the global counters when
+  // the thread (or the process) exits.
+  bool ThreadLocal = false;
+  // `binary` - instead of printing the results to stdout, append the raw
+  // counter and name tables to a binary profile file (see ProfileFormat.h)
+  bool BinaryOutput = false;
+  // `flush` - register the counter table with the lt_rt runtime library
+  // (runtime/lt_rt.h), which writes binary profiles on demand, periodically
+  // and at exit. The instrumented program has to be linked against lt_rt.
+  bool Flush = false;
+  // `edges` - also count how often every call site executes and, for indirect
+  // calls, which functions it reaches. The result is a weighted dynamic call
+  // graph. Implies `flush` (lt_rt writes the call graph).
+  bool CallEdges = false;
+  // `blocks` - also count how often every basic block and every CFG edge
+  // executes. Only the edges off a maximum spanning tree of the CFG (weighted
+  // with BlockFrequencyInfo) get a counter - the runtime reconstructs the
+  // remaining counts. `blocks=all` instruments every edge instead (mostly
+  // useful as a baseline). Implies `flush` (lt_rt writes the counts).
+  enum class BlockCounting { None, SpanningTree, AllEdges };
+  BlockCounting Blocks = BlockCounting::None;
+  // `timing` - also measure the time spent in every function, including
+  // (inclusive) and excluding (exclusive) its callees. Every function entry
+  // and every return calls into lt_rt, which reads the clock (`rdtsc` or
+  // `clock_gettime`) and keeps a per-thread shadow stack of the active
+  // functions. Implies `flush` (lt_rt writes the times).
+  bool Timing = false;
+  // `cct` - also build a calling-context tree per thread, i.e. count how
+  // often every distinct call path (e.g. `main -> foo -> bar`) is entered.
+  // Uses the same lt_rt hooks as `timing` (the two can be combined). dcc-prof
+  // prints the trees as folded stacks for flame graph tools. Implies `flush`
+  // (lt_rt writes the trees).
+  bool CallingContexts = false;
+  // `shm` - let lt_rt export the live call counts through a POSIX
+  // shared-memory segment named after the process (`/lt_rt.<pid>`), so that
+  // other processes (e.g. lt-top) can read them while the program is
+  // running. The counter table is page aligned, so that lt_rt can map the
+  // segment over it - the code that increments the counters doesn't change.
+  // Implies `flush`. Not supported in the `tls` mode (the thread-local counts
+  // wouldn't be visible until the threads exit).
+  bool SharedMemory = false;
+
+  // `coverage` - instead of counting the calls, only record which functions
+  // were executed: every function entry stores 1 into the function's byte
+  // in `dcc_coverage` (a single store, no load). `coverage=blocks` does the
+  // same for every basic block. lt_rt writes the bytes as a bitmap. Implies
+  // `flush`. Can only be combined with the function filters.
+  enum class CoverageMode { None, Functions, Blocks };
+  CoverageMode Coverage = CoverageMode::None;
+
+  // `no-promote` - don't promote the call site and the block counters out of
+  // loops (see CounterPromotion.h). Promotion keeps these counters in
+  // registers inside loops and updates memory once per loop exit, so the
+  // snapshots written by lt_rt while a loop is running miss its iterations.
+  bool PromoteCounters = true;
+
+  // Print (or, in the `binary` mode, write) the counts when the module exits.
+  // This is not a pass parameter - tools that read `dcc_counters` themselves
+  // (e.g. dcc-run) turn it off. Ignored when lt_rt writes the profile.
+  bool Report = true;
+
+  // `allow=FILE`, `deny=FILE`, `min-size=N`, `skip-cold`, `only-hot` and
+  // `min-entry-count=N` - only instrument the selected functions (see
+  // FunctionFilter.h)
+  FunctionFilterOptions Filter;
+
+  // True if the profile is written by the lt_rt runtime
+  bool usesRuntime() const {
+    return Flush || CallEdges || Blocks != BlockCounting::None || Timing ||
+           CallingContexts || SharedMemory || Coverage != CoverageMode::None;
+  }
+};
+
 //------------------------------------------------------------------------------
 // New PM interface
 //------------------------------------------------------------------------------
 struct DynamicCallCounter : public llvm::PassInfoMixin<DynamicCallCounter> {
+  explicit DynamicCallCounter(DynamicCallCounterOptions Opts = {})
+      : Opts(Opts) {}
+
   llvm::PreservedAnalyses run(llvm::Module &M,
                               llvm::ModuleAnalysisManager &);
-  bool runOnModule(llvm::Module &M);
+  bool runOnModule(
+      llvm::Module &M,
+      llvm::function_ref<llvm::BlockFrequencyInfo &(llvm::Function &)> GetBFI);
 
   // Without isRequired returning true, this pass will be skipped for functions
   // decorated with the optnone LLVM attribute. Note that clang -O0 decorates
   // all functions with optnone.
   static bool isRequired() { return true; }
+
+private:
+  DynamicCallCounterOptions Opts;
 };
 
 #endif
@@ -0,0 +1,77 @@
+//==============================================================================
+// FILE:
+//    FunctionFilter.h
+//
+// DESCRIPTION:
+//    Declares the function filters shared by the instrumentation passes
+//    (InjectFuncCall and DynamicCallCounter). By default, these passes
+//    instrument every function defined in the module. The filters restrict
+//    that to the functions that are worth the overhead, e.g.:
+//    ```
+//      opt -passes="dynamic-cc<deny=skip.txt;min-size=20;skip-cold>" ...
+//    ```
+//    The function-entry-count and the `hot`/`cold` filters make most sense
+//    after applying a profile, e.g. with ProfileAnnotator.
+//
+//    This is not a plugin - it is compiled into the plugins that need it (see
+//    lib/CMakeLists.txt).
+//
+// License: MIT
+//==============================================================================
+#ifndef LLVM_TUTOR_FUNCTION_FILTER_H
+#define LLVM_TUTOR_FUNCTION_FILTER_H
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Error.h"
+
+#include <string>
+
+//------------------------------------------------------------------------------
+// Filter options, i.e. `-passes="<pass-name><option1;option2>"`
+//------------------------------------------------------------------------------
+struct FunctionFilterOptions {
+  // `allow=FILE` - only instrument the functions whose names match one of the
+  // regexes in FILE. The regexes (one per line, empty lines and lines
+  // starting with `#` are ignored) have to match the whole name.
+  std::string AllowList;
+  // `deny=FILE` - don't instrument the functions whose names match one of the
+  // regexes in FILE (same format as above). Takes precedence over `allow`.
+  std::string DenyList;
+  // `min-size=N` - don't instrument functions with fewer than N IR
+  // instructions
+  uint64_t MinSize = 0;
+  // `skip-cold` - don't instrument functions marked as `cold`
+  bool SkipCold = false;
+  // `only-hot` - only instrument functions marked as `hot`
+  bool OnlyHot = false;
+  // `min-entry-count=N` - don't instrument functions with an entry count
+  // (the `function_entry_count` metadata) below N. Functions without an entry
+  // count are instrumented.
+  uint64_t MinEntryCount = 0;
+
+  // True if any filter is set
+  bool isActive() const {
+    return !AllowList.empty() || !DenyList.empty() || MinSize || SkipCold ||
+           OnlyHot || MinEntryCount;
+  }
+};
+
+// Parses Param into Opts if it's one of the filter options. Returns false if
+// Param is not a filter option and an error if its value is invalid. PassName
+// is used in the error messages.
+llvm::Expected<bool> parseFunctionFilterParam(llvm::StringRef Param,
+                                              llvm::StringRef PassName,
+                                              FunctionFilterOptions &Opts);
+
+// Returns the functions defined in M that pass the filters in Opts (in module
+// order). If any filter is set, reports the number of functions selected and
+// skipped as a remark. Unreadable allow/deny lists and invalid regexes are
+// reported as errors, nothing is selected then.
+llvm::SmallVector<llvm::Function *, 16>
+selectFunctionsToInstrument(llvm::Module &M,
+                            const FunctionFilterOptions &Opts,
+                            llvm::StringRef PassName);
+
+#endif // LLVM_TUTOR_FUNCTION_FILTER_H
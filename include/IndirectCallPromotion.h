@@ -0,0 +1,58 @@
+//==============================================================================
+// FILE:
+//    IndirectCallPromotion.h
+//
+// DESCRIPTION:
+//    Declares the IndirectCallPromotion pass for the new pass manager.
+//
+// License: MIT
+//==============================================================================
+#ifndef LLVM_TUTOR_INDIRECT_CALL_PROMOTION_H
+#define LLVM_TUTOR_INDIRECT_CALL_PROMOTION_H
+
+#include "ProfileReader.h"
+
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Pass.h"
+
+#include <string>
+
+//------------------------------------------------------------------------------
+// Pass options, i.e. `-passes="indirect-call-promotion<option1;option2>"`
+//------------------------------------------------------------------------------
+struct IndirectCallPromotionOptions {
+  // `file=PATH` - the profile to read. Defaults to the file that lt_rt writes,
+  // i.e. LT_PROFILE_FILE or `default.ltprof` (see ProfileFormat.h).
+  std::string ProfileFile;
+  // `threshold=P` - only promote targets that receive at least P percent of
+  // the calls that are still indirect (i.e. not yet promoted) at a call site
+  uint64_t Threshold = 30;
+  // `max-targets=N` - promote at most N targets per call site
+  uint64_t MaxTargets = 3;
+};
+
+//------------------------------------------------------------------------------
+// New PM interface
+//------------------------------------------------------------------------------
+struct IndirectCallPromotion
+    : public llvm::PassInfoMixin<IndirectCallPromotion> {
+  explicit IndirectCallPromotion(IndirectCallPromotionOptions Opts = {})
+      : Opts(std::move(Opts)) {}
+
+  llvm::PreservedAnalyses run(llvm::Module &M,
+                              llvm::ModuleAnalysisManager &);
+  // Promotes the indirect calls in M that are hot in Prof. Returns true if M
+  // was modified.
+  bool runOnModule(llvm::Module &M, const Profile &Prof);
+
+  // Without isRequired returning true, this pass will be skipped for functions
+  // decorated with the optnone LLVM attribute. Note that clang -O0 decorates
+  // all functions with optnone.
+  static bool isRequired() { return true; }
+
+private:
+  IndirectCallPromotionOptions Opts;
+};
+
+#endif // LLVM_TUTOR_INDIRECT_CALL_PROMOTION_H
@@ -10,14 +10,54 @@
 #ifndef LLVM_TUTOR_INSTRUMENT_BASIC_H
 #define LLVM_TUTOR_INSTRUMENT_BASIC_H
 
+#include "FunctionFilter.h"
+
 #include "llvm/IR/Module.h"
 #include "llvm/IR/PassManager.h"
 #include "llvm/Pass.h"
 
+//------------------------------------------------------------------------------
+// Pass options, i.e. `-passes="inject-func-call<option1;option2>"`
+//------------------------------------------------------------------------------
+struct InjectFuncCallOptions {
+  enum class TraceMode {
+    // Call printf
+    None,
+    // `trace` - instead of calling printf, record a binary event (function
+    // ID, timestamp and the number of arguments) in a per-thread ring buffer
+    // managed by the lt_rt runtime. Use lt-trace to decode the trace.
+    Entry,
+    // `trace=entry-exit` - as above, but also record an event before every
+    // `ret` and `resume`, so that lt-trace can reconstruct the durations and
+    // the nesting of the calls
+    EntryExit,
+    // `trace=patchable` - instead of calling lt_rt, request XRay sleds (i.e.
+    // patchable no-op instruction sequences) at the entry and the exits of
+    // every function. The sleds cost next to nothing until lt_rt patches them
+    // into calls that record the same events as `trace=entry-exit`, e.g. in a
+    // running process (x86-64 only).
+    Patchable
+  };
+  TraceMode Trace = TraceMode::None;
+
+  // `args=FILE` - in the `trace` and `trace=entry-exit` modes, also record
+  // the values of selected integer and pointer arguments. Every line of FILE
+  // names a function and the indices of the arguments to capture, e.g.
+  // `memcpy_wrapper 2` (empty lines and lines starting with `#` are ignored).
+  std::string ArgsConfig;
+
+  // `allow=FILE`, `deny=FILE`, `min-size=N`, `skip-cold`, `only-hot` and
+  // `min-entry-count=N` - only instrument the selected functions (see
+  // FunctionFilter.h)
+  FunctionFilterOptions Filter;
+};
+
 //------------------------------------------------------------------------------
 // New PM interface
 //------------------------------------------------------------------------------
 struct InjectFuncCall : public llvm::PassInfoMixin<InjectFuncCall> {
+  explicit InjectFuncCall(InjectFuncCallOptions Opts = {}) : Opts(Opts) {}
+
   llvm::PreservedAnalyses run(llvm::Module &M,
                               llvm::ModuleAnalysisManager &);
   bool runOnModule(llvm::Module &M);
@@ -26,6 +66,17 @@ struct InjectFuncCall : public llvm::PassInfoMixin<InjectFuncCall> {
   // decorated with the optnone LLVM attribute. Note that clang -O0 decorates
   // all functions with optnone.
   static bool isRequired() { return true; }
+
+private:
+  // Implements the `trace` modes
+  bool injectTraceCalls(llvm::Module &M);
+  // Implements the `trace=patchable` mode
+  llvm::GlobalVariable *
+  createPatchableModule(llvm::Module &M,
+                        llvm::ArrayRef<llvm::Function *> Functions,
+                        llvm::Constant *TraceInit);
+
+  InjectFuncCallOptions Opts;
 };
 
 #endif
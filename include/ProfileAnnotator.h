@@ -0,0 +1,51 @@
+//==============================================================================
+// FILE:
+//    ProfileAnnotator.h
+//
+// DESCRIPTION:
+//    Declares the ProfileAnnotator pass for the new pass manager.
+//
+// License: MIT
+//==============================================================================
+#ifndef LLVM_TUTOR_PROFILE_ANNOTATOR_H
+#define LLVM_TUTOR_PROFILE_ANNOTATOR_H
+
+#include "ProfileReader.h"
+
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Pass.h"
+
+#include <string>
+
+//------------------------------------------------------------------------------
+// Pass options, i.e. `-passes="profile-annotator<option1;option2>"`
+//------------------------------------------------------------------------------
+struct ProfileAnnotatorOptions {
+  // `file=PATH` - the profile to read. Defaults to the file that lt_rt writes,
+  // i.e. LT_PROFILE_FILE or `default.ltprof` (see ProfileFormat.h).
+  std::string ProfileFile;
+};
+
+//------------------------------------------------------------------------------
+// New PM interface
+//------------------------------------------------------------------------------
+struct ProfileAnnotator : public llvm::PassInfoMixin<ProfileAnnotator> {
+  explicit ProfileAnnotator(ProfileAnnotatorOptions Opts = {})
+      : Opts(std::move(Opts)) {}
+
+  llvm::PreservedAnalyses run(llvm::Module &M,
+                              llvm::ModuleAnalysisManager &);
+  // Annotates M with the counts from Prof. Returns true if M was modified.
+  bool runOnModule(llvm::Module &M, const Profile &Prof);
+
+  // Without isRequired returning true, this pass will be skipped for functions
+  // decorated with the optnone LLVM attribute. Note that clang -O0 decorates
+  // all functions with optnone.
+  static bool isRequired() { return true; }
+
+private:
+  ProfileAnnotatorOptions Opts;
+};
+
+#endif // LLVM_TUTOR_PROFILE_ANNOTATOR_H
@@ -0,0 +1,376 @@
+//==============================================================================
+// FILE:
+//    ProfileFormat.h
+//
+// DESCRIPTION:
+//    Describes the binary profile format used by the llvm-tutor
+//    instrumentation passes (e.g. `dynamic-cc<binary>`). A profile file is a
+//    sequence of records, one per instrumented module:
+//
+//      +--------------------+
+//      | LTProfRecordHeader |  Magic, Version, Kind, Size
+//      +--------------------+
+//      | payload            |  Size bytes, depends on Kind
+//      +--------------------+
+//      | LTProfRecordHeader |
+//      +--------------------+
+//      | ...                |
+//
+//    The payload of an LT_PROF_FUNCTION_COUNTS record is:
+//
+//      LTProfFunctionCountsHeader  NumCounters, NamesSize
+//      uint64_t[NumCounters]       the raw counter table (slot order)
+//      char[NamesSize]             the raw name table (NUL-separated names in
+//                                  slot order)
+//      char[]                      zero padding up to a multiple of 8 bytes
+//
+//    These are just verbatim copies of the `dcc_counters` and `dcc_names`
+//    tables, so writing a record is three `fwrite` calls.
+//
+//    The payload of an LT_PROF_CALL_EDGES record (the dynamic call graph of
+//    one module, written by lt_rt) is:
+//
+//      LTProfCallEdgesHeader       NumEdges, NamesSize
+//      LTProfCallEdge[NumEdges]    one entry per call site and callee
+//      char[NamesSize]             the NUL-terminated caller and callee names
+//                                  (referenced by their offsets)
+//      char[]                      zero padding up to a multiple of 8 bytes
+//
+//    The payload of an LT_PROF_BLOCK_COUNTS record (the block and CFG edge
+//    counts of the functions of one module, written by lt_rt) is:
+//
+//      LTProfBlockCountsHeader           NumFunctions, NumBlocks, NumEdges,
+//                                        NamesSize
+//      LTProfBlockFunction[NumFunctions] the functions
+//      uint64_t[NumBlocks]               the block counts of all functions
+//                                        (function by function, in layout
+//                                        order)
+//      LTProfBlockEdge[NumEdges]         the edge counts of all functions
+//                                        (function by function)
+//      char[NamesSize]                   the NUL-terminated function names
+//      char[]                            zero padding up to a multiple of 8
+//
+//    The payload of an LT_PROF_FUNCTION_TIMES record (the time spent in the
+//    functions of one module, written by lt_rt) is:
+//
+//      LTProfFunctionTimesHeader         NumFunctions, Unit
+//      LTProfFunctionTimes[NumFunctions] the times (slot order)
+//
+//    This record doesn't name the functions - it always follows the
+//    LT_PROF_FUNCTION_COUNTS record of the same module (with NumFunctions ==
+//    NumCounters).
+//
+//    The payload of an LT_PROF_CALLING_CONTEXTS record (the calling-context
+//    trees of all threads, written by lt_rt once per profile, after the
+//    per-module records) is:
+//
+//      LTProfContextsHeader              NumNodes, NamesSize
+//      LTProfContextNode[NumNodes]       the nodes of all trees, in preorder
+//      char[NamesSize]                   the NUL-terminated function names
+//      char[]                            zero padding up to a multiple of 8
+//
+//    The payload of an LT_PROF_COVERAGE record (which functions, or blocks,
+//    of one module were executed, written by lt_rt instead of the
+//    LT_PROF_FUNCTION_COUNTS record in the `coverage` mode) is:
+//
+//      LTProfCoverageHeader              NumFunctions, NumBlocks, NamesSize
+//      uint64_t[NumFunctions]            the number of blocks of every
+//                                        function (slot order), only present
+//                                        if NumBlocks != 0
+//      uint8_t[(NumBits + 7) / 8]        the bitmap: bit N % 8 of byte N / 8
+//                                        is set if function N (slot order)
+//                                        or, if NumBlocks != 0, block N
+//                                        (function by function, in layout
+//                                        order) was executed. NumBits is
+//                                        NumBlocks or, if that's 0,
+//                                        NumFunctions.
+//      char[NamesSize]                   the NUL-separated function names
+//                                        (slot order)
+//      char[]                            zero padding up to a multiple of 8
+//
+//    Function traces (`inject-func-call<trace>`) are written to a separate
+//    file, which uses the same record format. The payload of an
+//    LT_PROF_TRACE_FUNCTIONS record (the functions of one traced module,
+//    written by lt_rt when the module is registered) is:
+//
+//      LTProfTraceFunctionsHeader        FirstId, NumFunctions, NamesSize
+//      char[NamesSize]                   the NUL-separated function names
+//                                        (the name of function FirstId + N
+//                                        is the Nth name)
+//      char[]                            zero padding up to a multiple of 8
+//
+//    The payload of an LT_PROF_TRACE_EVENTS record (a batch of events
+//    recorded by one thread, written by lt_rt when the thread or the process
+//    exits or, with LT_RT_TRACE_FLUSH=full, when the thread's buffer fills
+//    up) is:
+//
+//      LTProfTraceEventsHeader           Thread, NumEvents, Dropped, Unit,
+//                                        TicksPerSecond
+//      LTProfTraceEvent[NumEvents]       the events (oldest first)
+//
+//    A thread can write multiple LT_PROF_TRACE_EVENTS records, the later
+//    records contain the later events.
+//
+//    The live counters of the modules instrumented with `dynamic-cc<shm>` are
+//    not written to a file - lt_rt exports them through a POSIX shared-memory
+//    segment named LT_SHM_NAME_PREFIX followed by the process ID (e.g.
+//    `/lt_rt.1234`), for as long as the process is running:
+//
+//      LTShmHeader                       the first page
+//      LTShmModule                       one region per module (starting at
+//      char[NamesSize]                   FirstModule, page aligned): the
+//      uint64_t[NumCounters]             module, its names and (at the next
+//                                        page boundary) its live counters
+//      ...
+//
+//    The counters are updated in place by the instrumented code. Modules are
+//    only ever appended - a reader that sees NumModules (an acquire load)
+//    can then read that many modules from a segment of Size bytes.
+//
+//    All records (and hence all counter arrays) are 8-byte aligned, so a
+//    memory-mapped profile can be read in place. Integers are stored in the
+//    byte order of the machine that wrote the profile.
+//
+//    This is a C header so that it can be shared with code that is linked into
+//    instrumented programs.
+//
+// License: MIT
+//==============================================================================
+#ifndef LLVM_TUTOR_PROFILE_FORMAT_H
+#define LLVM_TUTOR_PROFILE_FORMAT_H
+
+#include <stdint.h>
+
+// "LTPROF" followed by two NUL characters (when written in little endian)
+#define LT_PROF_MAGIC 0x0000464f5250544cULL
+#define LT_PROF_VERSION 1
+
+// The default name of the profile file. Override it with the LT_PROFILE_FILE
+// environment variable.
+#define LT_PROF_DEFAULT_FILE "default.ltprof"
+#define LT_PROF_FILE_ENV_VAR "LT_PROFILE_FILE"
+
+// The default name of the trace file. Override it with the LT_TRACE_FILE
+// environment variable.
+#define LT_TRACE_DEFAULT_FILE "default.lttrace"
+#define LT_TRACE_FILE_ENV_VAR "LT_TRACE_FILE"
+
+enum LTProfRecordKind {
+  // Function entry counts (DynamicCallCounter)
+  LT_PROF_FUNCTION_COUNTS = 1,
+  // Caller -> callee edge counts (`dynamic-cc<edges>`)
+  LT_PROF_CALL_EDGES = 2,
+  // Basic block and CFG edge counts (`dynamic-cc<blocks>`)
+  LT_PROF_BLOCK_COUNTS = 3,
+  // Inclusive and exclusive time per function (`dynamic-cc<timing>`)
+  LT_PROF_FUNCTION_TIMES = 4,
+  // Calling-context trees (`dynamic-cc<cct>`)
+  LT_PROF_CALLING_CONTEXTS = 5,
+  // The names of traced functions (`inject-func-call<trace>`)
+  LT_PROF_TRACE_FUNCTIONS = 6,
+  // The events recorded by one thread (`inject-func-call<trace>`)
+  LT_PROF_TRACE_EVENTS = 7,
+  // Function or block coverage (`dynamic-cc<coverage>`)
+  LT_PROF_COVERAGE = 8
+};
+
+typedef struct {
+  uint64_t Magic;
+  uint32_t Version;
+  uint32_t Kind;
+  // The size of the payload that follows this header (a multiple of 8)
+  uint64_t Size;
+} LTProfRecordHeader;
+
+typedef struct {
+  uint64_t NumCounters;
+  // The size of the name table, excluding the padding
+  uint64_t NamesSize;
+} LTProfFunctionCountsHeader;
+
+typedef struct {
+  uint64_t NumEdges;
+  // The size of the name table, excluding the padding
+  uint64_t NamesSize;
+} LTProfCallEdgesHeader;
+
+// Set for edges recorded at indirect call sites
+#define LT_PROF_EDGE_INDIRECT 0x1
+// The callee name used for the calls from an indirect call site to targets
+// that didn't fit into the (bounded) table of targets for that site
+#define LT_PROF_OTHER_TARGETS "<other>"
+
+typedef struct {
+  // The offsets of the caller and the callee names in the name table
+  uint64_t Caller;
+  uint64_t Callee;
+  // The index of the call site within the caller (in instruction order)
+  uint64_t Site;
+  // LT_PROF_EDGE_* flags
+  uint64_t Flags;
+  uint64_t Count;
+} LTProfCallEdge;
+
+typedef struct {
+  uint64_t NumFunctions;
+  // The total number of blocks and edges (in all functions)
+  uint64_t NumBlocks;
+  uint64_t NumEdges;
+  // The size of the name table, excluding the padding
+  uint64_t NamesSize;
+} LTProfBlockCountsHeader;
+
+typedef struct {
+  // The offset of the function name in the name table
+  uint64_t Name;
+  uint64_t NumBlocks;
+  uint64_t NumEdges;
+} LTProfBlockFunction;
+
+typedef struct {
+  // The indices of the source and the destination blocks (in layout order).
+  // NumBlocks (of the function) stands for the function entry (as Src) and
+  // the function exit (as Dst).
+  uint64_t Src;
+  uint64_t Dst;
+  uint64_t Count;
+} LTProfBlockEdge;
+
+// The units of LTProfFunctionTimes
+enum LTProfTimeUnit {
+  // Time stamp counter ticks (`rdtsc`)
+  LT_PROF_TIME_CYCLES = 0,
+  // Nanoseconds (`clock_gettime`)
+  LT_PROF_TIME_NANOSECONDS = 1
+};
+
+typedef struct {
+  uint64_t NumFunctions;
+  // An LTProfTimeUnit
+  uint64_t Unit;
+} LTProfFunctionTimesHeader;
+
+typedef struct {
+  // The time spent in the function, including and excluding its callees
+  uint64_t Inclusive;
+  uint64_t Exclusive;
+} LTProfFunctionTimes;
+
+typedef struct {
+  uint64_t NumNodes;
+  // The size of the name table, excluding the padding
+  uint64_t NamesSize;
+} LTProfContextsHeader;
+
+// LTProfContextNode::Parent of the outermost instrumented function of a call
+// path (e.g. `main` or a thread's start routine)
+#define LT_PROF_NO_PARENT UINT64_MAX
+
+// A calling context, i.e. a path of calls between instrumented functions
+typedef struct {
+  // The index of the calling context of the caller (always smaller than the
+  // index of this node) or LT_PROF_NO_PARENT
+  uint64_t Parent;
+  // The offset of the function name in the name table
+  uint64_t Name;
+  // The number of times this calling context was entered
+  uint64_t Count;
+} LTProfContextNode;
+
+typedef struct {
+  uint64_t NumFunctions;
+  // The total number of blocks (in all functions), 0 for function coverage
+  uint64_t NumBlocks;
+  // The size of the name table, excluding the padding
+  uint64_t NamesSize;
+} LTProfCoverageHeader;
+
+typedef struct {
+  // The ID of the first function of the module. IDs are assigned by lt_rt
+  // (consecutively, in the order in which the modules are registered).
+  uint64_t FirstId;
+  uint64_t NumFunctions;
+  // The size of the name table, excluding the padding
+  uint64_t NamesSize;
+} LTProfTraceFunctionsHeader;
+
+typedef struct {
+  // Numbers the threads of one process in the order in which they recorded
+  // their first event, starting from 1
+  uint64_t Thread;
+  uint64_t NumEvents;
+  // The number of events that were recorded by this thread after its
+  // previous record (or since it started) and before the first event of this
+  // record, but were overwritten before they could be written (the
+  // per-thread buffers are ring buffers)
+  uint64_t Dropped;
+  // An LTProfTimeUnit
+  uint64_t Unit;
+  // The rate of the clock, i.e. 1000000000 for LT_PROF_TIME_NANOSECONDS and
+  // the (measured) TSC frequency for LT_PROF_TIME_CYCLES
+  uint64_t TicksPerSecond;
+} LTProfTraceEventsHeader;
+
+enum LTProfTraceEventKind {
+  // A function entry
+  LT_PROF_TRACE_ENTRY = 0,
+  // A function exit (`inject-func-call<trace=entry-exit>`), i.e. a `ret` or
+  // a `resume`
+  LT_PROF_TRACE_EXIT = 1,
+  // The value of an integer argument (`inject-func-call<args=FILE>`). Follows
+  // the entry event of its function (and the preceding argument events) in
+  // the same thread.
+  LT_PROF_TRACE_ARGUMENT = 2,
+  // As above, but the value of a pointer argument
+  LT_PROF_TRACE_POINTER_ARGUMENT = 3
+};
+
+typedef struct {
+  // The value of the argument (sign-extended to 64 bits) for argument events
+  uint64_t Timestamp;
+  // The ID of the function (see LTProfTraceFunctionsHeader)
+  uint32_t Function;
+  // The number of arguments of the function (0 for exits, saturates at
+  // UINT16_MAX). The index of the argument for argument events.
+  uint16_t NumArgs;
+  // An LTProfTraceEventKind
+  uint16_t Kind;
+} LTProfTraceEvent;
+
+// "LTSHM" followed by three NUL characters (when written in little endian)
+#define LT_SHM_MAGIC 0x0000004d4853544cULL
+#define LT_SHM_VERSION 1
+
+// The name of the shared-memory segment of a process is LT_SHM_NAME_PREFIX
+// followed by its PID
+#define LT_SHM_NAME_PREFIX "/lt_rt."
+
+typedef struct {
+  uint64_t Magic;
+  uint32_t Version;
+  uint32_t Reserved;
+  // The ID of the process that exports the counters
+  uint64_t Pid;
+  // The offset of the first LTShmModule
+  uint64_t FirstModule;
+  // The number of modules (incremented with release semantics after a module
+  // has been added)
+  uint64_t NumModules;
+  // The size of the segment that holds NumModules modules
+  uint64_t Size;
+  // The name of the program (NUL-terminated, possibly truncated)
+  char Name[64];
+} LTShmHeader;
+
+typedef struct {
+  // The offset of the next module (i.e. of the end of this one)
+  uint64_t Next;
+  uint64_t NumCounters;
+  // The size of the name table that follows this struct (NUL-separated
+  // names in slot order)
+  uint64_t NamesSize;
+  // The offset of the counter table (slot order)
+  uint64_t Counters;
+} LTShmModule;
+
+#endif // LLVM_TUTOR_PROFILE_FORMAT_H
@@ -0,0 +1,160 @@
+//==============================================================================
+// FILE:
+//    ProfileReader.h
+//
+// DESCRIPTION:
+//    Declares a reader for the binary profiles described in ProfileFormat.h.
+//    The reader doesn't copy the counters - the returned records point
+//    directly into the input buffer (normally a memory-mapped file), so the
+//    buffer has to outlive them.
+//
+// License: MIT
+//==============================================================================
+#ifndef LLVM_TUTOR_PROFILE_READER_H
+#define LLVM_TUTOR_PROFILE_READER_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBufferRef.h"
+
+#include <vector>
+
+// The function entry counts recorded for one instrumented module
+struct ProfileModuleRecord {
+  // The raw counter table (in slot order)
+  llvm::ArrayRef<uint64_t> Counters;
+  // The names of the instrumented functions (in slot order)
+  std::vector<llvm::StringRef> Names;
+
+  // The time spent in the instrumented functions (in slot order). Empty
+  // unless the profile contains an LT_PROF_FUNCTION_TIMES record for this
+  // module (`dynamic-cc<timing>`).
+  struct FunctionTimes {
+    uint64_t Inclusive;
+    uint64_t Exclusive;
+  };
+  std::vector<FunctionTimes> Times;
+  // True if Times are in TSC ticks, false if in nanoseconds
+  bool TimesInCycles = false;
+};
+
+// One edge of the dynamic call graph (`dynamic-cc<edges>`)
+struct ProfileCallEdge {
+  llvm::StringRef Caller;
+  llvm::StringRef Callee;
+  // The index of the call site within Caller (in instruction order)
+  uint64_t Site;
+  // True for edges recorded at indirect call sites
+  bool Indirect;
+  uint64_t Count;
+};
+
+// The block and CFG edge counts of one function (`dynamic-cc<blocks>`)
+struct ProfileBlockCounts {
+  llvm::StringRef Function;
+  // The block counts (in layout order)
+  llvm::ArrayRef<uint64_t> Blocks;
+  // The edges of the CFG. Blocks.size() stands for the function entry (as
+  // Src) and the function exit (as Dst).
+  struct Edge {
+    uint64_t Src;
+    uint64_t Dst;
+    uint64_t Count;
+  };
+  std::vector<Edge> Edges;
+};
+
+// The functions (or blocks) of one module that were executed
+// (`dynamic-cc<coverage>`)
+struct ProfileCoverage {
+  // The names of the instrumented functions (in slot order)
+  std::vector<llvm::StringRef> Names;
+  // The number of blocks of every function (in slot order). Empty unless the
+  // module was instrumented with `coverage=blocks`.
+  std::vector<uint64_t> NumBlocks;
+  // The raw bitmap, one bit per function (in slot order) or, if NumBlocks is
+  // not empty, per block (function by function, in layout order)
+  llvm::ArrayRef<uint8_t> Bitmap;
+  // The number of bits in Bitmap
+  uint64_t NumBits;
+
+  bool isCovered(uint64_t Bit) const {
+    return Bitmap[Bit / 8] & (1u << Bit % 8);
+  }
+};
+
+// A node of a calling-context tree (`dynamic-cc<cct>`)
+struct ProfileContextNode {
+  // The index of the caller's node in Profile::CallingContexts (always smaller
+  // than the index of this node) or NoParent for the outermost function
+  uint64_t Parent;
+  llvm::StringRef Function;
+  // The number of times this calling context was entered
+  uint64_t Count;
+
+  static constexpr uint64_t NoParent = UINT64_MAX;
+};
+
+// A function entry or exit (or a captured argument) recorded by
+// `inject-func-call<trace>`. Matches LTProfTraceEvent in ProfileFormat.h.
+struct ProfileTraceEvent {
+  // The value of the argument for Argument and PointerArgument
+  uint64_t Timestamp;
+  // The index of the function in Profile::TraceFunctions
+  uint32_t Function;
+  // 0 for exits, the index of the argument for Argument and PointerArgument
+  uint16_t NumArgs;
+  // Entry, Exit, Argument or PointerArgument
+  uint16_t Kind;
+
+  static constexpr uint16_t Entry = 0;
+  static constexpr uint16_t Exit = 1;
+  static constexpr uint16_t Argument = 2;
+  static constexpr uint16_t PointerArgument = 3;
+};
+
+// A batch of events recorded by one thread (`inject-func-call<trace>`)
+struct ProfileTraceThread {
+  // The number of the thread within the traced process (starting from 1)
+  uint64_t Thread;
+  // The raw event table (oldest first)
+  llvm::ArrayRef<ProfileTraceEvent> Events;
+  // The number of events that were overwritten before they were saved (i.e.
+  // that are missing before Events)
+  uint64_t Dropped;
+  // True if the timestamps are in TSC ticks, false if in nanoseconds
+  bool InCycles;
+  // The rate of the clock that produced the timestamps
+  uint64_t TicksPerSecond;
+};
+
+// The contents of one profile file
+struct Profile {
+  std::vector<ProfileModuleRecord> Modules;
+  // The call graph edges of all modules (empty unless the profile contains
+  // LT_PROF_CALL_EDGES records)
+  std::vector<ProfileCallEdge> CallEdges;
+  // The block counts of all modules (empty unless the profile contains
+  // LT_PROF_BLOCK_COUNTS records)
+  std::vector<ProfileBlockCounts> BlockCounts;
+  // The coverage of all modules (empty unless the profile contains
+  // LT_PROF_COVERAGE records)
+  std::vector<ProfileCoverage> Coverage;
+  // The nodes of the calling-context trees of all threads, in preorder (empty
+  // unless the profile contains an LT_PROF_CALLING_CONTEXTS record)
+  std::vector<ProfileContextNode> CallingContexts;
+
+  // The names of the traced functions, indexed by function ID (empty unless
+  // this is a trace file, i.e. contains LT_PROF_TRACE_FUNCTIONS records)
+  std::vector<llvm::StringRef> TraceFunctions;
+  // The events of all traced threads (in the order of the
+  // LT_PROF_TRACE_EVENTS records, so a thread can have multiple batches)
+  std::vector<ProfileTraceThread> TraceThreads;
+};
+
+// Parses the profile (or the trace) in Buffer. Records of unknown kinds are
+// skipped.
+llvm::Expected<Profile> readProfile(llvm::MemoryBufferRef Buffer);
+
+#endif // LLVM_TUTOR_PROFILE_READER_H
@@ -29,6 +29,9 @@ struct StaticCallCounter : public llvm::AnalysisInfoMixin<StaticCallCounter> {
   using Result = ResultStaticCC;
   Result run(llvm::Module &M, llvm::ModuleAnalysisManager &);
   Result runOnModule(llvm::Module &M);
+  // Adds the direct calls made from Func to Res. Func has to be materialized
+  // (see tools/StaticMain.cpp for how this is used with lazy loading).
+  static void countDirectCalls(const llvm::Function &Func, Result &Res);
   // Part of the official API:
   //  https://llvm.org/docs/WritingAnLLVMNewPMPass.html#required-passes
   static bool isRequired() { return true; }
@@ -0,0 +1,57 @@
+//=============================================================================
+// FILE:
+//      input_for_cc_blocks.c
+//
+// DESCRIPTION:
+//      Sample input file for the block and edge counting mode of
+//      DynamicCallCounter. Contains loops, nested branches, a switch (with
+//      several cases sharing a block, i.e. critical edges) and an early
+//      return. The control flow depends on the number of arguments, so the
+//      counts can't be constant-folded.
+//
+// License: MIT
+//=============================================================================
+#include <stdio.h>
+
+int classify(int x) {
+  switch (x % 5) {
+  case 0:
+  case 3:
+    return 1;
+  case 1:
+    return 2;
+  default:
+    break;
+  }
+
+  if (x > 40)
+    return 3;
+  return 0;
+}
+
+int collatz(int n) {
+  int steps = 0;
+  while (n != 1) {
+    if (n % 2)
+      n = 3 * n + 1;
+    else
+      n = n / 2;
+    steps++;
+  }
+  return steps;
+}
+
+int main(int argc, char *argv[]) {
+  int sum = 0;
+  int ii = 0;
+
+  for (ii = 0; ii < 50 + argc; ii++) {
+    sum += classify(ii);
+    if (ii % 7 == 0)
+      continue;
+    sum += collatz(ii + 1);
+  }
+
+  printf("%d\n", sum);
+  return 0;
+}
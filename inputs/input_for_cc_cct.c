@@ -0,0 +1,38 @@
+//=============================================================================
+// FILE:
+//      input_for_cc_cct.c
+//
+// DESCRIPTION:
+//      Sample input file for the `cct` mode of DynamicCallCounter. `leaf` and
+//      `a` are reached through several distinct call paths, from two threads.
+//
+// License: MIT
+//=============================================================================
+#include <pthread.h>
+
+void leaf() {}
+
+void a() { leaf(); }
+
+void b() {
+  leaf();
+  a();
+  leaf();
+}
+
+void *worker(void *Arg) {
+  a();
+  return Arg;
+}
+
+int main() {
+  for (int I = 0; I < 3; I++)
+    a();
+  b();
+
+  pthread_t Thread;
+  pthread_create(&Thread, 0, worker, 0);
+  pthread_join(Thread, 0);
+
+  return 0;
+}
@@ -0,0 +1,36 @@
+//=============================================================================
+// FILE:
+//      input_for_cc_coverage.c
+//
+// DESCRIPTION:
+//      Sample input file for the coverage mode of DynamicCallCounter. Which
+//      of `fast` and `slow` is called depends on the number of arguments, so
+//      two runs with different arguments cover different code. `unused` is
+//      never called.
+//
+// License: MIT
+//=============================================================================
+#include <stdio.h>
+
+int fast(int x) { return x + 1; }
+
+int slow(int x) {
+  int ii = 0;
+  for (ii = 0; ii < 1000; ii++)
+    x = (x * 7 + 3) % 1001;
+  return x;
+}
+
+int unused(int x) { return x * 2; }
+
+int main(int argc, char *argv[]) {
+  int result = 0;
+
+  if (argc > 1)
+    result = slow(argc);
+  else
+    result = fast(argc);
+
+  printf("%d\n", result);
+  return 0;
+}
@@ -0,0 +1,33 @@
+//=============================================================================
+// FILE:
+//      input_for_cc_edges.c
+//
+// DESCRIPTION:
+//      Sample input file for CallCounter analysis with both direct and
+//      indirect calls. `dispatch` calls through a function pointer and reaches
+//      more targets than DynamicCallCounter records per call site, so that
+//      some of the targets are evicted and attributed to "<other>".
+//
+// License: MIT
+//=============================================================================
+void foo() { }
+void bar() { foo(); }
+void t1() { }
+void t2() { }
+void t3() { }
+void t4() { }
+void t5() { }
+
+void dispatch(void (*fptr)()) { fptr(); }
+
+int main() {
+  void (*targets[])() = {foo, bar, foo, t1, t2, t3, t4, t5};
+  int ii = 0;
+
+  for (ii = 0; ii < 8; ii++)
+    dispatch(targets[ii]);
+
+  bar();
+
+  return 0;
+}
@@ -0,0 +1,50 @@
+//=============================================================================
+// FILE:
+//      input_for_cc_edges_hot.c
+//
+// DESCRIPTION:
+//      Sample input file for CallCounter analysis with one hot indirect call
+//      target. `dispatch` calls through a function pointer: `hot` is called
+//      a few times, then the 3 `warm` targets take over, and finally `hot`
+//      is called on every 3rd call, in between a stream of many different
+//      `cold` targets. `hot` receives more than a quarter of all the calls,
+//      so DynamicCallCounter must keep it among the recorded targets.
+//
+// License: MIT
+//=============================================================================
+void hot() { }
+void w1() { }
+void w2() { }
+void w3() { }
+void c0() { }
+void c1() { }
+void c2() { }
+void c3() { }
+void c4() { }
+void c5() { }
+void c6() { }
+void c7() { }
+
+void dispatch(void (*fptr)()) { fptr(); }
+
+int main() {
+  void (*warm[])() = {w1, w2, w3};
+  void (*cold[])() = {c0, c1, c2, c3, c4, c5, c6, c7};
+  int ii = 0;
+  int jj = 0;
+
+  for (ii = 0; ii < 4; ii++)
+    dispatch(hot);
+
+  for (ii = 0; ii < 8; ii++)
+    for (jj = 0; jj < 3; jj++)
+      dispatch(warm[jj]);
+
+  for (ii = 0; ii < 24; ii++) {
+    dispatch(cold[(2 * ii) % 8]);
+    dispatch(cold[(2 * ii + 1) % 8]);
+    dispatch(hot);
+  }
+
+  return 0;
+}
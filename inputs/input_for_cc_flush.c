@@ -0,0 +1,64 @@
+//=============================================================================
+// FILE:
+//      input_for_cc_flush.c
+//
+// DESCRIPTION:
+//      Sample input file for CallCounter analysis that mimics a long-running
+//      process: it never exits cleanly (i.e. it calls `_exit`), so the call
+//      counts are only available if the lt_rt runtime library writes a
+//      snapshot while the process is running. Depending on argv[1], the
+//      snapshot is requested:
+//        * `api` - by calling lt_rt_flush()
+//        * `signal` - by sending SIGUSR1 to itself (requires
+//          LT_RT_FLUSH_SIGNAL=USR1)
+//        * `interval` - not at all, i.e. this waits for the periodic snapshot
+//          (requires LT_RT_FLUSH_INTERVAL_MS)
+//      `foo` is called 3 times before and 2 times after the snapshot.
+//
+// License: MIT
+//=============================================================================
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Defined in lt_rt (runtime/lt_rt.h)
+int lt_rt_flush(void);
+
+void foo() { }
+
+// Waits (for up to 5s) for the snapshot written by the lt_rt flusher thread
+void wait_for_profile() {
+  const char *path = getenv("LT_PROFILE_FILE");
+  struct stat buf;
+  int ii = 0;
+
+  for (ii = 0; ii < 500; ii++) {
+    if (stat(path, &buf) == 0)
+      return;
+    usleep(10000);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  const char *mode = argc > 1 ? argv[1] : "api";
+  int ii = 0;
+
+  for (ii = 0; ii < 3; ii++)
+    foo();
+
+  if (strcmp(mode, "api") == 0) {
+    lt_rt_flush();
+  } else if (strcmp(mode, "signal") == 0) {
+    raise(SIGUSR1);
+    wait_for_profile();
+  } else {
+    wait_for_profile();
+  }
+
+  for (ii = 0; ii < 2; ii++)
+    foo();
+
+  _exit(0);
+}
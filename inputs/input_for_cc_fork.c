@@ -0,0 +1,46 @@
+//=============================================================================
+// FILE:
+//      input_for_cc_fork.c
+//
+// DESCRIPTION:
+//      Sample input file for CallCounter analysis that forks: the parent calls
+//      `foo` twice, then starts 3 children (one at a time) and finally calls
+//      `foo` once more. Child N (counting from 0) calls `foo` once and `bar`
+//      N + 1 times. With the lt_rt runtime library, every process writes its
+//      own profile that only contains its own calls.
+//
+// License: MIT
+//=============================================================================
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+void foo() { }
+void bar() { }
+
+int main() {
+  int ii = 0;
+  int jj = 0;
+
+  for (ii = 0; ii < 2; ii++)
+    foo();
+
+  for (ii = 0; ii < 3; ii++) {
+    pid_t pid = fork();
+    if (pid < 0)
+      return 1;
+
+    if (pid == 0) {
+      foo();
+      for (jj = 0; jj <= ii; jj++)
+        bar();
+      // Unlike _exit, exit runs the destructors, i.e. lt_rt writes the profile
+      exit(0);
+    }
+
+    waitpid(pid, NULL, 0);
+  }
+
+  foo();
+  return 0;
+}
@@ -0,0 +1,52 @@
+//=============================================================================
+// FILE:
+//      input_for_cc_shm.c
+//
+// DESCRIPTION:
+//      Sample input file for CallCounter analysis that watches itself: it
+//      runs the command given in argv[1..] (e.g. `lt-top <options>`) with its
+//      own PID appended and keeps calling `foo` until that command exits.
+//      `bar` is called once. Meant to be instrumented with
+//      `dynamic-cc<shm>`, so that the command can read the live counts.
+//
+// License: MIT
+//=============================================================================
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+void foo() { }
+void bar() { }
+
+int main(int argc, char *argv[]) {
+  char pid[32];
+  char **args = calloc(argc + 1, sizeof(char *));
+  int ii = 0;
+  int status = 0;
+
+  if (argc < 2 || !args)
+    return 1;
+
+  bar();
+
+  for (ii = 1; ii < argc; ii++)
+    args[ii - 1] = argv[ii];
+  snprintf(pid, sizeof(pid), "%d", (int)getpid());
+  args[argc - 1] = pid;
+
+  pid_t child = fork();
+  if (child < 0)
+    return 1;
+  if (child == 0) {
+    execv(args[0], args);
+    _exit(127);
+  }
+
+  while (waitpid(child, &status, WNOHANG) == 0)
+    for (ii = 0; ii < 1000; ii++)
+      foo();
+
+  free(args);
+  return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
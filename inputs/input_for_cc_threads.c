@@ -0,0 +1,42 @@
+//=============================================================================
+// FILE:
+//      input_for_cc_threads.c
+//
+// DESCRIPTION:
+//      Sample multi-threaded input file for CallCounter analysis. Every
+//      thread calls `foo` and `bar` in a tight loop, so that the (dynamic)
+//      call counts are only correct if the counters are updated in a
+//      thread-safe manner.
+//
+// License: MIT
+//=============================================================================
+#include <pthread.h>
+
+#define NUM_THREADS 8
+#define NUM_ITERATIONS 100000
+
+void foo() { }
+void bar() { foo(); }
+
+void *worker(void *arg) {
+  int ii = 0;
+  for (ii = 0; ii < NUM_ITERATIONS; ii++)
+    bar();
+
+  return 0;
+}
+
+int main() {
+  pthread_t threads[NUM_THREADS];
+  int ii = 0;
+
+  for (ii = 0; ii < NUM_THREADS; ii++)
+    pthread_create(&threads[ii], 0, worker, 0);
+
+  for (ii = 0; ii < NUM_THREADS; ii++)
+    pthread_join(threads[ii], 0);
+
+  foo();
+
+  return 0;
+}
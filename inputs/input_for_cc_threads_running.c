@@ -0,0 +1,58 @@
+//=============================================================================
+// FILE:
+//      input_for_cc_threads_running.c
+//
+// DESCRIPTION:
+//      Sample multi-threaded input file for CallCounter analysis. Every
+//      thread calls `foo` and `bar` and then keeps running (i.e. it is never
+//      joined), so the (dynamic) call counts are only correct if the counts of
+//      threads that are still running at exit are accounted for.
+//
+// License: MIT
+//=============================================================================
+#include <pthread.h>
+#include <unistd.h>
+
+#define NUM_THREADS 4
+#define NUM_ITERATIONS 1000
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+static int num_done = 0;
+
+void foo() { }
+void bar() { foo(); }
+
+void *worker(void *arg) {
+  int ii = 0;
+  for (ii = 0; ii < NUM_ITERATIONS; ii++)
+    bar();
+
+  pthread_mutex_lock(&lock);
+  num_done++;
+  pthread_cond_signal(&done_cond);
+  pthread_mutex_unlock(&lock);
+
+  // Keep running until the process exits
+  for (;;)
+    pause();
+
+  return 0;
+}
+
+int main() {
+  pthread_t threads[NUM_THREADS];
+  int ii = 0;
+
+  for (ii = 0; ii < NUM_THREADS; ii++)
+    pthread_create(&threads[ii], 0, worker, 0);
+
+  pthread_mutex_lock(&lock);
+  while (num_done < NUM_THREADS)
+    pthread_cond_wait(&done_cond, &lock);
+  pthread_mutex_unlock(&lock);
+
+  foo();
+
+  return 0;
+}
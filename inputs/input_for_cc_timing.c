@@ -0,0 +1,42 @@
+//=============================================================================
+// FILE:
+//      input_for_cc_timing.c
+//
+// DESCRIPTION:
+//      Sample input file for the `timing` mode of DynamicCallCounter. The
+//      second time `leaf` is called, it leaves itself and `mid` with
+//      `longjmp`, so neither of them returns.
+//
+// License: MIT
+//=============================================================================
+#include <setjmp.h>
+#include <time.h>
+
+static jmp_buf Env;
+
+static void wait_ms(long Ms) {
+  struct timespec Duration = {0, Ms * 1000000};
+  nanosleep(&Duration, 0);
+}
+
+void leaf(int Jump) {
+  wait_ms(10);
+  if (Jump)
+    longjmp(Env, 1);
+}
+
+void mid(int Jump) {
+  wait_ms(10);
+  leaf(Jump);
+}
+
+void other() { wait_ms(20); }
+
+int main() {
+  mid(0);
+  if (!setjmp(Env))
+    mid(1);
+  other();
+
+  return 0;
+}
@@ -0,0 +1,34 @@
+//=============================================================================
+// FILE:
+//      input_for_icall_promotion.c
+//
+// DESCRIPTION:
+//      Sample input file for IndirectCallPromotion. `apply` calls through a
+//      function pointer: 80 times to `add`, 15 times to `sub` and 5 times to
+//      `mul`.
+//
+// License: MIT
+//=============================================================================
+#include <stdio.h>
+
+int add(int x) { return x + 1; }
+int sub(int x) { return x - 1; }
+int mul(int x) { return x * 2; }
+
+int apply(int (*op)(int), int x) { return op(x); }
+
+int main() {
+  int sum = 0;
+
+  for (int ii = 0; ii < 100; ii++) {
+    int (*op)(int) = add;
+    if (ii % 20 == 0)
+      op = mul;
+    else if (ii % 5 == 0)
+      op = sub;
+    sum += apply(op, ii);
+  }
+
+  printf("%d\n", sum);
+  return 0;
+}
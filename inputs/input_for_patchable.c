@@ -0,0 +1,39 @@
+//=============================================================================
+// FILE:
+//      input_for_patchable.c
+//
+// DESCRIPTION:
+//      Sample input file for InjectFuncCall in the `trace=patchable` mode.
+//      Enables tracing only around the call to bar (see lt_rt.h).
+//
+// License: MIT
+//=============================================================================
+int lt_rt_patch(void);
+int lt_rt_unpatch(void);
+
+int foo(int a) {
+  return a * 2;
+}
+
+int bar(int a, int b) {
+  return (a + foo(b) * 2);
+}
+
+int fez(int a, int b, int c) {
+  return (a + bar(a, b) * 2 + c * 3);
+}
+
+int main(int argc, char *argv[]) {
+  int a = 123;
+  int ret = 0;
+
+  ret += foo(a);
+  if (lt_rt_patch())
+    return 1;
+  ret += bar(a, ret);
+  if (lt_rt_unpatch())
+    return 1;
+  ret += fez(a, ret, 123);
+
+  return ret;
+}
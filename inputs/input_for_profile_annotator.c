@@ -0,0 +1,43 @@
+//=============================================================================
+// FILE:
+//      input_for_profile_annotator.c
+//
+// DESCRIPTION:
+//      Sample input file for ProfileAnnotator. `main` calls `common` 9 times
+//      as often as `rare` and never calls `never_called`.
+//
+//      Build with -DSTALE to get an "updated" version of this file that the
+//      profile of the original no longer matches: `rare` is renamed and the
+//      loop in `main` gets an early exit.
+//
+// License: MIT
+//=============================================================================
+#include <stdio.h>
+
+#ifdef STALE
+#define rare rarely_used
+#endif
+
+int common(int x) { return x + 1; }
+
+int rare(int x) { return x * 2; }
+
+void never_called(void) { printf("never called\n"); }
+
+int main() {
+  int sum = 0;
+
+  for (int ii = 0; ii < 100; ii++) {
+#ifdef STALE
+    if (sum < 0)
+      break;
+#endif
+    if (ii % 10 == 0)
+      sum += rare(ii);
+    else
+      sum += common(ii);
+  }
+
+  printf("%d\n", sum);
+  return 0;
+}
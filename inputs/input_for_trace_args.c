@@ -0,0 +1,32 @@
+//=============================================================================
+// FILE:
+//      input_for_trace_args.c
+//
+// DESCRIPTION:
+//      Sample input file for InjectFuncCall with `args=FILE`
+//
+// License: MIT
+//=============================================================================
+#include <string.h>
+
+void copy_buffer(char *dst, const char *src, unsigned long size) {
+  memcpy(dst, src, size);
+}
+
+int sum(const int *values, int count) {
+  int ret = 0;
+  for (int i = 0; i < count; i++)
+    ret += values[i];
+  return ret;
+}
+
+int main(void) {
+  int values[] = {1, 2, 3, 4};
+  char src[64] = "llvm-tutor";
+  char dst[64];
+
+  copy_buffer(dst, src, 11);
+  copy_buffer(dst, src, sizeof(src));
+
+  return sum(values, 4) + sum(values, -1);
+}
@@ -0,0 +1,36 @@
+//=============================================================================
+// FILE:
+//      input_for_trace_fork.c
+//
+// DESCRIPTION:
+//      Sample input file for InjectFuncCall (the `trace` mode) that forks: the
+//      parent calls `foo`, starts one child and calls `foo` again once the
+//      child is done. The child only calls `bar`. With the lt_rt runtime
+//      library, every process writes its own trace.
+//
+// License: MIT
+//=============================================================================
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+void foo() { }
+void bar() { }
+
+int main() {
+  foo();
+
+  pid_t pid = fork();
+  if (pid < 0)
+    return 1;
+
+  if (pid == 0) {
+    bar();
+    // Unlike _exit, exit runs the destructors, i.e. lt_rt writes the trace
+    exit(0);
+  }
+
+  waitpid(pid, NULL, 0);
+  foo();
+  return 0;
+}
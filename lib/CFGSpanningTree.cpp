@@ -0,0 +1,139 @@
+//==============================================================================
+// FILE:
+//    CFGSpanningTree.cpp
+//
+// DESCRIPTION:
+//    Implements CFGSpanningTree (see CFGSpanningTree.h). The tree is built
+//    with Kruskal's algorithm: the edges are visited from the hottest to the
+//    coldest and every edge that doesn't form a cycle is added to the tree.
+//
+// License: MIT
+//==============================================================================
+#include "CFGSpanningTree.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/BranchProbabilityInfo.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+
+#include <numeric>
+
+using namespace llvm;
+
+// Placing a counter on a critical edge requires splitting it, i.e. a new
+// block and an extra jump. Such edges are preferred for the spanning tree as
+// if they were this many times hotter (the same heuristic is used by LLVM's
+// own PGO instrumentation).
+static constexpr uint64_t CriticalEdgeMultiplier = 1000;
+
+static bool isCriticalEdge(const CFGEdge &Edge) {
+  return Edge.Src && Edge.Dst &&
+         Edge.Src->getTerminator()->getNumSuccessors() > 1 &&
+         !Edge.Dst->hasNPredecessors(1);
+}
+
+bool CFGSpanningTree::canInstrument(const CFGEdge &Edge) {
+  if (!isCriticalEdge(Edge))
+    return true;
+
+  // Edges out of `indirectbr` and `callbr` can't be split. Neither can edges
+  // into EH pads (these have to remain the first instruction in the block).
+  const Instruction *TI = Edge.Src->getTerminator();
+  return !isa<IndirectBrInst>(TI) && !isa<CallBrInst>(TI) &&
+         !Edge.Dst->isEHPad();
+}
+
+Instruction *CFGSpanningTree::getInsertionPoint(const CFGEdge &Edge) {
+  // The edge from the virtual node (i.e. the function entry) and the edges to
+  // the virtual node (i.e. the function exits). The latter are counted at the
+  // beginning of the exit block (rather than before the terminator) so that
+  // blocks that end with a call to a `noreturn` function (e.g. `exit`) are
+  // accounted for.
+  if (!Edge.Dst)
+    return &*Edge.Src->getFirstInsertionPt();
+  if (!Edge.Src)
+    return &*Edge.Dst->getFirstInsertionPt();
+
+  Instruction *TI = Edge.Src->getTerminator();
+  if (TI->getNumSuccessors() == 1)
+    return TI;
+  if (Edge.Dst->hasNPredecessors(1))
+    return &*Edge.Dst->getFirstInsertionPt();
+
+  assert(canInstrument(Edge) && "Can't place a counter on this edge");
+  BasicBlock *NewBB = SplitCriticalEdge(TI, Edge.SuccNum);
+  return NewBB->getTerminator();
+}
+
+CFGSpanningTree::CFGSpanningTree(Function &F, BlockFrequencyInfo *BFI,
+                                 bool AllEdges) {
+  for (BasicBlock &BB : F)
+    BlockIndices[&BB] = NumBlocks++;
+
+  const BranchProbabilityInfo *BPI = BFI ? BFI->getBPI() : nullptr;
+  auto GetFreq = [BFI](const BasicBlock *BB) -> uint64_t {
+    return BFI ? BFI->getBlockFreq(BB).getFrequency() : 1;
+  };
+
+  // STEP 1: Collect the edges of the extended CFG
+  BasicBlock &Entry = F.getEntryBlock();
+  Edges.push_back({nullptr, &Entry, 0, GetFreq(&Entry)});
+  for (BasicBlock &BB : F) {
+    Instruction *TI = BB.getTerminator();
+    uint64_t Freq = GetFreq(&BB);
+
+    for (unsigned SuccNum = 0; SuccNum < TI->getNumSuccessors(); SuccNum++) {
+      uint64_t Weight =
+          BPI ? BPI->getEdgeProbability(&BB, SuccNum).scale(Freq) : 1;
+      Edges.push_back({&BB, TI->getSuccessor(SuccNum), SuccNum, Weight});
+    }
+
+    if (!TI->getNumSuccessors())
+      Edges.push_back({&BB, nullptr, 0, Freq});
+  }
+
+  if (AllEdges)
+    return;
+
+  // STEP 2: Sort the edges, hottest first. Edges that can't be instrumented
+  // go first so that they end up in the tree (unless they form a cycle).
+  SmallVector<uint64_t, 32> Priorities;
+  for (const CFGEdge &Edge : Edges) {
+    if (!canInstrument(Edge))
+      Priorities.push_back(UINT64_MAX);
+    else if (isCriticalEdge(Edge))
+      Priorities.push_back(SaturatingMultiply(Edge.Weight,
+                                              CriticalEdgeMultiplier));
+    else
+      Priorities.push_back(Edge.Weight);
+  }
+
+  SmallVector<unsigned, 32> Order(Edges.size());
+  std::iota(Order.begin(), Order.end(), 0);
+  llvm::stable_sort(Order, [&Priorities](unsigned A, unsigned B) {
+    return Priorities[A] > Priorities[B];
+  });
+
+  // STEP 3: Kruskal's algorithm. Every set in the union-find structure is a
+  // connected component of the tree built so far.
+  SmallVector<uint64_t, 32> Parent(NumBlocks + 1);
+  std::iota(Parent.begin(), Parent.end(), 0);
+  auto Find = [&Parent](uint64_t Node) {
+    while (Parent[Node] != Node)
+      Node = Parent[Node] = Parent[Parent[Node]];
+    return Node;
+  };
+
+  for (unsigned Idx : Order) {
+    CFGEdge &Edge = Edges[Idx];
+    uint64_t SrcSet = Find(getBlockIndex(Edge.Src));
+    uint64_t DstSet = Find(getBlockIndex(Edge.Dst));
+    if (SrcSet == DstSet)
+      continue;
+
+    Parent[SrcSet] = DstSet;
+    Edge.InTree = true;
+  }
+}
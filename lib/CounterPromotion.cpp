@@ -0,0 +1,177 @@
+//==============================================================================
+// FILE:
+//    CounterPromotion.cpp
+//
+// DESCRIPTION:
+//    Implements the promotion of instrumentation counters out of loops (see
+//    CounterPromotion.h). The SSA form for the promoted counters is built with
+//    SSAUpdater.
+//
+// License: MIT
+//==============================================================================
+#include "CounterPromotion.h"
+
+#include "llvm/ADT/MapVector.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Transforms/Utils/LoopSimplify.h"
+#include "llvm/Transforms/Utils/LoopUtils.h"
+#include "llvm/Transforms/Utils/SSAUpdater.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "counter-promotion"
+
+// Every promoted counter occupies a register in the loop. Don't promote more
+// than this many counters per loop (the same limit as used by LLVM's PGO
+// instrumentation).
+static constexpr unsigned MaxPromotionsPerLoop = 20;
+
+CounterUpdate injectCounterUpdate(IRBuilder<> &Builder, Value *Counter,
+                                  Value *Inc) {
+  CounterUpdate Update;
+  Update.Load = Builder.CreateLoad(Inc->getType(), Counter);
+  Update.Add = cast<Instruction>(Builder.CreateAdd(Inc, Update.Load));
+  Update.Store = Builder.CreateStore(Update.Add, Counter);
+  return Update;
+}
+
+// Makes sure that L has a preheader and dedicated exit blocks that counters
+// can be written back in. Returns the exit blocks or an empty vector if the
+// counters in L can't be promoted.
+static SmallVector<BasicBlock *, 4> prepareLoop(Loop &L, DominatorTree &DT,
+                                                LoopInfo &LI) {
+  SmallVector<BasicBlock *, 4> ExitBlocks;
+  L.getExitBlocks(ExitBlocks);
+  // Counters in loops that never exit would never be written back
+  if (ExitBlocks.empty())
+    return {};
+
+  // Both can fail, e.g. for edges out of `indirectbr`
+  if (!L.getLoopPreheader() &&
+      !InsertPreheaderForLoop(&L, &DT, &LI, /*MSSAU=*/nullptr,
+                              /*PreserveLCSSA=*/false))
+    return {};
+  if (!L.hasDedicatedExits()) {
+    formDedicatedExitBlocks(&L, &DT, &LI, /*MSSAU=*/nullptr,
+                            /*PreserveLCSSA=*/false);
+    if (!L.hasDedicatedExits())
+      return {};
+  }
+
+  ExitBlocks.clear();
+  L.getUniqueExitBlocks(ExitBlocks);
+  // E.g. `catchswitch` blocks
+  for (BasicBlock *Exit : ExitBlocks)
+    if (Exit->getFirstInsertionPt() == Exit->end())
+      return {};
+
+  return ExitBlocks;
+}
+
+// Promotes the counter updated by Updates (all of these are in L and update
+// the same counter) out of L. The updates injected into the exit blocks are
+// appended to WriteBacks.
+static void promoteCounter(Loop &L, ArrayRef<CounterUpdate> Updates,
+                           ArrayRef<BasicBlock *> ExitBlocks,
+                           SmallVectorImpl<CounterUpdate> &WriteBacks) {
+  Value *Counter = Updates.front().Store->getPointerOperand();
+  Type *CounterTy = Updates.front().Load->getType();
+
+  // The updates in every block, in instruction order
+  MapVector<BasicBlock *, SmallVector<CounterUpdate, 2>> BlockUpdates;
+  for (const CounterUpdate &Update : Updates)
+    BlockUpdates[Update.Store->getParent()].push_back(Update);
+  for (auto &Entry : BlockUpdates)
+    llvm::sort(Entry.second,
+               [](const CounterUpdate &A, const CounterUpdate &B) {
+                 return A.Store->comesBefore(B.Store);
+               });
+
+  // STEP 1: Register the definitions of the delta (i.e. of the number of
+  // updates since entering the loop): 0 in the preheader and the result of
+  // the last update in every block
+  SSAUpdater SSA;
+  SSA.Initialize(CounterTy, "counter.delta");
+  SSA.AddAvailableValue(L.getLoopPreheader(), ConstantInt::get(CounterTy, 0));
+  for (auto &Entry : BlockUpdates)
+    SSA.AddAvailableValue(Entry.first, Entry.second.back().Add);
+
+  // STEP 2: Update the delta instead of the counter
+  for (auto &[BB, UpdatesInBB] : BlockUpdates) {
+    Value *Delta = nullptr;
+    for (CounterUpdate &Update : UpdatesInBB) {
+      if (!Delta)
+        Delta = SSA.GetValueInMiddleOfBlock(BB);
+      Update.Load->replaceAllUsesWith(Delta);
+      Update.Store->eraseFromParent();
+      Update.Load->eraseFromParent();
+      Delta = Update.Add;
+    }
+  }
+
+  // STEP 3: Write the delta back in every exit block. Exits that are only
+  // reachable before the first update don't need to.
+  for (BasicBlock *Exit : ExitBlocks) {
+    Value *Delta = SSA.GetValueInMiddleOfBlock(Exit);
+    if (auto *C = dyn_cast<Constant>(Delta); C && C->isNullValue())
+      continue;
+
+    IRBuilder<> Builder(&*Exit->getFirstInsertionPt());
+    WriteBacks.push_back(injectCounterUpdate(Builder, Counter, Delta));
+  }
+}
+
+unsigned promoteCounterUpdates(Function &F, ArrayRef<CounterUpdate> Updates) {
+  if (Updates.empty())
+    return 0;
+
+  // The instrumentation passes modify the CFG, so the analyses are computed
+  // from scratch
+  DominatorTree DT(F);
+  LoopInfo LI(DT);
+  if (LI.empty())
+    return 0;
+
+  SmallVector<CounterUpdate, 32> Pending(Updates.begin(), Updates.end());
+  unsigned NumPromoted = 0;
+
+  // Visit the innermost loops first, so that the counters written back in
+  // the exit blocks of a loop can be promoted out of the enclosing loop
+  SmallVector<Loop *, 8> Loops = LI.getLoopsInPreorder();
+  for (Loop *L : reverse(Loops)) {
+    // Group the pending updates in L by counter
+    MapVector<Value *, SmallVector<CounterUpdate, 2>> InLoop;
+    SmallVector<CounterUpdate, 32> Remaining;
+    for (const CounterUpdate &Update : Pending) {
+      if (L->contains(Update.Store->getParent()))
+        InLoop[Update.Store->getPointerOperand()].push_back(Update);
+      else
+        Remaining.push_back(Update);
+    }
+
+    if (InLoop.empty())
+      continue;
+
+    SmallVector<BasicBlock *, 4> ExitBlocks = prepareLoop(*L, DT, LI);
+    unsigned NumPromotedInLoop = 0;
+    for (auto &[Counter, CounterUpdates] : InLoop) {
+      if (ExitBlocks.empty() || NumPromotedInLoop == MaxPromotionsPerLoop) {
+        Remaining.append(CounterUpdates.begin(), CounterUpdates.end());
+        continue;
+      }
+
+      promoteCounter(*L, CounterUpdates, ExitBlocks, Remaining);
+      NumPromotedInLoop++;
+    }
+
+    LLVM_DEBUG(dbgs() << " Promoted " << NumPromotedInLoop
+                      << " counter(s) out of loop " << L->getName() << " in "
+                      << F.getName() << "\n");
+    NumPromoted += NumPromotedInLoop;
+    Pending = std::move(Remaining);
+  }
+
+  return NumPromoted;
+}
@@ -11,114 +11,1279 @@
 //
 //    This pass adds/injects code that will count function calls at
 //    runtime and prints the results when the module exits. More specifically:
-//      1. For every function F _defined_ in M:
-//          * defines a global variable, `i32 CounterFor_F`, initialised with 0
-//          * adds instructions at the beginning of F that increment `CounterFor_F`
-//            every time F executes
-//      2. At the end of the module (after `main`), calls `printf_wrapper` that
-//         prints the global call counters injected by this pass (e.g.
-//         `CounterFor_F`). The definition of `printf_wrapper` is also inserted by
-//         DynamicCallCounter.
+//      1. Assigns a slot to every function F _defined_ in M and defines:
+//          * `dcc_counters`, an array of `i64` call counters (one per slot),
+//            initialised with 0
+//          * `dcc_names`, a table with the names of the instrumented
+//            functions (NUL-separated, in slot order)
+//      2. For every function F _defined_ in M, adds instructions at the
+//         beginning of F that increment `dcc_counters[Slot(F)]` every time F
+//         executes
+//      3. At the end of the module (after `main`), calls `printf_wrapper` that
+//         prints the call counters injected by this pass. The definition of
+//         `printf_wrapper` is also inserted by DynamicCallCounter.
 //
 //    To illustrate, the following code will be injected at the beginning of
-//    function F (defined in the input module):
+//    function F (defined in the input module and assigned slot 1):
 //    ```IR
-//      %1 = load i32, i32* @CounterFor_F
-//      %2 = add i32 1, %1
-//      store i32 %2, i32* @CounterFor_F
+//      %1 = load i64, ptr getelementptr inbounds ([2 x i64], ptr @dcc_counters, i64 0, i64 1)
+//      %2 = add i64 1, %1
+//      store i64 %2, ptr getelementptr inbounds ([2 x i64], ptr @dcc_counters, i64 0, i64 1)
 //    ```
-//    The following definition of `CounterFor_F` is also added:
+//    The following definitions are also added:
 //    ```IR
-//      @CounterFor_foo = common global i32 0, align 4
+//      @dcc_counters = internal global [2 x i64] zeroinitializer, section "lt_dcc_cnts", align 8
+//      @dcc_names = internal constant [8 x i8] c"foo\00F\00", section "lt_dcc_names", align 1
 //    ```
+//    Both tables are internal to the module (so these never clash with
+//    tables from other modules) and are placed in dedicated sections. When
+//    linking, the sections from all modules are concatenated (in the same
+//    order for both sections). The name section is byte-aligned, so the
+//    result is one contiguous counter array and one matching name table for
+//    the whole program - a runtime can find all counters with one section
+//    scan (e.g. via `__start_lt_dcc_cnts`/`__stop_lt_dcc_cnts` on ELF).
 //
 //    This pass will only count calls to functions _defined_ in the input
 //    module. Functions that are only _declared_ (and defined elsewhere) are not
 //    counted.
 //
+//    The code above is not thread-safe - concurrent updates of `dcc_counters`
+//    are lost and the underlying cache lines bounce between cores. Use the
+//    `tls` option for multi-threaded programs:
+//      * the counter table gets a thread-local shard, `dcc_thread_counters`,
+//        and the code injected into F increments that shard instead
+//      * the first time a thread enters an instrumented function, it links
+//        its shard into a global list of shards, `dcc_threads`, and registers
+//        a pthread key destructor that merges the thread's shard into the
+//        global counters (using `atomicrmw add`) and unlinks it when the
+//        thread exits
+//      * `printf_wrapper` merges the shards of all the threads that are still
+//        in that list (i.e. the thread that calls `exit` and the threads that
+//        are still running) before printing the results
+//    The list is protected by a spin lock that is only taken when a thread
+//    registers or exits and at exit. The hot path is then a plain
+//    (uncontended) thread-local increment plus a well-predicted check of a
+//    thread-local flag.
+//
+//    Function entry counts don't tell which call sites make a function hot.
+//    The `edges` option additionally instruments every call site (apart from
+//    intrinsics and inline assembly):
+//      * direct call sites increment their own counter in
+//        `dcc_site_counters`
+//      * indirect call sites pass the call target to
+//        `__lt_rt_record_indirect_call`, which keeps the counts of (up to) the
+//        4 most frequent targets per site (in `dcc_indirect_targets`) and
+//        lumps the others together
+//    The call sites are described by `dcc_call_sites` (caller, index within
+//    the caller, callee name). The resulting weighted dynamic call graph is
+//    written by the lt_rt runtime library, so `edges` implies `flush`. Note
+//    that the site counters are always updated with plain load/add/store
+//    sequences (i.e. `tls` doesn't apply to them).
+//
+//    The `blocks` option goes one level deeper and counts how often every
+//    basic block and every CFG edge executes. Rather than a counter per block,
+//    it places one counter (in `dcc_block_counters`) on every CFG edge that
+//    is _not_ in a maximum spanning tree of the CFG (see CFGSpanningTree.h).
+//    The tree is built from the hottest edges (as estimated by
+//    BlockFrequencyInfo), so the counters end up on the cold edges. The CFGs
+//    are described by `dcc_cfg_functions` and `dcc_cfg_edges` and the lt_rt
+//    runtime reconstructs the counts of the remaining edges (and of the
+//    blocks) when writing the profile. `blocks=all` places a counter on every
+//    edge instead. As with `edges`, the counters are updated with plain
+//    load/add/store sequences. Note that the reconstruction assumes that
+//    every function that is entered also returns (or unwinds) - the counts
+//    are skewed for functions that are left via `longjmp` or that are still
+//    running when the profile is written.
+//
+//    The call site and the block counters are often updated inside loops,
+//    where a load/add/store per iteration adds up and, as the counters might
+//    alias with the memory accessed by the loop, blocks vectorisation. Unless
+//    the `no-promote` option is used, these counters are promoted out of
+//    loops: inside a loop, the updates are accumulated in a register and the
+//    counter is updated once on every loop exit (see CounterPromotion.h).
+//
+//    Call counts don't tell where the time goes. The `timing` option measures
+//    the time spent in every function, both including (inclusive) and
+//    excluding (exclusive) the time spent in its callees:
+//      * `dcc_function_times` holds the two totals for every slot
+//      * the code injected at the top of F calls `__lt_rt_enter_function`
+//        with the entry for F and the frame address of F
+//      * the code injected before every `ret` in F calls
+//        `__lt_rt_exit_function` with the same frame address
+//    The lt_rt runtime reads the clock (`rdtsc` if the TSC is invariant,
+//    `clock_gettime` otherwise) and keeps a per-thread shadow stack of the
+//    active functions. Functions that are left without returning (i.e. by
+//    unwinding or by `longjmp`) are recognised through their frame addresses:
+//    landing pads and `setjmp` call sites call `__lt_rt_unwind_to`, which
+//    pops the shadow stack entries above the current activation. That way,
+//    exceptions and `longjmp` don't corrupt the shadow stack. The times are
+//    written by lt_rt (next to the call counts), so `timing` implies `flush`.
+//    Note that every instrumented function calls into lt_rt twice, so the
+//    times include the overhead of the instrumentation.
+//
+//    Flat times and counts lose the context: a function that is cheap when
+//    called from one place might be expensive when called from another. The
+//    `cct` option injects the same lt_rt hooks as `timing`, which then also
+//    maintain a calling-context tree per thread (a node per distinct call path
+//    with the number of times that path was entered). Moving to the callee's
+//    node on entry is a pointer comparison in the common case - there's no
+//    hashing on the hot path. The trees are written by lt_rt and printed by
+//    `dcc-prof --folded` in the folded-stack format used by flame graph
+//    tools (e.g. `flamegraph.pl`).
+//
+//    Printing one formatted line per function interleaves with the output of
+//    the instrumented program and gets slow for large modules. Use the
+//    `binary` option to replace `printf_wrapper` with `dcc_write_profile`,
+//    which appends the raw counter and name tables to a binary profile file
+//    (see ProfileFormat.h) with a handful of `fwrite` calls. The file name is
+//    read from the LT_PROFILE_FILE environment variable (`default.ltprof` by
+//    default). Use `dcc-prof` (tools/ProfileMain.cpp) to read it.
+//
+//    Profiles written at exit are of little use for long-running processes
+//    (e.g. servers) that rarely exit cleanly. Use the `flush` option to hand
+//    the counter table over to the lt_rt runtime library (runtime/lt_rt.c)
+//    instead. This pass then defines a module descriptor, `dcc_module`, and a
+//    module constructor that registers it via `__lt_rt_register_module`. lt_rt
+//    writes the profile (in the `binary` format) on demand (`lt_rt_flush()`),
+//    periodically, on a signal and at exit - see lt_rt.h for the details. Note
+//    that in the `tls` mode, the snapshots only include the counts of threads
+//    that have already exited. With LT_RT_REPORT=text, lt_rt also prints the
+//    report that `printf_wrapper` would print, so no reporting code is
+//    injected at all. Processes forked by the instrumented program reset
+//    their counters and write their own profiles, which `lt-merge`
+//    (tools/MergeMain.cpp) combines into one.
+//
+//    To watch the counts of a running process without requesting snapshots,
+//    use the `shm` option (implies `flush`): lt_rt then also exports the
+//    counter table through a POSIX shared-memory segment (`/lt_rt.<pid>`, see
+//    ProfileFormat.h) by mapping the segment over the table. To make that
+//    possible, `dcc_counters` is aligned to (and padded to a multiple of)
+//    64KiB and placed in .bss rather than in `lt_dcc_cnts`. The injected
+//    increments are exactly the same as without `shm`. `lt-top`
+//    (tools/TopMain.cpp) samples the segment and prints the call rates of the
+//    hottest functions.
+//
+//    For "is this code ever executed" questions, the counts are more than
+//    needed. The `coverage` option (implies `flush`) replaces the counter
+//    table with `dcc_coverage`, a table with one byte per function, and
+//    injects a single `store i8 1` (no load, no add) at every function entry.
+//    `coverage=blocks` does the same for every basic block. lt_rt writes the
+//    bytes as a bitmap (an LT_PROF_COVERAGE record, see ProfileFormat.h),
+//    `dcc-prof --coverage` prints it and `lt-merge` computes the union of
+//    many of them.
+//
+//    Instrumenting tiny or rarely executed functions costs more than it tells.
+//    The filters from FunctionFilter.h (`allow=FILE`, `deny=FILE`,
+//    `min-size=N`, `skip-cold`, `only-hot` and `min-entry-count=N`) restrict
+//    the instrumentation to the selected functions - the skipped ones get no
+//    slot (and, in the `edges` and `blocks` modes, no call site or block
+//    counters). The last three make most sense after ProfileAnnotator.
+//
 // USAGE:
 //      $ opt -load-pass-plugin <BUILD_DIR>/lib/libDynamicCallCounter.so `\`
 //        -passes=-"dynamic-cc" <bitcode-file> -o instrumentend.bin
 //      $ lli instrumented.bin
+//    Multi-threaded programs:
+//      $ opt -load-pass-plugin <BUILD_DIR>/lib/libDynamicCallCounter.so `\`
+//        -passes=-"dynamic-cc<tls>" <bitcode-file> -o instrumentend.bin
+//      $ clang -pthread instrumented.bin -o instrumented
+//    Binary output:
+//      $ opt -load-pass-plugin <BUILD_DIR>/lib/libDynamicCallCounter.so `\`
+//        -passes=-"dynamic-cc<binary>" <bitcode-file> -o instrumentend.bin
+//      $ LT_PROFILE_FILE=prof.ltprof lli instrumented.bin
+//      $ <BUILD_DIR>/bin/dcc-prof prof.ltprof
+//    Call-edge profiling (implies `flush`, see below):
+//      $ opt -load-pass-plugin <BUILD_DIR>/lib/libDynamicCallCounter.so `\`
+//        -passes=-"dynamic-cc<edges>" <bitcode-file> -o instrumentend.bin
+//      $ clang instrumented.bin -L<BUILD_DIR>/lib -llt_rt -o instrumented
+//      $ ./instrumented && <BUILD_DIR>/bin/dcc-prof --call-graph default.ltprof
+//    Block and edge counts (implies `flush`):
+//      $ opt -load-pass-plugin <BUILD_DIR>/lib/libDynamicCallCounter.so `\`
+//        -passes=-"dynamic-cc<blocks>" <bitcode-file> -o instrumentend.bin
+//      $ clang instrumented.bin -L<BUILD_DIR>/lib -llt_rt -o instrumented
+//      $ ./instrumented && <BUILD_DIR>/bin/dcc-prof --blocks default.ltprof
+//    Inclusive and exclusive time per function (implies `flush`):
+//      $ opt -load-pass-plugin <BUILD_DIR>/lib/libDynamicCallCounter.so `\`
+//        -passes=-"dynamic-cc<timing>" <bitcode-file> -o instrumentend.bin
+//      $ clang instrumented.bin -L<BUILD_DIR>/lib -llt_rt -o instrumented
+//      $ ./instrumented && <BUILD_DIR>/bin/dcc-prof default.ltprof
+//    Calling-context trees as folded stacks (implies `flush`):
+//      $ opt -load-pass-plugin <BUILD_DIR>/lib/libDynamicCallCounter.so `\`
+//        -passes=-"dynamic-cc<cct>" <bitcode-file> -o instrumentend.bin
+//      $ clang instrumented.bin -L<BUILD_DIR>/lib -llt_rt -o instrumented
+//      $ ./instrumented && <BUILD_DIR>/bin/dcc-prof --folded default.ltprof
+//    Runtime-managed output:
+//      $ opt -load-pass-plugin <BUILD_DIR>/lib/libDynamicCallCounter.so `\`
+//        -passes=-"dynamic-cc<flush>" <bitcode-file> -o instrumentend.bin
+//      $ clang instrumented.bin -L<BUILD_DIR>/lib -llt_rt -o instrumented
+//      $ LT_RT_FLUSH_INTERVAL_MS=1000 ./instrumented
+//      $ LT_RT_REPORT=text ./instrumented
+//    Live call rates:
+//      $ opt -load-pass-plugin <BUILD_DIR>/lib/libDynamicCallCounter.so `\`
+//        -passes=-"dynamic-cc<shm>" <bitcode-file> -o instrumentend.bin
+//      $ clang instrumented.bin -L<BUILD_DIR>/lib -llt_rt -o instrumented
+//      $ ./instrumented & <BUILD_DIR>/bin/lt-top $!
+//    Function (or block) coverage (implies `flush`):
+//      $ opt -load-pass-plugin <BUILD_DIR>/lib/libDynamicCallCounter.so `\`
+//        -passes=-"dynamic-cc<coverage=blocks>" <bitcode-file> `\`
+//        -o instrumentend.bin
+//      $ clang instrumented.bin -L<BUILD_DIR>/lib -llt_rt -o instrumented
+//      $ ./instrumented && <BUILD_DIR>/bin/dcc-prof --coverage default.ltprof
+//    Skipping functions (e.g. the ones listed in deny.txt):
+//      $ opt -load-pass-plugin <BUILD_DIR>/lib/libDynamicCallCounter.so `\`
+//        -passes=-"dynamic-cc<deny=deny.txt;min-size=10>" <bitcode-file> `\`
+//        -o instrumentend.bin
 //
 // License: MIT
 //========================================================================
 #include "DynamicCallCounter.h"
+#include "CFGSpanningTree.h"
+#include "CounterPromotion.h"
+#include "FunctionFilter.h"
+#include "ProfileFormat.h"
 
+#include "llvm/ADT/MapVector.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Plugins/PassPlugin.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/TargetParser/Triple.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
 #include "llvm/Transforms/Utils/ModuleUtils.h"
 
 using namespace llvm;
 
 #define DEBUG_TYPE "dynamic-cc"
 
-Constant *CreateGlobalCounter(Module &M, StringRef GlobalVarName) {
+//-----------------------------------------------------------------------------
+// The counter table
+//-----------------------------------------------------------------------------
+namespace {
+// The call counters and the function names for all functions instrumented in
+// one module
+struct CounterTable {
+  // `[N x i64] dcc_counters`
+  GlobalVariable *Counters = nullptr;
+  // `[M x i8] dcc_names`
+  GlobalVariable *Names = nullptr;
+  // The offset of the name of every function (in slot order) in `dcc_names`
+  SmallVector<uint64_t, 16> NameOffsets;
+  // `thread_local [N x i64] dcc_thread_counters` (`tls` mode only)
+  GlobalVariable *ThreadCounters = nullptr;
+
+  uint64_t size() const { return NameOffsets.size(); }
+};
+} // namespace
+
+// Returns the section name for the counter/name tables. On MachO, section
+// names have to be prefixed with the segment name.
+static std::string getTableSectionName(const Module &M, StringRef Name) {
+  Triple TT(M.getTargetTriple());
+  if (TT.isOSBinFormatMachO())
+    return ("__DATA,__" + Name).str();
+  return Name.str();
+}
+
+// The alignment of the counter table in the `shm` mode. This has to match
+// LT_RT_SHM_ALIGNMENT in runtime/lt_rt.h.
+static constexpr uint64_t ShmAlignment = 65536;
+
+// Defines the counter and the name tables for Functions (slot N is assigned to
+// Functions[N]). In the `shm` mode, the counter table is padded to a multiple
+// of ShmAlignment and aligned accordingly. In the `coverage` mode, there are
+// no counters - only the name table is defined.
+static CounterTable CreateCounterTable(Module &M,
+                                       ArrayRef<Function *> Functions,
+                                       const DynamicCallCounterOptions &Opts) {
   auto &CTX = M.getContext();
+  CounterTable Table;
+
+  // The name table: "name0\0name1\0...\0"
+  std::string Names;
+  for (Function *F : Functions) {
+    Table.NameOffsets.push_back(Names.size());
+    Names += F->getName();
+    Names.push_back('\0');
+  }
+
+  if (Opts.Coverage == DynamicCallCounterOptions::CoverageMode::None) {
+    uint64_t NumCounters = Functions.size();
+    if (Opts.SharedMemory)
+      NumCounters = alignTo(NumCounters, ShmAlignment / sizeof(uint64_t));
+    auto *CountersTy =
+        ArrayType::get(IntegerType::getInt64Ty(CTX), NumCounters);
+    Table.Counters = new GlobalVariable(
+        M, CountersTy, /*isConstant=*/false, GlobalValue::InternalLinkage,
+        ConstantAggregateZero::get(CountersTy), "dcc_counters");
+    if (Opts.SharedMemory) {
+      // lt_rt replaces the pages of this table with shared memory, so nothing
+      // else can live in them. Outside of `lt_dcc_cnts`, the table lands in
+      // .bss and the padding takes no space in the binary.
+      Table.Counters->setAlignment(Align(ShmAlignment));
+    } else {
+      Table.Counters->setSection(getTableSectionName(M, "lt_dcc_cnts"));
+      Table.Counters->setAlignment(MaybeAlign(8));
+    }
+  }
 
-  // This will insert a declaration into M
-  Constant *NewGlobalVar =
-      M.getOrInsertGlobal(GlobalVarName, IntegerType::getInt32Ty(CTX));
+  // getString would add another NUL terminator - Names already ends with one
+  Constant *NamesInit =
+      ConstantDataArray::getString(CTX, Names, /*AddNull=*/false);
+  Table.Names = new GlobalVariable(M, NamesInit->getType(), /*isConstant=*/true,
+                                   GlobalValue::InternalLinkage, NamesInit,
+                                   "dcc_names");
+  Table.Names->setSection(getTableSectionName(M, "lt_dcc_names"));
+  Table.Names->setAlignment(MaybeAlign(1));
 
-  // This will change the declaration into definition (and initialise to 0)
-  GlobalVariable *NewGV = M.getNamedGlobal(GlobalVarName);
-  NewGV->setLinkage(GlobalValue::CommonLinkage);
-  NewGV->setAlignment(MaybeAlign(4));
-  NewGV->setInitializer(llvm::ConstantInt::get(CTX, APInt(32, 0)));
+  return Table;
+}
 
-  return NewGlobalVar;
+// Returns a pointer to the counter in Slot (Counters is either
+// `dcc_counters` or the address of `dcc_thread_counters`)
+static Value *getCounterPtr(IRBuilder<> &Builder, GlobalVariable *Table,
+                            Value *Counters, uint64_t Slot) {
+  return Builder.CreateConstInBoundsGEP2_64(Table->getValueType(), Counters, 0,
+                                            Slot);
 }
 
+// The counter updates (per function) that can be promoted out of loops (see
+// CounterPromotion.h). These are the updates of the call site and the block
+// counters - the function entry counters are never inside a loop.
+using PromotableUpdates = MapVector<Function *, SmallVector<CounterUpdate, 8>>;
+
 //-----------------------------------------------------------------------------
-// DynamicCallCounter implementation
+// Thread-local counters (`dynamic-cc<tls>`)
 //-----------------------------------------------------------------------------
-bool DynamicCallCounter::runOnModule(Module &M) {
-  bool Instrumented = false;
+namespace {
+// IR entities shared by all functions instrumented in the `tls` mode
+struct ThreadLocalCounters {
+  // `thread_local i8` - set once the current thread has registered its
+  // thread-exit hook
+  GlobalVariable *Registered = nullptr;
+  // The pthread key whose destructor merges the shard of an exiting thread
+  GlobalVariable *Key = nullptr;
+  // `thread_local { ptr, ptr, ptr }` - the entry of the current thread in the
+  // list of the registered shards: next entry, previous entry, shard (null
+  // once merged)
+  GlobalVariable *Node = nullptr;
+  // The first entry of that list and the spin lock that protects it
+  GlobalVariable *Threads = nullptr;
+  GlobalVariable *Lock = nullptr;
+  // `void dcc_register_thread()`
+  Function *RegisterThread = nullptr;
+  // `void dcc_merge_thread_counters(ptr)`
+  Function *MergeThreadCounters = nullptr;
+  // `void dcc_merge_all_threads()`
+  Function *MergeAllThreads = nullptr;
+};
+} // namespace
 
-  // Function name <--> IR variable that holds the call counter
-  llvm::StringMap<Constant *> CallCounterMap;
-  // Function name <--> IR variable that holds the function name
-  llvm::StringMap<Constant *> FuncNameMap;
+static Function *createInternalFunction(Module &M, FunctionType *FTy,
+                                        StringRef Name) {
+  Function *F = Function::Create(FTy, GlobalValue::InternalLinkage, Name, M);
+  F->setDoesNotThrow();
+  return F;
+}
+
+// Defines the per-thread copy (shard) of the counter table
+static GlobalVariable *CreateThreadLocalCounters(Module &M,
+                                                 const CounterTable &Table) {
+  auto *Shard = new GlobalVariable(
+      M, Table.Counters->getValueType(), /*isConstant=*/false,
+      GlobalValue::InternalLinkage,
+      ConstantAggregateZero::get(Table.Counters->getValueType()),
+      "dcc_thread_counters", /*InsertBefore=*/nullptr,
+      GlobalValue::GeneralDynamicTLSModel);
+  Shard->setAlignment(MaybeAlign(8));
 
+  return Shard;
+}
+
+// Creates the globals and the helper functions used in the `tls` mode. The
+// counter table has to be created beforehand.
+static ThreadLocalCounters createThreadLocalCounters(Module &M,
+                                                     CounterTable &Table) {
   auto &CTX = M.getContext();
+  ThreadLocalCounters TLC;
 
-  // STEP 1: For each function in the module, inject a call-counting code
-  // --------------------------------------------------------------------
-  for (auto &F : M) {
-    if (F.isDeclaration())
+  // pthread_key_t is `unsigned int` on Linux and `unsigned long` on Darwin
+  Triple TT(M.getTargetTriple());
+  IntegerType *KeyTy = TT.isOSDarwin() ? IntegerType::getInt64Ty(CTX)
+                                       : IntegerType::getInt32Ty(CTX);
+  PointerType *PtrTy = PointerType::getUnqual(CTX);
+  IntegerType *Int64Ty = IntegerType::getInt64Ty(CTX);
+
+  Table.ThreadCounters = CreateThreadLocalCounters(M, Table);
+
+  TLC.Registered = new GlobalVariable(
+      M, IntegerType::getInt8Ty(CTX), /*isConstant=*/false,
+      GlobalValue::InternalLinkage, ConstantInt::get(CTX, APInt(8, 0)),
+      "dcc_thread_registered", /*InsertBefore=*/nullptr,
+      GlobalValue::GeneralDynamicTLSModel);
+
+  TLC.Key = new GlobalVariable(M, KeyTy, /*isConstant=*/false,
+                               GlobalValue::InternalLinkage,
+                               ConstantInt::get(KeyTy, 0), "dcc_thread_key");
+
+  StructType *NodeTy = StructType::get(CTX, {PtrTy, PtrTy, PtrTy});
+  TLC.Node = new GlobalVariable(M, NodeTy, /*isConstant=*/false,
+                                GlobalValue::InternalLinkage,
+                                ConstantAggregateZero::get(NodeTy),
+                                "dcc_thread_node", /*InsertBefore=*/nullptr,
+                                GlobalValue::GeneralDynamicTLSModel);
+  TLC.Threads = new GlobalVariable(M, PtrTy, /*isConstant=*/false,
+                                   GlobalValue::InternalLinkage,
+                                   ConstantPointerNull::get(PtrTy),
+                                   "dcc_threads");
+  TLC.Lock = new GlobalVariable(M, IntegerType::getInt32Ty(CTX),
+                                /*isConstant=*/false,
+                                GlobalValue::InternalLinkage,
+                                ConstantInt::get(CTX, APInt(32, 0)),
+                                "dcc_threads_lock");
+
+  IRBuilder<> Builder(CTX);
+  auto NodeField = [&](Value *Node, unsigned Field) {
+    return Builder.CreateStructGEP(NodeTy, Node, Field);
+  };
+
+  // STEP 1: Define the spin lock that protects the list of the registered
+  // shards. The lock is only taken when a thread starts or exits and at exit,
+  // so spinning is fine.
+  // ```
+  //    void dcc_lock_threads() {
+  //      while (!atomic_compare_exchange(&dcc_threads_lock, 0, 1))
+  //        ;
+  //    }
+  //    void dcc_unlock_threads() {
+  //      atomic_store(&dcc_threads_lock, 0);
+  //    }
+  // ```
+  Function *LockF = createInternalFunction(
+      M, FunctionType::get(Type::getVoidTy(CTX), {}, /*IsVarArgs=*/false),
+      "dcc_lock_threads");
+  BasicBlock *LockLoop = BasicBlock::Create(CTX, "loop", LockF);
+  BasicBlock *LockExit = BasicBlock::Create(CTX, "exit", LockF);
+  Builder.SetInsertPoint(BasicBlock::Create(CTX, "enter", LockF, LockLoop));
+  Builder.CreateBr(LockLoop);
+  Builder.SetInsertPoint(LockLoop);
+  Value *Exchanged = Builder.CreateAtomicCmpXchg(
+      TLC.Lock, Builder.getInt32(0), Builder.getInt32(1), MaybeAlign(4),
+      AtomicOrdering::Acquire, AtomicOrdering::Monotonic);
+  Builder.CreateCondBr(Builder.CreateExtractValue(Exchanged, 1), LockExit,
+                       LockLoop);
+  Builder.SetInsertPoint(LockExit);
+  Builder.CreateRetVoid();
+
+  Function *UnlockF = createInternalFunction(
+      M, FunctionType::get(Type::getVoidTy(CTX), {}, /*IsVarArgs=*/false),
+      "dcc_unlock_threads");
+  Builder.SetInsertPoint(BasicBlock::Create(CTX, "enter", UnlockF));
+  Builder.CreateAlignedStore(Builder.getInt32(0), TLC.Lock, MaybeAlign(4))
+      ->setAtomic(AtomicOrdering::Release);
+  Builder.CreateRetVoid();
+
+  // STEP 2: Define `void dcc_merge_shard(ptr)`. This is equivalent to:
+  // ```
+  //    void dcc_merge_shard(uint64_t *Shard) {
+  //      for (uint64_t Slot = 0; Slot < N; Slot++) {
+  //        atomic_fetch_add(&dcc_counters[Slot], Shard[Slot]);
+  //        Shard[Slot] = 0;
+  //      }
+  //    }
+  // ```
+  // Resetting the shard makes it safe to call this more than once per shard.
+  Function *MergeShard = createInternalFunction(
+      M, FunctionType::get(Type::getVoidTy(CTX), {PtrTy}, /*IsVarArgs=*/false),
+      "dcc_merge_shard");
+
+  BasicBlock *Entry = BasicBlock::Create(CTX, "enter", MergeShard);
+  BasicBlock *Loop = BasicBlock::Create(CTX, "loop", MergeShard);
+  BasicBlock *Exit = BasicBlock::Create(CTX, "exit", MergeShard);
+
+  Builder.SetInsertPoint(Entry);
+  Value *ShardAddr = MergeShard->getArg(0);
+  Builder.CreateBr(Loop);
+
+  Builder.SetInsertPoint(Loop);
+  PHINode *Slot = Builder.CreatePHI(Int64Ty, 2, "slot");
+  Slot->addIncoming(Builder.getInt64(0), Entry);
+  Value *ShardPtr = Builder.CreateInBoundsGEP(
+      Table.ThreadCounters->getValueType(), ShardAddr,
+      {Builder.getInt64(0), Slot});
+  Value *CounterPtr =
+      Builder.CreateInBoundsGEP(Table.Counters->getValueType(), Table.Counters,
+                                {Builder.getInt64(0), Slot});
+  LoadInst *Shard = Builder.CreateLoad(Int64Ty, ShardPtr);
+  Builder.CreateAtomicRMW(AtomicRMWInst::Add, CounterPtr, Shard, MaybeAlign(8),
+                          AtomicOrdering::Monotonic);
+  Builder.CreateStore(Builder.getInt64(0), ShardPtr);
+  Value *NextSlot = Builder.CreateAdd(Slot, Builder.getInt64(1));
+  Slot->addIncoming(NextSlot, Loop);
+  Builder.CreateCondBr(
+      Builder.CreateICmpEQ(NextSlot, Builder.getInt64(Table.size())), Exit,
+      Loop);
+
+  Builder.SetInsertPoint(Exit);
+  Builder.CreateRetVoid();
+
+  // STEP 3: Define `void dcc_merge_thread_counters(ptr)`. It has the
+  // signature of a pthread key destructor (the key holds the list entry of
+  // the thread) and is equivalent to:
+  // ```
+  //    void dcc_merge_thread_counters(Node *N) {
+  //      dcc_lock_threads();
+  //      if (N->Shard) {
+  //        dcc_merge_shard(N->Shard);
+  //        N->Shard = NULL;
+  //        // Unlink N
+  //        if (N->Prev)
+  //          N->Prev->Next = N->Next;
+  //        else
+  //          dcc_threads = N->Next;
+  //        if (N->Next)
+  //          N->Next->Prev = N->Prev;
+  //      }
+  //      dcc_unlock_threads();
+  //    }
+  // ```
+  // The shard is null if it was already merged by dcc_merge_all_threads.
+  TLC.MergeThreadCounters = createInternalFunction(
+      M, FunctionType::get(Type::getVoidTy(CTX), {PtrTy}, /*IsVarArgs=*/false),
+      "dcc_merge_thread_counters");
+  Value *Node = TLC.MergeThreadCounters->getArg(0);
+
+  Entry = BasicBlock::Create(CTX, "enter", TLC.MergeThreadCounters);
+  BasicBlock *Merge = BasicBlock::Create(CTX, "merge", TLC.MergeThreadCounters);
+  BasicBlock *HasPrev =
+      BasicBlock::Create(CTX, "has_prev", TLC.MergeThreadCounters);
+  BasicBlock *IsFirst =
+      BasicBlock::Create(CTX, "is_first", TLC.MergeThreadCounters);
+  BasicBlock *CheckNext =
+      BasicBlock::Create(CTX, "check_next", TLC.MergeThreadCounters);
+  BasicBlock *HasNext =
+      BasicBlock::Create(CTX, "has_next", TLC.MergeThreadCounters);
+  Exit = BasicBlock::Create(CTX, "exit", TLC.MergeThreadCounters);
+
+  Builder.SetInsertPoint(Entry);
+  Builder.CreateCall(LockF);
+  Value *NodeShard = Builder.CreateLoad(PtrTy, NodeField(Node, 2));
+  Builder.CreateCondBr(Builder.CreateIsNull(NodeShard), Exit, Merge);
+
+  Builder.SetInsertPoint(Merge);
+  Builder.CreateCall(MergeShard, {NodeShard});
+  Builder.CreateStore(ConstantPointerNull::get(PtrTy), NodeField(Node, 2));
+  Value *Next = Builder.CreateLoad(PtrTy, NodeField(Node, 0));
+  Value *Prev = Builder.CreateLoad(PtrTy, NodeField(Node, 1));
+  Builder.CreateCondBr(Builder.CreateIsNull(Prev), IsFirst, HasPrev);
+
+  Builder.SetInsertPoint(HasPrev);
+  Builder.CreateStore(Next, NodeField(Prev, 0));
+  Builder.CreateBr(CheckNext);
+
+  Builder.SetInsertPoint(IsFirst);
+  Builder.CreateStore(Next, TLC.Threads);
+  Builder.CreateBr(CheckNext);
+
+  Builder.SetInsertPoint(CheckNext);
+  Builder.CreateCondBr(Builder.CreateIsNull(Next), Exit, HasNext);
+
+  Builder.SetInsertPoint(HasNext);
+  Builder.CreateStore(Prev, NodeField(Next, 1));
+  Builder.CreateBr(Exit);
+
+  Builder.SetInsertPoint(Exit);
+  Builder.CreateCall(UnlockF);
+  Builder.CreateRetVoid();
+
+  // STEP 4: Define `void dcc_merge_all_threads()`. It merges the shards of
+  // all the registered threads, including the ones that are still running
+  // (e.g. worker pools) when the process exits. This is equivalent to:
+  // ```
+  //    void dcc_merge_all_threads() {
+  //      dcc_lock_threads();
+  //      for (Node *N = dcc_threads; N; N = N->Next) {
+  //        dcc_merge_shard(N->Shard);
+  //        N->Shard = NULL;
+  //      }
+  //      dcc_threads = NULL;
+  //      dcc_unlock_threads();
+  //    }
+  // ```
+  // The threads that are still running keep updating their shards, but
+  // these are not merged again (the updates happen after the results are
+  // reported anyway).
+  TLC.MergeAllThreads = createInternalFunction(
+      M, FunctionType::get(Type::getVoidTy(CTX), {}, /*IsVarArgs=*/false),
+      "dcc_merge_all_threads");
+
+  Entry = BasicBlock::Create(CTX, "enter", TLC.MergeAllThreads);
+  Loop = BasicBlock::Create(CTX, "loop", TLC.MergeAllThreads);
+  Exit = BasicBlock::Create(CTX, "exit", TLC.MergeAllThreads);
+
+  Builder.SetInsertPoint(Entry);
+  Builder.CreateCall(LockF);
+  Value *First = Builder.CreateLoad(PtrTy, TLC.Threads);
+  Builder.CreateCondBr(Builder.CreateIsNull(First), Exit, Loop);
+
+  Builder.SetInsertPoint(Loop);
+  PHINode *Cur = Builder.CreatePHI(PtrTy, 2, "node");
+  Cur->addIncoming(First, Entry);
+  Builder.CreateCall(MergeShard,
+                     {Builder.CreateLoad(PtrTy, NodeField(Cur, 2))});
+  Builder.CreateStore(ConstantPointerNull::get(PtrTy), NodeField(Cur, 2));
+  Next = Builder.CreateLoad(PtrTy, NodeField(Cur, 0));
+  Cur->addIncoming(Next, Loop);
+  Builder.CreateCondBr(Builder.CreateIsNull(Next), Exit, Loop);
+
+  Builder.SetInsertPoint(Exit);
+  Builder.CreateStore(ConstantPointerNull::get(PtrTy), TLC.Threads);
+  Builder.CreateCall(UnlockF);
+  Builder.CreateRetVoid();
+
+  // STEP 5: Define `void dcc_register_thread()`. This is equivalent to:
+  // ```
+  //    void dcc_register_thread() {
+  //      dcc_thread_registered = 1;
+  //      dcc_lock_threads();
+  //      dcc_thread_node.Shard = dcc_thread_counters;
+  //      dcc_thread_node.Prev = NULL;
+  //      dcc_thread_node.Next = dcc_threads;
+  //      if (dcc_threads)
+  //        dcc_threads->Prev = &dcc_thread_node;
+  //      dcc_threads = &dcc_thread_node;
+  //      dcc_unlock_threads();
+  //      // The key destructor merges and unlinks the entry of this thread
+  //      pthread_setspecific(dcc_thread_key, &dcc_thread_node);
+  //    }
+  // ```
+  FunctionCallee SetSpecific = M.getOrInsertFunction(
+      "pthread_setspecific",
+      FunctionType::get(IntegerType::getInt32Ty(CTX), {KeyTy, PtrTy},
+                        /*IsVarArgs=*/false));
+
+  TLC.RegisterThread = createInternalFunction(
+      M, FunctionType::get(Type::getVoidTy(CTX), {}, /*IsVarArgs=*/false),
+      "dcc_register_thread");
+  // This is only called once per thread - keep it out of the callers
+  TLC.RegisterThread->addFnAttr(Attribute::NoInline);
+  TLC.RegisterThread->addFnAttr(Attribute::Cold);
+
+  Entry = BasicBlock::Create(CTX, "enter", TLC.RegisterThread);
+  BasicBlock *Link = BasicBlock::Create(CTX, "link", TLC.RegisterThread);
+  Exit = BasicBlock::Create(CTX, "exit", TLC.RegisterThread);
+
+  Builder.SetInsertPoint(Entry);
+  Builder.CreateStore(Builder.getInt8(1),
+                      Builder.CreateThreadLocalAddress(TLC.Registered));
+  Node = Builder.CreateThreadLocalAddress(TLC.Node);
+  Builder.CreateCall(LockF);
+  Builder.CreateStore(Builder.CreateThreadLocalAddress(Table.ThreadCounters),
+                      NodeField(Node, 2));
+  Builder.CreateStore(ConstantPointerNull::get(PtrTy), NodeField(Node, 1));
+  First = Builder.CreateLoad(PtrTy, TLC.Threads);
+  Builder.CreateStore(First, NodeField(Node, 0));
+  Builder.CreateCondBr(Builder.CreateIsNull(First), Exit, Link);
+
+  Builder.SetInsertPoint(Link);
+  Builder.CreateStore(Node, NodeField(First, 1));
+  Builder.CreateBr(Exit);
+
+  Builder.SetInsertPoint(Exit);
+  Builder.CreateStore(Node, TLC.Threads);
+  Builder.CreateCall(UnlockF);
+  Builder.CreateCall(SetSpecific, {Builder.CreateLoad(KeyTy, TLC.Key), Node});
+  Builder.CreateRetVoid();
+
+  // STEP 6: Define the module constructor that creates the pthread key:
+  // ```
+  //    void dcc_init_thread_counters() {
+  //      pthread_key_create(&dcc_thread_key, dcc_merge_thread_counters);
+  //    }
+  // ```
+  FunctionCallee KeyCreate = M.getOrInsertFunction(
+      "pthread_key_create",
+      FunctionType::get(IntegerType::getInt32Ty(CTX), {PtrTy, PtrTy},
+                        /*IsVarArgs=*/false));
+
+  Function *Init = createInternalFunction(
+      M, FunctionType::get(Type::getVoidTy(CTX), {}, /*IsVarArgs=*/false),
+      "dcc_init_thread_counters");
+  Builder.SetInsertPoint(BasicBlock::Create(CTX, "enter", Init));
+  Builder.CreateCall(KeyCreate, {TLC.Key, TLC.MergeThreadCounters});
+  Builder.CreateRetVoid();
+
+  appendToGlobalCtors(M, Init, /*Priority=*/0);
+
+  return TLC;
+}
+
+// Defines `void dcc_reset_thread_counters()` that zeroes the shard of the
+// calling thread. lt_rt calls it in forked children - the child inherits the
+// shard of the forking thread, i.e. counts that belong to the parent. The
+// child also inherits the list of the registered shards, but only the forking
+// thread exists in the child (and the lock might have been held by another
+// thread). This is equivalent to:
+// ```
+//    void dcc_reset_thread_counters() {
+//      memset(dcc_thread_counters, 0, sizeof(dcc_thread_counters));
+//      dcc_threads_lock = 0;
+//      dcc_threads = NULL;
+//      if (dcc_thread_registered) {
+//        dcc_thread_node = {NULL, NULL, dcc_thread_counters};
+//        dcc_threads = &dcc_thread_node;
+//      }
+//    }
+// ```
+static Function *createResetThreadCounters(Module &M,
+                                           const CounterTable &Table,
+                                           const ThreadLocalCounters &TLC) {
+  auto &CTX = M.getContext();
+  PointerType *PtrTy = PointerType::getUnqual(CTX);
+  Function *ResetF = createInternalFunction(
+      M, FunctionType::get(Type::getVoidTy(CTX), {}, /*IsVarArgs=*/false),
+      "dcc_reset_thread_counters");
+  BasicBlock *Entry = BasicBlock::Create(CTX, "enter", ResetF);
+  BasicBlock *Link = BasicBlock::Create(CTX, "link", ResetF);
+  BasicBlock *Exit = BasicBlock::Create(CTX, "exit", ResetF);
+
+  IRBuilder<> Builder(Entry);
+  Value *ShardAddr = Builder.CreateThreadLocalAddress(Table.ThreadCounters);
+  Builder.CreateMemSet(ShardAddr, Builder.getInt8(0),
+                       Table.size() * sizeof(uint64_t), MaybeAlign(8));
+  Builder.CreateStore(Builder.getInt32(0), TLC.Lock);
+  Builder.CreateStore(ConstantPointerNull::get(PtrTy), TLC.Threads);
+  Value *Registered = Builder.CreateLoad(
+      Builder.getInt8Ty(), Builder.CreateThreadLocalAddress(TLC.Registered));
+  Builder.CreateCondBr(Builder.CreateIsNull(Registered), Exit, Link);
+
+  Builder.SetInsertPoint(Link);
+  Type *NodeTy = TLC.Node->getValueType();
+  Value *Node = Builder.CreateThreadLocalAddress(TLC.Node);
+  Builder.CreateStore(ConstantPointerNull::get(PtrTy),
+                      Builder.CreateStructGEP(NodeTy, Node, 0));
+  Builder.CreateStore(ConstantPointerNull::get(PtrTy),
+                      Builder.CreateStructGEP(NodeTy, Node, 1));
+  Builder.CreateStore(ShardAddr, Builder.CreateStructGEP(NodeTy, Node, 2));
+  Builder.CreateStore(Node, TLC.Threads);
+  Builder.CreateBr(Exit);
+
+  Builder.SetInsertPoint(Exit);
+  Builder.CreateRetVoid();
+
+  return ResetF;
+}
+
+// Injects `if (__builtin_expect(Cond, 0)) Callee(Args);` at the current
+// insertion point of Builder. The current block is split after the static
+// allocas so that these stay in the entry block.
+static void injectUnlikelyCall(IRBuilder<> &Builder, Value *Cond,
+                               FunctionCallee Callee, ArrayRef<Value *> Args) {
+  BasicBlock::iterator SplitPt = Builder.GetInsertPoint();
+  while (isa<AllocaInst>(*SplitPt))
+    ++SplitPt;
+
+  Instruction *ThenTerm = SplitBlockAndInsertIfThen(
+      Cond, &*SplitPt, /*Unreachable=*/false,
+      MDBuilder(Builder.getContext()).createUnlikelyBranchWeights());
+  IRBuilder<> ThenBuilder(ThenTerm);
+  ThenBuilder.CreateCall(Callee, Args);
+}
+
+// Injects the following at the current insertion point of Builder:
+// ```
+//    if (__builtin_expect(!dcc_thread_registered, 0))
+//      dcc_register_thread();
+// ```
+static void injectRegisterThreadCheck(IRBuilder<> &Builder,
+                                      const ThreadLocalCounters &TLC) {
+  Value *Registered =
+      Builder.CreateLoad(Builder.getInt8Ty(),
+                         Builder.CreateThreadLocalAddress(TLC.Registered));
+  injectUnlikelyCall(Builder, Builder.CreateIsNull(Registered),
+                     TLC.RegisterThread, {});
+}
+
+// Injects the following at the current insertion point of Builder (i.e. at
+// the top of the instrumented function):
+// ```
+//    dcc_thread_counters[Slot]++;
+//    if (__builtin_expect(!dcc_thread_registered, 0))
+//      dcc_register_thread();
+// ```
+static void injectThreadLocalIncrement(IRBuilder<> &Builder,
+                                       const CounterTable &Table,
+                                       uint64_t Slot,
+                                       const ThreadLocalCounters &TLC) {
+  auto &CTX = Builder.getContext();
+
+  Value *ShardPtr = getCounterPtr(
+      Builder, Table.ThreadCounters,
+      Builder.CreateThreadLocalAddress(Table.ThreadCounters), Slot);
+  LoadInst *Load = Builder.CreateLoad(IntegerType::getInt64Ty(CTX), ShardPtr);
+  Value *Inc = Builder.CreateAdd(Builder.getInt64(1), Load);
+  Builder.CreateStore(Inc, ShardPtr);
+
+  injectRegisterThreadCheck(Builder, TLC);
+}
+
+//-----------------------------------------------------------------------------
+// Call-edge profiling (the `edges` mode)
+//-----------------------------------------------------------------------------
+namespace {
+// The call sites instrumented in one module (see LTRTModule in
+// runtime/lt_rt.h)
+struct CallSiteTable {
+  // `[N x ptr] dcc_functions`
+  GlobalVariable *Functions = nullptr;
+  // `[S x {i64, i64, ptr, i64}] dcc_call_sites`
+  GlobalVariable *Sites = nullptr;
+  uint64_t NumSites = 0;
+  // `[D x i64] dcc_site_counters` (one per direct call site)
+  GlobalVariable *SiteCounters = nullptr;
+  // `[I x {[K x ptr], [K x i64], [K x i64], i64}] dcc_indirect_targets` (one
+  // per indirect call site)
+  GlobalVariable *IndirectTargets = nullptr;
+};
+
+// A call site to instrument
+struct CallSite {
+  CallBase *CB;
+  // The slot of the caller
+  uint64_t Caller;
+  // The index of this call site within the caller
+  uint64_t Ordinal;
+  // The index into `dcc_site_counters` or `dcc_indirect_targets`
+  uint64_t Index;
+};
+} // namespace
+
+// The maximum number of targets recorded per indirect call site. This has to
+// match LT_RT_MAX_INDIRECT_TARGETS in runtime/lt_rt.h.
+static constexpr uint64_t MaxIndirectTargets = 4;
+
+// Returns true for the calls that are profiled in the `edges` mode, i.e. all
+// calls apart from intrinsics and inline assembly
+static bool isProfiledCallSite(const CallBase &CB) {
+  return !isa<IntrinsicInst>(CB) && !CB.isInlineAsm();
+}
+
+static GlobalVariable *createZeroInitializedTable(Module &M, Type *ElementTy,
+                                                  uint64_t NumElements,
+                                                  StringRef Name) {
+  if (!NumElements)
+    return nullptr;
+
+  ArrayType *TableTy = ArrayType::get(ElementTy, NumElements);
+  auto *Table = new GlobalVariable(M, TableTy, /*isConstant=*/false,
+                                   GlobalValue::InternalLinkage,
+                                   ConstantAggregateZero::get(TableTy), Name);
+  Table->setAlignment(MaybeAlign(8));
+  return Table;
+}
+
+// Creates the tables for all the call sites in Functions (these have to be in
+// slot order) and injects the following before every call site (the updates
+// of the direct call site counters are appended to Updates):
+//  * direct calls:
+//    ```
+//      dcc_site_counters[Index]++;
+//    ```
+//  * indirect calls (e.g. via `ptr %fptr`):
+//    ```
+//      __lt_rt_record_indirect_call(&dcc_indirect_targets[Index], fptr);
+//    ```
+static CallSiteTable instrumentCallSites(Module &M,
+                                         ArrayRef<Function *> Functions,
+                                         PromotableUpdates &Updates) {
+  auto &CTX = M.getContext();
+  PointerType *PtrTy = PointerType::getUnqual(CTX);
+  IntegerType *Int64Ty = IntegerType::getInt64Ty(CTX);
+  CallSiteTable Table;
+
+  // STEP 1: Collect the call sites
+  SmallVector<CallSite, 32> Sites;
+  uint64_t NumDirect = 0, NumIndirect = 0;
+  for (uint64_t Slot = 0; Slot < Functions.size(); Slot++) {
+    uint64_t Ordinal = 0;
+    for (Instruction &I : instructions(*Functions[Slot])) {
+      auto *CB = dyn_cast<CallBase>(&I);
+      if (!CB || !isProfiledCallSite(*CB))
+        continue;
+
+      uint64_t Index = CB->getCalledFunction() ? NumDirect++ : NumIndirect++;
+      Sites.push_back({CB, Slot, Ordinal++, Index});
+    }
+  }
+
+  Table.NumSites = Sites.size();
+  if (Sites.empty())
+    return Table;
+
+  // STEP 2: Create the tables
+  SmallVector<Constant *, 16> FunctionAddrs(Functions.begin(),
+                                            Functions.end());
+  ArrayType *FunctionsTy = ArrayType::get(PtrTy, Functions.size());
+  Table.Functions = new GlobalVariable(
+      M, FunctionsTy, /*isConstant=*/true, GlobalValue::InternalLinkage,
+      ConstantArray::get(FunctionsTy, FunctionAddrs), "dcc_functions");
+
+  StructType *SiteTy = StructType::get(CTX, {Int64Ty, Int64Ty, PtrTy, Int64Ty});
+  StringMap<Constant *> CalleeNames;
+  SmallVector<Constant *, 32> SiteDescs;
+  for (const CallSite &Site : Sites) {
+    Constant *CalleeName = ConstantPointerNull::get(PtrTy);
+    if (Function *Callee = Site.CB->getCalledFunction()) {
+      Constant *&Name = CalleeNames[Callee->getName()];
+      if (!Name) {
+        Constant *Str = ConstantDataArray::getString(CTX, Callee->getName());
+        auto *NameGV = new GlobalVariable(M, Str->getType(),
+                                          /*isConstant=*/true,
+                                          GlobalValue::PrivateLinkage, Str,
+                                          "dcc_callee_name");
+        NameGV->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+        NameGV->setAlignment(Align(1));
+        Name = NameGV;
+      }
+      CalleeName = Name;
+    }
+
+    SiteDescs.push_back(ConstantStruct::get(
+        SiteTy, {ConstantInt::get(Int64Ty, Site.Caller),
+                 ConstantInt::get(Int64Ty, Site.Ordinal), CalleeName,
+                 ConstantInt::get(Int64Ty, Site.Index)}));
+  }
+  ArrayType *SitesTy = ArrayType::get(SiteTy, SiteDescs.size());
+  Table.Sites = new GlobalVariable(
+      M, SitesTy, /*isConstant=*/true, GlobalValue::InternalLinkage,
+      ConstantArray::get(SitesTy, SiteDescs), "dcc_call_sites");
+
+  Table.SiteCounters = createZeroInitializedTable(M, Int64Ty, NumDirect,
+                                                  "dcc_site_counters");
+  StructType *TargetsTy = StructType::get(
+      CTX, {ArrayType::get(PtrTy, MaxIndirectTargets),
+            ArrayType::get(Int64Ty, MaxIndirectTargets),
+            ArrayType::get(Int64Ty, MaxIndirectTargets), Int64Ty});
+  Table.IndirectTargets = createZeroInitializedTable(
+      M, TargetsTy, NumIndirect, "dcc_indirect_targets");
+
+  // STEP 3: Instrument the call sites
+  FunctionCallee RecordIndirect = M.getOrInsertFunction(
+      "__lt_rt_record_indirect_call",
+      FunctionType::get(Type::getVoidTy(CTX), {PtrTy, PtrTy},
+                        /*IsVarArgs=*/false));
+
+  for (const CallSite &Site : Sites) {
+    IRBuilder<> Builder(Site.CB);
+    if (Site.CB->getCalledFunction()) {
+      Value *Counter = getCounterPtr(Builder, Table.SiteCounters,
+                                     Table.SiteCounters, Site.Index);
+      Updates[Site.CB->getFunction()].push_back(
+          injectCounterUpdate(Builder, Counter, Builder.getInt64(1)));
+    } else {
+      Value *Targets = getCounterPtr(Builder, Table.IndirectTargets,
+                                     Table.IndirectTargets, Site.Index);
+      Builder.CreateCall(RecordIndirect,
+                         {Targets, Site.CB->getCalledOperand()});
+    }
+  }
+
+  return Table;
+}
+
+//-----------------------------------------------------------------------------
+// Block and edge profiling (the `blocks` mode)
+//-----------------------------------------------------------------------------
+namespace {
+// The CFGs instrumented in one module (see LTRTModule in runtime/lt_rt.h)
+struct CFGTable {
+  // `[F x {i64, i64, i64, i64}] dcc_cfg_functions`
+  GlobalVariable *Functions = nullptr;
+  uint64_t NumFunctions = 0;
+  // `[E x {i64, i64, i64}] dcc_cfg_edges`
+  GlobalVariable *Edges = nullptr;
+  // `[C x i64] dcc_block_counters`
+  GlobalVariable *Counters = nullptr;
+};
+} // namespace
+
+// Marks the CFG edges without a counter. This has to match LT_RT_NO_COUNTER
+// in runtime/lt_rt.h.
+static constexpr uint64_t NoCounter = UINT64_MAX;
+
+// Returns true if the CFG of F can be profiled in the `blocks` mode. Funclet
+// based EH pads (e.g. `catchswitch`) constrain how the edges into and out of
+// them can be split, so such functions are skipped altogether. So are the
+// functions in which some of the edges that need a counter can't be split.
+static bool canInstrumentCFG(const Function &F, const CFGSpanningTree &Tree) {
+  for (const BasicBlock &BB : F)
+    if (BB.isEHPad() && !BB.isLandingPad())
+      return false;
+
+  return all_of(Tree.edges(), [](const CFGEdge &Edge) {
+    return Edge.InTree || CFGSpanningTree::canInstrument(Edge);
+  });
+}
+
+// Creates the tables for the CFGs of Functions (these have to be in slot
+// order) and injects `dcc_block_counters[Counter]++;` on every edge that is
+// not in the spanning tree of its function (on every edge if AllEdges is
+// true). The counts of the remaining edges and of the blocks are
+// reconstructed by the runtime. The counter updates are appended to Updates.
+static CFGTable
+instrumentBlocks(Module &M, ArrayRef<Function *> Functions,
+                 function_ref<BlockFrequencyInfo &(Function &)> GetBFI,
+                 bool AllEdges, PromotableUpdates &Updates) {
+  auto &CTX = M.getContext();
+  IntegerType *Int64Ty = IntegerType::getInt64Ty(CTX);
+  CFGTable Table;
+
+  // STEP 1: Build the spanning trees. This has to be done before any of the
+  // CFGs are modified (the spanning trees refer to the original edges).
+  SmallVector<std::pair<uint64_t, CFGSpanningTree>, 16> Trees;
+  for (uint64_t Slot = 0; Slot < Functions.size(); Slot++) {
+    Function &F = *Functions[Slot];
+    CFGSpanningTree Tree(F, &GetBFI(F), AllEdges);
+    if (!canInstrumentCFG(F, Tree)) {
+      LLVM_DEBUG(dbgs() << " Skipping the CFG of: " << F.getName() << "\n");
       continue;
+    }
+    Trees.emplace_back(Slot, std::move(Tree));
+  }
 
-    // Get an IR builder. Sets the insertion point to the top of the function
-    IRBuilder<> Builder(&*F.getEntryBlock().getFirstInsertionPt());
+  Table.NumFunctions = Trees.size();
+  if (Trees.empty())
+    return Table;
 
-    // Create a global variable to count the calls to this function
-    std::string CounterName = "CounterFor_" + std::string(F.getName());
-    Constant *Var = CreateGlobalCounter(M, CounterName);
-    CallCounterMap[F.getName()] = Var;
+  // STEP 2: Create the tables
+  StructType *FunctionTy =
+      StructType::get(CTX, {Int64Ty, Int64Ty, Int64Ty, Int64Ty});
+  StructType *EdgeTy = StructType::get(CTX, {Int64Ty, Int64Ty, Int64Ty});
+  SmallVector<Constant *, 16> FunctionDescs;
+  SmallVector<Constant *, 64> EdgeDescs;
+  uint64_t NumCounters = 0;
+  for (const auto &[Slot, Tree] : Trees) {
+    FunctionDescs.push_back(ConstantStruct::get(
+        FunctionTy, {ConstantInt::get(Int64Ty, Slot),
+                     ConstantInt::get(Int64Ty, Tree.numBlocks()),
+                     ConstantInt::get(Int64Ty, EdgeDescs.size()),
+                     ConstantInt::get(Int64Ty, Tree.edges().size())}));
 
-    // Create a global variable to hold the name of this function
-    auto FuncName = Builder.CreateGlobalString(F.getName());
-    FuncNameMap[F.getName()] = FuncName;
+    for (const CFGEdge &Edge : Tree.edges())
+      EdgeDescs.push_back(ConstantStruct::get(
+          EdgeTy,
+          {ConstantInt::get(Int64Ty, Tree.getBlockIndex(Edge.Src)),
+           ConstantInt::get(Int64Ty, Tree.getBlockIndex(Edge.Dst)),
+           ConstantInt::get(Int64Ty,
+                            Edge.InTree ? NoCounter : NumCounters++)}));
+  }
 
-    // Inject instruction to increment the call count each time this function
-    // executes
-    LoadInst *Load2 = Builder.CreateLoad(IntegerType::getInt32Ty(CTX), Var);
-    Value *Inc2 = Builder.CreateAdd(Builder.getInt32(1), Load2);
-    Builder.CreateStore(Inc2, Var);
+  ArrayType *FunctionsTy = ArrayType::get(FunctionTy, FunctionDescs.size());
+  Table.Functions = new GlobalVariable(
+      M, FunctionsTy, /*isConstant=*/true, GlobalValue::InternalLinkage,
+      ConstantArray::get(FunctionsTy, FunctionDescs), "dcc_cfg_functions");
+  ArrayType *EdgesTy = ArrayType::get(EdgeTy, EdgeDescs.size());
+  Table.Edges = new GlobalVariable(
+      M, EdgesTy, /*isConstant=*/true, GlobalValue::InternalLinkage,
+      ConstantArray::get(EdgesTy, EdgeDescs), "dcc_cfg_edges");
+  Table.Counters = createZeroInitializedTable(M, Int64Ty, NumCounters,
+                                              "dcc_block_counters");
 
-    // The following is visible only if you pass -debug on the command line
-    // *and* you have an assert build.
-    LLVM_DEBUG(dbgs() << " Instrumented: " << F.getName() << "\n");
+  // STEP 3: Instrument the edges (in the same order as the counters were
+  // assigned above)
+  uint64_t Counter = 0;
+  for (const auto &[Slot, Tree] : Trees) {
+    for (const CFGEdge &Edge : Tree.edges()) {
+      if (Edge.InTree)
+        continue;
+
+      IRBuilder<> Builder(CFGSpanningTree::getInsertionPoint(Edge));
+      Value *CounterPtr =
+          getCounterPtr(Builder, Table.Counters, Table.Counters, Counter++);
+      Updates[Functions[Slot]].push_back(
+          injectCounterUpdate(Builder, CounterPtr, Builder.getInt64(1)));
+    }
+  }
+
+  return Table;
+}
+
+//-----------------------------------------------------------------------------
+// Function entries and exits (the `timing` and `cct` modes)
+//-----------------------------------------------------------------------------
+// Creates `dcc_function_times` for Functions (these have to be in slot order)
+// and injects the following into every function:
+// ```
+//    void *Frame = __builtin_frame_address(0);
+//    __lt_rt_enter_function(&dcc_function_times[Slot], Frame);
+//    ...
+//    __lt_rt_exit_function(&dcc_function_times[Slot], Frame);
+//    return ...;
+// ```
+// Functions that are left by unwinding or by `longjmp` don't reach the exit
+// hook. Instead, `__lt_rt_unwind_to(&dcc_function_times[Slot], Frame)` is
+// injected at the top of every landing pad and after every call to `setjmp`
+// (and other `returns_twice` functions), i.e. wherever such a function hands
+// control back to one of its callers. lt_rt then pops the callees above the
+// current activation (see lt_rt.c). The address of the function's entry in
+// `dcc_function_times` also identifies the function in the calling-context
+// trees. Returns `dcc_function_times`.
+static GlobalVariable *
+instrumentEntriesAndExits(Module &M, ArrayRef<Function *> Functions) {
+  auto &CTX = M.getContext();
+  PointerType *PtrTy = PointerType::getUnqual(CTX);
+  IntegerType *Int64Ty = IntegerType::getInt64Ty(CTX);
+
+  // `[N x {i64, i64}]`, see LTRTFunctionTimes in runtime/lt_rt.h
+  GlobalVariable *Times = createZeroInitializedTable(
+      M, StructType::get(CTX, {Int64Ty, Int64Ty}), Functions.size(),
+      "dcc_function_times");
+
+  FunctionCallee Enter = M.getOrInsertFunction(
+      "__lt_rt_enter_function",
+      FunctionType::get(Type::getVoidTy(CTX), {PtrTy, PtrTy},
+                        /*IsVarArgs=*/false));
+  FunctionCallee Exit = M.getOrInsertFunction(
+      "__lt_rt_exit_function",
+      FunctionType::get(Type::getVoidTy(CTX), {PtrTy, PtrTy},
+                        /*IsVarArgs=*/false));
+  FunctionCallee UnwindTo = M.getOrInsertFunction(
+      "__lt_rt_unwind_to",
+      FunctionType::get(Type::getVoidTy(CTX), {PtrTy, PtrTy},
+                        /*IsVarArgs=*/false));
+
+  for (uint64_t Slot = 0; Slot < Functions.size(); Slot++) {
+    Function &F = *Functions[Slot];
+
+    // The returns and the points where control comes back from callees
+    // that were left by unwinding or by `longjmp`
+    SmallVector<ReturnInst *, 4> Returns;
+    SmallVector<Instruction *, 4> Resumptions;
+    for (Instruction &I : instructions(F)) {
+      if (auto *Ret = dyn_cast<ReturnInst>(&I))
+        Returns.push_back(Ret);
+      else if (isa<LandingPadInst>(I))
+        Resumptions.push_back(I.getNextNode());
+      else if (auto *CI = dyn_cast<CallInst>(&I); CI && CI->canReturnTwice())
+        Resumptions.push_back(CI->getNextNode());
+    }
+
+    // Keep the static allocas at the top of the entry block
+    BasicBlock::iterator EntryPt = F.getEntryBlock().getFirstInsertionPt();
+    while (isa<AllocaInst>(*EntryPt))
+      ++EntryPt;
+
+    IRBuilder<> Builder(&*EntryPt);
+    Value *Frame = Builder.CreateIntrinsic(Intrinsic::frameaddress, {PtrTy},
+                                           {Builder.getInt32(0)}, {}, "frame");
+    Value *FTimes = Builder.CreateConstInBoundsGEP2_64(Times->getValueType(),
+                                                       Times, 0, Slot);
+    Builder.CreateCall(Enter, {FTimes, Frame});
+
+    for (ReturnInst *Ret : Returns) {
+      // Nothing can be inserted between a `musttail` call and the return. The
+      // tail-called function is then timed as a callee of our caller.
+      Instruction *InsertPt = Ret;
+      if (CallInst *MustTail = Ret->getParent()->getTerminatingMustTailCall())
+        InsertPt = MustTail;
 
-    Instrumented = true;
+      Builder.SetInsertPoint(InsertPt);
+      Builder.CreateCall(Exit, {FTimes, Frame});
+    }
+
+    for (Instruction *InsertPt : Resumptions) {
+      Builder.SetInsertPoint(InsertPt);
+      Builder.CreateCall(UnwindTo, {FTimes, Frame});
+    }
   }
 
-  // Stop here if there are no function definitions in this module
-  if (false == Instrumented)
-    return Instrumented;
+  return Times;
+}
+
+//-----------------------------------------------------------------------------
+// Coverage (the `coverage` mode)
+//-----------------------------------------------------------------------------
+namespace {
+// The coverage tables of one module (see LTRTModule in runtime/lt_rt.h)
+struct CoverageTable {
+  // `[N x i8] dcc_coverage`
+  GlobalVariable *Bytes = nullptr;
+  // `[F x i64] dcc_coverage_blocks` (`coverage=blocks` only)
+  GlobalVariable *Blocks = nullptr;
+};
+} // namespace
 
-  // STEP 2: Inject the declaration of printf
+// Creates the coverage table for Functions (these have to be in slot order)
+// and injects `dcc_coverage[Idx] = 1;` at the entry of every function or, if
+// PerBlock is true, at the beginning of every block. There's no load and no
+// add - executing the store once or a million times has the same effect. The
+// store is `monotonic` only because lt_rt may read the table while it's being
+// updated (a monotonic byte store is a plain store on all common targets).
+// The blocks of a function are
+// numbered in layout order (the entry block first). Blocks that can't hold
+// any instructions other than their terminator (i.e. `catchswitch` blocks)
+// are never marked as executed.
+static CoverageTable instrumentCoverage(Module &M,
+                                        ArrayRef<Function *> Functions,
+                                        bool PerBlock) {
+  auto &CTX = M.getContext();
+  IntegerType *Int8Ty = IntegerType::getInt8Ty(CTX);
+  IntegerType *Int64Ty = IntegerType::getInt64Ty(CTX);
+  CoverageTable Table;
+
+  // STEP 1: Collect the code locations to mark, the index into this vector
+  // is the index into `dcc_coverage`
+  SmallVector<BasicBlock *, 64> Blocks;
+  SmallVector<Constant *, 16> NumBlocks;
+  for (Function *F : Functions) {
+    if (!PerBlock) {
+      Blocks.push_back(&F->getEntryBlock());
+      continue;
+    }
+    for (BasicBlock &BB : *F)
+      Blocks.push_back(&BB);
+    NumBlocks.push_back(ConstantInt::get(Int64Ty, F->size()));
+  }
+
+  Table.Bytes = createZeroInitializedTable(M, Int8Ty, Blocks.size(),
+                                           "dcc_coverage");
+  Table.Bytes->setSection(getTableSectionName(M, "lt_dcc_cov"));
+  if (PerBlock) {
+    auto *BlocksTy = ArrayType::get(Int64Ty, NumBlocks.size());
+    Table.Blocks = new GlobalVariable(
+        M, BlocksTy, /*isConstant=*/true, GlobalValue::InternalLinkage,
+        ConstantArray::get(BlocksTy, NumBlocks), "dcc_coverage_blocks");
+    Table.Blocks->setAlignment(MaybeAlign(8));
+  }
+
+  // STEP 2: Mark every location as executed
+  for (uint64_t Idx = 0; Idx < Blocks.size(); Idx++) {
+    BasicBlock::iterator InsertPt = Blocks[Idx]->getFirstInsertionPt();
+    if (InsertPt == Blocks[Idx]->end())
+      continue;
+
+    IRBuilder<> Builder(Blocks[Idx], InsertPt);
+    StoreInst *Store = Builder.CreateStore(
+        Builder.getInt8(1),
+        Builder.CreateConstInBoundsGEP2_64(Table.Bytes->getValueType(),
+                                           Table.Bytes, 0, Idx));
+    Store->setAtomic(AtomicOrdering::Monotonic);
+  }
+
+  return Table;
+}
+
+//-----------------------------------------------------------------------------
+// Reporting the results
+//-----------------------------------------------------------------------------
+// Defines `printf_wrapper` that prints the counter table to stdout
+static Function *CreatePrintfWrapper(Module &M, const CounterTable &Table) {
+  auto &CTX = M.getContext();
+
+  // STEP 1: Inject the declaration of printf
   // ----------------------------------------
   // Create (or _get_ in cases where it's already available) the following
   // declaration in the IR module:
@@ -139,7 +1304,7 @@ bool DynamicCallCounter::runOnModule(Module &M) {
                                M.getContext(), llvm::CaptureInfo::none()));
   PrintfF->addParamAttr(0, Attribute::ReadOnly);
 
-  // STEP 3: Inject a global variable that will hold the printf format string
+  // STEP 2: Inject a global variable that will hold the printf format string
   // ------------------------------------------------------------------------
   llvm::Constant *ResultFormatStr =
       llvm::ConstantDataArray::getString(CTX, "%-20s %-10lu\n");
@@ -162,19 +1327,17 @@ bool DynamicCallCounter::runOnModule(Module &M) {
       M.getOrInsertGlobal("ResultHeaderStrIR", ResultHeaderStr->getType());
   dyn_cast<GlobalVariable>(ResultHeaderStrVar)->setInitializer(ResultHeaderStr);
 
-  // STEP 4: Define a printf wrapper that will print the results
+  // STEP 3: Define a printf wrapper that will print the results
   // -----------------------------------------------------------
-  // Define `printf_wrapper` that will print the results stored in FuncNameMap
-  // and CallCounterMap.  It is equivalent to the following C++ function:
+  // Define `printf_wrapper` that will print the results stored in the counter
+  // table. It is equivalent to the following C++ function:
   // ```
   //    void printf_wrapper() {
-  //      for (auto &item : Functions)
-  //        printf("llvm-tutor): Function %s was called %d times. \n",
-  //        item.name, item.count);
+  //      for (uint64_t Slot = 0; Slot < N; Slot++)
+  //        printf("%-20s %-10lu\n", &dcc_names[NameOffsets[Slot]],
+  //        dcc_counters[Slot]);
   //    }
   // ```
-  // (item.name comes from FuncNameMap, item.count comes from
-  // CallCounterMap)
   FunctionType *PrintfWrapperTy =
       FunctionType::get(llvm::Type::getVoidTy(CTX), {},
                         /*IsVarArgs=*/false);
@@ -196,26 +1359,358 @@ bool DynamicCallCounter::runOnModule(Module &M) {
   Builder.CreateCall(Printf, {ResultHeaderStrPtr});
 
   LoadInst *LoadCounter;
-  for (auto &item : CallCounterMap) {
-    LoadCounter = Builder.CreateLoad(IntegerType::getInt32Ty(CTX), item.second);
-    // LoadCounter = Builder.CreateLoad(item.second);
-    Builder.CreateCall(
-        Printf, {ResultFormatStrPtr, FuncNameMap[item.first()], LoadCounter});
+  for (uint64_t Slot = 0; Slot < Table.size(); Slot++) {
+    LoadCounter = Builder.CreateLoad(
+        IntegerType::getInt64Ty(CTX),
+        getCounterPtr(Builder, Table.Counters, Table.Counters, Slot));
+    Value *FuncName = Builder.CreateConstInBoundsGEP2_64(
+        Table.Names->getValueType(), Table.Names, 0, Table.NameOffsets[Slot]);
+    Builder.CreateCall(Printf, {ResultFormatStrPtr, FuncName, LoadCounter});
   }
 
   // Finally, insert return instruction
   Builder.CreateRetVoid();
 
-  // STEP 5: Call `printf_wrapper` at the very end of this module
-  // ------------------------------------------------------------
-  appendToGlobalDtors(M, PrintfWrapperF, /*Priority=*/0);
+  return PrintfWrapperF;
+}
+
+// Defines `dcc_write_profile` that appends the counter table to a binary
+// profile file (see ProfileFormat.h). It is equivalent to:
+// ```
+//    void dcc_write_profile() {
+//      const char *Path = getenv("LT_PROFILE_FILE");
+//      FILE *File = fopen(Path ? Path : "default.ltprof", "ab");
+//      if (!File)
+//        return;
+//      fwrite(&dcc_profile_header, sizeof(dcc_profile_header), 1, File);
+//      fwrite(dcc_counters, sizeof(uint64_t), N, File);
+//      fwrite(dcc_names, 1, sizeof(dcc_names), File);
+//      fwrite(dcc_profile_padding, 1, sizeof(dcc_profile_padding), File);
+//      fclose(File);
+//    }
+// ```
+// The file is opened in append mode, so that every instrumented module in the
+// program contributes one record.
+static Function *CreateProfileWriter(Module &M, const CounterTable &Table) {
+  auto &CTX = M.getContext();
+  PointerType *PtrTy = PointerType::getUnqual(CTX);
+  IntegerType *Int32Ty = IntegerType::getInt32Ty(CTX);
+  IntegerType *Int64Ty = IntegerType::getInt64Ty(CTX);
+  IntegerType *SizeTy = M.getDataLayout().getIntPtrType(CTX);
+
+  // STEP 1: Inject the declarations of the required libc functions
+  // ---------------------------------------------------------------
+  FunctionCallee Getenv = M.getOrInsertFunction(
+      "getenv", FunctionType::get(PtrTy, {PtrTy}, /*IsVarArgs=*/false));
+  FunctionCallee Fopen = M.getOrInsertFunction(
+      "fopen", FunctionType::get(PtrTy, {PtrTy, PtrTy}, /*IsVarArgs=*/false));
+  FunctionCallee Fwrite = M.getOrInsertFunction(
+      "fwrite", FunctionType::get(SizeTy, {PtrTy, SizeTy, SizeTy, PtrTy},
+                                  /*IsVarArgs=*/false));
+  FunctionCallee Fclose = M.getOrInsertFunction(
+      "fclose", FunctionType::get(Int32Ty, {PtrTy}, /*IsVarArgs=*/false));
+
+  // STEP 2: Inject the record header (and the padding for the name table)
+  // ---------------------------------------------------------------------
+  uint64_t NamesSize = Table.Names->getValueType()->getArrayNumElements();
+  uint64_t PaddingSize = alignTo(NamesSize, 8) - NamesSize;
+  uint64_t PayloadSize = sizeof(LTProfFunctionCountsHeader) +
+                         Table.size() * sizeof(uint64_t) + NamesSize +
+                         PaddingSize;
+
+  // LTProfRecordHeader + LTProfFunctionCountsHeader
+  Constant *HeaderInit = ConstantStruct::getAnon(
+      {ConstantInt::get(Int64Ty, LT_PROF_MAGIC),
+       ConstantInt::get(Int32Ty, LT_PROF_VERSION),
+       ConstantInt::get(Int32Ty, LT_PROF_FUNCTION_COUNTS),
+       ConstantInt::get(Int64Ty, PayloadSize),
+       ConstantInt::get(Int64Ty, Table.size()),
+       ConstantInt::get(Int64Ty, NamesSize)});
+  auto *Header = new GlobalVariable(M, HeaderInit->getType(),
+                                    /*isConstant=*/true,
+                                    GlobalValue::PrivateLinkage, HeaderInit,
+                                    "dcc_profile_header");
+
+  GlobalVariable *Padding = nullptr;
+  if (PaddingSize) {
+    auto *PaddingTy = ArrayType::get(IntegerType::getInt8Ty(CTX), PaddingSize);
+    Padding = new GlobalVariable(M, PaddingTy, /*isConstant=*/true,
+                                 GlobalValue::PrivateLinkage,
+                                 ConstantAggregateZero::get(PaddingTy),
+                                 "dcc_profile_padding");
+  }
+
+  // STEP 3: Define the function that writes the profile
+  // ----------------------------------------------------
+  Function *WriterF = Function::Create(
+      FunctionType::get(Type::getVoidTy(CTX), {}, /*IsVarArgs=*/false),
+      GlobalValue::InternalLinkage, "dcc_write_profile", M);
+
+  BasicBlock *Entry = BasicBlock::Create(CTX, "enter", WriterF);
+  BasicBlock *Write = BasicBlock::Create(CTX, "write", WriterF);
+  BasicBlock *Exit = BasicBlock::Create(CTX, "exit", WriterF);
+
+  IRBuilder<> Builder(Entry);
+  Value *EnvPath =
+      Builder.CreateCall(Getenv, {Builder.CreateGlobalString(
+                                     LT_PROF_FILE_ENV_VAR, "dcc_env_var")});
+  Value *Path = Builder.CreateSelect(
+      Builder.CreateIsNull(EnvPath),
+      Builder.CreateGlobalString(LT_PROF_DEFAULT_FILE, "dcc_default_file"),
+      EnvPath);
+  Value *File = Builder.CreateCall(
+      Fopen, {Path, Builder.CreateGlobalString("ab", "dcc_file_mode")});
+  Builder.CreateCondBr(Builder.CreateIsNull(File), Exit, Write);
+
+  Builder.SetInsertPoint(Write);
+  const DataLayout &DL = M.getDataLayout();
+  auto WriteTable = [&](GlobalVariable *GV, uint64_t ElementSize) {
+    uint64_t Size = DL.getTypeAllocSize(GV->getValueType());
+    Builder.CreateCall(Fwrite, {GV, ConstantInt::get(SizeTy, ElementSize),
+                                ConstantInt::get(SizeTy, Size / ElementSize),
+                                File});
+  };
+  WriteTable(Header, DL.getTypeAllocSize(Header->getValueType()));
+  WriteTable(Table.Counters, sizeof(uint64_t));
+  WriteTable(Table.Names, 1);
+  if (Padding)
+    WriteTable(Padding, 1);
+  Builder.CreateCall(Fclose, {File});
+  Builder.CreateBr(Exit);
+
+  Builder.SetInsertPoint(Exit);
+  Builder.CreateRetVoid();
+
+  return WriterF;
+}
+
+// LTRTModule::Flags. These have to match LT_RT_MODULE_TIMING,
+// LT_RT_MODULE_CCT, LT_RT_MODULE_SHM and LT_RT_MODULE_COVERAGE in
+// runtime/lt_rt.h.
+static constexpr uint64_t ModuleTiming = 0x1;
+static constexpr uint64_t ModuleCCT = 0x2;
+static constexpr uint64_t ModuleShm = 0x4;
+static constexpr uint64_t ModuleCoverage = 0x8;
+
+// Defines the module descriptor (LTRTModule in runtime/lt_rt.h) for Table
+// (and Sites in the `edges` mode, CFGs in the `blocks` mode, Times in the
+// `timing` and `cct` modes, Coverage in the `coverage` mode,
+// ResetThreadCounters in the `tls` mode) and a module
+// constructor that registers it with the lt_rt runtime. Flags are the
+// LT_RT_MODULE_* flags (see lt_rt.h):
+// ```
+//    LTRTModule dcc_module = {NULL, dcc_counters, dcc_names, N,
+//                             sizeof(dcc_names), ...};
+//    void dcc_register_module() {
+//      __lt_rt_register_module(&dcc_module);
+//    }
+// ```
+static void CreateRuntimeRegistration(Module &M, const CounterTable &Table,
+                                      const CallSiteTable &Sites,
+                                      const CFGTable &CFGs,
+                                      GlobalVariable *Times,
+                                      const CoverageTable &Coverage,
+                                      Function *ResetThreadCounters,
+                                      uint64_t Flags) {
+  auto &CTX = M.getContext();
+  PointerType *PtrTy = PointerType::getUnqual(CTX);
+  IntegerType *Int64Ty = IntegerType::getInt64Ty(CTX);
+
+  // Tables that don't exist in this mode are represented with null
+  auto GetTable = [PtrTy](GlobalValue *GV) -> Constant * {
+    if (GV)
+      return GV;
+    return ConstantPointerNull::get(PtrTy);
+  };
+
+  // STEP 1: Inject the module descriptor. The runtime links the registered
+  // descriptors through the first field, so this is not a constant.
+  StructType *ModuleTy =
+      StructType::get(CTX, {PtrTy, PtrTy, PtrTy, Int64Ty, Int64Ty, PtrTy,
+                            PtrTy, Int64Ty, PtrTy, PtrTy, PtrTy, Int64Ty,
+                            PtrTy, PtrTy, PtrTy, Int64Ty, PtrTy, PtrTy,
+                            PtrTy});
+  uint64_t NamesSize =
+      cast<ArrayType>(Table.Names->getValueType())->getNumElements();
+  auto *Desc = new GlobalVariable(
+      M, ModuleTy, /*isConstant=*/false, GlobalValue::InternalLinkage,
+      ConstantStruct::get(
+          ModuleTy,
+          {ConstantPointerNull::get(PtrTy), GetTable(Table.Counters),
+           Table.Names,
+           ConstantInt::get(Int64Ty, Table.size()),
+           ConstantInt::get(Int64Ty, NamesSize), GetTable(Sites.Functions),
+           GetTable(Sites.Sites), ConstantInt::get(Int64Ty, Sites.NumSites),
+           GetTable(Sites.SiteCounters), GetTable(Sites.IndirectTargets),
+           GetTable(CFGs.Functions),
+           ConstantInt::get(Int64Ty, CFGs.NumFunctions), GetTable(CFGs.Edges),
+           GetTable(CFGs.Counters), GetTable(Times),
+           ConstantInt::get(Int64Ty, Flags), GetTable(Coverage.Bytes),
+           GetTable(Coverage.Blocks), GetTable(ResetThreadCounters)}),
+      "dcc_module");
+  Desc->setAlignment(MaybeAlign(8));
+
+  // STEP 2: Define the module constructor that registers the descriptor
+  FunctionCallee Register = M.getOrInsertFunction(
+      "__lt_rt_register_module",
+      FunctionType::get(Type::getVoidTy(CTX), {PtrTy}, /*IsVarArgs=*/false));
+
+  Function *RegisterF = createInternalFunction(
+      M, FunctionType::get(Type::getVoidTy(CTX), {}, /*IsVarArgs=*/false),
+      "dcc_register_module");
+  IRBuilder<> Builder(BasicBlock::Create(CTX, "enter", RegisterF));
+  Builder.CreateCall(Register, {Desc});
+  Builder.CreateRetVoid();
+
+  appendToGlobalCtors(M, RegisterF, /*Priority=*/0);
+}
+
+//-----------------------------------------------------------------------------
+// DynamicCallCounter implementation
+//-----------------------------------------------------------------------------
+bool DynamicCallCounter::runOnModule(
+    Module &M, function_ref<BlockFrequencyInfo &(Function &)> GetBFI) {
+  auto &CTX = M.getContext();
+
+  // Collect the functions to instrument first - the index into this vector is
+  // the slot in the counter table. Note that the `tls` mode adds new function
+  // definitions to M.
+  SmallVector<Function *, 16> FunctionsToInstrument =
+      selectFunctionsToInstrument(M, Opts.Filter, "dynamic-cc");
+
+  // Stop here if there are no functions to instrument in this module
+  if (FunctionsToInstrument.empty())
+    return false;
+
+  CounterTable Table = CreateCounterTable(M, FunctionsToInstrument, Opts);
+
+  ThreadLocalCounters TLC;
+  if (Opts.ThreadLocal)
+    TLC = createThreadLocalCounters(M, Table);
+
+  // In the `blocks` mode, instrument the CFGs before anything else modifies
+  // them (e.g. the `tls` code adds blocks)
+  PromotableUpdates Updates;
+  CFGTable CFGs;
+  if (Opts.Blocks != DynamicCallCounterOptions::BlockCounting::None)
+    CFGs = instrumentBlocks(
+        M, FunctionsToInstrument, GetBFI,
+        Opts.Blocks == DynamicCallCounterOptions::BlockCounting::AllEdges,
+        Updates);
+
+  // In the `edges` mode, instrument the call sites before the function entries
+  // (so that the calls injected at the function entries are not profiled)
+  CallSiteTable Sites;
+  if (Opts.CallEdges)
+    Sites = instrumentCallSites(M, FunctionsToInstrument, Updates);
+
+  // In the `timing` and `cct` modes, instrument the function entries and
+  // returns. The calls to lt_rt are injected after the call sites are
+  // instrumented (so that these are not profiled) and before the entry
+  // counters (so that the counting code is not timed).
+  GlobalVariable *Times = nullptr;
+  if (Opts.Timing || Opts.CallingContexts)
+    Times = instrumentEntriesAndExits(M, FunctionsToInstrument);
+
+  // In the `coverage` mode, there are no counters to update - just mark the
+  // functions (or the blocks) as executed
+  CoverageTable Coverage;
+  if (Opts.Coverage != DynamicCallCounterOptions::CoverageMode::None)
+    Coverage = instrumentCoverage(
+        M, FunctionsToInstrument,
+        Opts.Coverage == DynamicCallCounterOptions::CoverageMode::Blocks);
+
+  // STEP 1: For each function in the module, inject a call-counting code
+  // --------------------------------------------------------------------
+  for (uint64_t Slot = 0; Table.Counters && Slot < Table.size(); Slot++) {
+    Function &F = *FunctionsToInstrument[Slot];
+
+    // Get an IR builder. Sets the insertion point to the top of the function
+    IRBuilder<> Builder(&*F.getEntryBlock().getFirstInsertionPt());
+
+    // Inject instruction to increment the call count each time this function
+    // executes
+    if (Opts.ThreadLocal) {
+      injectThreadLocalIncrement(Builder, Table, Slot, TLC);
+    } else {
+      Value *Counter =
+          getCounterPtr(Builder, Table.Counters, Table.Counters, Slot);
+      LoadInst *Load2 =
+          Builder.CreateLoad(IntegerType::getInt64Ty(CTX), Counter);
+      Value *Inc2 = Builder.CreateAdd(Builder.getInt64(1), Load2);
+      Builder.CreateStore(Inc2, Counter);
+    }
+
+    // The following is visible only if you pass -debug on the command line
+    // *and* you have an assert build.
+    LLVM_DEBUG(dbgs() << " Instrumented: " << F.getName() << " (slot " << Slot
+                      << ")\n");
+  }
+
+  // Keep the call site and the block counters in registers inside loops
+  if (Opts.PromoteCounters) {
+    for (auto &[F, FUpdates] : Updates) {
+      unsigned NumPromoted = promoteCounterUpdates(*F, FUpdates);
+      (void)NumPromoted;
+      LLVM_DEBUG(dbgs() << " Promoted " << NumPromoted
+                        << " counter(s) out of loops in: " << F->getName()
+                        << "\n");
+    }
+  }
+
+  // STEP 2: Report the results when the module exits
+  // ------------------------------------------------
+  Function *ReportF = nullptr;
+  if (Opts.usesRuntime()) {
+    // lt_rt writes the profile. In the `tls` mode, the counters of the threads
+    // that are still running still need to be merged (before lt_rt writes the
+    // final snapshot).
+    uint64_t Flags = (Opts.Timing ? ModuleTiming : 0) |
+                     (Opts.CallingContexts ? ModuleCCT : 0) |
+                     (Opts.SharedMemory ? ModuleShm : 0) |
+                     (Coverage.Bytes ? ModuleCoverage : 0);
+    Function *ResetThreadCounters =
+        Opts.ThreadLocal ? createResetThreadCounters(M, Table, TLC)
+                          : nullptr;
+    CreateRuntimeRegistration(M, Table, Sites, CFGs, Times, Coverage,
+                              ResetThreadCounters, Flags);
+    if (!Opts.ThreadLocal)
+      return true;
+
+    ReportF = createInternalFunction(
+        M, FunctionType::get(Type::getVoidTy(CTX), {}, /*IsVarArgs=*/false),
+        "dcc_merge_at_exit");
+    ReturnInst::Create(CTX, BasicBlock::Create(CTX, "enter", ReportF));
+  } else if (!Opts.Report) {
+    // The caller reads the counters itself
+    return true;
+  } else {
+    ReportF = Opts.BinaryOutput ? CreateProfileWriter(M, Table)
+                                : CreatePrintfWrapper(M, Table);
+  }
+
+  // In the `tls` mode, the threads that are still running (including the one
+  // running the global destructors) haven't merged their counters yet. Do it
+  // first.
+  if (Opts.ThreadLocal) {
+    IRBuilder<> Builder(&*ReportF->getEntryBlock().getFirstInsertionPt());
+    Builder.CreateCall(TLC.MergeAllThreads);
+  }
+
+  // STEP 3: Call the reporting function at the very end of this module
+  // ------------------------------------------------------------------
+  appendToGlobalDtors(M, ReportF, /*Priority=*/0);
 
   return true;
 }
 
 PreservedAnalyses DynamicCallCounter::run(llvm::Module &M,
-                                          llvm::ModuleAnalysisManager &) {
-  bool Changed = runOnModule(M);
+                                          llvm::ModuleAnalysisManager &MAM) {
+  auto &FAM = MAM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+  auto GetBFI = [&FAM](Function &F) -> BlockFrequencyInfo & {
+    return FAM.getResult<BlockFrequencyAnalysis>(F);
+  };
+  bool Changed = runOnModule(M, GetBFI);
 
   return (Changed ? llvm::PreservedAnalyses::none()
                   : llvm::PreservedAnalyses::all());
@@ -224,17 +1719,101 @@ PreservedAnalyses DynamicCallCounter::run(llvm::Module &M,
 //-----------------------------------------------------------------------------
 // New PM Registration
 //-----------------------------------------------------------------------------
+// Parses the options in `dynamic-cc<option1;option2>`
+static Expected<DynamicCallCounterOptions>
+parseDynamicCallCounterOptions(StringRef Params) {
+  DynamicCallCounterOptions Opts;
+
+  while (!Params.empty()) {
+    StringRef ParamName;
+    std::tie(ParamName, Params) = Params.split(';');
+
+    Expected<bool> IsFilter =
+        parseFunctionFilterParam(ParamName, "dynamic-cc", Opts.Filter);
+    if (!IsFilter)
+      return IsFilter.takeError();
+
+    if (*IsFilter) {
+      continue;
+    } else if (ParamName == "tls") {
+      Opts.ThreadLocal = true;
+    } else if (ParamName == "binary") {
+      Opts.BinaryOutput = true;
+    } else if (ParamName == "flush") {
+      Opts.Flush = true;
+    } else if (ParamName == "edges") {
+      Opts.CallEdges = true;
+    } else if (ParamName == "timing") {
+      Opts.Timing = true;
+    } else if (ParamName == "cct") {
+      Opts.CallingContexts = true;
+    } else if (ParamName == "shm") {
+      Opts.SharedMemory = true;
+    } else if (ParamName == "coverage") {
+      Opts.Coverage = DynamicCallCounterOptions::CoverageMode::Functions;
+    } else if (ParamName == "coverage=blocks") {
+      Opts.Coverage = DynamicCallCounterOptions::CoverageMode::Blocks;
+    } else if (ParamName == "no-promote") {
+      Opts.PromoteCounters = false;
+    } else if (ParamName == "blocks") {
+      Opts.Blocks = DynamicCallCounterOptions::BlockCounting::SpanningTree;
+    } else if (ParamName == "blocks=all") {
+      Opts.Blocks = DynamicCallCounterOptions::BlockCounting::AllEdges;
+    } else {
+      return make_error<StringError>(
+          formatv("invalid dynamic-cc pass parameter '{0}'", ParamName).str(),
+          inconvertibleErrorCode());
+    }
+  }
+
+  if (Opts.SharedMemory && Opts.ThreadLocal)
+    return make_error<StringError>(
+        "dynamic-cc parameter 'shm' can't be combined with 'tls'",
+        inconvertibleErrorCode());
+
+  // `coverage` replaces the counters, so it only works with the filters
+  if (Opts.Coverage != DynamicCallCounterOptions::CoverageMode::None) {
+    std::pair<bool, StringRef> Conflicts[] = {
+        {Opts.ThreadLocal, "tls"},
+        {Opts.BinaryOutput, "binary"},
+        {Opts.CallEdges, "edges"},
+        {Opts.Blocks != DynamicCallCounterOptions::BlockCounting::None,
+         "blocks"},
+        {Opts.Timing, "timing"},
+        {Opts.CallingContexts, "cct"},
+        {Opts.SharedMemory, "shm"}};
+    for (auto [IsSet, Name] : Conflicts)
+      if (IsSet)
+        return make_error<StringError>(
+            formatv("dynamic-cc parameter 'coverage' can't be combined with "
+                    "'{0}'",
+                    Name)
+                .str(),
+            inconvertibleErrorCode());
+  }
+
+  return Opts;
+}
+
 llvm::PassPluginLibraryInfo getDynamicCallCounterPluginInfo() {
   return {LLVM_PLUGIN_API_VERSION, "dynamic-cc", LLVM_VERSION_STRING,
           [](PassBuilder &PB) {
             PB.registerPipelineParsingCallback(
                 [](StringRef Name, ModulePassManager &MPM,
                    ArrayRef<PassBuilder::PipelineElement>) {
-                  if (Name == "dynamic-cc") {
-                    MPM.addPass(DynamicCallCounter());
-                    return true;
+                  if (!PassBuilder::checkParametrizedPassName(Name,
+                                                              "dynamic-cc"))
+                    return false;
+
+                  auto Opts = PassBuilder::parsePassParameters(
+                      parseDynamicCallCounterOptions, Name, "dynamic-cc");
+                  if (!Opts) {
+                    errs() << toString(Opts.takeError()) << "\n";
+                    return false;
                   }
-                  return false;
+
+                  MPM.addPass(DynamicCallCounter(*Opts));
+                  return true;
                 });
           }};
 }
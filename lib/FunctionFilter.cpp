@@ -0,0 +1,185 @@
+//==============================================================================
+// FILE:
+//    FunctionFilter.cpp
+//
+// DESCRIPTION:
+//    Implements the function filters shared by the instrumentation passes (see
+//    FunctionFilter.h). The allow and deny lists are read when the pass runs
+//    (rather than when the pipeline is parsed), so that every error is reported
+//    through the LLVMContext.
+//
+// License: MIT
+//==============================================================================
+#include "FunctionFilter.h"
+
+#include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/LineIterator.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Regex.h"
+
+using namespace llvm;
+
+//-----------------------------------------------------------------------------
+// Option parsing
+//-----------------------------------------------------------------------------
+Expected<bool> parseFunctionFilterParam(StringRef Param, StringRef PassName,
+                                        FunctionFilterOptions &Opts) {
+  auto InvalidValue = [&](StringRef Option) {
+    return make_error<StringError>(
+        formatv("invalid {0} {1} value '{2}'", PassName, Option, Param).str(),
+        inconvertibleErrorCode());
+  };
+
+  if (Param == "skip-cold") {
+    Opts.SkipCold = true;
+  } else if (Param == "only-hot") {
+    Opts.OnlyHot = true;
+  } else if (Param.consume_front("allow=")) {
+    if (Param.empty())
+      return InvalidValue("allow");
+    Opts.AllowList = Param.str();
+  } else if (Param.consume_front("deny=")) {
+    if (Param.empty())
+      return InvalidValue("deny");
+    Opts.DenyList = Param.str();
+  } else if (Param.consume_front("min-size=")) {
+    if (Param.getAsInteger(0, Opts.MinSize))
+      return InvalidValue("min-size");
+  } else if (Param.consume_front("min-entry-count=")) {
+    if (Param.getAsInteger(0, Opts.MinEntryCount))
+      return InvalidValue("min-entry-count");
+  } else {
+    return false;
+  }
+
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+// Function selection
+//-----------------------------------------------------------------------------
+// Reads the regexes in the allow/deny list at Path into Regexes. Every regex
+// has to match the whole function name.
+static Error readFunctionList(StringRef Path, std::vector<Regex> &Regexes) {
+  auto Buffer = MemoryBuffer::getFile(Path, /*IsText=*/true);
+  if (!Buffer)
+    return createStringError(Buffer.getError(), "%s: %s", Path.str().c_str(),
+                             Buffer.getError().message().c_str());
+
+  for (line_iterator Line(**Buffer, /*SkipBlanks=*/true, '#');
+       !Line.is_at_eof(); ++Line) {
+    StringRef Pattern = Line->trim();
+    if (Pattern.empty())
+      continue;
+
+    Regex R(("^(" + Pattern + ")$").str());
+    std::string RegexError;
+    if (!R.isValid(RegexError))
+      return createStringError(inconvertibleErrorCode(),
+                               "%s:%lld: invalid regex '%s': %s",
+                               Path.str().c_str(),
+                               static_cast<long long>(Line.line_number()),
+                               Pattern.str().c_str(), RegexError.c_str());
+    Regexes.push_back(std::move(R));
+  }
+
+  return Error::success();
+}
+
+static bool matchesAny(const std::vector<Regex> &Regexes, StringRef Name) {
+  return llvm::any_of(Regexes,
+                      [Name](const Regex &R) { return R.match(Name); });
+}
+
+SmallVector<Function *, 16>
+selectFunctionsToInstrument(Module &M, const FunctionFilterOptions &Opts,
+                            StringRef PassName) {
+  SmallVector<Function *, 16> Selected;
+
+  // Returns false (after reporting an error) if the list can't be used
+  auto ReadList = [&](const std::string &Path, std::vector<Regex> &Regexes) {
+    if (Path.empty())
+      return true;
+    if (Error E = readFunctionList(Path, Regexes)) {
+      std::string Msg = (PassName + ": " + toString(std::move(E))).str();
+      M.getContext().diagnose(DiagnosticInfoGeneric(Msg));
+      return false;
+    }
+    return true;
+  };
+  std::vector<Regex> Allowed, Denied;
+  if (!ReadList(Opts.AllowList, Allowed) || !ReadList(Opts.DenyList, Denied))
+    return Selected;
+
+  // The number of functions skipped by each filter
+  unsigned NumDenied = 0, NumNotAllowed = 0, NumCold = 0, NumNotHot = 0,
+           NumSmall = 0, NumRare = 0;
+  for (Function &F : M) {
+    if (F.isDeclaration())
+      continue;
+
+    StringRef Name = F.getName();
+    if (!Opts.DenyList.empty() && matchesAny(Denied, Name)) {
+      NumDenied++;
+      continue;
+    }
+    if (!Opts.AllowList.empty() && !matchesAny(Allowed, Name)) {
+      NumNotAllowed++;
+      continue;
+    }
+    if (Opts.SkipCold && F.hasFnAttribute(Attribute::Cold)) {
+      NumCold++;
+      continue;
+    }
+    if (Opts.OnlyHot && !F.hasFnAttribute(Attribute::Hot)) {
+      NumNotHot++;
+      continue;
+    }
+    if (Opts.MinSize && F.getInstructionCount() < Opts.MinSize) {
+      NumSmall++;
+      continue;
+    }
+    if (Opts.MinEntryCount) {
+      auto Count = F.getEntryCount();
+      if (Count && Count->getCount() < Opts.MinEntryCount) {
+        NumRare++;
+        continue;
+      }
+    }
+
+    Selected.push_back(&F);
+  }
+
+  if (!Opts.isActive())
+    return Selected;
+
+  // Report what the filters did, e.g.:
+  //    inject-func-call: instrumented 2 function(s), skipped 3 (1 denied,
+  //    2 cold)
+  unsigned NumSkipped =
+      NumDenied + NumNotAllowed + NumCold + NumNotHot + NumSmall + NumRare;
+  std::string Msg = formatv("{0}: instrumented {1} function(s), skipped {2}",
+                            PassName, Selected.size(), NumSkipped)
+                        .str();
+  std::string Reasons;
+  auto AddReason = [&](unsigned Num, const Twine &Reason) {
+    if (!Num)
+      return;
+    Reasons += Reasons.empty() ? " (" : ", ";
+    Reasons += (Twine(Num) + " " + Reason).str();
+  };
+  AddReason(NumDenied, "denied");
+  AddReason(NumNotAllowed, "not allowed");
+  AddReason(NumCold, "cold");
+  AddReason(NumNotHot, "not hot");
+  AddReason(NumSmall,
+            formatv("smaller than {0} instructions", Opts.MinSize).str());
+  AddReason(NumRare,
+            formatv("entered fewer than {0} times", Opts.MinEntryCount).str());
+  if (!Reasons.empty())
+    Msg += Reasons + ")";
+  M.getContext().diagnose(DiagnosticInfoGeneric(Msg, DS_Remark));
+
+  return Selected;
+}
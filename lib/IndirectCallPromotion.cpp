@@ -0,0 +1,328 @@
+//========================================================================
+// FILE:
+//    IndirectCallPromotion.cpp
+//
+// DESCRIPTION:
+//    Promotes hot indirect calls to direct calls, based on the call targets
+//    recorded by DynamicCallCounter in the `edges` mode (see
+//    ProfileFormat.h). An indirect call that mostly reaches `foo`:
+//    ```
+//      %r = call i32 %fptr(i32 %x)
+//    ```
+//    is rewritten as:
+//    ```
+//      %is.foo = icmp eq ptr %fptr, @foo
+//      br i1 %is.foo, label %if.true.direct_targ, label %if.false.orig_indirect
+//    if.true.direct_targ:
+//      %r.foo = call i32 @foo(i32 %x)
+//      br label %if.end.icp
+//    if.false.orig_indirect:
+//      %r.other = call i32 %fptr(i32 %x)
+//      br label %if.end.icp
+//    if.end.icp:
+//      %r = phi i32 [ %r.foo, %if.true.direct_targ ], [ %r.other, ... ]
+//    ```
+//    The guard is cheap and well predicted, and the direct call can then be
+//    inlined (or otherwise optimised) by the rest of the pipeline. The
+//    branch gets the recorded counts as its weights.
+//
+//    The targets of every call site are considered from the most to the
+//    least frequent one. A target is promoted if it receives at least
+//    `threshold` percent of the calls that are still indirect (i.e. that
+//    don't go to any of the targets promoted before), up to `max-targets`
+//    targets per call site. Targets that are not defined or declared in the
+//    module (e.g. static functions from other translation units or the calls
+//    lumped together as `<other>`), or whose type doesn't match the call, are
+//    skipped.
+//
+//    The call sites are matched by the name of the caller and their index
+//    within it, i.e. this pass has to run at the same point in the pipeline
+//    as DynamicCallCounter did. Call sites from the profile that no longer
+//    exist are reported with a warning (see also ProfileAnnotator.cpp).
+//
+// USAGE:
+//      $ opt -load-pass-plugin <BUILD_DIR>/lib/libDynamicCallCounter.so `\`
+//        -passes=-"dynamic-cc<edges>" input.bc -o instrumented.bc
+//      $ clang instrumented.bc -L<BUILD_DIR>/lib -llt_rt -o instrumented
+//      $ LT_PROFILE_FILE=input.ltprof ./instrumented
+//      $ opt -load-pass-plugin <BUILD_DIR>/lib/libIndirectCallPromotion.so `\`
+//        -passes="indirect-call-promotion<file=input.ltprof>,default<O2>" `\`
+//        input.bc -o optimised.bc
+//
+// License: MIT
+//========================================================================
+#include "IndirectCallPromotion.h"
+#include "ProfileFormat.h"
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Plugins/PassPlugin.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Transforms/Utils/CallPromotionUtils.h"
+
+#include <cstdlib>
+#include <map>
+
+using namespace llvm;
+
+#define DEBUG_TYPE "indirect-call-promotion"
+
+STATISTIC(NumPromotedTargets, "Number of promoted indirect call targets");
+
+//-----------------------------------------------------------------------------
+// IndirectCallPromotion implementation
+//-----------------------------------------------------------------------------
+namespace {
+// The targets recorded for one indirect call site, merged over all the
+// records for it
+struct SiteProfile {
+  StringMap<uint64_t> Targets;
+  // The number of calls made from this site
+  uint64_t Total = 0;
+  bool Matched = false;
+};
+
+// An indirect call site to promote
+struct Candidate {
+  CallBase *CB;
+  SiteProfile *Profile;
+};
+} // namespace
+
+// Returns the profile to read
+static std::string getProfilePath(const IndirectCallPromotionOptions &Opts) {
+  if (!Opts.ProfileFile.empty())
+    return Opts.ProfileFile;
+  const char *Path = std::getenv(LT_PROF_FILE_ENV_VAR);
+  return (Path && *Path) ? Path : LT_PROF_DEFAULT_FILE;
+}
+
+// Returns true for the calls that DynamicCallCounter profiles in the `edges`
+// mode. This has to match isProfiledCallSite in DynamicCallCounter.cpp, or
+// the call sites won't be numbered the same way.
+static bool isProfiledCallSite(const CallBase &CB) {
+  return !isa<IntrinsicInst>(CB) && !CB.isInlineAsm();
+}
+
+// Creates branch weights for a guard taken Taken times and not taken NotTaken
+// times. Branch weights are 32-bit, so the counts are scaled down if
+// necessary.
+static MDNode *createGuardWeights(LLVMContext &Ctx, uint64_t Taken,
+                                  uint64_t NotTaken) {
+  uint64_t Scale = std::max(Taken, NotTaken) / UINT32_MAX + 1;
+  return MDBuilder(Ctx).createBranchWeights(
+      static_cast<uint32_t>(Taken / Scale),
+      static_cast<uint32_t>(NotTaken / Scale));
+}
+
+// Promotes the hot targets of the indirect call CB. Returns the number of
+// promoted targets.
+static unsigned promoteCallSite(CallBase &CB, const SiteProfile &Profile,
+                                const IndirectCallPromotionOptions &Opts) {
+  Module &M = *CB.getModule();
+
+  // The targets, from the most to the least frequent one
+  std::vector<std::pair<StringRef, uint64_t>> Targets;
+  for (const auto &Target : Profile.Targets)
+    Targets.emplace_back(Target.getKey(), Target.getValue());
+  llvm::sort(Targets, [](const auto &A, const auto &B) {
+    return A.second != B.second ? A.second > B.second : A.first < B.first;
+  });
+
+  unsigned NumPromoted = 0;
+  uint64_t Remaining = Profile.Total;
+  for (auto [Name, Count] : Targets) {
+    if (NumPromoted == Opts.MaxTargets ||
+        Count * 100 < Opts.Threshold * Remaining)
+      break;
+
+    Function *Callee = M.getFunction(Name);
+    const char *Reason = nullptr;
+    if (!Callee || !isLegalToPromote(CB, Callee, &Reason)) {
+      LLVM_DEBUG(dbgs() << "Not promoting " << Name << " in "
+                        << CB.getFunction()->getName() << ": "
+                        << (Reason ? Reason : "not in the module") << "\n");
+      continue;
+    }
+
+    // CB stays in place as the fallback, so the next target is promoted
+    // within the fallback path of this one
+    MDNode *Weights =
+        createGuardWeights(M.getContext(), Count, Remaining - Count);
+    promoteCallWithIfThenElse(CB, Callee, Weights);
+    LLVM_DEBUG(dbgs() << "Promoted " << Name << " in "
+                      << CB.getFunction()->getName() << " (" << Count << " of "
+                      << Remaining << " calls)\n");
+    Remaining -= Count;
+    NumPromoted++;
+  }
+
+  return NumPromoted;
+}
+
+bool IndirectCallPromotion::runOnModule(Module &M, const Profile &Prof) {
+  // STEP 1: Index the indirect call targets by caller and call site
+  // ---------------------------------------------------------------
+  std::map<std::pair<StringRef, uint64_t>, SiteProfile> Sites;
+  for (const ProfileCallEdge &Edge : Prof.CallEdges) {
+    if (!Edge.Indirect)
+      continue;
+    SiteProfile &Site = Sites[{Edge.Caller, Edge.Site}];
+    Site.Targets[Edge.Callee] += Edge.Count;
+    Site.Total += Edge.Count;
+  }
+
+  // STEP 2: Find the indirect calls that have a profile. The call sites are
+  // numbered as in DynamicCallCounter.
+  // -------------------------------------------------------------------------
+  SmallVector<Candidate, 16> Candidates;
+  for (Function &F : M) {
+    if (F.isDeclaration())
+      continue;
+
+    uint64_t Ordinal = 0;
+    for (Instruction &I : instructions(F)) {
+      auto *CB = dyn_cast<CallBase>(&I);
+      if (!CB || !isProfiledCallSite(*CB))
+        continue;
+
+      uint64_t Site = Ordinal++;
+      if (!CB->isIndirectCall())
+        continue;
+      auto It = Sites.find({F.getName(), Site});
+      if (It == Sites.end())
+        continue;
+      It->second.Matched = true;
+      Candidates.push_back({CB, &It->second});
+    }
+  }
+
+  // Call sites recorded for functions in this module that don't match an
+  // indirect call (any more)
+  unsigned NumStale = 0;
+  for (const auto &[Key, Site] : Sites) {
+    Function *Caller = M.getFunction(Key.first);
+    if (!Site.Matched && Caller && !Caller->isDeclaration())
+      NumStale++;
+  }
+  if (NumStale) {
+    std::string Path = getProfilePath(Opts);
+    M.getContext().diagnose(DiagnosticInfoPGOProfile(
+        Path.c_str(),
+        formatv("stale profile: {0} indirect call site(s) not found",
+                NumStale),
+        DS_Warning));
+  }
+
+  // STEP 3: Promote the hot targets
+  // -------------------------------
+  unsigned NumPromoted = 0;
+  for (const Candidate &C : Candidates)
+    NumPromoted += promoteCallSite(*C.CB, *C.Profile, Opts);
+  NumPromotedTargets += NumPromoted;
+
+  return NumPromoted != 0;
+}
+
+PreservedAnalyses IndirectCallPromotion::run(llvm::Module &M,
+                                             llvm::ModuleAnalysisManager &) {
+  std::string Path = getProfilePath(Opts);
+
+  // The reader uses the counters in place (see dcc-prof)
+  auto Buffer = MemoryBuffer::getFile(Path, /*IsText=*/false,
+                                      /*RequiresNullTerminator=*/false);
+  if (!Buffer) {
+    M.getContext().diagnose(DiagnosticInfoPGOProfile(
+        Path.c_str(), Buffer.getError().message()));
+    return PreservedAnalyses::all();
+  }
+
+  auto Prof = readProfile((*Buffer)->getMemBufferRef());
+  if (!Prof) {
+    M.getContext().diagnose(
+        DiagnosticInfoPGOProfile(Path.c_str(), toString(Prof.takeError())));
+    return PreservedAnalyses::all();
+  }
+
+  bool Changed = runOnModule(M, *Prof);
+
+  return (Changed ? llvm::PreservedAnalyses::none()
+                  : llvm::PreservedAnalyses::all());
+}
+
+//-----------------------------------------------------------------------------
+// New PM Registration
+//-----------------------------------------------------------------------------
+// Parses the options in `indirect-call-promotion<option1;option2>`
+static Expected<IndirectCallPromotionOptions>
+parseIndirectCallPromotionOptions(StringRef Params) {
+  IndirectCallPromotionOptions Opts;
+
+  while (!Params.empty()) {
+    StringRef ParamName;
+    std::tie(ParamName, Params) = Params.split(';');
+
+    if (ParamName.consume_front("file=") && !ParamName.empty()) {
+      Opts.ProfileFile = ParamName.str();
+    } else if (ParamName.consume_front("threshold=")) {
+      if (ParamName.getAsInteger(0, Opts.Threshold) || Opts.Threshold > 100)
+        return make_error<StringError>(
+            formatv("invalid indirect-call-promotion threshold '{0}' "
+                    "(expected a percentage)",
+                    ParamName)
+                .str(),
+            inconvertibleErrorCode());
+    } else if (ParamName.consume_front("max-targets=")) {
+      if (ParamName.getAsInteger(0, Opts.MaxTargets))
+        return make_error<StringError>(
+            formatv("invalid indirect-call-promotion max-targets '{0}'",
+                    ParamName)
+                .str(),
+            inconvertibleErrorCode());
+    } else {
+      return make_error<StringError>(
+          formatv("invalid indirect-call-promotion pass parameter '{0}'",
+                  ParamName)
+              .str(),
+          inconvertibleErrorCode());
+    }
+  }
+
+  return Opts;
+}
+
+llvm::PassPluginLibraryInfo getIndirectCallPromotionPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "indirect-call-promotion",
+          LLVM_VERSION_STRING, [](PassBuilder &PB) {
+            PB.registerPipelineParsingCallback(
+                [](StringRef Name, ModulePassManager &MPM,
+                   ArrayRef<PassBuilder::PipelineElement>) {
+                  if (!PassBuilder::checkParametrizedPassName(
+                          Name, "indirect-call-promotion"))
+                    return false;
+
+                  auto Opts = PassBuilder::parsePassParameters(
+                      parseIndirectCallPromotionOptions, Name,
+                      "indirect-call-promotion");
+                  if (!Opts) {
+                    errs() << toString(Opts.takeError()) << "\n";
+                    return false;
+                  }
+
+                  MPM.addPass(IndirectCallPromotion(*Opts));
+                  return true;
+                });
+          }};
+}
+
+extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
+llvmGetPassPluginInfo() {
+  return getIndirectCallPromotionPluginInfo();
+}
@@ -20,17 +20,70 @@
 //    (llvm-tutor)   number of arguments: 3
 //    ```
 //
+//    In the `trace` mode, printing is replaced with a call to the lt_rt
+//    runtime that records a fixed-size binary event (function ID, timestamp
+//    and the number of arguments) in a per-thread lock-free ring buffer:
+//    ```C
+//      __lt_rt_trace_enter(&ifc_trace_module, FuncSlot, FuncNumArgs);
+//    ```
+//    The function names are stored once per module, in `ifc_trace_module`,
+//    which a module constructor registers with the runtime. The runtime
+//    writes the buffers to LT_TRACE_FILE (`default.lttrace` by default) and
+//    lt-trace decodes them into text or into the Chrome Trace Event format.
+//    In the `trace=entry-exit` mode, every `ret` and `resume` is also
+//    preceded with:
+//    ```C
+//      __lt_rt_trace_exit(&ifc_trace_module, FuncSlot);
+//    ```
+//
+//    With `args=FILE`, every traced entry is followed by calls that record
+//    the values of the integer and pointer arguments selected in FILE:
+//    ```C
+//      __lt_rt_trace_arg(&ifc_trace_module, FuncSlot, ArgNo, IsPointer, Value);
+//    ```
+//
+//    In the `trace=patchable` mode, no calls are injected. Instead, every
+//    function is marked with `"function-instrument"="xray-always"`, so that
+//    the backend emits XRay sleds (short sequences of no-ops) at its entry
+//    and exits. The module constructor registers `ifc_patchable_module`
+//    (the trace descriptor plus the function addresses) and lt_rt patches the
+//    sleds into calls that record the `trace=entry-exit` events on demand,
+//    e.g. when the process receives LT_RT_PATCH_SIGNAL (x86-64 Linux only).
+//
+//    In all modes, the instrumented functions can be restricted with the
+//    filters from FunctionFilter.h (e.g. `deny=FILE` or `min-size=N`).
+//
 // USAGE:
 //      $ opt -load-pass-plugin <BUILD_DIR>/lib/libInjectFunctCall.so `\`
 //        -passes=-"inject-func-call" <bitcode-file>
+//      $ opt -load-pass-plugin <BUILD_DIR>/lib/libInjectFunctCall.so `\`
+//        -passes=-"inject-func-call<trace>" <bitcode-file>
+//      $ opt -load-pass-plugin <BUILD_DIR>/lib/libInjectFunctCall.so `\`
+//        -passes=-"inject-func-call<trace=entry-exit>" <bitcode-file>
+//      $ opt -load-pass-plugin <BUILD_DIR>/lib/libInjectFunctCall.so `\`
+//        -passes=-"inject-func-call<trace=patchable>" <bitcode-file>
+//      $ opt -load-pass-plugin <BUILD_DIR>/lib/libInjectFunctCall.so `\`
+//        -passes=-"inject-func-call<trace;args=args.txt>" <bitcode-file>
+//      $ opt -load-pass-plugin <BUILD_DIR>/lib/libInjectFunctCall.so `\`
+//        -passes=-"inject-func-call<trace;deny=deny.txt;min-size=10>" `\`
+//        <bitcode-file>
+//      (link the output with <BUILD_DIR>/lib/liblt_rt.so)
 //
 // License: MIT
 //========================================================================
 #include "InjectFuncCall.h"
+#include "FunctionFilter.h"
 
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/IR/DiagnosticInfo.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/Plugins/PassPlugin.h"
 #include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/LineIterator.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
 
 using namespace llvm;
 
@@ -40,6 +93,9 @@ using namespace llvm;
 // InjectFuncCall implementation
 //-----------------------------------------------------------------------------
 bool InjectFuncCall::runOnModule(Module &M) {
+  if (Opts.Trace != InjectFuncCallOptions::TraceMode::None)
+    return injectTraceCalls(M);
+
   bool InsertedAtLeastOnePrintf = false;
 
   auto &CTX = M.getContext();
@@ -78,15 +134,13 @@ bool InjectFuncCall::runOnModule(Module &M) {
 
   // STEP 3: For each function in the module, inject a call to printf
   // ----------------------------------------------------------------
-  for (auto &F : M) {
-    if (F.isDeclaration())
-      continue;
-
+  for (Function *F : selectFunctionsToInstrument(M, Opts.Filter,
+                                                 "inject-func-call")) {
     // Get an IR builder. Sets the insertion point to the top of the function
-    IRBuilder<> Builder(&*F.getEntryBlock().getFirstInsertionPt());
+    IRBuilder<> Builder(&*F->getEntryBlock().getFirstInsertionPt());
 
     // Inject a global variable that contains the function name
-    auto FuncName = Builder.CreateGlobalString(F.getName());
+    auto FuncName = Builder.CreateGlobalString(F->getName());
 
     // Printf requires i8*, but PrintfFormatStrVar is an array: [n x i8]. Add
     // a cast: [n x i8] -> i8*
@@ -95,12 +149,12 @@ bool InjectFuncCall::runOnModule(Module &M) {
 
     // The following is visible only if you pass -debug on the command line
     // *and* you have an assert build.
-    LLVM_DEBUG(dbgs() << " Injecting call to printf inside " << F.getName()
+    LLVM_DEBUG(dbgs() << " Injecting call to printf inside " << F->getName()
                       << "\n");
 
     // Finally, inject a call to printf
     Builder.CreateCall(
-        Printf, {FormatStrPtr, FuncName, Builder.getInt32(F.arg_size())});
+        Printf, {FormatStrPtr, FuncName, Builder.getInt32(F->arg_size())});
 
     InsertedAtLeastOnePrintf = true;
   }
@@ -108,6 +162,277 @@ bool InjectFuncCall::runOnModule(Module &M) {
   return InsertedAtLeastOnePrintf;
 }
 
+// Reads the `args=FILE` config into Captured (the indices of the arguments to
+// capture, per function). Every line has the form:
+//    <function name> <argument index> [<argument index>...]
+// Functions that are not defined in M are ignored.
+static Error
+readArgumentConfig(Module &M, StringRef Path,
+                   DenseMap<Function *, SmallVector<unsigned, 4>> &Captured) {
+  auto Buffer = MemoryBuffer::getFile(Path, /*IsText=*/true);
+  if (!Buffer)
+    return createStringError(Buffer.getError(), "%s: %s", Path.str().c_str(),
+                             Buffer.getError().message().c_str());
+
+  for (line_iterator Line(**Buffer, /*SkipBlanks=*/true, '#');
+       !Line.is_at_eof(); ++Line) {
+    auto LineError = [&](const Twine &Msg) {
+      return createStringError(inconvertibleErrorCode(), "%s:%lld: %s",
+                               Path.str().c_str(),
+                               static_cast<long long>(Line.line_number()),
+                               Msg.str().c_str());
+    };
+
+    SmallVector<StringRef, 4> Fields;
+    SplitString(*Line, Fields);
+    if (Fields.size() < 2)
+      return LineError("expected '<function> <argument index>...'");
+
+    Function *F = M.getFunction(Fields[0]);
+    for (StringRef Field : drop_begin(Fields)) {
+      unsigned ArgNo;
+      if (Field.getAsInteger(10, ArgNo))
+        return LineError("invalid argument index '" + Field + "'");
+      if (!F || F->isDeclaration())
+        continue;
+      if (ArgNo >= F->arg_size())
+        return LineError("'" + F->getName() + "' has no argument " +
+                         Twine(ArgNo));
+      Type *ArgTy = F->getArg(ArgNo)->getType();
+      if (!ArgTy->isPointerTy() &&
+          !(ArgTy->isIntegerTy() && ArgTy->getIntegerBitWidth() <= 64))
+        return LineError("argument " + Twine(ArgNo) + " of '" + F->getName() +
+                         "' is not an integer or a pointer");
+      Captured[F].push_back(ArgNo);
+    }
+  }
+
+  return Error::success();
+}
+
+// Implements the `trace` mode. The injected IR code corresponds to:
+// ```C
+//    LTRTTraceModule ifc_trace_module = {"name0\0name1\0...", N,
+//                                        sizeof(names), 0};
+//    void ifc_register_trace_module() {
+//      __lt_rt_register_trace_module(&ifc_trace_module);
+//    }
+//
+//    void foo(int a, int b, int c) {
+//      __lt_rt_trace_enter(&ifc_trace_module, /*foo's slot*/ 0, 3);
+//      // `args=FILE` only, for every captured argument (e.g. `foo 2`)
+//      __lt_rt_trace_arg(&ifc_trace_module, /*foo's slot*/ 0, 2,
+//                        /*IsPointer=*/0, (int64_t)c);
+//      ...
+//      // `trace=entry-exit` only, before every return
+//      __lt_rt_trace_exit(&ifc_trace_module, /*foo's slot*/ 0);
+//      return;
+//    }
+// ```
+// The runtime assigns each registered module a range of function IDs, so
+// slots (i.e. positions in the name table) only have to be unique within a
+// module.
+bool InjectFuncCall::injectTraceCalls(Module &M) {
+  auto &CTX = M.getContext();
+  PointerType *PtrTy = PointerType::getUnqual(CTX);
+  IntegerType *Int32Ty = IntegerType::getInt32Ty(CTX);
+  IntegerType *Int64Ty = IntegerType::getInt64Ty(CTX);
+
+  SmallVector<Function *, 16> Functions =
+      selectFunctionsToInstrument(M, Opts.Filter, "inject-func-call");
+  if (Functions.empty())
+    return false;
+
+  DenseMap<Function *, SmallVector<unsigned, 4>> Captured;
+  if (!Opts.ArgsConfig.empty()) {
+    if (Error E = readArgumentConfig(M, Opts.ArgsConfig, Captured)) {
+      std::string Msg = "inject-func-call: " + toString(std::move(E));
+      CTX.diagnose(DiagnosticInfoGeneric(Msg));
+      return false;
+    }
+  }
+
+  // STEP 1: Inject the name table: "name0\0name1\0...\0"
+  // ----------------------------------------------------
+  std::string Names;
+  for (Function *F : Functions) {
+    Names += F->getName();
+    Names.push_back('\0');
+  }
+  // getString would add another NUL terminator - Names already ends with one
+  Constant *NamesInit =
+      ConstantDataArray::getString(CTX, Names, /*AddNull=*/false);
+  auto *NamesVar = new GlobalVariable(M, NamesInit->getType(),
+                                      /*isConstant=*/true,
+                                      GlobalValue::InternalLinkage, NamesInit,
+                                      "ifc_names");
+  NamesVar->setAlignment(MaybeAlign(1));
+
+  // STEP 2: Inject the module descriptor (LTRTTraceModule in lt_rt.h). The
+  // runtime writes the first function ID into the last field, so this is not
+  // a constant.
+  // ------------------------------------------------------------------------
+  StructType *ModuleTy =
+      StructType::get(CTX, {PtrTy, Int64Ty, Int64Ty, Int32Ty});
+  Constant *ModuleInit = ConstantStruct::get(
+      ModuleTy, {NamesVar, ConstantInt::get(Int64Ty, Functions.size()),
+                 ConstantInt::get(Int64Ty, Names.size()),
+                 ConstantInt::get(Int32Ty, 0)});
+  bool Patchable = Opts.Trace == InjectFuncCallOptions::TraceMode::Patchable;
+  GlobalVariable *Desc =
+      Patchable ? createPatchableModule(M, Functions, ModuleInit)
+                : new GlobalVariable(M, ModuleTy, /*isConstant=*/false,
+                                     GlobalValue::InternalLinkage, ModuleInit,
+                                     "ifc_trace_module");
+  Desc->setAlignment(MaybeAlign(8));
+
+  // STEP 3: Define the module constructor that registers the descriptor
+  // -------------------------------------------------------------------
+  FunctionCallee Register = M.getOrInsertFunction(
+      Patchable ? "__lt_rt_register_patchable_module"
+                : "__lt_rt_register_trace_module",
+      FunctionType::get(Type::getVoidTy(CTX), {PtrTy}, /*IsVarArgs=*/false));
+
+  Function *RegisterF = Function::Create(
+      FunctionType::get(Type::getVoidTy(CTX), {}, /*IsVarArgs=*/false),
+      GlobalValue::InternalLinkage, "ifc_register_trace_module", M);
+  IRBuilder<> CtorBuilder(BasicBlock::Create(CTX, "enter", RegisterF));
+  CtorBuilder.CreateCall(Register, {Desc});
+  CtorBuilder.CreateRetVoid();
+  appendToGlobalCtors(M, RegisterF, /*Priority=*/0);
+
+  // STEP 4: In the `trace=patchable` mode, leave the sleds to the backend
+  // ---------------------------------------------------------------------
+  if (Patchable) {
+    for (Function *F : Functions) {
+      LLVM_DEBUG(dbgs() << " Requesting XRay sleds for " << F->getName()
+                        << "\n");
+      F->addFnAttr("function-instrument", "xray-always");
+    }
+    return true;
+  }
+
+  // STEP 5: For each function in the module, inject a call to
+  // __lt_rt_trace_enter (followed by calls to __lt_rt_trace_arg) and calls to
+  // __lt_rt_trace_exit
+  // ------------------------------------------------------------------------
+  bool TraceExits =
+      Opts.Trace == InjectFuncCallOptions::TraceMode::EntryExit;
+  FunctionCallee Enter = M.getOrInsertFunction(
+      "__lt_rt_trace_enter",
+      FunctionType::get(Type::getVoidTy(CTX), {PtrTy, Int32Ty, Int32Ty},
+                        /*IsVarArgs=*/false));
+  FunctionCallee CaptureArg;
+  if (!Captured.empty())
+    CaptureArg = M.getOrInsertFunction(
+        "__lt_rt_trace_arg",
+        FunctionType::get(Type::getVoidTy(CTX),
+                          {PtrTy, Int32Ty, Int32Ty, Int32Ty, Int64Ty},
+                          /*IsVarArgs=*/false));
+  FunctionCallee Exit;
+  if (TraceExits)
+    Exit = M.getOrInsertFunction(
+        "__lt_rt_trace_exit",
+        FunctionType::get(Type::getVoidTy(CTX), {PtrTy, Int32Ty},
+                          /*IsVarArgs=*/false));
+
+  for (unsigned Slot = 0; Slot < Functions.size(); Slot++) {
+    Function *F = Functions[Slot];
+    // Collect the exits first - the inserted calls are not exits
+    SmallVector<Instruction *, 4> Exits;
+    if (TraceExits)
+      for (BasicBlock &BB : *F)
+        if (isa<ReturnInst, ResumeInst>(BB.getTerminator()))
+          Exits.push_back(BB.getTerminator());
+
+    IRBuilder<> Builder(&*F->getEntryBlock().getFirstInsertionPt());
+
+    LLVM_DEBUG(dbgs() << " Injecting call to __lt_rt_trace_enter inside "
+                      << F->getName() << "\n");
+
+    Builder.CreateCall(Enter, {Desc, Builder.getInt32(Slot),
+                               Builder.getInt32(F->arg_size())});
+
+    // The values are widened to 64 bits. Integers are sign-extended, unless
+    // they are booleans or marked as `zeroext`.
+    for (unsigned ArgNo : Captured.lookup(F)) {
+      Argument *Arg = F->getArg(ArgNo);
+      bool IsPointer = Arg->getType()->isPointerTy();
+      Value *ArgValue;
+      if (IsPointer)
+        ArgValue = Builder.CreatePtrToInt(Arg, Int64Ty);
+      else if (Arg->getType()->isIntegerTy(1) || Arg->hasZExtAttr())
+        ArgValue = Builder.CreateZExtOrBitCast(Arg, Int64Ty);
+      else
+        ArgValue = Builder.CreateSExtOrBitCast(Arg, Int64Ty);
+      Builder.CreateCall(CaptureArg,
+                         {Desc, Builder.getInt32(Slot), Builder.getInt32(ArgNo),
+                          Builder.getInt32(IsPointer), ArgValue});
+    }
+
+    for (Instruction *Term : Exits) {
+      // Nothing can be inserted between a `musttail` call and the `ret`
+      // that follows it, so record the exit before the call
+      Instruction *InsertPt = Term;
+      if (auto *RI = dyn_cast<ReturnInst>(Term))
+        if (CallInst *CI = RI->getParent()->getTerminatingMustTailCall())
+          InsertPt = CI;
+      Builder.SetInsertPoint(InsertPt);
+      Builder.CreateCall(Exit, {Desc, Builder.getInt32(Slot)});
+    }
+  }
+
+  return true;
+}
+
+// Creates the descriptor of a module instrumented in the `trace=patchable`
+// mode (LTRTPatchableModule in lt_rt.h). TraceInit is the initializer of the
+// embedded LTRTTraceModule. The sled table is delimited by the symbols that
+// the linker defines for the `xray_instr_map` section. These are hidden, so
+// that every executable and shared object finds its own sleds, and weak, in
+// case the backend emits no sleds at all.
+GlobalVariable *
+InjectFuncCall::createPatchableModule(Module &M, ArrayRef<Function *> Functions,
+                                      Constant *TraceInit) {
+  auto &CTX = M.getContext();
+  PointerType *PtrTy = PointerType::getUnqual(CTX);
+  IntegerType *Int8Ty = IntegerType::getInt8Ty(CTX);
+  IntegerType *Int32Ty = IntegerType::getInt32Ty(CTX);
+
+  // The function addresses and the numbers of arguments (in slot order)
+  SmallVector<Constant *, 16> Addresses(Functions.begin(), Functions.end());
+  SmallVector<Constant *, 16> NumArgs;
+  for (Function *F : Functions)
+    NumArgs.push_back(ConstantInt::get(Int32Ty, F->arg_size()));
+
+  ArrayType *FunctionsTy = ArrayType::get(PtrTy, Functions.size());
+  auto *FunctionsVar = new GlobalVariable(
+      M, FunctionsTy, /*isConstant=*/true, GlobalValue::InternalLinkage,
+      ConstantArray::get(FunctionsTy, Addresses), "ifc_functions");
+  ArrayType *NumArgsTy = ArrayType::get(Int32Ty, Functions.size());
+  auto *NumArgsVar = new GlobalVariable(
+      M, NumArgsTy, /*isConstant=*/true, GlobalValue::InternalLinkage,
+      ConstantArray::get(NumArgsTy, NumArgs), "ifc_num_args");
+
+  auto GetSectionBound = [&](StringRef Name) {
+    auto *GV = cast<GlobalVariable>(M.getOrInsertGlobal(Name, Int8Ty));
+    GV->setLinkage(GlobalValue::ExternalWeakLinkage);
+    GV->setVisibility(GlobalValue::HiddenVisibility);
+    return GV;
+  };
+  Constant *SledsBegin = GetSectionBound("__start_xray_instr_map");
+  Constant *SledsEnd = GetSectionBound("__stop_xray_instr_map");
+
+  StructType *ModuleTy = StructType::get(
+      CTX, {TraceInit->getType(), PtrTy, PtrTy, PtrTy, PtrTy, PtrTy});
+  return new GlobalVariable(
+      M, ModuleTy, /*isConstant=*/false, GlobalValue::InternalLinkage,
+      ConstantStruct::get(ModuleTy,
+                          {TraceInit, FunctionsVar, NumArgsVar, SledsBegin,
+                           SledsEnd, ConstantPointerNull::get(PtrTy)}),
+      "ifc_patchable_module");
+}
+
 PreservedAnalyses InjectFuncCall::run(llvm::Module &M,
                                        llvm::ModuleAnalysisManager &) {
   bool Changed =  runOnModule(M);
@@ -120,17 +445,73 @@ PreservedAnalyses InjectFuncCall::run(llvm::Module &M,
 //-----------------------------------------------------------------------------
 // New PM Registration
 //-----------------------------------------------------------------------------
+// Parses the options in `inject-func-call<option1;option2>`
+static Expected<InjectFuncCallOptions>
+parseInjectFuncCallOptions(StringRef Params) {
+  InjectFuncCallOptions Opts;
+
+  while (!Params.empty()) {
+    StringRef ParamName;
+    std::tie(ParamName, Params) = Params.split(';');
+
+    Expected<bool> IsFilter =
+        parseFunctionFilterParam(ParamName, "inject-func-call", Opts.Filter);
+    if (!IsFilter)
+      return IsFilter.takeError();
+
+    if (*IsFilter) {
+      continue;
+    } else if (ParamName == "trace") {
+      Opts.Trace = InjectFuncCallOptions::TraceMode::Entry;
+    } else if (ParamName == "trace=entry-exit") {
+      Opts.Trace = InjectFuncCallOptions::TraceMode::EntryExit;
+    } else if (ParamName == "trace=patchable") {
+      Opts.Trace = InjectFuncCallOptions::TraceMode::Patchable;
+    } else if (ParamName.consume_front("args=")) {
+      if (ParamName.empty())
+        return make_error<StringError>(
+            "invalid inject-func-call args value ''",
+            inconvertibleErrorCode());
+      Opts.ArgsConfig = ParamName.str();
+    } else {
+      return make_error<StringError>(
+          formatv("invalid inject-func-call pass parameter '{0}'", ParamName)
+              .str(),
+          inconvertibleErrorCode());
+    }
+  }
+
+  // The values are recorded in the binary trace
+  if (!Opts.ArgsConfig.empty() &&
+      Opts.Trace != InjectFuncCallOptions::TraceMode::Entry &&
+      Opts.Trace != InjectFuncCallOptions::TraceMode::EntryExit)
+    return make_error<StringError>(
+        "inject-func-call parameter 'args' requires 'trace' or "
+        "'trace=entry-exit'",
+        inconvertibleErrorCode());
+
+  return Opts;
+}
+
 llvm::PassPluginLibraryInfo getInjectFuncCallPluginInfo() {
   return {LLVM_PLUGIN_API_VERSION, "inject-func-call", LLVM_VERSION_STRING,
           [](PassBuilder &PB) {
             PB.registerPipelineParsingCallback(
                 [](StringRef Name, ModulePassManager &MPM,
                    ArrayRef<PassBuilder::PipelineElement>) {
-                  if (Name == "inject-func-call") {
-                    MPM.addPass(InjectFuncCall());
-                    return true;
+                  if (!PassBuilder::checkParametrizedPassName(
+                          Name, "inject-func-call"))
+                    return false;
+
+                  auto Opts = PassBuilder::parsePassParameters(
+                      parseInjectFuncCallOptions, Name, "inject-func-call");
+                  if (!Opts) {
+                    errs() << toString(Opts.takeError()) << "\n";
+                    return false;
                   }
-                  return false;
+
+                  MPM.addPass(InjectFuncCall(*Opts));
+                  return true;
                 });
           }};
 }
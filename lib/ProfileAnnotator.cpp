@@ -0,0 +1,351 @@
+//========================================================================
+// FILE:
+//    ProfileAnnotator.cpp
+//
+// DESCRIPTION:
+//    Reads a profile recorded by DynamicCallCounter (see ProfileFormat.h)
+//    and attaches the counts to the module, so that the standard
+//    optimisation pipeline (the inliner, block placement, hot/cold function
+//    splitting, etc.) can act on them:
+//      * every function found in the profile gets its entry count
+//        (`!prof !{!"function_entry_count", i64 N}`)
+//      * if the profile contains the block and CFG edge counts of a function
+//        (`dynamic-cc<blocks>`), every branch, `switch` and `indirectbr` in
+//        that function gets branch weights (`!prof !{!"branch_weights", ...}`)
+//      * the module gets a profile summary, which is what
+//        ProfileSummaryInfo uses to tell hot and cold code apart
+//      * functions with hot entry counts are marked with the `hot` attribute
+//        and the `hot` section prefix, functions that never (or hardly ever)
+//        run are marked with `cold` and the `unlikely` section prefix
+//
+//    The counts are matched to the functions by name. The CFG edges are
+//    recorded in the layout order of the blocks and in the order of the
+//    successors (see CFGSpanningTree.h), so branch weights are only attached
+//    if the CFG of the function still has exactly the same shape. That's
+//    always the case if the module is the one that was instrumented (i.e.
+//    this pass runs at the same point in the pipeline as DynamicCallCounter
+//    did).
+//
+//    Profiles go stale as the code changes. Functions that are not in the
+//    profile (e.g. new or renamed functions) are left alone, functions whose
+//    CFG has changed only get their entry counts and entries for functions
+//    that no longer exist are ignored. A warning summarises what didn't match
+//    - stale profiles are never an error.
+//
+//    Records for the same function from several modules (e.g. copies of an
+//    inline function instrumented in several translation units) are merged.
+//
+// USAGE:
+//      $ clang -O0 -Xclang -disable-O0-optnone -emit-llvm -c input.c `\`
+//        -o input.bc
+//      $ opt -load-pass-plugin <BUILD_DIR>/lib/libDynamicCallCounter.so `\`
+//        -passes=-"dynamic-cc<blocks>" input.bc -o instrumented.bc
+//      $ clang instrumented.bc -L<BUILD_DIR>/lib -llt_rt -o instrumented
+//      $ LT_PROFILE_FILE=input.ltprof ./instrumented
+//      $ opt -load-pass-plugin <BUILD_DIR>/lib/libProfileAnnotator.so `\`
+//        -passes="profile-annotator<file=input.ltprof>,default<O2>" `\`
+//        input.bc -o optimised.bc
+//
+// License: MIT
+//========================================================================
+#include "ProfileAnnotator.h"
+#include "ProfileFormat.h"
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/ProfileSummary.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Plugins/PassPlugin.h"
+#include "llvm/ProfileData/InstrProf.h"
+#include "llvm/ProfileData/ProfileCommon.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <cstdlib>
+
+using namespace llvm;
+
+#define DEBUG_TYPE "profile-annotator"
+
+//-----------------------------------------------------------------------------
+// ProfileAnnotator implementation
+//-----------------------------------------------------------------------------
+namespace {
+// The profile of one function, merged over all the records for it
+struct FunctionProfile {
+  uint64_t EntryCount = 0;
+  // The CFG edge and block counts (`dynamic-cc<blocks>` only)
+  SmallVector<const ProfileBlockCounts *, 1> CFGs;
+};
+
+// A function annotated with its entry count
+struct AnnotatedFunction {
+  Function *F;
+  uint64_t EntryCount;
+  // The largest count recorded for F (the entry or any block)
+  uint64_t MaxCount;
+  // False if there are no (matching) block counts for F, i.e. MaxCount is
+  // just the entry count
+  bool HasBlockCounts;
+};
+} // namespace
+
+// Returns the profile to read
+static std::string getProfilePath(const ProfileAnnotatorOptions &Opts) {
+  if (!Opts.ProfileFile.empty())
+    return Opts.ProfileFile;
+  const char *Path = std::getenv(LT_PROF_FILE_ENV_VAR);
+  return (Path && *Path) ? Path : LT_PROF_DEFAULT_FILE;
+}
+
+// Returns true if the CFG of F has the shape recorded in Counts, i.e. if the
+// edges of F, enumerated as in CFGSpanningTree, are exactly Counts.Edges
+static bool matchesCFG(const Function &F, const ProfileBlockCounts &Counts) {
+  uint64_t NumBlocks = Counts.Blocks.size();
+  if (F.size() != NumBlocks)
+    return false;
+
+  DenseMap<const BasicBlock *, uint64_t> Indices;
+  uint64_t NextIndex = 0;
+  for (const BasicBlock &BB : F)
+    Indices[&BB] = NextIndex++;
+
+  ArrayRef<ProfileBlockCounts::Edge> Edges = Counts.Edges;
+  // Consumes the next recorded edge if it is Src -> Dst
+  auto Match = [&Edges](uint64_t Src, uint64_t Dst) {
+    if (Edges.empty() || Edges.front().Src != Src || Edges.front().Dst != Dst)
+      return false;
+    Edges = Edges.drop_front();
+    return true;
+  };
+
+  // The function entry, then the successors of every block (the exit blocks
+  // lead to the function exit)
+  if (!Match(NumBlocks, 0))
+    return false;
+  for (const BasicBlock &BB : F) {
+    uint64_t Src = Indices.lookup(&BB);
+    for (const BasicBlock *Succ : successors(&BB))
+      if (!Match(Src, Indices.lookup(Succ)))
+        return false;
+    if (succ_empty(&BB) && !Match(Src, NumBlocks))
+      return false;
+  }
+
+  return Edges.empty();
+}
+
+// Attaches branch weights to the conditional terminators of F. EdgeCounts
+// are the counts of the edges of F (as enumerated by matchesCFG).
+static void setBranchWeights(Function &F, ArrayRef<uint64_t> EdgeCounts) {
+  MDBuilder MDB(F.getContext());
+  // Skip the edge from the function entry
+  EdgeCounts = EdgeCounts.drop_front();
+
+  for (BasicBlock &BB : F) {
+    Instruction *TI = BB.getTerminator();
+    unsigned NumSuccs = TI->getNumSuccessors();
+    // Exit blocks have one edge (to the function exit)
+    ArrayRef<uint64_t> Counts = EdgeCounts.take_front(std::max(NumSuccs, 1U));
+    EdgeCounts = EdgeCounts.drop_front(Counts.size());
+
+    // Invokes (and `callbr`) take call counts rather than edge weights
+    if (NumSuccs < 2 || !isa<BranchInst, SwitchInst, IndirectBrInst>(TI))
+      continue;
+
+    // Branch weights are 32-bit, scale the counts down if necessary (the
+    // same as LLVM's own PGO does)
+    uint64_t MaxCount = *llvm::max_element(Counts);
+    if (!MaxCount)
+      continue;
+    uint64_t Scale = MaxCount / UINT32_MAX + 1;
+
+    SmallVector<uint32_t, 4> Weights;
+    for (uint64_t Count : Counts)
+      Weights.push_back(static_cast<uint32_t>(Count / Scale));
+    TI->setMetadata(LLVMContext::MD_prof, MDB.createBranchWeights(Weights));
+  }
+}
+
+bool ProfileAnnotator::runOnModule(Module &M, const Profile &Prof) {
+  // STEP 1: Index the profile by function name
+  // ------------------------------------------
+  StringMap<FunctionProfile> Profiles;
+  for (const ProfileModuleRecord &Module : Prof.Modules)
+    for (auto [Name, Count] : zip(Module.Names, Module.Counters))
+      Profiles[Name].EntryCount += Count;
+  for (const ProfileBlockCounts &CFG : Prof.BlockCounts)
+    Profiles[CFG.Function].CFGs.push_back(&CFG);
+
+  // STEP 2: Attach the entry counts and the branch weights
+  // ------------------------------------------------------
+  SmallVector<AnnotatedFunction, 32> Annotated;
+  InstrProfSummaryBuilder Summary(ProfileSummaryBuilder::DefaultCutoffs);
+  unsigned NumMissing = 0;
+  unsigned NumStale = 0;
+  for (Function &F : M) {
+    if (F.isDeclaration())
+      continue;
+
+    auto It = Profiles.find(F.getName());
+    if (It == Profiles.end()) {
+      LLVM_DEBUG(dbgs() << "No profile for " << F.getName() << "\n");
+      NumMissing++;
+      continue;
+    }
+    const FunctionProfile &FP = It->second;
+    F.setEntryCount(FP.EntryCount);
+
+    // The counts of the edges and the blocks, summed over the records that
+    // match the CFG of F
+    SmallVector<uint64_t, 32> EdgeCounts;
+    std::vector<uint64_t> Counts = {FP.EntryCount};
+    for (const ProfileBlockCounts *CFG : FP.CFGs) {
+      if (!matchesCFG(F, *CFG))
+        continue;
+
+      if (EdgeCounts.empty()) {
+        EdgeCounts.resize(CFG->Edges.size());
+        Counts.resize(1 + CFG->Blocks.size());
+      }
+      for (auto [Sum, Edge] : zip(EdgeCounts, CFG->Edges))
+        Sum += Edge.Count;
+      for (auto [Sum, Count] : zip(drop_begin(Counts), CFG->Blocks))
+        Sum += Count;
+    }
+
+    if (!EdgeCounts.empty()) {
+      setBranchWeights(F, EdgeCounts);
+    } else if (!FP.CFGs.empty()) {
+      LLVM_DEBUG(dbgs() << "Stale CFG profile for " << F.getName() << "\n");
+      NumStale++;
+    }
+
+    Annotated.push_back({&F, FP.EntryCount, *llvm::max_element(Counts),
+                         !EdgeCounts.empty()});
+    Summary.addRecord(InstrProfRecord(std::move(Counts)));
+  }
+
+  if (NumMissing || NumStale) {
+    std::string Path = getProfilePath(Opts);
+    M.getContext().diagnose(DiagnosticInfoPGOProfile(
+        Path.c_str(),
+        formatv("stale profile: {0} of {1} function(s) not found, {2} "
+                "function(s) with a changed CFG (branch weights dropped)",
+                NumMissing, NumMissing + Annotated.size(), NumStale),
+        DS_Warning));
+  }
+
+  if (Annotated.empty())
+    return false;
+
+  // STEP 3: Attach the profile summary and mark hot and cold functions
+  // ------------------------------------------------------------------
+  M.setProfileSummary(Summary.getSummary()->getMD(M.getContext()),
+                      ProfileSummary::PSK_Instr);
+  ProfileSummaryInfo PSI(M);
+
+  // As in LLVM's own PGO: a function is hot if it is entered often and cold
+  // if not even its hottest block executes often. Without the block counts, a
+  // function entered once may still spend all its time in a loop - only
+  // functions that never ran are known to be cold.
+  for (const AnnotatedFunction &AF : Annotated) {
+    Function &F = *AF.F;
+    bool MaybeCold = AF.HasBlockCounts || !AF.EntryCount;
+    if (PSI.isHotCount(AF.EntryCount) && !F.hasFnAttribute(Attribute::Cold)) {
+      F.addFnAttr(Attribute::Hot);
+      F.setSectionPrefix("hot");
+    } else if (MaybeCold && PSI.isColdCount(AF.MaxCount) &&
+               !F.hasFnAttribute(Attribute::Hot)) {
+      F.addFnAttr(Attribute::Cold);
+      F.setSectionPrefix("unlikely");
+    }
+  }
+
+  return true;
+}
+
+PreservedAnalyses ProfileAnnotator::run(llvm::Module &M,
+                                        llvm::ModuleAnalysisManager &) {
+  std::string Path = getProfilePath(Opts);
+
+  // The reader uses the counters in place (see dcc-prof)
+  auto Buffer = MemoryBuffer::getFile(Path, /*IsText=*/false,
+                                      /*RequiresNullTerminator=*/false);
+  if (!Buffer) {
+    M.getContext().diagnose(DiagnosticInfoPGOProfile(
+        Path.c_str(), Buffer.getError().message()));
+    return PreservedAnalyses::all();
+  }
+
+  auto Prof = readProfile((*Buffer)->getMemBufferRef());
+  if (!Prof) {
+    M.getContext().diagnose(
+        DiagnosticInfoPGOProfile(Path.c_str(), toString(Prof.takeError())));
+    return PreservedAnalyses::all();
+  }
+
+  bool Changed = runOnModule(M, *Prof);
+
+  return (Changed ? llvm::PreservedAnalyses::none()
+                  : llvm::PreservedAnalyses::all());
+}
+
+//-----------------------------------------------------------------------------
+// New PM Registration
+//-----------------------------------------------------------------------------
+// Parses the options in `profile-annotator<option1;option2>`
+static Expected<ProfileAnnotatorOptions>
+parseProfileAnnotatorOptions(StringRef Params) {
+  ProfileAnnotatorOptions Opts;
+
+  while (!Params.empty()) {
+    StringRef ParamName;
+    std::tie(ParamName, Params) = Params.split(';');
+
+    if (ParamName.consume_front("file=") && !ParamName.empty()) {
+      Opts.ProfileFile = ParamName.str();
+    } else {
+      return make_error<StringError>(
+          formatv("invalid profile-annotator pass parameter '{0}'", ParamName)
+              .str(),
+          inconvertibleErrorCode());
+    }
+  }
+
+  return Opts;
+}
+
+llvm::PassPluginLibraryInfo getProfileAnnotatorPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "profile-annotator", LLVM_VERSION_STRING,
+          [](PassBuilder &PB) {
+            PB.registerPipelineParsingCallback(
+                [](StringRef Name, ModulePassManager &MPM,
+                   ArrayRef<PassBuilder::PipelineElement>) {
+                  if (!PassBuilder::checkParametrizedPassName(
+                          Name, "profile-annotator"))
+                    return false;
+
+                  auto Opts = PassBuilder::parsePassParameters(
+                      parseProfileAnnotatorOptions, Name,
+                      "profile-annotator");
+                  if (!Opts) {
+                    errs() << toString(Opts.takeError()) << "\n";
+                    return false;
+                  }
+
+                  MPM.addPass(ProfileAnnotator(*Opts));
+                  return true;
+                });
+          }};
+}
+
+extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
+llvmGetPassPluginInfo() {
+  return getProfileAnnotatorPluginInfo();
+}
@@ -0,0 +1,452 @@
+//==============================================================================
+// FILE:
+//    ProfileReader.cpp
+//
+// DESCRIPTION:
+//    Implements the reader for the binary profiles described in
+//    ProfileFormat.h. This is not a plugin - it is compiled into the tools
+//    and the plugins that consume profiles (see tools/CMakeLists.txt and
+//    lib/CMakeLists.txt).
+//
+// License: MIT
+//==============================================================================
+#include "ProfileReader.h"
+#include "ProfileFormat.h"
+
+#include "llvm/Support/Alignment.h"
+#include "llvm/Support/FormatVariadic.h"
+
+#include <cstddef>
+#include <cstring>
+
+using namespace llvm;
+
+static Error makeProfileError(const Twine &Msg) {
+  return make_error<StringError>("malformed profile: " + Msg,
+                                 inconvertibleErrorCode());
+}
+
+// Parses the payload of an LT_PROF_FUNCTION_COUNTS record
+static Expected<ProfileModuleRecord> readFunctionCounts(StringRef Payload) {
+  LTProfFunctionCountsHeader Header;
+  if (Payload.size() < sizeof(Header))
+    return makeProfileError("truncated function counts header");
+  std::memcpy(&Header, Payload.data(), sizeof(Header));
+  Payload = Payload.drop_front(sizeof(Header));
+
+  if (Header.NumCounters > Payload.size() / sizeof(uint64_t) ||
+      Header.NamesSize >
+          Payload.size() - Header.NumCounters * sizeof(uint64_t))
+    return makeProfileError("truncated counter or name table");
+
+  ProfileModuleRecord Record;
+  // Records are 8-byte aligned, so the counters can be used in place
+  Record.Counters = ArrayRef<uint64_t>(
+      reinterpret_cast<const uint64_t *>(Payload.data()), Header.NumCounters);
+  StringRef Names = Payload.substr(Header.NumCounters * sizeof(uint64_t),
+                                   Header.NamesSize);
+
+  while (!Names.empty()) {
+    StringRef Name;
+    std::tie(Name, Names) = Names.split('\0');
+    Record.Names.push_back(Name);
+  }
+
+  if (Record.Names.size() != Record.Counters.size())
+    return makeProfileError(formatv("{0} names for {1} counters",
+                                    Record.Names.size(),
+                                    Record.Counters.size()));
+
+  return Record;
+}
+
+// Parses the payload of an LT_PROF_FUNCTION_TIMES record into Record (the
+// module that the record follows)
+static Error readFunctionTimes(StringRef Payload, ProfileModuleRecord &Record) {
+  LTProfFunctionTimesHeader Header;
+  if (Payload.size() < sizeof(Header))
+    return makeProfileError("truncated function times header");
+  std::memcpy(&Header, Payload.data(), sizeof(Header));
+  Payload = Payload.drop_front(sizeof(Header));
+
+  if (Header.NumFunctions != Record.Counters.size())
+    return makeProfileError(formatv("{0} function times for {1} counters",
+                                    Header.NumFunctions,
+                                    Record.Counters.size()));
+  if (Header.NumFunctions > Payload.size() / sizeof(LTProfFunctionTimes))
+    return makeProfileError("truncated function times table");
+  if (Header.Unit != LT_PROF_TIME_CYCLES &&
+      Header.Unit != LT_PROF_TIME_NANOSECONDS)
+    return makeProfileError(formatv("unknown time unit {0}", Header.Unit));
+
+  Record.TimesInCycles = Header.Unit == LT_PROF_TIME_CYCLES;
+  Record.Times.clear();
+  for (uint64_t Idx = 0; Idx < Header.NumFunctions; Idx++) {
+    LTProfFunctionTimes Times;
+    std::memcpy(&Times, Payload.data() + Idx * sizeof(Times), sizeof(Times));
+    Record.Times.push_back({Times.Inclusive, Times.Exclusive});
+  }
+
+  return Error::success();
+}
+
+// Parses the payload of an LT_PROF_CALL_EDGES record and appends the edges to
+// Edges
+static Error readCallEdges(StringRef Payload,
+                           std::vector<ProfileCallEdge> &Edges) {
+  LTProfCallEdgesHeader Header;
+  if (Payload.size() < sizeof(Header))
+    return makeProfileError("truncated call edges header");
+  std::memcpy(&Header, Payload.data(), sizeof(Header));
+  Payload = Payload.drop_front(sizeof(Header));
+
+  if (Header.NumEdges > Payload.size() / sizeof(LTProfCallEdge) ||
+      Header.NamesSize >
+          Payload.size() - Header.NumEdges * sizeof(LTProfCallEdge))
+    return makeProfileError("truncated edge or name table");
+
+  StringRef Names = Payload.substr(Header.NumEdges * sizeof(LTProfCallEdge),
+                                   Header.NamesSize);
+  // Returns the NUL-terminated name at Offset
+  auto GetName = [Names](uint64_t Offset) -> Expected<StringRef> {
+    size_t End = Names.find('\0', Offset);
+    if (Offset >= Names.size() || End == StringRef::npos)
+      return makeProfileError(formatv("bad name offset {0}", Offset));
+    return Names.slice(Offset, End);
+  };
+
+  for (uint64_t Idx = 0; Idx < Header.NumEdges; Idx++) {
+    LTProfCallEdge Edge;
+    std::memcpy(&Edge, Payload.data() + Idx * sizeof(Edge), sizeof(Edge));
+
+    auto Caller = GetName(Edge.Caller);
+    if (!Caller)
+      return Caller.takeError();
+    auto Callee = GetName(Edge.Callee);
+    if (!Callee)
+      return Callee.takeError();
+
+    Edges.push_back({*Caller, *Callee, Edge.Site,
+                     (Edge.Flags & LT_PROF_EDGE_INDIRECT) != 0, Edge.Count});
+  }
+
+  return Error::success();
+}
+
+// Parses the payload of an LT_PROF_BLOCK_COUNTS record and appends the
+// functions to Functions
+static Error readBlockCounts(StringRef Payload,
+                             std::vector<ProfileBlockCounts> &Functions) {
+  LTProfBlockCountsHeader Header;
+  if (Payload.size() < sizeof(Header))
+    return makeProfileError("truncated block counts header");
+  std::memcpy(&Header, Payload.data(), sizeof(Header));
+  Payload = Payload.drop_front(sizeof(Header));
+
+  // Consumes the table of NumElements elements of ElementSize bytes each at
+  // the front of Payload
+  auto TakeTable = [&Payload](uint64_t NumElements, uint64_t ElementSize,
+                              StringRef &Table) {
+    if (NumElements > Payload.size() / ElementSize)
+      return false;
+    Table = Payload.take_front(NumElements * ElementSize);
+    Payload = Payload.drop_front(NumElements * ElementSize);
+    return true;
+  };
+
+  StringRef FunctionTable, BlockTable, EdgeTable, Names;
+  if (!TakeTable(Header.NumFunctions, sizeof(LTProfBlockFunction),
+                 FunctionTable) ||
+      !TakeTable(Header.NumBlocks, sizeof(uint64_t), BlockTable) ||
+      !TakeTable(Header.NumEdges, sizeof(LTProfBlockEdge), EdgeTable) ||
+      !TakeTable(Header.NamesSize, 1, Names))
+    return makeProfileError("truncated function, block, edge or name table");
+
+  // Records are 8-byte aligned, so the block counts can be used in place
+  ArrayRef<uint64_t> Blocks(
+      reinterpret_cast<const uint64_t *>(BlockTable.data()), Header.NumBlocks);
+  uint64_t NextEdge = 0;
+  for (uint64_t Idx = 0; Idx < Header.NumFunctions; Idx++) {
+    LTProfBlockFunction Function;
+    std::memcpy(&Function,
+                FunctionTable.data() + Idx * sizeof(LTProfBlockFunction),
+                sizeof(Function));
+
+    size_t End = Names.find('\0', Function.Name);
+    if (Function.Name >= Names.size() || End == StringRef::npos)
+      return makeProfileError(formatv("bad name offset {0}", Function.Name));
+    if (Function.NumBlocks > Blocks.size() ||
+        Function.NumEdges > Header.NumEdges - NextEdge)
+      return makeProfileError(
+          formatv("too few blocks or edges for function {0}", Idx));
+
+    ProfileBlockCounts Counts;
+    Counts.Function = Names.slice(Function.Name, End);
+    Counts.Blocks = Blocks.take_front(Function.NumBlocks);
+    Blocks = Blocks.drop_front(Function.NumBlocks);
+
+    for (uint64_t E = 0; E < Function.NumEdges; E++, NextEdge++) {
+      LTProfBlockEdge Edge;
+      std::memcpy(&Edge, EdgeTable.data() + NextEdge * sizeof(Edge),
+                  sizeof(Edge));
+      if (Edge.Src > Function.NumBlocks || Edge.Dst > Function.NumBlocks)
+        return makeProfileError(formatv("bad edge in function {0}", Idx));
+      Counts.Edges.push_back({Edge.Src, Edge.Dst, Edge.Count});
+    }
+
+    Functions.push_back(std::move(Counts));
+  }
+
+  return Error::success();
+}
+
+// Parses the payload of an LT_PROF_COVERAGE record
+static Expected<ProfileCoverage> readCoverage(StringRef Payload) {
+  LTProfCoverageHeader Header;
+  if (Payload.size() < sizeof(Header))
+    return makeProfileError("truncated coverage header");
+  std::memcpy(&Header, Payload.data(), sizeof(Header));
+  Payload = Payload.drop_front(sizeof(Header));
+
+  ProfileCoverage Coverage;
+  if (Header.NumBlocks) {
+    if (Header.NumFunctions > Payload.size() / sizeof(uint64_t))
+      return makeProfileError("truncated block table");
+    Coverage.NumBlocks.resize(Header.NumFunctions);
+    std::memcpy(Coverage.NumBlocks.data(), Payload.data(),
+                Header.NumFunctions * sizeof(uint64_t));
+    Payload = Payload.drop_front(Header.NumFunctions * sizeof(uint64_t));
+
+    uint64_t Total = 0;
+    for (uint64_t NumBlocks : Coverage.NumBlocks) {
+      if (NumBlocks > Header.NumBlocks - Total)
+        return makeProfileError("too many blocks");
+      Total += NumBlocks;
+    }
+    if (Total != Header.NumBlocks)
+      return makeProfileError(
+          formatv("{0} blocks instead of {1}", Total, Header.NumBlocks));
+  }
+
+  Coverage.NumBits = Header.NumBlocks ? Header.NumBlocks : Header.NumFunctions;
+  uint64_t BitmapSize = Coverage.NumBits / 8 + (Coverage.NumBits % 8 != 0);
+  if (BitmapSize > Payload.size() ||
+      Header.NamesSize > Payload.size() - BitmapSize)
+    return makeProfileError("truncated bitmap or name table");
+  Coverage.Bitmap = ArrayRef<uint8_t>(
+      reinterpret_cast<const uint8_t *>(Payload.data()), BitmapSize);
+  StringRef Names = Payload.substr(BitmapSize, Header.NamesSize);
+
+  while (!Names.empty()) {
+    StringRef Name;
+    std::tie(Name, Names) = Names.split('\0');
+    Coverage.Names.push_back(Name);
+  }
+
+  if (Coverage.Names.size() != Header.NumFunctions)
+    return makeProfileError(formatv("{0} names for {1} functions",
+                                    Coverage.Names.size(),
+                                    Header.NumFunctions));
+
+  return Coverage;
+}
+
+// Parses the payload of an LT_PROF_CALLING_CONTEXTS record and appends the
+// nodes to Nodes
+static Error readCallingContexts(StringRef Payload,
+                                 std::vector<ProfileContextNode> &Nodes) {
+  LTProfContextsHeader Header;
+  if (Payload.size() < sizeof(Header))
+    return makeProfileError("truncated calling contexts header");
+  std::memcpy(&Header, Payload.data(), sizeof(Header));
+  Payload = Payload.drop_front(sizeof(Header));
+
+  if (Header.NumNodes > Payload.size() / sizeof(LTProfContextNode) ||
+      Header.NamesSize >
+          Payload.size() - Header.NumNodes * sizeof(LTProfContextNode))
+    return makeProfileError("truncated node or name table");
+
+  StringRef Names = Payload.substr(
+      Header.NumNodes * sizeof(LTProfContextNode), Header.NamesSize);
+  // The parent indices are relative to this record
+  uint64_t FirstNode = Nodes.size();
+  for (uint64_t Idx = 0; Idx < Header.NumNodes; Idx++) {
+    LTProfContextNode Node;
+    std::memcpy(&Node, Payload.data() + Idx * sizeof(Node), sizeof(Node));
+
+    size_t End = Names.find('\0', Node.Name);
+    if (Node.Name >= Names.size() || End == StringRef::npos)
+      return makeProfileError(formatv("bad name offset {0}", Node.Name));
+    if (Node.Parent != LT_PROF_NO_PARENT && Node.Parent >= Idx)
+      return makeProfileError(formatv("bad parent of node {0}", Idx));
+
+    Nodes.push_back({Node.Parent == LT_PROF_NO_PARENT
+                         ? ProfileContextNode::NoParent
+                         : FirstNode + Node.Parent,
+                     Names.slice(Node.Name, End), Node.Count});
+  }
+
+  return Error::success();
+}
+
+// The maximum number of functions in a trace (function IDs are 32-bit, but
+// no real program comes anywhere near that)
+static constexpr uint64_t MaxTraceFunctions = 1 << 24;
+
+// Parses the payload of an LT_PROF_TRACE_FUNCTIONS record into Functions
+// (indexed by function ID)
+static Error readTraceFunctions(StringRef Payload,
+                                std::vector<StringRef> &Functions) {
+  LTProfTraceFunctionsHeader Header;
+  if (Payload.size() < sizeof(Header))
+    return makeProfileError("truncated trace functions header");
+  std::memcpy(&Header, Payload.data(), sizeof(Header));
+  Payload = Payload.drop_front(sizeof(Header));
+
+  if (Header.NamesSize > Payload.size())
+    return makeProfileError("truncated name table");
+  // Every name takes at least its NUL byte
+  if (Header.NumFunctions > Header.NamesSize)
+    return makeProfileError(formatv("{0} functions in a {1}-byte name table",
+                                    Header.NumFunctions, Header.NamesSize));
+  // lt_rt numbers the functions of all modules consecutively from 0. Don't
+  // let a corrupt FirstId blow up the size of Functions.
+  if (Header.FirstId > MaxTraceFunctions ||
+      Header.NumFunctions > MaxTraceFunctions - Header.FirstId)
+    return makeProfileError(formatv("bad function IDs {0}+{1}", Header.FirstId,
+                                    Header.NumFunctions));
+
+  StringRef Names = Payload.take_front(Header.NamesSize);
+  if (Functions.size() < Header.FirstId + Header.NumFunctions)
+    Functions.resize(Header.FirstId + Header.NumFunctions);
+  for (uint64_t Idx = 0; Idx < Header.NumFunctions; Idx++) {
+    if (Names.empty())
+      return makeProfileError(formatv("{0} names for {1} functions", Idx,
+                                      Header.NumFunctions));
+    std::tie(Functions[Header.FirstId + Idx], Names) = Names.split('\0');
+  }
+
+  return Error::success();
+}
+
+static_assert(sizeof(ProfileTraceEvent) == sizeof(LTProfTraceEvent) &&
+                  offsetof(ProfileTraceEvent, Timestamp) ==
+                      offsetof(LTProfTraceEvent, Timestamp) &&
+                  offsetof(ProfileTraceEvent, Function) ==
+                      offsetof(LTProfTraceEvent, Function) &&
+                  offsetof(ProfileTraceEvent, NumArgs) ==
+                      offsetof(LTProfTraceEvent, NumArgs) &&
+                  offsetof(ProfileTraceEvent, Kind) ==
+                      offsetof(LTProfTraceEvent, Kind) &&
+                  ProfileTraceEvent::Entry == LT_PROF_TRACE_ENTRY &&
+                  ProfileTraceEvent::Exit == LT_PROF_TRACE_EXIT &&
+                  ProfileTraceEvent::Argument == LT_PROF_TRACE_ARGUMENT &&
+                  ProfileTraceEvent::PointerArgument ==
+                      LT_PROF_TRACE_POINTER_ARGUMENT,
+              "ProfileTraceEvent has to match LTProfTraceEvent");
+
+// Parses the payload of an LT_PROF_TRACE_EVENTS record and appends the batch
+// to Threads
+static Error readTraceEvents(StringRef Payload,
+                             std::vector<ProfileTraceThread> &Threads) {
+  LTProfTraceEventsHeader Header;
+  if (Payload.size() < sizeof(Header))
+    return makeProfileError("truncated trace events header");
+  std::memcpy(&Header, Payload.data(), sizeof(Header));
+  Payload = Payload.drop_front(sizeof(Header));
+
+  if (Header.NumEvents > Payload.size() / sizeof(LTProfTraceEvent))
+    return makeProfileError("truncated event table");
+  if (Header.Unit != LT_PROF_TIME_CYCLES &&
+      Header.Unit != LT_PROF_TIME_NANOSECONDS)
+    return makeProfileError(formatv("unknown time unit {0}", Header.Unit));
+  if (!Header.TicksPerSecond)
+    return makeProfileError("bad clock rate");
+
+  // Records are 8-byte aligned, so the events can be used in place
+  Threads.push_back(
+      {Header.Thread,
+       ArrayRef<ProfileTraceEvent>(
+           reinterpret_cast<const ProfileTraceEvent *>(Payload.data()),
+           Header.NumEvents),
+       Header.Dropped, Header.Unit == LT_PROF_TIME_CYCLES,
+       Header.TicksPerSecond});
+
+  return Error::success();
+}
+
+Expected<Profile> readProfile(MemoryBufferRef Buffer) {
+  Profile Prof;
+  StringRef Data = Buffer.getBuffer();
+
+  if (!isAddrAligned(Align(8), Data.data()))
+    return makeProfileError("the buffer is not 8-byte aligned");
+
+  while (!Data.empty()) {
+    LTProfRecordHeader Header;
+    if (Data.size() < sizeof(Header))
+      return makeProfileError("truncated record header");
+    std::memcpy(&Header, Data.data(), sizeof(Header));
+    Data = Data.drop_front(sizeof(Header));
+
+    if (Header.Magic != LT_PROF_MAGIC)
+      return makeProfileError("bad magic (or a profile from a machine with "
+                              "different endianness)");
+    if (Header.Version != LT_PROF_VERSION)
+      return makeProfileError(
+          formatv("unsupported version {0}", Header.Version));
+    if (Header.Size > Data.size() || Header.Size % 8)
+      return makeProfileError("bad record size");
+
+    StringRef Payload = Data.take_front(Header.Size);
+    Data = Data.drop_front(Header.Size);
+
+    switch (Header.Kind) {
+    case LT_PROF_FUNCTION_COUNTS: {
+      auto Record = readFunctionCounts(Payload);
+      if (!Record)
+        return Record.takeError();
+      Prof.Modules.push_back(std::move(*Record));
+      break;
+    }
+    case LT_PROF_FUNCTION_TIMES:
+      if (Prof.Modules.empty())
+        return makeProfileError("function times without function counts");
+      if (Error Err = readFunctionTimes(Payload, Prof.Modules.back()))
+        return std::move(Err);
+      break;
+    case LT_PROF_CALL_EDGES:
+      if (Error Err = readCallEdges(Payload, Prof.CallEdges))
+        return std::move(Err);
+      break;
+    case LT_PROF_BLOCK_COUNTS:
+      if (Error Err = readBlockCounts(Payload, Prof.BlockCounts))
+        return std::move(Err);
+      break;
+    case LT_PROF_COVERAGE: {
+      auto Coverage = readCoverage(Payload);
+      if (!Coverage)
+        return Coverage.takeError();
+      Prof.Coverage.push_back(std::move(*Coverage));
+      break;
+    }
+    case LT_PROF_CALLING_CONTEXTS:
+      if (Error Err = readCallingContexts(Payload, Prof.CallingContexts))
+        return std::move(Err);
+      break;
+    case LT_PROF_TRACE_FUNCTIONS:
+      if (Error Err = readTraceFunctions(Payload, Prof.TraceFunctions))
+        return std::move(Err);
+      break;
+    case LT_PROF_TRACE_EVENTS:
+      if (Error Err = readTraceEvents(Payload, Prof.TraceThreads))
+        return std::move(Err);
+      break;
+    default:
+      // Written by a newer version of llvm-tutor - skip
+      break;
+    }
+  }
+
+  return Prof;
+}
@@ -34,35 +34,38 @@ static void printStaticCCResult(llvm::raw_ostream &OutS,
 //------------------------------------------------------------------------------
 // StaticCallCounter Implementation
 //------------------------------------------------------------------------------
-StaticCallCounter::Result StaticCallCounter::runOnModule(Module &M) {
-  llvm::MapVector<const llvm::Function *, unsigned> Res;
+void StaticCallCounter::countDirectCalls(const Function &Func, Result &Res) {
+  for (auto &BB : Func) {
+    for (auto &Ins : BB) {
+
+      // If this is a call instruction then CB will be not null.
+      auto *CB = dyn_cast<CallBase>(&Ins);
+      if (nullptr == CB) {
+        continue;
+      }
+
+      // If CB is a direct function call then DirectInvoc will be not null.
+      auto DirectInvoc = CB->getCalledFunction();
+      if (nullptr == DirectInvoc) {
+        continue;
+      }
 
-  for (auto &Func : M) {
-    for (auto &BB : Func) {
-      for (auto &Ins : BB) {
-
-        // If this is a call instruction then CB will be not null.
-        auto *CB = dyn_cast<CallBase>(&Ins);
-        if (nullptr == CB) {
-          continue;
-        }
-
-        // If CB is a direct function call then DirectInvoc will be not null.
-        auto DirectInvoc = CB->getCalledFunction();
-        if (nullptr == DirectInvoc) {
-          continue;
-        }
-
-        // We have a direct function call - update the count for the function
-        // being called.
-        auto CallCount = Res.find(DirectInvoc);
-        if (Res.end() == CallCount) {
-          CallCount = Res.insert(std::make_pair(DirectInvoc, 0)).first;
-        }
-        ++CallCount->second;
+      // We have a direct function call - update the count for the function
+      // being called.
+      auto CallCount = Res.find(DirectInvoc);
+      if (Res.end() == CallCount) {
+        CallCount = Res.insert(std::make_pair(DirectInvoc, 0)).first;
       }
+      ++CallCount->second;
     }
   }
+}
+
+StaticCallCounter::Result StaticCallCounter::runOnModule(Module &M) {
+  llvm::MapVector<const llvm::Function *, unsigned> Res;
+
+  for (auto &Func : M)
+    countDirectCalls(Func, Res);
 
   return Res;
 }
@@ -0,0 +1,2588 @@
+//==============================================================================
+// FILE:
+//    lt_rt.c
+//
+// DESCRIPTION:
+//    The runtime library for the llvm-tutor instrumentation passes. Modules
+//    instrumented with `dynamic-cc<flush>` register their counter tables here
+//    and lt_rt takes care of writing the profile (see ProfileFormat.h):
+//      * on demand, when the program calls lt_rt_flush()
+//      * periodically, from a background thread (LT_RT_FLUSH_INTERVAL_MS)
+//      * when the process receives a signal (LT_RT_FLUSH_SIGNAL)
+//      * when the process exits
+//
+//    Every snapshot is written to a temporary file that's then renamed over
+//    the profile file, so readers never see a partially written profile. The
+//    counters are read with relaxed atomic loads while the application keeps
+//    running - the application threads are never stopped and never take a
+//    lock.
+//
+//    For modules instrumented in the `edges` mode, every snapshot also
+//    contains the dynamic call graph of the module (an LT_PROF_CALL_EDGES
+//    record). The targets of indirect calls are recorded by
+//    __lt_rt_record_indirect_call and named (via the module's function table
+//    or dladdr) when the snapshot is written.
+//
+//    For modules instrumented in the `blocks` mode, every snapshot also
+//    contains the block and CFG edge counts (an LT_PROF_BLOCK_COUNTS record).
+//    Only the edges off a spanning tree of the CFG are instrumented - the
+//    remaining counts are reconstructed here (see reconstructEdgeCounts).
+//
+//    For modules instrumented in the `timing` mode, every snapshot also
+//    contains the inclusive and exclusive time spent in every function (an
+//    LT_PROF_FUNCTION_TIMES record). The instrumented functions call
+//    __lt_rt_enter_function and __lt_rt_exit_function, which maintain a
+//    per-thread shadow stack of the active functions (see "Function timing"
+//    below).
+//
+//    For modules instrumented in the `cct` mode, the same hooks also maintain a
+//    calling-context tree per thread (see "Calling contexts" below). Every
+//    snapshot then contains all these trees (one LT_PROF_CALLING_CONTEXTS
+//    record).
+//
+//    Modules instrumented with `inject-func-call<trace>` record an event on
+//    every function entry (and exit, in the `trace=entry-exit` mode). The
+//    events are buffered per thread (in lock-free ring buffers) and written
+//    to a separate trace file (see "Function tracing" below).
+//
+//    For modules instrumented in the `coverage` mode, there are no counters -
+//    every snapshot contains the coverage bitmap of the module instead (an
+//    LT_PROF_COVERAGE record with one bit per function or block).
+//
+//    For modules instrumented in the `shm` mode, the counter tables are also
+//    exported through shared memory, so that other processes can read the
+//    live counts (see "Live counters" below).
+//
+//    Processes forked by an instrumented program start with their counters
+//    reset and write their own profile (see "fork() support" below).
+//
+//    The signal handler doesn't write anything itself (that wouldn't be
+//    async-signal-safe). Instead, it wakes up the background thread through a
+//    pipe.
+//
+// License: MIT
+//==============================================================================
+// For dladdr and program_invocation_short_name
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "lt_rt.h"
+#include "ProfileFormat.h"
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
+#define LT_RT_API __attribute__((visibility("default")))
+
+//------------------------------------------------------------------------------
+// Global state
+//------------------------------------------------------------------------------
+// The registered modules, in the order of registration. Modules are never
+// unregistered.
+static LTRTModule *ModulesHead = NULL;
+static LTRTModule *ModulesTail = NULL;
+static pthread_mutex_t ModulesLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Serialises the snapshots
+static pthread_mutex_t FlushLock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_once_t InitOnce = PTHREAD_ONCE_INIT;
+// The flush interval (0 if periodic flushing is disabled)
+static int FlushIntervalMs = 0;
+// Used by the signal handler to wake up the flusher thread
+static int WakeupPipe[2] = {-1, -1};
+// Set in the children forked after the first module was registered (see
+// "fork() support" below)
+static int ForkedChild = 0;
+static pthread_once_t ForkOnce = PTHREAD_ONCE_INIT;
+static void installForkHandlers(void);
+
+//------------------------------------------------------------------------------
+// Helper functions
+//------------------------------------------------------------------------------
+static const char *getProfilePattern(void) {
+  const char *Path = getenv(LT_PROF_FILE_ENV_VAR);
+  return (Path && *Path) ? Path : LT_PROF_DEFAULT_FILE;
+}
+
+// Expands the file name Pattern into Buf: every `%p` is replaced with the ID
+// of the process. In a forked child, `.<pid>` is appended to names without
+// `%p`, so that the child doesn't overwrite the file of its parent. Returns
+// -1 if the result doesn't fit into Buf.
+static int expandPath(const char *Pattern, char *Buf, size_t Size) {
+  long Pid = (long)getpid();
+  int HasPid = 0;
+  size_t Len = 0;
+  Buf[0] = '\0';
+  for (const char *C = Pattern; *C; C++) {
+    int Written;
+    if (C[0] == '%' && C[1] == 'p') {
+      Written = snprintf(Buf + Len, Size - Len, "%ld", Pid);
+      HasPid = 1;
+      C++;
+    } else {
+      Written = snprintf(Buf + Len, Size - Len, "%c", *C);
+    }
+    if (Written < 0 || (size_t)Written >= Size - Len)
+      return -1;
+    Len += (size_t)Written;
+  }
+
+  if (ForkedChild && !HasPid) {
+    int Written = snprintf(Buf + Len, Size - Len, ".%ld", Pid);
+    if (Written < 0 || (size_t)Written >= Size - Len)
+      return -1;
+  }
+  return 0;
+}
+
+static int getProfilePath(char *Buf, size_t Size) {
+  return expandPath(getProfilePattern(), Buf, Size);
+}
+
+static int writeAll(int FD, const void *Buf, size_t Size) {
+  const char *Ptr = (const char *)Buf;
+  while (Size) {
+    ssize_t Written = write(FD, Ptr, Size);
+    if (Written < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    Ptr += Written;
+    Size -= (size_t)Written;
+  }
+  return 0;
+}
+
+// Writes the LT_PROF_FUNCTION_COUNTS record for Module
+static int writeModule(int FD, const LTRTModule *Module) {
+  static const char Zeros[8] = {0};
+  uint64_t Padding = (8 - Module->NamesSize % 8) % 8;
+
+  LTProfRecordHeader Header;
+  Header.Magic = LT_PROF_MAGIC;
+  Header.Version = LT_PROF_VERSION;
+  Header.Kind = LT_PROF_FUNCTION_COUNTS;
+  Header.Size = sizeof(LTProfFunctionCountsHeader) +
+                Module->NumCounters * sizeof(uint64_t) + Module->NamesSize +
+                Padding;
+
+  LTProfFunctionCountsHeader CountsHeader;
+  CountsHeader.NumCounters = Module->NumCounters;
+  CountsHeader.NamesSize = Module->NamesSize;
+
+  if (writeAll(FD, &Header, sizeof(Header)) ||
+      writeAll(FD, &CountsHeader, sizeof(CountsHeader)))
+    return -1;
+
+  // The counters are being updated by the application while we read them, so
+  // copy them out (in chunks) with atomic loads rather than writing them
+  // straight from the table.
+  uint64_t Chunk[512];
+  const uint64_t ChunkSize = sizeof(Chunk) / sizeof(Chunk[0]);
+  for (uint64_t Idx = 0; Idx < Module->NumCounters; Idx += ChunkSize) {
+    uint64_t Num = Module->NumCounters - Idx;
+    if (Num > ChunkSize)
+      Num = ChunkSize;
+    for (uint64_t I = 0; I < Num; I++)
+      Chunk[I] = __atomic_load_n(&Module->Counters[Idx + I], __ATOMIC_RELAXED);
+    if (writeAll(FD, Chunk, Num * sizeof(uint64_t)))
+      return -1;
+  }
+
+  if (writeAll(FD, Module->Names, Module->NamesSize) ||
+      writeAll(FD, Zeros, Padding))
+    return -1;
+
+  return 0;
+}
+
+// Returns the number of bytes in the coverage table of Module (one per
+// function or, with `coverage=blocks`, per block)
+static uint64_t getCoverageSize(const LTRTModule *Module) {
+  if (!Module->CoverageBlocks)
+    return Module->NumCounters;
+  uint64_t NumBlocks = 0;
+  for (uint64_t Slot = 0; Slot < Module->NumCounters; Slot++)
+    NumBlocks += Module->CoverageBlocks[Slot];
+  return NumBlocks;
+}
+
+// Writes the LT_PROF_COVERAGE record for Module (`dynamic-cc<coverage>`). The
+// bytes set by the instrumented code are packed into a bitmap, i.e. a function
+// (or a block) takes up one bit in the profile.
+static int writeCoverage(int FD, const LTRTModule *Module) {
+  static const char Zeros[8] = {0};
+  uint64_t NumBits = getCoverageSize(Module);
+  uint64_t BitmapSize = (NumBits + 7) / 8;
+  uint64_t BlocksSize =
+      Module->CoverageBlocks ? Module->NumCounters * sizeof(uint64_t) : 0;
+  uint64_t Padding = (8 - (BitmapSize + Module->NamesSize) % 8) % 8;
+
+  LTProfRecordHeader Header;
+  Header.Magic = LT_PROF_MAGIC;
+  Header.Version = LT_PROF_VERSION;
+  Header.Kind = LT_PROF_COVERAGE;
+  Header.Size = sizeof(LTProfCoverageHeader) + BlocksSize + BitmapSize +
+                Module->NamesSize + Padding;
+
+  LTProfCoverageHeader CoverageHeader;
+  CoverageHeader.NumFunctions = Module->NumCounters;
+  CoverageHeader.NumBlocks = Module->CoverageBlocks ? NumBits : 0;
+  CoverageHeader.NamesSize = Module->NamesSize;
+
+  if (writeAll(FD, &Header, sizeof(Header)) ||
+      writeAll(FD, &CoverageHeader, sizeof(CoverageHeader)) ||
+      writeAll(FD, Module->CoverageBlocks, BlocksSize))
+    return -1;
+
+  // As in writeModule, the bytes are read with atomic loads (in chunks)
+  uint8_t Chunk[512];
+  uint64_t Bit = 0;
+  while (Bit < NumBits) {
+    uint64_t Num = NumBits - Bit;
+    if (Num > sizeof(Chunk) * 8)
+      Num = sizeof(Chunk) * 8;
+    memset(Chunk, 0, sizeof(Chunk));
+    for (uint64_t I = 0; I < Num; I++)
+      if (__atomic_load_n(&Module->Coverage[Bit + I], __ATOMIC_RELAXED))
+        Chunk[I / 8] |= (uint8_t)(1u << I % 8);
+    if (writeAll(FD, Chunk, (Num + 7) / 8))
+      return -1;
+    Bit += Num;
+  }
+
+  if (writeAll(FD, Module->Names, Module->NamesSize) ||
+      writeAll(FD, Zeros, Padding))
+    return -1;
+
+  return 0;
+}
+
+// A growable byte buffer
+typedef struct {
+  char *Data;
+  size_t Size;
+  size_t Capacity;
+} Buffer;
+
+static int appendBytes(Buffer *Buf, const void *Bytes, size_t Size) {
+  if (Buf->Size + Size > Buf->Capacity) {
+    size_t Capacity = Buf->Capacity ? Buf->Capacity : 4096;
+    while (Buf->Size + Size > Capacity)
+      Capacity *= 2;
+    char *Data = (char *)realloc(Buf->Data, Capacity);
+    if (!Data)
+      return -1;
+    Buf->Data = Data;
+    Buf->Capacity = Capacity;
+  }
+  memcpy(Buf->Data + Buf->Size, Bytes, Size);
+  Buf->Size += Size;
+  return 0;
+}
+
+// Appends Name (including the NUL terminator) to Names and returns its offset
+// in *Offset
+static int appendName(Buffer *Names, const char *Name, uint64_t *Offset) {
+  *Offset = Names->Size;
+  return appendBytes(Names, Name, strlen(Name) + 1);
+}
+
+// Maps the addresses of the instrumented functions back to their slots
+typedef struct {
+  void *Address;
+  uint64_t Slot;
+} FunctionAddress;
+
+static int compareFunctionAddresses(const void *LHS, const void *RHS) {
+  const FunctionAddress *A = (const FunctionAddress *)LHS;
+  const FunctionAddress *B = (const FunctionAddress *)RHS;
+  return (A->Address > B->Address) - (A->Address < B->Address);
+}
+
+// The information needed to name the functions of one module
+typedef struct {
+  // The name of every instrumented function (slot order)
+  const char **Names;
+  // The addresses of the instrumented functions (sorted)
+  FunctionAddress *Addresses;
+  uint64_t NumFunctions;
+} FunctionNames;
+
+static int initFunctionNames(FunctionNames *FN, const LTRTModule *Module) {
+  FN->NumFunctions = Module->NumCounters;
+  FN->Names = (const char **)calloc(FN->NumFunctions, sizeof(const char *));
+  FN->Addresses =
+      (FunctionAddress *)calloc(FN->NumFunctions, sizeof(FunctionAddress));
+  if (!FN->Names || !FN->Addresses)
+    return -1;
+
+  const char *Name = Module->Names;
+  for (uint64_t Slot = 0; Slot < FN->NumFunctions; Slot++) {
+    FN->Names[Slot] = Name;
+    Name += strlen(Name) + 1;
+    FN->Addresses[Slot].Address = Module->Functions[Slot];
+    FN->Addresses[Slot].Slot = Slot;
+  }
+  qsort(FN->Addresses, FN->NumFunctions, sizeof(FunctionAddress),
+        compareFunctionAddresses);
+
+  return 0;
+}
+
+// Returns the name of the function at Target. Functions from the module are
+// looked up first (these might be internal and hence invisible to dladdr).
+// Unknown targets are named after their address (formatted into Scratch).
+static const char *getTargetName(const FunctionNames *FN, void *Target,
+                                 char *Scratch, size_t ScratchSize) {
+  FunctionAddress Key = {Target, 0};
+  const FunctionAddress *Found = (const FunctionAddress *)bsearch(
+      &Key, FN->Addresses, FN->NumFunctions, sizeof(FunctionAddress),
+      compareFunctionAddresses);
+  if (Found)
+    return FN->Names[Found->Slot];
+
+  Dl_info Info;
+  if (dladdr(Target, &Info) && Info.dli_sname && Info.dli_saddr == Target)
+    return Info.dli_sname;
+
+  snprintf(Scratch, ScratchSize, "%p", Target);
+  return Scratch;
+}
+
+static int appendEdge(Buffer *Edges, Buffer *Names, uint64_t Caller,
+                      const char *Callee, uint64_t Site, uint64_t Flags,
+                      uint64_t Count) {
+  LTProfCallEdge Edge;
+  Edge.Caller = Caller;
+  Edge.Site = Site;
+  Edge.Flags = Flags;
+  Edge.Count = Count;
+  if (appendName(Names, Callee, &Edge.Callee))
+    return -1;
+  return appendBytes(Edges, &Edge, sizeof(Edge));
+}
+
+// Collects the edges of the call graph of Module (and the names used by these)
+static int collectCallEdges(const LTRTModule *Module, Buffer *Edges,
+                            Buffer *Names) {
+  FunctionNames FN;
+  int Ret = initFunctionNames(&FN, Module);
+
+  uint64_t CallerSlot = UINT64_MAX;
+  uint64_t CallerName = 0;
+  for (uint64_t Idx = 0; Idx < Module->NumSites && !Ret; Idx++) {
+    const LTRTCallSite *Site = &Module->Sites[Idx];
+
+    // The sites are grouped by caller, so every caller name is stored once
+    if (Site->Caller != CallerSlot) {
+      CallerSlot = Site->Caller;
+      if ((Ret = appendName(Names, FN.Names[CallerSlot], &CallerName)))
+        break;
+    }
+
+    if (Site->Callee) {
+      uint64_t Count = __atomic_load_n(&Module->SiteCounters[Site->Index],
+                                       __ATOMIC_RELAXED);
+      Ret = appendEdge(Edges, Names, CallerName, Site->Callee, Site->Ordinal,
+                       0, Count);
+      continue;
+    }
+
+    // Indirect call site - only report the targets that have been reached
+    LTRTIndirectTargets *Targets = &Module->IndirectTargets[Site->Index];
+    for (int I = 0; I < LT_RT_MAX_INDIRECT_TARGETS && !Ret; I++) {
+      // Only report the calls that are known to have reached Target, the
+      // inherited ones (the error) are already counted in Other
+      void *Target = __atomic_load_n(&Targets->Targets[I], __ATOMIC_RELAXED);
+      uint64_t Count = __atomic_load_n(&Targets->Counts[I], __ATOMIC_RELAXED) -
+                       __atomic_load_n(&Targets->Errors[I], __ATOMIC_RELAXED);
+      if (!Target || !Count)
+        continue;
+
+      char Scratch[32];
+      Ret = appendEdge(Edges, Names, CallerName,
+                       getTargetName(&FN, Target, Scratch, sizeof(Scratch)),
+                       Site->Ordinal, LT_PROF_EDGE_INDIRECT, Count);
+    }
+
+    uint64_t Other = __atomic_load_n(&Targets->Other, __ATOMIC_RELAXED);
+    if (!Ret && Other)
+      Ret = appendEdge(Edges, Names, CallerName, LT_PROF_OTHER_TARGETS,
+                       Site->Ordinal, LT_PROF_EDGE_INDIRECT, Other);
+  }
+
+  free(FN.Names);
+  free(FN.Addresses);
+  return Ret;
+}
+
+// Writes the LT_PROF_CALL_EDGES record for Module
+static int writeCallEdges(int FD, const LTRTModule *Module) {
+  static const char Zeros[8] = {0};
+  Buffer Edges = {NULL, 0, 0};
+  Buffer Names = {NULL, 0, 0};
+
+  int Ret = collectCallEdges(Module, &Edges, &Names);
+  if (!Ret) {
+    uint64_t Padding = (8 - Names.Size % 8) % 8;
+
+    LTProfRecordHeader Header;
+    Header.Magic = LT_PROF_MAGIC;
+    Header.Version = LT_PROF_VERSION;
+    Header.Kind = LT_PROF_CALL_EDGES;
+    Header.Size =
+        sizeof(LTProfCallEdgesHeader) + Edges.Size + Names.Size + Padding;
+
+    LTProfCallEdgesHeader EdgesHeader;
+    EdgesHeader.NumEdges = Edges.Size / sizeof(LTProfCallEdge);
+    EdgesHeader.NamesSize = Names.Size;
+
+    if (writeAll(FD, &Header, sizeof(Header)) ||
+        writeAll(FD, &EdgesHeader, sizeof(EdgesHeader)) ||
+        writeAll(FD, Edges.Data, Edges.Size) ||
+        writeAll(FD, Names.Data, Names.Size) || writeAll(FD, Zeros, Padding))
+      Ret = -1;
+  }
+
+  free(Edges.Data);
+  free(Names.Data);
+  return Ret;
+}
+
+// Computes the counts of all the edges of Function (one entry per edge in
+// Counts) from the counters of the instrumented edges. The edges that are not
+// instrumented form a spanning tree of the CFG extended with a virtual
+// entry/exit node (see CFGSpanningTree.h). As the flow is conserved at every
+// node, the count of the only unknown edge of a node (e.g. a leaf of the tree)
+// is the difference between the known incoming and outgoing counts. Solving
+// for that edge turns the node at its other end into a leaf and so on.
+static int reconstructEdgeCounts(const LTRTModule *Module,
+                                 const LTRTCFGFunction *Function,
+                                 uint64_t *Counts) {
+  const LTRTCFGEdge *Edges = &Module->CFGEdges[Function->FirstEdge];
+  uint64_t NumEdges = Function->NumEdges;
+  uint64_t NumNodes = Function->NumBlocks + 1;
+
+  // For every node: the sum of the known incoming counts minus the sum of the
+  // known outgoing counts, the number of unknown edges and (in Adj) the
+  // unknown edges
+  int64_t *Balance = (int64_t *)calloc(NumNodes, sizeof(int64_t));
+  uint64_t *NumUnknown = (uint64_t *)calloc(NumNodes, sizeof(uint64_t));
+  uint64_t *AdjStart = (uint64_t *)calloc(NumNodes + 1, sizeof(uint64_t));
+  uint64_t *Adj = (uint64_t *)calloc(2 * NumEdges + 1, sizeof(uint64_t));
+  char *Known = (char *)calloc(NumEdges + 1, 1);
+  uint64_t *Worklist =
+      (uint64_t *)calloc(NumNodes + NumEdges, sizeof(uint64_t));
+  int Ret = -1;
+  if (!Balance || !NumUnknown || !AdjStart || !Adj || !Known || !Worklist)
+    goto cleanup;
+
+  for (uint64_t E = 0; E < NumEdges; E++) {
+    if (Edges[E].Counter == LT_RT_NO_COUNTER) {
+      NumUnknown[Edges[E].Src]++;
+      NumUnknown[Edges[E].Dst]++;
+      continue;
+    }
+
+    Counts[E] = __atomic_load_n(&Module->BlockCounters[Edges[E].Counter],
+                                __ATOMIC_RELAXED);
+    Known[E] = 1;
+    Balance[Edges[E].Dst] += (int64_t)Counts[E];
+    Balance[Edges[E].Src] -= (int64_t)Counts[E];
+  }
+
+  for (uint64_t N = 0; N < NumNodes; N++)
+    AdjStart[N + 1] = AdjStart[N] + NumUnknown[N];
+  uint64_t *AdjEnd = (uint64_t *)calloc(NumNodes, sizeof(uint64_t));
+  if (!AdjEnd)
+    goto cleanup;
+  memcpy(AdjEnd, AdjStart, NumNodes * sizeof(uint64_t));
+  for (uint64_t E = 0; E < NumEdges; E++) {
+    if (Known[E])
+      continue;
+    Adj[AdjEnd[Edges[E].Src]++] = E;
+    Adj[AdjEnd[Edges[E].Dst]++] = E;
+  }
+  free(AdjEnd);
+
+  uint64_t WorklistSize = 0;
+  for (uint64_t N = 0; N < NumNodes; N++)
+    if (NumUnknown[N] == 1)
+      Worklist[WorklistSize++] = N;
+
+  while (WorklistSize) {
+    uint64_t N = Worklist[--WorklistSize];
+    if (NumUnknown[N] != 1)
+      continue;
+
+    uint64_t E = 0;
+    for (uint64_t I = AdjStart[N]; I < AdjStart[N + 1]; I++)
+      if (!Known[Adj[I]])
+        E = Adj[I];
+
+    // In a consistent profile the result is never negative. It might be if
+    // the process exited in the middle of an instrumented function.
+    int64_t Count = Edges[E].Dst == N ? -Balance[N] : Balance[N];
+    Counts[E] = Count < 0 ? 0 : (uint64_t)Count;
+    Known[E] = 1;
+    Balance[Edges[E].Dst] += (int64_t)Counts[E];
+    Balance[Edges[E].Src] -= (int64_t)Counts[E];
+
+    uint64_t Other = Edges[E].Dst == N ? Edges[E].Src : Edges[E].Dst;
+    NumUnknown[N]--;
+    if (--NumUnknown[Other] == 1)
+      Worklist[WorklistSize++] = Other;
+  }
+
+  // Only the edges of inconsistent profiles might remain unknown
+  for (uint64_t E = 0; E < NumEdges; E++)
+    if (!Known[E])
+      Counts[E] = 0;
+  Ret = 0;
+
+cleanup:
+  free(Balance);
+  free(NumUnknown);
+  free(AdjStart);
+  free(Adj);
+  free(Known);
+  free(Worklist);
+  return Ret;
+}
+
+// Writes the LT_PROF_BLOCK_COUNTS record for Module
+static int writeBlockCounts(int FD, const LTRTModule *Module) {
+  static const char Zeros[8] = {0};
+  Buffer Functions = {NULL, 0, 0};
+  Buffer Blocks = {NULL, 0, 0};
+  Buffer Edges = {NULL, 0, 0};
+  Buffer Names = {NULL, 0, 0};
+  uint64_t *Counts = NULL;
+  uint64_t *BlockCounts = NULL;
+  int Ret = 0;
+
+  // The function names in slot order
+  const char **FunctionNames =
+      (const char **)calloc(Module->NumCounters, sizeof(const char *));
+  if (!FunctionNames)
+    return -1;
+  const char *Name = Module->Names;
+  for (uint64_t Slot = 0; Slot < Module->NumCounters; Slot++) {
+    FunctionNames[Slot] = Name;
+    Name += strlen(Name) + 1;
+  }
+
+  for (uint64_t Idx = 0; Idx < Module->NumCFGFunctions && !Ret; Idx++) {
+    const LTRTCFGFunction *Function = &Module->CFGFunctions[Idx];
+    const LTRTCFGEdge *CFGEdges = &Module->CFGEdges[Function->FirstEdge];
+
+    Counts = (uint64_t *)calloc(Function->NumEdges, sizeof(uint64_t));
+    BlockCounts = (uint64_t *)calloc(Function->NumBlocks, sizeof(uint64_t));
+    if (!Counts || !BlockCounts ||
+        reconstructEdgeCounts(Module, Function, Counts)) {
+      Ret = -1;
+      break;
+    }
+
+    LTProfBlockFunction Record;
+    Record.NumBlocks = Function->NumBlocks;
+    Record.NumEdges = Function->NumEdges;
+    Ret = appendName(&Names, FunctionNames[Function->Function], &Record.Name) ||
+          appendBytes(&Functions, &Record, sizeof(Record));
+
+    // The count of a block is the sum of the counts of its incoming edges
+    for (uint64_t E = 0; E < Function->NumEdges && !Ret; E++) {
+      if (CFGEdges[E].Dst < Function->NumBlocks)
+        BlockCounts[CFGEdges[E].Dst] += Counts[E];
+
+      LTProfBlockEdge Edge;
+      Edge.Src = CFGEdges[E].Src;
+      Edge.Dst = CFGEdges[E].Dst;
+      Edge.Count = Counts[E];
+      Ret = appendBytes(&Edges, &Edge, sizeof(Edge));
+    }
+
+    if (!Ret)
+      Ret = appendBytes(&Blocks, BlockCounts,
+                        Function->NumBlocks * sizeof(uint64_t));
+
+    free(Counts);
+    free(BlockCounts);
+    Counts = BlockCounts = NULL;
+  }
+  free(Counts);
+  free(BlockCounts);
+
+  if (!Ret) {
+    uint64_t Padding = (8 - Names.Size % 8) % 8;
+
+    LTProfRecordHeader Header;
+    Header.Magic = LT_PROF_MAGIC;
+    Header.Version = LT_PROF_VERSION;
+    Header.Kind = LT_PROF_BLOCK_COUNTS;
+    Header.Size = sizeof(LTProfBlockCountsHeader) + Functions.Size +
+                  Blocks.Size + Edges.Size + Names.Size + Padding;
+
+    LTProfBlockCountsHeader CountsHeader;
+    CountsHeader.NumFunctions = Functions.Size / sizeof(LTProfBlockFunction);
+    CountsHeader.NumBlocks = Blocks.Size / sizeof(uint64_t);
+    CountsHeader.NumEdges = Edges.Size / sizeof(LTProfBlockEdge);
+    CountsHeader.NamesSize = Names.Size;
+
+    if (writeAll(FD, &Header, sizeof(Header)) ||
+        writeAll(FD, &CountsHeader, sizeof(CountsHeader)) ||
+        writeAll(FD, Functions.Data, Functions.Size) ||
+        writeAll(FD, Blocks.Data, Blocks.Size) ||
+        writeAll(FD, Edges.Data, Edges.Size) ||
+        writeAll(FD, Names.Data, Names.Size) || writeAll(FD, Zeros, Padding))
+      Ret = -1;
+  }
+
+  free(FunctionNames);
+  free(Functions.Data);
+  free(Blocks.Data);
+  free(Edges.Data);
+  free(Names.Data);
+  return Ret;
+}
+
+//------------------------------------------------------------------------------
+// Function timing (the `timing` mode)
+//------------------------------------------------------------------------------
+// Every thread keeps a shadow stack of the active (i.e. entered but not yet
+// returned) instrumented functions. The time of an activation is accounted
+// for when it's popped: the whole interval goes to the inclusive time of the
+// function and to the callee time of its caller (the activation below it on
+// the shadow stack), the interval minus the callee time goes to the exclusive
+// time of the function.
+//
+// Functions can also be left without returning, i.e. by unwinding (C++
+// exceptions) or by `longjmp`. The shadow stack still contains these
+// activations, so every entry is identified with the frame address of the
+// activation and the function. As the stack grows downwards, the entries
+// above that of a live activation belong to activations that are no longer
+// live. Such entries are popped (as if they had returned just now):
+//  * by __lt_rt_unwind_to, which the instrumented functions call when they
+//    regain control other than through a return, i.e. in landing pads and
+//    after `setjmp` returns
+//  * by __lt_rt_exit_function, before it pops the returning activation
+//  * by __lt_rt_enter_function - the entries with frames below that of the
+//    new activation (this catches the functions that were unwound into
+//    uninstrumented code)
+// Note that inlining (after instrumentation) gives a function the frame
+// address of its caller. Hence the frame address alone doesn't identify an
+// activation and __lt_rt_enter_function never considers entries with the
+// same frame address stale.
+//
+// The inclusive time of a recursive function includes the time of the nested
+// activations more than once (as in gprof). Activations that are still
+// running when a snapshot is written (e.g. `main` if the program calls `exit`)
+// are not included in the snapshot.
+//
+// The shadow stack is also maintained for the `cct` mode (the time is then
+// only measured if some module was instrumented in the `timing` mode).
+
+// The maximum depth of the shadow stack. Deeper activations are not timed -
+// their time is accounted to the deepest timed activation.
+#define LT_RT_SHADOW_STACK_SIZE 512
+
+struct CCTNode;
+
+typedef struct {
+  LTRTFunctionTimes *Times;
+  uintptr_t Frame;
+  uint64_t Start;
+  // The inclusive time of the callees that have returned so far
+  uint64_t Callees;
+  // The calling context of the caller (restored when this entry is popped)
+  struct CCTNode *CallerContext;
+} ShadowFrame;
+
+static __thread ShadowFrame ShadowStack[LT_RT_SHADOW_STACK_SIZE];
+static __thread unsigned ShadowDepth = 0;
+
+// Set when the first module instrumented in the corresponding mode is
+// registered. The functions from all modules are then timed (or tracked in
+// the calling-context trees), regardless of the mode they were instrumented
+// in.
+static int TimingEnabled = 0;
+static int ContextsEnabled = 0;
+
+// The calling context of the innermost activation on the shadow stack (NULL
+// for the root of the thread's tree), see "Calling contexts"
+static __thread struct CCTNode *CurrentContext = NULL;
+
+// An LTProfTimeUnit. Selected (once) before any instrumented code runs.
+static uint64_t ClockUnit = LT_PROF_TIME_NANOSECONDS;
+
+static uint64_t readMonotonicClock(void) {
+  struct timespec Now;
+  clock_gettime(CLOCK_MONOTONIC, &Now);
+  return (uint64_t)Now.tv_sec * 1000000000ULL + (uint64_t)Now.tv_nsec;
+}
+
+static uint64_t readClock(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  if (ClockUnit == LT_PROF_TIME_CYCLES)
+    return __rdtsc();
+#endif
+  return readMonotonicClock();
+}
+
+// Returns 0 if no module is instrumented in the `timing` mode (the shadow
+// stack is then only used for the calling contexts)
+static uint64_t readClockIfTiming(void) {
+  return __atomic_load_n(&TimingEnabled, __ATOMIC_RELAXED) ? readClock() : 0;
+}
+
+// Returns 1 if the TSC ticks at a constant rate across all cores and power
+// states, i.e. if TSC deltas measure time
+static int hasInvariantTSC(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  unsigned EAX, EBX, ECX, EDX;
+  if (__get_cpuid(0x80000000, &EAX, &EBX, &ECX, &EDX) && EAX >= 0x80000007 &&
+      __get_cpuid(0x80000007, &EAX, &EBX, &ECX, &EDX))
+    return (EDX >> 8) & 1;
+#endif
+  return 0;
+}
+
+// lt_rt is a dependency of every instrumented program, so this runs before
+// any instrumented code (including module constructors)
+__attribute__((constructor)) static void initClock(void) {
+  const char *Clock = getenv(LT_RT_CLOCK_ENV_VAR);
+  if (!Clock || !*Clock) {
+    ClockUnit =
+        hasInvariantTSC() ? LT_PROF_TIME_CYCLES : LT_PROF_TIME_NANOSECONDS;
+  } else if (!strcmp(Clock, "monotonic")) {
+    ClockUnit = LT_PROF_TIME_NANOSECONDS;
+#if defined(__x86_64__) || defined(__i386__)
+  } else if (!strcmp(Clock, "tsc")) {
+    ClockUnit = LT_PROF_TIME_CYCLES;
+#endif
+  } else {
+    fprintf(stderr, "lt_rt: ignoring unsupported %s: '%s'\n",
+            LT_RT_CLOCK_ENV_VAR, Clock);
+  }
+}
+
+// Pops the top of the shadow stack (accounting for the activation as if it
+// had returned at Now)
+static void popShadowFrame(uint64_t Now) {
+  ShadowFrame *Top = &ShadowStack[--ShadowDepth];
+  CurrentContext = Top->CallerContext;
+  // Start is 0 if the activation began before the first module instrumented
+  // in the `timing` mode was registered (e.g. loaded with dlopen)
+  if (!__atomic_load_n(&TimingEnabled, __ATOMIC_RELAXED) || !Top->Start)
+    return;
+
+  uint64_t Inclusive = Now - Top->Start;
+  // The callees can only take longer than their caller if the clock is off
+  uint64_t Exclusive = Inclusive > Top->Callees ? Inclusive - Top->Callees : 0;
+  __atomic_fetch_add(&Top->Times->Inclusive, Inclusive, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&Top->Times->Exclusive, Exclusive, __ATOMIC_RELAXED);
+
+  if (ShadowDepth)
+    ShadowStack[ShadowDepth - 1].Callees += Inclusive;
+}
+
+// Pops the activations that were left without returning, i.e. the ones
+// deeper in the stack than Frame
+static void popStaleFrames(uintptr_t Frame, uint64_t Now) {
+  while (ShadowDepth && ShadowStack[ShadowDepth - 1].Frame < Frame)
+    popShadowFrame(Now);
+}
+
+// Pops the activations above the (live) activation of the function described
+// by Times with the frame address Frame. Returns 1 if that activation is then
+// at the top of the shadow stack.
+static int unwindTo(LTRTFunctionTimes *Times, uintptr_t Frame, uint64_t Now) {
+  while (ShadowDepth) {
+    const ShadowFrame *Top = &ShadowStack[ShadowDepth - 1];
+    if (Top->Frame > Frame)
+      return 0;
+    if (Top->Frame == Frame && Top->Times == Times)
+      return 1;
+    popShadowFrame(Now);
+  }
+  return 0;
+}
+
+// Writes the LT_PROF_FUNCTION_TIMES record for Module
+static int writeFunctionTimes(int FD, const LTRTModule *Module) {
+  LTProfRecordHeader Header;
+  Header.Magic = LT_PROF_MAGIC;
+  Header.Version = LT_PROF_VERSION;
+  Header.Kind = LT_PROF_FUNCTION_TIMES;
+  Header.Size = sizeof(LTProfFunctionTimesHeader) +
+                Module->NumCounters * sizeof(LTProfFunctionTimes);
+
+  LTProfFunctionTimesHeader TimesHeader;
+  TimesHeader.NumFunctions = Module->NumCounters;
+  TimesHeader.Unit = ClockUnit;
+
+  if (writeAll(FD, &Header, sizeof(Header)) ||
+      writeAll(FD, &TimesHeader, sizeof(TimesHeader)))
+    return -1;
+
+  for (uint64_t Slot = 0; Slot < Module->NumCounters; Slot++) {
+    LTProfFunctionTimes Times;
+    Times.Inclusive =
+        __atomic_load_n(&Module->Times[Slot].Inclusive, __ATOMIC_RELAXED);
+    Times.Exclusive =
+        __atomic_load_n(&Module->Times[Slot].Exclusive, __ATOMIC_RELAXED);
+    if (writeAll(FD, &Times, sizeof(Times)))
+      return -1;
+  }
+
+  return 0;
+}
+
+//------------------------------------------------------------------------------
+// Calling contexts (the `cct` mode)
+//------------------------------------------------------------------------------
+// Every thread builds a calling-context tree: a node per distinct path of
+// calls between instrumented functions, counting the number of times that
+// path was entered. The thread keeps a pointer to the node of the innermost
+// activation (CurrentContext) - entering a function moves it to the child
+// node for that function (creating the child on first use), leaving a
+// function restores the node saved on the shadow stack. The children of a
+// node are kept in a linked list with a cache of the last child entered, so
+// the common case (e.g. a loop calling the same function) is a single
+// comparison. Nothing is hashed and no lock is taken on the hot path.
+//
+// The nodes are bump-allocated from per-thread arenas and never freed - the
+// trees of threads that have exited are still part of the final profile.
+// Only the owning thread modifies a tree. The snapshots read it concurrently:
+// new nodes are published with release stores and the counts are updated
+// with relaxed atomic stores (the owner is the only writer).
+
+// The number of nodes in one chunk of the arena
+#define LT_RT_CCT_CHUNK_SIZE 1024
+
+typedef struct CCTNode {
+  // The function entered (NULL for the root of a tree)
+  const LTRTFunctionTimes *Function;
+  struct CCTNode *FirstChild;
+  struct CCTNode *NextSibling;
+  // The child entered most recently (only accessed by the owning thread)
+  struct CCTNode *LastChild;
+  uint64_t Count;
+} CCTNode;
+
+// The tree of one thread
+typedef struct CCTThread {
+  CCTNode Root;
+  struct CCTThread *Next;
+} CCTThread;
+
+// The trees of all threads that have entered an instrumented function
+static CCTThread *CCTThreads = NULL;
+static pthread_mutex_t CCTThreadsLock = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread CCTNode *ThreadRoot = NULL;
+static __thread CCTNode *ArenaNext = NULL;
+static __thread CCTNode *ArenaEnd = NULL;
+
+static CCTNode *allocateNode(void) {
+  if (ArenaNext == ArenaEnd) {
+    CCTNode *Chunk = (CCTNode *)calloc(LT_RT_CCT_CHUNK_SIZE, sizeof(CCTNode));
+    if (!Chunk)
+      return NULL;
+    ArenaNext = Chunk;
+    ArenaEnd = Chunk + LT_RT_CCT_CHUNK_SIZE;
+  }
+  return ArenaNext++;
+}
+
+static CCTNode *getThreadRoot(void) {
+  if (ThreadRoot)
+    return ThreadRoot;
+
+  CCTThread *Thread = (CCTThread *)calloc(1, sizeof(CCTThread));
+  if (!Thread)
+    return NULL;
+  pthread_mutex_lock(&CCTThreadsLock);
+  Thread->Next = CCTThreads;
+  CCTThreads = Thread;
+  pthread_mutex_unlock(&CCTThreadsLock);
+  return ThreadRoot = &Thread->Root;
+}
+
+// Moves CurrentContext to the child for Function. CurrentContext is left
+// unchanged if there's no memory for a new node (the callees of Function are
+// then attributed to its caller).
+static void enterContext(const LTRTFunctionTimes *Function) {
+  CCTNode *Parent = CurrentContext ? CurrentContext : getThreadRoot();
+  if (!Parent)
+    return;
+
+  CCTNode *Child = Parent->LastChild;
+  if (!Child || Child->Function != Function) {
+    for (Child = Parent->FirstChild; Child; Child = Child->NextSibling)
+      if (Child->Function == Function)
+        break;
+
+    if (!Child) {
+      if (!(Child = allocateNode()))
+        return;
+      Child->Function = Function;
+      Child->NextSibling = Parent->FirstChild;
+      __atomic_store_n(&Parent->FirstChild, Child, __ATOMIC_RELEASE);
+    }
+    Parent->LastChild = Child;
+  }
+
+  __atomic_store_n(&Child->Count, Child->Count + 1, __ATOMIC_RELAXED);
+  CurrentContext = Child;
+}
+
+// Returns the offset of the name of Function in the name table of the
+// LT_PROF_CALLING_CONTEXTS record. NameOffsets holds the offsets of the names
+// of all instrumented functions (module by module, in slot order) followed by
+// the offset of the name used for unknown functions.
+static uint64_t getContextName(const LTRTFunctionTimes *Function,
+                               const uint64_t *NameOffsets) {
+  for (const LTRTModule *Module = ModulesHead; Module; Module = Module->Next) {
+    if (Module->Times && Function >= Module->Times &&
+        Function < Module->Times + Module->NumCounters)
+      return NameOffsets[Function - Module->Times];
+    NameOffsets += Module->NumCounters;
+  }
+  return *NameOffsets;
+}
+
+// An entry of the work list used to walk the trees in preorder
+typedef struct {
+  const CCTNode *Node;
+  uint64_t Parent;
+} ContextWorkItem;
+
+// Collects the nodes of all calling-context trees (in preorder, the roots
+// themselves are left out)
+static int collectContexts(Buffer *Nodes, const uint64_t *NameOffsets) {
+  Buffer Worklist = {NULL, 0, 0};
+  int Ret = 0;
+
+  pthread_mutex_lock(&CCTThreadsLock);
+  for (CCTThread *Thread = CCTThreads; Thread && !Ret; Thread = Thread->Next) {
+    ContextWorkItem Item = {&Thread->Root, LT_PROF_NO_PARENT};
+    Ret = appendBytes(&Worklist, &Item, sizeof(Item));
+
+    while (Worklist.Size && !Ret) {
+      Worklist.Size -= sizeof(Item);
+      memcpy(&Item, Worklist.Data + Worklist.Size, sizeof(Item));
+
+      uint64_t Index = Item.Parent;
+      if (Item.Node != &Thread->Root) {
+        LTProfContextNode Node;
+        Node.Parent = Item.Parent;
+        Node.Name = getContextName(Item.Node->Function, NameOffsets);
+        Node.Count = __atomic_load_n(&Item.Node->Count, __ATOMIC_RELAXED);
+        Index = Nodes->Size / sizeof(Node);
+        if ((Ret = appendBytes(Nodes, &Node, sizeof(Node))))
+          break;
+      }
+
+      for (const CCTNode *Child =
+               __atomic_load_n(&Item.Node->FirstChild, __ATOMIC_ACQUIRE);
+           Child && !Ret; Child = Child->NextSibling) {
+        ContextWorkItem ChildItem = {Child, Index};
+        Ret = appendBytes(&Worklist, &ChildItem, sizeof(ChildItem));
+      }
+    }
+  }
+  pthread_mutex_unlock(&CCTThreadsLock);
+
+  free(Worklist.Data);
+  return Ret;
+}
+
+// Writes the LT_PROF_CALLING_CONTEXTS record. Expects ModulesLock to be held.
+static int writeCallingContexts(int FD) {
+  static const char Zeros[8] = {0};
+  static const char UnknownName[] = "<unknown>";
+  Buffer Nodes = {NULL, 0, 0};
+  Buffer Names = {NULL, 0, 0};
+  uint64_t NumFunctions = 0;
+  for (const LTRTModule *Module = ModulesHead; Module; Module = Module->Next)
+    NumFunctions += Module->NumCounters;
+
+  // The name table is the concatenation of the name tables of all modules
+  // followed by UnknownName (used for functions that ran before their module
+  // was registered, e.g. when called from the constructors of other modules)
+  uint64_t *NameOffsets =
+      (uint64_t *)calloc(NumFunctions + 1, sizeof(uint64_t));
+  int Ret = NameOffsets ? 0 : -1;
+  uint64_t *Offset = NameOffsets;
+  for (const LTRTModule *Module = ModulesHead; Module && !Ret;
+       Module = Module->Next) {
+    const char *Name = Module->Names;
+    for (uint64_t Slot = 0; Slot < Module->NumCounters; Slot++) {
+      *Offset++ = Names.Size + (uint64_t)(Name - Module->Names);
+      Name += strlen(Name) + 1;
+    }
+    Ret = appendBytes(&Names, Module->Names, Module->NamesSize);
+  }
+
+  if (!Ret) {
+    *Offset = Names.Size;
+    Ret = appendBytes(&Names, UnknownName, sizeof(UnknownName)) ||
+          collectContexts(&Nodes, NameOffsets);
+  }
+
+  if (!Ret) {
+    uint64_t Padding = (8 - Names.Size % 8) % 8;
+
+    LTProfRecordHeader Header;
+    Header.Magic = LT_PROF_MAGIC;
+    Header.Version = LT_PROF_VERSION;
+    Header.Kind = LT_PROF_CALLING_CONTEXTS;
+    Header.Size =
+        sizeof(LTProfContextsHeader) + Nodes.Size + Names.Size + Padding;
+
+    LTProfContextsHeader ContextsHeader;
+    ContextsHeader.NumNodes = Nodes.Size / sizeof(LTProfContextNode);
+    ContextsHeader.NamesSize = Names.Size;
+
+    if (writeAll(FD, &Header, sizeof(Header)) ||
+        writeAll(FD, &ContextsHeader, sizeof(ContextsHeader)) ||
+        writeAll(FD, Nodes.Data, Nodes.Size) ||
+        writeAll(FD, Names.Data, Names.Size) || writeAll(FD, Zeros, Padding))
+      Ret = -1;
+  }
+
+  free(NameOffsets);
+  free(Nodes.Data);
+  free(Names.Data);
+  return Ret;
+}
+
+//------------------------------------------------------------------------------
+// Function tracing (`inject-func-call<trace>`)
+//------------------------------------------------------------------------------
+// Every thread records its events in its own ring buffer, so recording an
+// event takes no locks and no atomic read-modify-write operations. What
+// happens once the buffer is full depends on LT_RT_TRACE_FLUSH:
+//  * `exit` - the oldest events are overwritten. The buffers are written to
+//    the trace file when their thread exits and, for the threads that are
+//    still running, when the process exits. The traced threads never do any
+//    I/O.
+//  * `full` - the thread writes all of its buffered events to the trace file
+//    and then reuses the buffer. Nothing is lost, but the thread stalls while
+//    writing (and contends for TraceLock with the other threads).
+// Every write appends one LT_PROF_TRACE_EVENTS record (under TraceLock), so
+// the trace file is only complete once the process has exited.
+//
+// When the process exits, the buffers of the running threads are read while
+// their owners might still be recording events. The owner first claims the
+// next entry (by advancing Claimed), then writes the event and finally
+// commits it (by advancing Committed):
+//  * the reader only copies the committed events
+//  * after the copy, the events that might have been overwritten in the
+//    meantime (i.e. the oldest events, up to the last claimed entry) are
+//    dropped
+
+// The default number of events per thread
+#define LT_RT_DEFAULT_TRACE_BUFFER_SIZE 65536
+
+// The minimum interval used to measure the TSC frequency
+#define LT_RT_TSC_CALIBRATION_NS 1000000
+
+typedef struct TraceBuffer {
+  LTProfTraceEvent *Events;
+  // The number of entries minus 1 (the size is a power of 2)
+  uint64_t Mask;
+  // The number of events claimed and committed so far. Entry `N & Mask`
+  // holds event N.
+  uint64_t Claimed;
+  uint64_t Committed;
+  // The number of events written (or dropped) so far. Only updated under
+  // TraceLock, but the owner reads it without taking the lock.
+  uint64_t Written;
+  uint64_t Thread;
+  // The buffers of the running threads (protected by TraceLock)
+  struct TraceBuffer *Prev;
+  struct TraceBuffer *Next;
+} TraceBuffer;
+
+static pthread_once_t TraceOnce = PTHREAD_ONCE_INIT;
+// Serialises the writes to the trace file and protects the state below
+static pthread_mutex_t TraceLock = PTHREAD_MUTEX_INITIALIZER;
+// The trace file (-1 if it couldn't be opened)
+static int TraceFD = -1;
+// The number of events per thread (a power of 2)
+static uint64_t TraceBufferSize = LT_RT_DEFAULT_TRACE_BUFFER_SIZE;
+// Set for LT_RT_TRACE_FLUSH=full
+static int TraceFlushWhenFull = 0;
+// The clocks when tracing started (used to measure the TSC frequency)
+static uint64_t TraceStartTicks = 0;
+static uint64_t TraceStartNs = 0;
+static uint32_t NextFunctionId = 0;
+static uint64_t NextThread = 1;
+static TraceBuffer *RunningThreads = NULL;
+// The registered modules (their function names are written again to the
+// trace file of a forked child)
+static LTRTTraceModule **TraceModules = NULL;
+static size_t NumTraceModules = 0;
+// Set once the process has written the buffers of the running threads. The
+// threads that exit later don't write theirs.
+static int TraceFinished = 0;
+// The destructor of this key writes the buffer of an exiting thread
+static pthread_key_t TraceKey;
+
+static __thread TraceBuffer *ThreadTrace = NULL;
+// Set once the buffer of this thread is gone (i.e. the thread is exiting).
+// Events recorded later (e.g. from other thread-exit hooks) are ignored.
+static __thread int ThreadTraceDone = 0;
+
+// Returns the rate of readClock(). The TSC frequency is measured against the
+// monotonic clock since tracing started (waiting if that was too recent).
+static uint64_t getTraceTicksPerSecond(void) {
+  if (ClockUnit != LT_PROF_TIME_CYCLES)
+    return 1000000000ULL;
+
+  uint64_t Ns, Ticks;
+  for (;;) {
+    Ns = readMonotonicClock();
+    Ticks = readClock();
+    if (Ns - TraceStartNs >= LT_RT_TSC_CALIBRATION_NS)
+      break;
+    struct timespec Delay = {0, LT_RT_TSC_CALIBRATION_NS};
+    nanosleep(&Delay, NULL);
+  }
+  return (uint64_t)((double)(Ticks - TraceStartTicks) * 1e9 /
+                    (double)(Ns - TraceStartNs));
+}
+
+// Writes the LT_PROF_TRACE_FUNCTIONS record for Module. Expects TraceLock to
+// be held.
+static int writeTraceFunctions(const LTRTTraceModule *Module) {
+  static const char Zeros[8] = {0};
+  uint64_t Padding = (8 - Module->NamesSize % 8) % 8;
+
+  LTProfRecordHeader Header;
+  Header.Magic = LT_PROF_MAGIC;
+  Header.Version = LT_PROF_VERSION;
+  Header.Kind = LT_PROF_TRACE_FUNCTIONS;
+  Header.Size =
+      sizeof(LTProfTraceFunctionsHeader) + Module->NamesSize + Padding;
+
+  LTProfTraceFunctionsHeader FunctionsHeader;
+  FunctionsHeader.FirstId = Module->FirstId;
+  FunctionsHeader.NumFunctions = Module->NumFunctions;
+  FunctionsHeader.NamesSize = Module->NamesSize;
+
+  if (writeAll(TraceFD, &Header, sizeof(Header)) ||
+      writeAll(TraceFD, &FunctionsHeader, sizeof(FunctionsHeader)) ||
+      writeAll(TraceFD, Module->Names, Module->NamesSize) ||
+      writeAll(TraceFD, Zeros, Padding))
+    return -1;
+  return 0;
+}
+
+// Writes the events of Buf that haven't been written yet (as one
+// LT_PROF_TRACE_EVENTS record). Expects TraceLock to be held.
+static int writeTraceEvents(TraceBuffer *Buf) {
+  uint64_t Size = Buf->Mask + 1;
+  uint64_t End = __atomic_load_n(&Buf->Committed, __ATOMIC_ACQUIRE);
+  uint64_t Begin = End > Size ? End - Size : 0;
+  if (Begin < Buf->Written)
+    Begin = Buf->Written;
+
+  LTProfTraceEvent *Events = NULL;
+  if (End > Begin &&
+      !(Events = (LTProfTraceEvent *)malloc((End - Begin) * sizeof(*Events))))
+    return -1;
+  for (uint64_t I = Begin; I < End; I++) {
+    LTProfTraceEvent *Event = &Buf->Events[I & Buf->Mask];
+    Events[I - Begin].Timestamp =
+        __atomic_load_n(&Event->Timestamp, __ATOMIC_RELAXED);
+    Events[I - Begin].Function =
+        __atomic_load_n(&Event->Function, __ATOMIC_RELAXED);
+    Events[I - Begin].NumArgs =
+        __atomic_load_n(&Event->NumArgs, __ATOMIC_RELAXED);
+    Events[I - Begin].Kind = __atomic_load_n(&Event->Kind, __ATOMIC_RELAXED);
+  }
+
+  // Drop the events that the owner might have overwritten during the copy
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  uint64_t Claimed = __atomic_load_n(&Buf->Claimed, __ATOMIC_RELAXED);
+  uint64_t Valid = Claimed > Size ? Claimed - Size : 0;
+  uint64_t Skip = Valid > Begin ? Valid - Begin : 0;
+  if (Skip > End - Begin)
+    Skip = End - Begin;
+
+  LTProfRecordHeader Header;
+  Header.Magic = LT_PROF_MAGIC;
+  Header.Version = LT_PROF_VERSION;
+  Header.Kind = LT_PROF_TRACE_EVENTS;
+  Header.Size = sizeof(LTProfTraceEventsHeader) +
+                (End - Begin - Skip) * sizeof(LTProfTraceEvent);
+
+  LTProfTraceEventsHeader EventsHeader;
+  EventsHeader.Thread = Buf->Thread;
+  EventsHeader.NumEvents = End - Begin - Skip;
+  EventsHeader.Dropped = Begin + Skip - Buf->Written;
+  EventsHeader.Unit = ClockUnit;
+  EventsHeader.TicksPerSecond = getTraceTicksPerSecond();
+  __atomic_store_n(&Buf->Written, End, __ATOMIC_RELAXED);
+
+  int Ret = -1;
+  if (!writeAll(TraceFD, &Header, sizeof(Header)) &&
+      !writeAll(TraceFD, &EventsHeader, sizeof(EventsHeader)) &&
+      !writeAll(TraceFD, Events + Skip,
+                EventsHeader.NumEvents * sizeof(LTProfTraceEvent)))
+    Ret = 0;
+  free(Events);
+  return Ret;
+}
+
+// Writes the buffer of the exiting thread (Arg) and frees it
+static void onTraceThreadExit(void *Arg) {
+  TraceBuffer *Buf = (TraceBuffer *)Arg;
+  ThreadTrace = NULL;
+  ThreadTraceDone = 1;
+
+  pthread_mutex_lock(&TraceLock);
+  if (Buf->Prev)
+    Buf->Prev->Next = Buf->Next;
+  else
+    RunningThreads = Buf->Next;
+  if (Buf->Next)
+    Buf->Next->Prev = Buf->Prev;
+  if (!TraceFinished && writeTraceEvents(Buf))
+    perror("lt_rt: failed to write the trace");
+  pthread_mutex_unlock(&TraceLock);
+
+  free(Buf->Events);
+  free(Buf);
+}
+
+static const char *getTracePattern(void) {
+  const char *Path = getenv(LT_TRACE_FILE_ENV_VAR);
+  return (Path && *Path) ? Path : LT_TRACE_DEFAULT_FILE;
+}
+
+// Opens (and truncates) the trace file. Returns -1 on failure.
+static int openTraceFile(void) {
+  char Path[PATH_MAX];
+  if (expandPath(getTracePattern(), Path, sizeof(Path))) {
+    fprintf(stderr, "lt_rt: trace path too long: '%s'\n", getTracePattern());
+    return -1;
+  }
+
+  TraceFD = open(Path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC,
+                 0644);
+  if (TraceFD < 0) {
+    fprintf(stderr, "lt_rt: failed to open '%s': %s\n", Path,
+            strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
+static void initTrace(void) {
+  // Forked children need their own trace file (see resetTraceInChild)
+  pthread_once(&ForkOnce, installForkHandlers);
+
+  TraceStartNs = readMonotonicClock();
+  TraceStartTicks = readClock();
+
+  const char *SizeStr = getenv(LT_RT_TRACE_BUFFER_SIZE_ENV_VAR);
+  if (SizeStr && *SizeStr) {
+    long long Size = strtoll(SizeStr, NULL, 10);
+    if (Size > 0 && Size <= (1LL << 32)) {
+      TraceBufferSize = 1;
+      while (TraceBufferSize < (uint64_t)Size)
+        TraceBufferSize *= 2;
+    } else {
+      fprintf(stderr, "lt_rt: ignoring invalid %s: '%s'\n",
+              LT_RT_TRACE_BUFFER_SIZE_ENV_VAR, SizeStr);
+    }
+  }
+
+  const char *Flush = getenv(LT_RT_TRACE_FLUSH_ENV_VAR);
+  if (Flush && !strcmp(Flush, "full")) {
+    TraceFlushWhenFull = 1;
+  } else if (Flush && *Flush && strcmp(Flush, "exit")) {
+    fprintf(stderr, "lt_rt: ignoring unsupported %s: '%s'\n",
+            LT_RT_TRACE_FLUSH_ENV_VAR, Flush);
+  }
+
+  if (openTraceFile())
+    return;
+
+  if (pthread_key_create(&TraceKey, onTraceThreadExit)) {
+    fprintf(stderr, "lt_rt: failed to create the trace key\n");
+    close(TraceFD);
+    TraceFD = -1;
+  }
+}
+
+// Creates the buffer of the calling thread. Returns NULL if the thread can't
+// record events.
+static TraceBuffer *createThreadTrace(void) {
+  if (ThreadTraceDone || TraceFD < 0)
+    return NULL;
+  // Don't try again if this fails
+  ThreadTraceDone = 1;
+
+  TraceBuffer *Buf = (TraceBuffer *)calloc(1, sizeof(TraceBuffer));
+  if (!Buf)
+    return NULL;
+  Buf->Events =
+      (LTProfTraceEvent *)malloc(TraceBufferSize * sizeof(LTProfTraceEvent));
+  if (!Buf->Events || pthread_setspecific(TraceKey, Buf)) {
+    free(Buf->Events);
+    free(Buf);
+    return NULL;
+  }
+  Buf->Mask = TraceBufferSize - 1;
+
+  pthread_mutex_lock(&TraceLock);
+  Buf->Thread = NextThread++;
+  Buf->Next = RunningThreads;
+  if (RunningThreads)
+    RunningThreads->Prev = Buf;
+  RunningThreads = Buf;
+  pthread_mutex_unlock(&TraceLock);
+
+  ThreadTraceDone = 0;
+  return ThreadTrace = Buf;
+}
+
+// Writes the full buffer of the calling thread (LT_RT_TRACE_FLUSH=full)
+static void flushThreadTrace(TraceBuffer *Buf) {
+  pthread_mutex_lock(&TraceLock);
+  if (!TraceFinished && writeTraceEvents(Buf))
+    perror("lt_rt: failed to write the trace");
+  // Once the process has written the trace, the later events are discarded
+  __atomic_store_n(&Buf->Written, Buf->Committed, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&TraceLock);
+}
+
+// Appends an event to the buffer of the calling thread. Value is recorded
+// instead of the time if Kind is one of the argument events.
+static inline void appendTraceEvent(uint32_t Function, uint32_t NumArgs,
+                                    uint16_t Kind, uint64_t Value) {
+  TraceBuffer *Buf = ThreadTrace;
+  if (__builtin_expect(!Buf, 0) && !(Buf = createThreadTrace()))
+    return;
+
+  // Only this thread writes to Buf (see "Function tracing")
+  uint64_t N = Buf->Claimed;
+  if (TraceFlushWhenFull &&
+      N - __atomic_load_n(&Buf->Written, __ATOMIC_RELAXED) > Buf->Mask)
+    flushThreadTrace(Buf);
+
+  uint64_t Timestamp = Kind == LT_PROF_TRACE_ARGUMENT ||
+                               Kind == LT_PROF_TRACE_POINTER_ARGUMENT
+                           ? Value
+                           : readClock();
+  __atomic_store_n(&Buf->Claimed, N + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  LTProfTraceEvent *Event = &Buf->Events[N & Buf->Mask];
+  __atomic_store_n(&Event->Timestamp, Timestamp, __ATOMIC_RELAXED);
+  __atomic_store_n(&Event->Function, Function, __ATOMIC_RELAXED);
+  __atomic_store_n(&Event->NumArgs,
+                   NumArgs > UINT16_MAX ? UINT16_MAX : (uint16_t)NumArgs,
+                   __ATOMIC_RELAXED);
+  __atomic_store_n(&Event->Kind, Kind, __ATOMIC_RELAXED);
+  __atomic_store_n(&Buf->Committed, N + 1, __ATOMIC_RELEASE);
+}
+
+// Appends a function entry or exit event to the buffer of the calling thread
+static inline void recordTraceEvent(uint32_t Function, uint32_t NumArgs,
+                                    uint16_t Kind) {
+  appendTraceEvent(Function, NumArgs, Kind, 0);
+}
+
+// Writes the buffers of the threads that are still running. Their events
+// recorded from now on are lost.
+static void finishTrace(void) {
+  pthread_mutex_lock(&TraceLock);
+  if (TraceFD >= 0 && !TraceFinished) {
+    // Oldest thread first
+    TraceBuffer *Buf = RunningThreads;
+    while (Buf && Buf->Next)
+      Buf = Buf->Next;
+    for (; Buf; Buf = Buf->Prev)
+      if (writeTraceEvents(Buf))
+        perror("lt_rt: failed to write the trace");
+    TraceFinished = 1;
+  }
+  pthread_mutex_unlock(&TraceLock);
+}
+
+// Gives a forked child its own trace file and drops what it inherited from
+// the parent: the buffers of the other threads (which don't exist in the
+// child) and the events that the forking thread recorded before fork() (which
+// are in the parent's trace). The forking thread becomes thread 1 of the new
+// trace. Runs in the child.
+static void resetTraceInChild(void) {
+  if (TraceFD < 0)
+    return;
+
+  TraceBuffer *Own = ThreadTrace;
+  TraceBuffer *Buf = RunningThreads;
+  while (Buf) {
+    TraceBuffer *Next = Buf->Next;
+    if (Buf != Own) {
+      free(Buf->Events);
+      free(Buf);
+    }
+    Buf = Next;
+  }
+  NextThread = 1;
+  RunningThreads = Own;
+  if (Own) {
+    Own->Prev = Own->Next = NULL;
+    Own->Claimed = Own->Committed = Own->Written = 0;
+    Own->Thread = NextThread++;
+  }
+
+  close(TraceFD);
+  TraceFD = -1;
+  TraceFinished = 0;
+  if (openTraceFile()) {
+    // The buffer of this thread is still there - don't try to write it
+    TraceFinished = 1;
+    return;
+  }
+  for (size_t I = 0; I < NumTraceModules; I++)
+    if (writeTraceFunctions(TraceModules[I]))
+      perror("lt_rt: failed to write the trace");
+}
+
+//------------------------------------------------------------------------------
+// Patchable sleds (`inject-func-call<trace=patchable>`)
+//------------------------------------------------------------------------------
+// The functions traced in the `trace=patchable` mode contain XRay sleds, which
+// the backend emits at the function entry, before every return and before
+// every tail call. On x86-64, the sleds look as follows:
+//    entry, tail call:  jmp .+11; <9-byte nop>    (i.e. skip the sled)
+//    exit:              ret; <10-byte nop>
+// and the backend records their addresses in the `xray_instr_map` section.
+// Patching replaces the beginning of every sled with an indirect call to the
+// trampoline (through LTRTPatchableModule::Trampoline):
+//    entry, tail call:  call *Trampoline(%rip); <5-byte nop>
+//    exit:              call *Trampoline(%rip); ret
+// The trampoline preserves the registers that carry the arguments and the
+// return values and passes its return address (which identifies the sled) to
+// __lt_rt_handle_sled, which records the trace event.
+//
+// The other threads keep running while the sleds are patched. The tail of a
+// sled is written first (while its first two bytes still skip it or return)
+// and then the first two bytes are replaced with one atomic store (the sleds
+// are 2-byte aligned, so the store never straddles a cache line). Unpatching
+// only restores the first two bytes, so threads that are still inside the
+// trampoline return to valid instructions.
+
+// The layout of an `xray_instr_map` entry (see XRaySledEntry in
+// compiler-rt/lib/xray/xray_interface_internal.h)
+typedef struct XRaySledEntry {
+  // Since version 2, both addresses are relative to the field itself
+  uint64_t Address;
+  uint64_t Function;
+  uint8_t Kind;
+  uint8_t AlwaysInstrument;
+  uint8_t Version;
+  uint8_t Padding[13];
+} XRaySledEntry;
+
+// XRaySledEntry::Kind
+#define XRAY_SLED_ENTRY 0
+#define XRAY_SLED_EXIT 1
+#define XRAY_SLED_TAIL 2
+
+// A sled of a registered module
+typedef struct PatchSled {
+  uintptr_t Address;
+  // The function ID and the number of arguments of the enclosing function
+  uint32_t Function;
+  uint32_t NumArgs;
+  // Where the patched sled finds the trampoline
+  void *const *Trampoline;
+  // The first two bytes of the disabled sled
+  uint16_t Original;
+  // LT_PROF_TRACE_ENTRY or LT_PROF_TRACE_EXIT (tail calls leave the function)
+  uint16_t Kind;
+} PatchSled;
+
+// The sleds of all registered modules, sorted by address. The table is
+// replaced (rather than modified) when a module is registered, because
+// __lt_rt_handle_sled reads it without taking a lock. The old tables are never
+// freed - a thread might still be reading one.
+typedef struct PatchTable {
+  size_t NumSleds;
+  PatchSled Sleds[];
+} PatchTable;
+
+static pthread_once_t PatchOnce = PTHREAD_ONCE_INIT;
+// Serialises patching and protects the state below
+static pthread_mutex_t PatchLock = PTHREAD_MUTEX_INITIALIZER;
+static PatchTable *Sleds = NULL;
+// Set while the sleds are (meant to be) patched
+static int Patched = 0;
+
+#if defined(__x86_64__) && defined(__ELF__)
+#define LT_RT_HAS_PATCHING 1
+
+// `call *disp32(%rip)`
+#define LT_RT_SLED_CALL_SIZE 6
+// The bytes replaced in every sled (i.e. the size of the shortest sled)
+#define LT_RT_SLED_SIZE 11
+
+void __lt_rt_sled_trampoline(void);
+
+// Saves the argument and return value registers (with the stack aligned to 16
+// bytes), calls __lt_rt_handle_sled with the return address and restores the
+// registers. x87 registers are not saved - the C code doesn't use them.
+__asm__(".text\n"
+        ".p2align 4\n"
+        ".globl __lt_rt_sled_trampoline\n"
+        ".hidden __lt_rt_sled_trampoline\n"
+        ".type __lt_rt_sled_trampoline, @function\n"
+        "__lt_rt_sled_trampoline:\n"
+        "  .cfi_startproc\n"
+        "  endbr64\n"
+        "  pushq %rbp\n"
+        "  .cfi_def_cfa_offset 16\n"
+        "  .cfi_offset %rbp, -16\n"
+        "  movq %rsp, %rbp\n"
+        "  .cfi_def_cfa_register %rbp\n"
+        "  subq $200, %rsp\n"
+        "  movdqu %xmm0, 0(%rsp)\n"
+        "  movdqu %xmm1, 16(%rsp)\n"
+        "  movdqu %xmm2, 32(%rsp)\n"
+        "  movdqu %xmm3, 48(%rsp)\n"
+        "  movdqu %xmm4, 64(%rsp)\n"
+        "  movdqu %xmm5, 80(%rsp)\n"
+        "  movdqu %xmm6, 96(%rsp)\n"
+        "  movdqu %xmm7, 112(%rsp)\n"
+        "  movq %rdi, 128(%rsp)\n"
+        "  movq %rsi, 136(%rsp)\n"
+        "  movq %rdx, 144(%rsp)\n"
+        "  movq %rcx, 152(%rsp)\n"
+        "  movq %r8, 160(%rsp)\n"
+        "  movq %r9, 168(%rsp)\n"
+        "  movq %rax, 176(%rsp)\n"
+        "  movq %r10, 184(%rsp)\n"
+        "  movq %r11, 192(%rsp)\n"
+        "  movq 8(%rbp), %rdi\n"
+        "  call __lt_rt_handle_sled\n"
+        "  movdqu 0(%rsp), %xmm0\n"
+        "  movdqu 16(%rsp), %xmm1\n"
+        "  movdqu 32(%rsp), %xmm2\n"
+        "  movdqu 48(%rsp), %xmm3\n"
+        "  movdqu 64(%rsp), %xmm4\n"
+        "  movdqu 80(%rsp), %xmm5\n"
+        "  movdqu 96(%rsp), %xmm6\n"
+        "  movdqu 112(%rsp), %xmm7\n"
+        "  movq 128(%rsp), %rdi\n"
+        "  movq 136(%rsp), %rsi\n"
+        "  movq 144(%rsp), %rdx\n"
+        "  movq 152(%rsp), %rcx\n"
+        "  movq 160(%rsp), %r8\n"
+        "  movq 168(%rsp), %r9\n"
+        "  movq 176(%rsp), %rax\n"
+        "  movq 184(%rsp), %r10\n"
+        "  movq 192(%rsp), %r11\n"
+        "  movq %rbp, %rsp\n"
+        "  popq %rbp\n"
+        "  .cfi_def_cfa %rsp, 8\n"
+        "  ret\n"
+        "  .cfi_endproc\n"
+        ".size __lt_rt_sled_trampoline, .-__lt_rt_sled_trampoline\n");
+
+// Called by the trampoline
+__attribute__((visibility("hidden"), used)) void
+__lt_rt_handle_sled(uintptr_t ReturnAddress);
+void __lt_rt_handle_sled(uintptr_t ReturnAddress) {
+  const PatchTable *Table = __atomic_load_n(&Sleds, __ATOMIC_ACQUIRE);
+  if (!Table)
+    return;
+
+  uintptr_t Address = ReturnAddress - LT_RT_SLED_CALL_SIZE;
+  size_t Lo = 0, Hi = Table->NumSleds;
+  while (Lo < Hi) {
+    size_t Mid = Lo + (Hi - Lo) / 2;
+    if (Table->Sleds[Mid].Address < Address)
+      Lo = Mid + 1;
+    else
+      Hi = Mid;
+  }
+  if (Lo == Table->NumSleds || Table->Sleds[Lo].Address != Address)
+    return;
+
+  const PatchSled *Sled = &Table->Sleds[Lo];
+  recordTraceEvent(Sled->Function, Sled->NumArgs, Sled->Kind);
+}
+
+// Returns 0 if the sled at Address has the expected layout (and stores its
+// first two bytes in Original)
+static int checkSled(uintptr_t Address, uint8_t Kind, uint16_t *Original) {
+  const uint8_t *Bytes = (const uint8_t *)Address;
+  if (Address % 2)
+    return -1;
+  if (Kind == XRAY_SLED_EXIT ? Bytes[0] != 0xc3
+                             : (Bytes[0] != 0xeb || Bytes[1] != 0x09))
+    return -1;
+  memcpy(Original, Bytes, sizeof(*Original));
+  return 0;
+}
+
+// Patches (Enable == 1) or restores (Enable == 0) Sled. The code has to be
+// writable.
+static int patchSled(const PatchSled *Sled, int Enable) {
+  uint16_t *First = (uint16_t *)Sled->Address;
+  if (!Enable) {
+    __atomic_store_n(First, Sled->Original, __ATOMIC_RELEASE);
+    return 0;
+  }
+
+  intptr_t Disp = (intptr_t)Sled->Trampoline -
+                  (intptr_t)(Sled->Address + LT_RT_SLED_CALL_SIZE);
+  if (Disp < INT32_MIN || Disp > INT32_MAX)
+    return -1;
+  int32_t Disp32 = (int32_t)Disp;
+
+  uint8_t *Bytes = (uint8_t *)Sled->Address;
+  memcpy(Bytes + 2, &Disp32, sizeof(Disp32));
+  if ((Sled->Original & 0xff) == 0xc3) {
+    Bytes[LT_RT_SLED_CALL_SIZE] = 0xc3;
+  } else {
+    static const uint8_t Nop5[] = {0x0f, 0x1f, 0x44, 0x00, 0x00};
+    memcpy(Bytes + LT_RT_SLED_CALL_SIZE, Nop5, sizeof(Nop5));
+  }
+  // `call *disp32(%rip)` is `ff 15 <disp32>`
+  __atomic_store_n(First, (uint16_t)0x15ff, __ATOMIC_RELEASE);
+  return 0;
+}
+
+// Makes the pages in [Begin, End) writable (Writable == 1) or read-only and
+// executable again (Writable == 0)
+static int protectCode(uintptr_t Begin, uintptr_t End, int Writable) {
+  int Prot = PROT_READ | PROT_EXEC | (Writable ? PROT_WRITE : 0);
+  if (mprotect((void *)Begin, End - Begin, Prot)) {
+    perror("lt_rt: failed to change the protection of the code");
+    return -1;
+  }
+  return 0;
+}
+
+// Patches or restores Sleds[0, NumSleds) (sorted by address). Expects
+// PatchLock to be held. The pages that contain sleds are made writable one
+// run of adjacent pages at a time.
+static int patchSleds(const PatchSled *Sleds, size_t NumSleds, int Enable) {
+  uintptr_t PageSize = (uintptr_t)sysconf(_SC_PAGESIZE);
+  int Ret = 0;
+  size_t I = 0;
+  while (I < NumSleds) {
+    uintptr_t Begin = Sleds[I].Address & ~(PageSize - 1);
+    uintptr_t End = (Sleds[I].Address + LT_RT_SLED_SIZE + PageSize - 1) &
+                    ~(PageSize - 1);
+    size_t Last = I + 1;
+    for (; Last < NumSleds && Sleds[Last].Address < End + PageSize; Last++)
+      End = (Sleds[Last].Address + LT_RT_SLED_SIZE + PageSize - 1) &
+            ~(PageSize - 1);
+
+    if (protectCode(Begin, End, 1))
+      return -1;
+    for (; I < Last; I++)
+      if (patchSled(&Sleds[I], Enable))
+        Ret = -1;
+    if (protectCode(Begin, End, 0))
+      return -1;
+  }
+
+  if (Ret)
+    fprintf(stderr, "lt_rt: some sleds are too far from the trampoline\n");
+  return Ret;
+}
+#else
+static int patchSleds(const PatchSled *Sleds, size_t NumSleds, int Enable) {
+  (void)Sleds;
+  (void)NumSleds;
+  (void)Enable;
+  fprintf(stderr, "lt_rt: patching is not supported on this platform\n");
+  return -1;
+}
+#endif
+
+static int comparePatchSleds(const void *LHS, const void *RHS) {
+  const PatchSled *A = (const PatchSled *)LHS;
+  const PatchSled *B = (const PatchSled *)RHS;
+  return (A->Address > B->Address) - (A->Address < B->Address);
+}
+
+// Collects the sleds of the functions of Module (from the sled table of the
+// enclosing binary, which also contains the sleds of the other modules). On
+// success, returns the sleds (sorted by address) and their number in
+// NumModuleSleds.
+static PatchSled *collectSleds(const LTRTPatchableModule *Module,
+                               size_t *NumModuleSleds) {
+  *NumModuleSleds = 0;
+  const XRaySledEntry *Begin = (const XRaySledEntry *)Module->SledsBegin;
+  const XRaySledEntry *End = (const XRaySledEntry *)Module->SledsEnd;
+  uint64_t NumFunctions = Module->Trace.NumFunctions;
+  if (!Begin || End <= Begin || !NumFunctions)
+    return NULL;
+
+  FunctionAddress *Addresses =
+      (FunctionAddress *)calloc(NumFunctions, sizeof(FunctionAddress));
+  PatchSled *Result = (PatchSled *)calloc(End - Begin, sizeof(PatchSled));
+  if (!Addresses || !Result) {
+    free(Addresses);
+    free(Result);
+    return NULL;
+  }
+  for (uint64_t Slot = 0; Slot < NumFunctions; Slot++) {
+    Addresses[Slot].Address = Module->Functions[Slot];
+    Addresses[Slot].Slot = Slot;
+  }
+  qsort(Addresses, NumFunctions, sizeof(FunctionAddress),
+        compareFunctionAddresses);
+
+  size_t NumSleds = 0, NumUnsupported = 0;
+  for (const XRaySledEntry *Entry = Begin; Entry < End; Entry++) {
+    uintptr_t Address = (uintptr_t)Entry->Address;
+    uintptr_t Function = (uintptr_t)Entry->Function;
+    if (Entry->Version >= 2) {
+      Address += (uintptr_t)&Entry->Address;
+      Function += (uintptr_t)&Entry->Function;
+    }
+
+    // Skip the sleds of the other modules
+    FunctionAddress Key = {(void *)Function, 0};
+    const FunctionAddress *Found = (const FunctionAddress *)bsearch(
+        &Key, Addresses, NumFunctions, sizeof(FunctionAddress),
+        compareFunctionAddresses);
+    if (!Found)
+      continue;
+
+    PatchSled *Sled = &Result[NumSleds];
+    if (Entry->Kind > XRAY_SLED_TAIL
+#ifdef LT_RT_HAS_PATCHING
+        || checkSled(Address, Entry->Kind, &Sled->Original)
+#endif
+    ) {
+      NumUnsupported++;
+      continue;
+    }
+    Sled->Address = Address;
+    Sled->Function = Module->Trace.FirstId + (uint32_t)Found->Slot;
+    Sled->Kind = Entry->Kind == XRAY_SLED_ENTRY ? LT_PROF_TRACE_ENTRY
+                                                : LT_PROF_TRACE_EXIT;
+    Sled->NumArgs =
+        Sled->Kind == LT_PROF_TRACE_ENTRY ? Module->NumArgs[Found->Slot] : 0;
+    Sled->Trampoline = (void *const *)&Module->Trampoline;
+    NumSleds++;
+  }
+  free(Addresses);
+
+  if (NumUnsupported)
+    fprintf(stderr, "lt_rt: ignoring %zu unsupported sled(s)\n",
+            NumUnsupported);
+  qsort(Result, NumSleds, sizeof(PatchSled), comparePatchSleds);
+  *NumModuleSleds = NumSleds;
+  return Result;
+}
+
+static void initPatching(void) {
+  const char *Patch = getenv(LT_RT_PATCH_ENV_VAR);
+  if (Patch && !strcmp(Patch, "1"))
+    Patched = 1;
+  else if (Patch && *Patch && strcmp(Patch, "0"))
+    fprintf(stderr, "lt_rt: ignoring invalid %s: '%s'\n", LT_RT_PATCH_ENV_VAR,
+            Patch);
+}
+
+// Patches (Enable == 1) or restores (Enable == 0) the sleds of all registered
+// modules. Expects PatchLock to be held.
+static int setPatched(int Enable) {
+  if (Patched == Enable)
+    return 0;
+  Patched = Enable;
+  return Sleds ? patchSleds(Sleds->Sleds, Sleds->NumSleds, Enable) : 0;
+}
+
+// Called from the background thread on LT_RT_PATCH_SIGNAL
+static void togglePatched(void) {
+  pthread_mutex_lock(&PatchLock);
+  setPatched(!Patched);
+  pthread_mutex_unlock(&PatchLock);
+}
+
+// Accepts signal numbers as well as names with or without the `SIG` prefix,
+// e.g. `10`, `USR1` and `SIGUSR1`. Returns 0 for unsupported values.
+static int parseSignal(const char *Str) {
+  static const struct {
+    const char *Name;
+    int Number;
+  } Signals[] = {{"USR1", SIGUSR1}, {"USR2", SIGUSR2}, {"HUP", SIGHUP}};
+
+  if (!Str || !*Str)
+    return 0;
+
+  char *End = NULL;
+  long Number = strtol(Str, &End, 10);
+  if (*End == '\0')
+    return (Number > 0 && Number < NSIG) ? (int)Number : 0;
+
+  if (strncasecmp(Str, "SIG", 3) == 0)
+    Str += 3;
+  for (size_t I = 0; I < sizeof(Signals) / sizeof(Signals[0]); I++)
+    if (strcasecmp(Str, Signals[I].Name) == 0)
+      return Signals[I].Number;
+
+  return 0;
+}
+
+// The requests sent to the background thread through WakeupPipe
+#define LT_RT_WAKEUP_FLUSH 'F'
+#define LT_RT_WAKEUP_PATCH 'P'
+
+static void wakeUp(char Request) {
+  int SavedErrno = errno;
+  // If the pipe is full then plenty of requests are pending already
+  ssize_t Ignored = write(WakeupPipe[1], &Request, 1);
+  (void)Ignored;
+  errno = SavedErrno;
+}
+
+static void onFlushSignal(int Signal) {
+  (void)Signal;
+  wakeUp(LT_RT_WAKEUP_FLUSH);
+}
+
+static void onPatchSignal(int Signal) {
+  (void)Signal;
+  wakeUp(LT_RT_WAKEUP_PATCH);
+}
+
+static void *flusherMain(void *Arg) {
+  (void)Arg;
+  // Leave the signals to the application threads
+  sigset_t AllSignals;
+  sigfillset(&AllSignals);
+  pthread_sigmask(SIG_BLOCK, &AllSignals, NULL);
+
+  struct pollfd WakeupFD = {WakeupPipe[0], POLLIN, 0};
+  nfds_t NumFDs = WakeupPipe[0] >= 0 ? 1 : 0;
+  int Timeout = FlushIntervalMs > 0 ? FlushIntervalMs : -1;
+
+  for (;;) {
+    int Ret = poll(&WakeupFD, NumFDs, Timeout);
+    if (Ret < 0) {
+      if (errno == EINTR)
+        continue;
+      return NULL;
+    }
+
+    // Coalesce all pending flush requests into one snapshot
+    int Flush = Ret == 0, Toggles = 0;
+    if (Ret > 0) {
+      char Buf[64];
+      ssize_t Size;
+      while ((Size = read(WakeupPipe[0], Buf, sizeof(Buf))) > 0)
+        for (ssize_t I = 0; I < Size; I++) {
+          if (Buf[I] == LT_RT_WAKEUP_PATCH)
+            Toggles++;
+          else
+            Flush = 1;
+        }
+    }
+
+    if (Toggles % 2)
+      togglePatched();
+    if (Flush && ModulesHead)
+      lt_rt_flush();
+  }
+
+  return NULL;
+}
+
+static int setFlags(int FD) {
+  int Flags = fcntl(FD, F_GETFL);
+  if (Flags < 0 || fcntl(FD, F_SETFL, Flags | O_NONBLOCK) < 0)
+    return -1;
+  return fcntl(FD, F_SETFD, FD_CLOEXEC);
+}
+
+static int createWakeupPipe(void) {
+  if (pipe(WakeupPipe) || setFlags(WakeupPipe[0]) ||
+      setFlags(WakeupPipe[1])) {
+    perror("lt_rt: failed to create the wake-up pipe");
+    for (int I = 0; I < 2; I++)
+      if (WakeupPipe[I] >= 0)
+        close(WakeupPipe[I]);
+    WakeupPipe[0] = WakeupPipe[1] = -1;
+    return -1;
+  }
+  return 0;
+}
+
+// Set once the flusher thread is running
+static int FlusherStarted = 0;
+
+static void startFlusher(void) {
+  pthread_t Flusher;
+  pthread_attr_t Attr;
+  pthread_attr_init(&Attr);
+  pthread_attr_setdetachstate(&Attr, PTHREAD_CREATE_DETACHED);
+  if (pthread_create(&Flusher, &Attr, flusherMain, NULL))
+    fprintf(stderr, "lt_rt: failed to start the flusher thread\n");
+  else
+    FlusherStarted = 1;
+  pthread_attr_destroy(&Attr);
+}
+
+//------------------------------------------------------------------------------
+// Live counters
+//------------------------------------------------------------------------------
+// The counter tables of the modules instrumented in the `shm` mode are moved
+// into a POSIX shared-memory segment (see ProfileFormat.h), from which other
+// processes (e.g. lt-top) can read the live counts. The tables are page
+// aligned and cover whole pages (see LT_RT_SHM_ALIGNMENT), so the segment is
+// mapped over them: the instrumented code keeps incrementing the same
+// addresses, without any extra instructions or system calls.
+//
+// The segment is created when the first such module is registered and
+// removed when the process exits. Forked children don't export their
+// counters (see "fork() support").
+
+// Protects the following
+static pthread_mutex_t ShmLock = PTHREAD_MUTEX_INITIALIZER;
+static int ShmFD = -1;
+// The first page of the segment
+static LTShmHeader *ShmHeader = NULL;
+static char ShmName[64];
+
+static uint64_t roundUpToPage(uint64_t Size) {
+  uint64_t PageSize = (uint64_t)sysconf(_SC_PAGESIZE);
+  return (Size + PageSize - 1) / PageSize * PageSize;
+}
+
+// Returns 1 if the counter table of Module can be replaced with a mapping of
+// the segment
+static int canExportModule(const LTRTModule *Module) {
+  return (Module->Flags & LT_RT_MODULE_SHM) && Module->NumCounters &&
+         sysconf(_SC_PAGESIZE) <= LT_RT_SHM_ALIGNMENT &&
+         (uintptr_t)Module->Counters % LT_RT_SHM_ALIGNMENT == 0;
+}
+
+static const char *getProgramName(void) {
+#ifdef __APPLE__
+  return getprogname();
+#else
+  return program_invocation_short_name;
+#endif
+}
+
+// Creates the segment (and maps its first page). Expects ShmLock to be held.
+static int createSegment(void) {
+  snprintf(ShmName, sizeof(ShmName), "%s%ld", LT_SHM_NAME_PREFIX,
+           (long)getpid());
+  // A segment left behind by an earlier process with the same PID
+  shm_unlink(ShmName);
+  ShmFD = shm_open(ShmName, O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (ShmFD < 0)
+    return -1;
+
+  uint64_t HeaderSize = roundUpToPage(sizeof(LTShmHeader));
+  if (ftruncate(ShmFD, (off_t)HeaderSize) == 0) {
+    void *Header = mmap(NULL, HeaderSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                        ShmFD, 0);
+    if (Header != MAP_FAILED) {
+      ShmHeader = (LTShmHeader *)Header;
+      ShmHeader->Magic = LT_SHM_MAGIC;
+      ShmHeader->Version = LT_SHM_VERSION;
+      ShmHeader->Pid = (uint64_t)getpid();
+      ShmHeader->FirstModule = HeaderSize;
+      ShmHeader->Size = HeaderSize;
+      snprintf(ShmHeader->Name, sizeof(ShmHeader->Name), "%s",
+               getProgramName());
+      return 0;
+    }
+  }
+
+  close(ShmFD);
+  shm_unlink(ShmName);
+  ShmFD = -1;
+  return -1;
+}
+
+// Copies the module and its names and counters into the segment and maps the
+// segment over its counter table. The increments made by other threads while
+// the counters are being copied might be lost (modules are normally
+// registered before main, i.e. before any other threads are started).
+static void exportModule(LTRTModule *Module) {
+  if (ForkedChild)
+    return;
+  if (!canExportModule(Module)) {
+    fprintf(stderr, "lt_rt: can't export the counters of a module that isn't "
+                    "aligned to %d bytes\n",
+            LT_RT_SHM_ALIGNMENT);
+    return;
+  }
+
+  pthread_mutex_lock(&ShmLock);
+  if (ShmFD < 0 && createSegment()) {
+    perror("lt_rt: failed to create the shared-memory segment");
+    pthread_mutex_unlock(&ShmLock);
+    return;
+  }
+
+  uint64_t Offset = ShmHeader->Size;
+  uint64_t ModuleSize = roundUpToPage(sizeof(LTShmModule) + Module->NamesSize);
+  uint64_t CountersSize = roundUpToPage(Module->NumCounters * sizeof(uint64_t));
+  uint64_t Size = Offset + ModuleSize + CountersSize;
+  void *Desc = MAP_FAILED;
+  void *Counters = MAP_FAILED;
+  if (ftruncate(ShmFD, (off_t)Size) == 0) {
+    Desc = mmap(NULL, ModuleSize + CountersSize, PROT_READ | PROT_WRITE,
+                MAP_SHARED, ShmFD, (off_t)Offset);
+  }
+  if (Desc != MAP_FAILED) {
+    LTShmModule *Entry = (LTShmModule *)Desc;
+    Entry->Next = Size;
+    Entry->NumCounters = Module->NumCounters;
+    Entry->NamesSize = Module->NamesSize;
+    Entry->Counters = Offset + ModuleSize;
+    memcpy(Entry + 1, Module->Names, Module->NamesSize);
+    memcpy((char *)Desc + ModuleSize, Module->Counters,
+           Module->NumCounters * sizeof(uint64_t));
+    munmap(Desc, ModuleSize + CountersSize);
+
+    Counters = mmap(Module->Counters, CountersSize, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_FIXED, ShmFD,
+                    (off_t)(Offset + ModuleSize));
+  }
+
+  if (Counters != MAP_FAILED) {
+    ShmHeader->Size = Size;
+    __atomic_store_n(&ShmHeader->NumModules, ShmHeader->NumModules + 1,
+                     __ATOMIC_RELEASE);
+  } else {
+    perror("lt_rt: failed to export the counters");
+    // Nothing refers to the (unpublished) space added for this module
+    ftruncate(ShmFD, (off_t)Offset);
+  }
+  pthread_mutex_unlock(&ShmLock);
+}
+
+// Removes the segment (the counter tables stay mapped)
+static void removeSegment(void) {
+  pthread_mutex_lock(&ShmLock);
+  if (ShmFD >= 0)
+    shm_unlink(ShmName);
+  pthread_mutex_unlock(&ShmLock);
+}
+
+// Gives the exported counter tables private (zero-filled) memory again and
+// forgets the segment, which belongs to the parent. Runs in a forked child.
+static void detachSegment(void) {
+  if (ShmFD < 0)
+    return;
+
+  for (LTRTModule *Module = ModulesHead; Module; Module = Module->Next)
+    if (canExportModule(Module))
+      mmap(Module->Counters,
+           roundUpToPage(Module->NumCounters * sizeof(uint64_t)),
+           PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1,
+           0);
+  munmap(ShmHeader, roundUpToPage(sizeof(LTShmHeader)));
+  close(ShmFD);
+  ShmHeader = NULL;
+  ShmFD = -1;
+}
+
+//------------------------------------------------------------------------------
+// fork() support
+//------------------------------------------------------------------------------
+// A forked child starts with a copy of the counters of its parent. To keep the
+// profiles of the two processes apart, the child resets all counters right
+// after fork() and writes its own profile file (see getProfilePath). The
+// profiles of all processes can then be combined with lt-merge. Likewise, the
+// child starts its own trace (see resetTraceInChild).
+//
+// Only the forking thread survives in the child, so the locks are taken
+// before fork() - otherwise the child could inherit a lock held by another
+// thread (e.g. by the flusher, in the middle of a snapshot) and deadlock on
+// its first flush. The lock order is the same as everywhere else.
+static void prepareFork(void) {
+  pthread_mutex_lock(&PatchLock);
+  pthread_mutex_lock(&TraceLock);
+  pthread_mutex_lock(&FlushLock);
+  pthread_mutex_lock(&ModulesLock);
+  pthread_mutex_lock(&CCTThreadsLock);
+  pthread_mutex_lock(&ShmLock);
+}
+
+static void unlockAfterFork(void) {
+  pthread_mutex_unlock(&ShmLock);
+  pthread_mutex_unlock(&CCTThreadsLock);
+  pthread_mutex_unlock(&ModulesLock);
+  pthread_mutex_unlock(&FlushLock);
+  pthread_mutex_unlock(&TraceLock);
+  pthread_mutex_unlock(&PatchLock);
+}
+
+static void resetContextCounts(CCTNode *Node) {
+  Node->Count = 0;
+  // The depth of the trees is bounded by LT_RT_SHADOW_STACK_SIZE
+  for (CCTNode *Child = Node->FirstChild; Child; Child = Child->NextSibling)
+    resetContextCounts(Child);
+}
+
+static void resetModule(LTRTModule *Module) {
+  if (Module->Counters)
+    memset(Module->Counters, 0, Module->NumCounters * sizeof(uint64_t));
+  if (Module->ResetThreadCounters)
+    Module->ResetThreadCounters();
+  if (Module->Coverage)
+    memset(Module->Coverage, 0, getCoverageSize(Module));
+  if (Module->Times)
+    memset(Module->Times, 0, Module->NumCounters * sizeof(LTRTFunctionTimes));
+
+  for (uint64_t I = 0; I < Module->NumSites; I++) {
+    const LTRTCallSite *Site = &Module->Sites[I];
+    if (Site->Callee)
+      Module->SiteCounters[Site->Index] = 0;
+    else
+      memset(&Module->IndirectTargets[Site->Index], 0,
+             sizeof(LTRTIndirectTargets));
+  }
+
+  for (uint64_t F = 0; F < Module->NumCFGFunctions; F++) {
+    const LTRTCFGFunction *Function = &Module->CFGFunctions[F];
+    for (uint64_t E = Function->FirstEdge;
+         E < Function->FirstEdge + Function->NumEdges; E++)
+      if (Module->CFGEdges[E].Counter != LT_RT_NO_COUNTER)
+        Module->BlockCounters[Module->CFGEdges[E].Counter] = 0;
+  }
+}
+
+// Runs in the child, i.e. in the only thread of the new process
+static void initForkedChild(void) {
+  unlockAfterFork();
+  ForkedChild = 1;
+
+  // Before the reset, which would otherwise clear the parent's live counters
+  detachSegment();
+  for (LTRTModule *Module = ModulesHead; Module; Module = Module->Next)
+    resetModule(Module);
+
+  // The trees of the other threads belong to the parent. Root is the first
+  // member of CCTThread, so ThreadRoot also points to this thread's entry.
+  CCTThreads = (CCTThread *)ThreadRoot;
+  if (CCTThreads) {
+    CCTThreads->Next = NULL;
+    resetContextCounts(ThreadRoot);
+  }
+
+  resetTraceInChild();
+
+  // The activations that are still on the shadow stack are timed from here
+  uint64_t Now = readClockIfTiming();
+  for (unsigned I = 0; I < ShadowDepth; I++) {
+    if (ShadowStack[I].Start)
+      ShadowStack[I].Start = Now;
+    ShadowStack[I].Callees = 0;
+  }
+
+  // The flusher thread didn't survive and the wake-up pipe is shared with
+  // the parent (which would then consume the child's signals)
+  if (!FlusherStarted)
+    return;
+  FlusherStarted = 0;
+  if (WakeupPipe[0] >= 0) {
+    close(WakeupPipe[0]);
+    close(WakeupPipe[1]);
+    WakeupPipe[0] = WakeupPipe[1] = -1;
+    if (createWakeupPipe() && !FlushIntervalMs)
+      return;
+  }
+  startFlusher();
+}
+
+static void installForkHandlers(void) {
+  pthread_atfork(prepareFork, unlockAfterFork, initForkedChild);
+}
+
+static void initRuntime(void) {
+  const char *Interval = getenv(LT_RT_FLUSH_INTERVAL_ENV_VAR);
+  if (Interval && *Interval) {
+    long Ms = strtol(Interval, NULL, 10);
+    if (Ms > 0)
+      FlushIntervalMs = Ms > INT_MAX ? INT_MAX : (int)Ms;
+    else
+      fprintf(stderr, "lt_rt: ignoring invalid %s: '%s'\n",
+              LT_RT_FLUSH_INTERVAL_ENV_VAR, Interval);
+  }
+
+  const char *SignalStr = getenv(LT_RT_FLUSH_SIGNAL_ENV_VAR);
+  int Signal = parseSignal(SignalStr);
+  if (SignalStr && *SignalStr && !Signal)
+    fprintf(stderr, "lt_rt: ignoring invalid %s: '%s'\n",
+            LT_RT_FLUSH_SIGNAL_ENV_VAR, SignalStr);
+
+  const char *PatchSignalStr = getenv(LT_RT_PATCH_SIGNAL_ENV_VAR);
+  int PatchSignal = parseSignal(PatchSignalStr);
+  if ((PatchSignalStr && *PatchSignalStr && !PatchSignal) ||
+      (PatchSignal && PatchSignal == Signal)) {
+    fprintf(stderr, "lt_rt: ignoring invalid %s: '%s'\n",
+            LT_RT_PATCH_SIGNAL_ENV_VAR, PatchSignalStr);
+    PatchSignal = 0;
+  }
+
+  if ((Signal || PatchSignal) && createWakeupPipe())
+    Signal = PatchSignal = 0;
+
+  struct sigaction Action;
+  memset(&Action, 0, sizeof(Action));
+  Action.sa_flags = SA_RESTART;
+  sigemptyset(&Action.sa_mask);
+  if (Signal) {
+    Action.sa_handler = onFlushSignal;
+    sigaction(Signal, &Action, NULL);
+  }
+  if (PatchSignal) {
+    Action.sa_handler = onPatchSignal;
+    sigaction(PatchSignal, &Action, NULL);
+  }
+
+  pthread_once(&ForkOnce, installForkHandlers);
+
+  if (FlushIntervalMs || Signal || PatchSignal)
+    startFlusher();
+}
+
+// Writes the final snapshot. This runs after the destructors of the
+// instrumented executable (which depends on lt_rt), i.e. after the
+// thread-local counters of the main thread have been merged.
+__attribute__((destructor)) static void finiRuntime(void) {
+  if (ModulesHead) {
+    lt_rt_flush();
+    removeSegment();
+
+    const char *Report = getenv(LT_RT_REPORT_ENV_VAR);
+    if (Report && !strcmp(Report, "text"))
+      lt_rt_print_report();
+    else if (Report && *Report && strcmp(Report, "none"))
+      fprintf(stderr, "lt_rt: ignoring unsupported %s: '%s'\n",
+              LT_RT_REPORT_ENV_VAR, Report);
+  }
+  finishTrace();
+}
+
+//------------------------------------------------------------------------------
+// ABI used by the instrumented code
+//------------------------------------------------------------------------------
+LT_RT_API void __lt_rt_register_module(LTRTModule *Module) {
+  pthread_once(&InitOnce, initRuntime);
+
+  if (Module->Flags & LT_RT_MODULE_TIMING)
+    __atomic_store_n(&TimingEnabled, 1, __ATOMIC_RELAXED);
+  if (Module->Flags & LT_RT_MODULE_CCT)
+    __atomic_store_n(&ContextsEnabled, 1, __ATOMIC_RELAXED);
+  if (Module->Flags & LT_RT_MODULE_SHM)
+    exportModule(Module);
+
+  pthread_mutex_lock(&ModulesLock);
+  Module->Next = NULL;
+  if (ModulesTail)
+    ModulesTail->Next = Module;
+  else
+    ModulesHead = Module;
+  ModulesTail = Module;
+  pthread_mutex_unlock(&ModulesLock);
+}
+
+LT_RT_API void __lt_rt_record_indirect_call(LTRTIndirectTargets *Site,
+                                            void *Target) {
+  for (int I = 0; I < LT_RT_MAX_INDIRECT_TARGETS; I++) {
+    void *Cur = __atomic_load_n(&Site->Targets[I], __ATOMIC_RELAXED);
+    if (!Cur) {
+      // Claim the free entry, unless another thread has just done so
+      void *Expected = NULL;
+      Cur = __atomic_compare_exchange_n(&Site->Targets[I], &Expected, Target,
+                                        /*weak=*/0, __ATOMIC_RELAXED,
+                                        __ATOMIC_RELAXED)
+                ? Target
+                : Expected;
+    }
+
+    if (Cur == Target) {
+      __atomic_fetch_add(&Site->Counts[I], 1, __ATOMIC_RELAXED);
+      return;
+    }
+  }
+
+  // The table is full and Target is not in it - Target takes over the entry
+  // of the least frequent target (Space-Saving). This is the slow path - it
+  // only runs for sites that reach more than LT_RT_MAX_INDIRECT_TARGETS
+  // targets.
+  int Min = 0;
+  uint64_t MinCount = __atomic_load_n(&Site->Counts[0], __ATOMIC_RELAXED);
+  for (int I = 1; I < LT_RT_MAX_INDIRECT_TARGETS; I++) {
+    uint64_t Count = __atomic_load_n(&Site->Counts[I], __ATOMIC_RELAXED);
+    if (Count < MinCount) {
+      Min = I;
+      MinCount = Count;
+    }
+  }
+
+  // Only one of the threads racing to evict this entry wins. Calls counted
+  // between claiming the entry and updating its error are attributed to the
+  // new target (i.e. under contention, the counts are approximate).
+  void *Evicted = __atomic_load_n(&Site->Targets[Min], __ATOMIC_RELAXED);
+  if (Evicted != Target &&
+      __atomic_compare_exchange_n(&Site->Targets[Min], &Evicted, Target,
+                                  /*weak=*/0, __ATOMIC_RELAXED,
+                                  __ATOMIC_RELAXED)) {
+    // The new target inherits the count of the evicted one as its error. The
+    // calls actually made to the evicted target move to Other.
+    uint64_t Count =
+        __atomic_add_fetch(&Site->Counts[Min], 1, __ATOMIC_RELAXED);
+    uint64_t Error =
+        __atomic_exchange_n(&Site->Errors[Min], Count - 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&Site->Other, Count - 1 - Error, __ATOMIC_RELAXED);
+    return;
+  }
+
+  // Lost the race - Evicted is the target that now owns the entry
+  if (Evicted == Target)
+    __atomic_fetch_add(&Site->Counts[Min], 1, __ATOMIC_RELAXED);
+  else
+    __atomic_fetch_add(&Site->Other, 1, __ATOMIC_RELAXED);
+}
+
+LT_RT_API void __lt_rt_register_trace_module(LTRTTraceModule *Module) {
+  pthread_once(&TraceOnce, initTrace);
+
+  pthread_mutex_lock(&TraceLock);
+  Module->FirstId = NextFunctionId;
+  NextFunctionId += (uint32_t)Module->NumFunctions;
+  LTRTTraceModule **Modules = (LTRTTraceModule **)realloc(
+      TraceModules, (NumTraceModules + 1) * sizeof(*TraceModules));
+  if (Modules) {
+    TraceModules = Modules;
+    TraceModules[NumTraceModules++] = Module;
+  }
+  if (TraceFD >= 0 && writeTraceFunctions(Module))
+    perror("lt_rt: failed to write the trace");
+  pthread_mutex_unlock(&TraceLock);
+}
+
+LT_RT_API void __lt_rt_trace_enter(LTRTTraceModule *Module, uint32_t Slot,
+                                   uint32_t NumArgs) {
+  recordTraceEvent(Module->FirstId + Slot, NumArgs, LT_PROF_TRACE_ENTRY);
+}
+
+LT_RT_API void __lt_rt_trace_exit(LTRTTraceModule *Module, uint32_t Slot) {
+  recordTraceEvent(Module->FirstId + Slot, 0, LT_PROF_TRACE_EXIT);
+}
+
+LT_RT_API void __lt_rt_trace_arg(LTRTTraceModule *Module, uint32_t Slot,
+                                 uint32_t Index, uint32_t IsPointer,
+                                 uint64_t Value) {
+  appendTraceEvent(Module->FirstId + Slot, Index,
+                   IsPointer ? LT_PROF_TRACE_POINTER_ARGUMENT
+                             : LT_PROF_TRACE_ARGUMENT,
+                   Value);
+}
+
+LT_RT_API void __lt_rt_register_patchable_module(LTRTPatchableModule *Module) {
+  __lt_rt_register_trace_module(&Module->Trace);
+  pthread_once(&PatchOnce, initPatching);
+  // For LT_RT_PATCH_SIGNAL
+  pthread_once(&InitOnce, initRuntime);
+
+#ifdef LT_RT_HAS_PATCHING
+  Module->Trampoline = (void *)__lt_rt_sled_trampoline;
+#endif
+
+  size_t NumModuleSleds;
+  PatchSled *ModuleSleds = collectSleds(Module, &NumModuleSleds);
+  if (!ModuleSleds)
+    return;
+
+  pthread_mutex_lock(&PatchLock);
+  size_t NumOld = Sleds ? Sleds->NumSleds : 0;
+  PatchTable *Table = (PatchTable *)malloc(
+      sizeof(PatchTable) + (NumOld + NumModuleSleds) * sizeof(PatchSled));
+  if (Table) {
+    Table->NumSleds = NumOld + NumModuleSleds;
+    if (NumOld)
+      memcpy(Table->Sleds, Sleds->Sleds, NumOld * sizeof(PatchSled));
+    memcpy(Table->Sleds + NumOld, ModuleSleds,
+           NumModuleSleds * sizeof(PatchSled));
+    qsort(Table->Sleds, Table->NumSleds, sizeof(PatchSled),
+          comparePatchSleds);
+    // Publish the table before patching, so that every patched sled is found
+    __atomic_store_n(&Sleds, Table, __ATOMIC_RELEASE);
+    if (Patched)
+      patchSleds(ModuleSleds, NumModuleSleds, 1);
+  } else {
+    fprintf(stderr, "lt_rt: failed to register the sleds\n");
+  }
+  pthread_mutex_unlock(&PatchLock);
+  free(ModuleSleds);
+}
+
+LT_RT_API void __lt_rt_enter_function(LTRTFunctionTimes *Times, void *Frame) {
+  uint64_t Now = readClockIfTiming();
+  popStaleFrames((uintptr_t)Frame, Now);
+  if (ShadowDepth == LT_RT_SHADOW_STACK_SIZE)
+    return;
+
+  ShadowFrame *Top = &ShadowStack[ShadowDepth++];
+  Top->Times = Times;
+  Top->Frame = (uintptr_t)Frame;
+  Top->Start = Now;
+  Top->Callees = 0;
+  Top->CallerContext = CurrentContext;
+  if (__atomic_load_n(&ContextsEnabled, __ATOMIC_RELAXED))
+    enterContext(Times);
+}
+
+LT_RT_API void __lt_rt_unwind_to(LTRTFunctionTimes *Times, void *Frame) {
+  unwindTo(Times, (uintptr_t)Frame, readClockIfTiming());
+}
+
+LT_RT_API void __lt_rt_exit_function(LTRTFunctionTimes *Times, void *Frame) {
+  uint64_t Now = readClockIfTiming();
+  // The activation is not on the stack if the stack was full on entry
+  if (unwindTo(Times, (uintptr_t)Frame, Now))
+    popShadowFrame(Now);
+}
+
+//------------------------------------------------------------------------------
+// Public API
+//------------------------------------------------------------------------------
+LT_RT_API int lt_rt_flush(void) {
+  char Path[PATH_MAX];
+  char TmpPath[PATH_MAX];
+  if (getProfilePath(Path, sizeof(Path)) ||
+      snprintf(TmpPath, sizeof(TmpPath), "%s.tmp.%ld", Path,
+               (long)getpid()) >= (int)sizeof(TmpPath)) {
+    fprintf(stderr, "lt_rt: profile path too long: '%s'\n",
+            getProfilePattern());
+    return -1;
+  }
+
+  pthread_mutex_lock(&FlushLock);
+
+  int Ret = -1;
+  int FD = open(TmpPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (FD >= 0) {
+    Ret = 0;
+    pthread_mutex_lock(&ModulesLock);
+    for (LTRTModule *Module = ModulesHead; Module && !Ret;
+         Module = Module->Next) {
+      if (Module->Flags & LT_RT_MODULE_COVERAGE)
+        Ret = writeCoverage(FD, Module);
+      else
+        Ret = writeModule(FD, Module);
+      if (!Ret && (Module->Flags & LT_RT_MODULE_TIMING))
+        Ret = writeFunctionTimes(FD, Module);
+      if (!Ret && Module->NumSites)
+        Ret = writeCallEdges(FD, Module);
+      if (!Ret && Module->NumCFGFunctions)
+        Ret = writeBlockCounts(FD, Module);
+    }
+    if (!Ret && __atomic_load_n(&ContextsEnabled, __ATOMIC_RELAXED))
+      Ret = writeCallingContexts(FD);
+    pthread_mutex_unlock(&ModulesLock);
+
+    if (close(FD))
+      Ret = -1;
+    if (!Ret)
+      Ret = rename(TmpPath, Path);
+    if (Ret)
+      unlink(TmpPath);
+  }
+
+  if (Ret)
+    fprintf(stderr, "lt_rt: failed to write '%s': %s\n", Path,
+            strerror(errno));
+
+  pthread_mutex_unlock(&FlushLock);
+  return Ret;
+}
+
+LT_RT_API int lt_rt_print_report(void) {
+  int Ret = 0;
+  if (printf("=================================================\n"
+             "LLVM-TUTOR: dynamic analysis results\n"
+             "=================================================\n"
+             "NAME                 #N DIRECT CALLS\n"
+             "-------------------------------------------------\n") < 0)
+    Ret = -1;
+
+  pthread_mutex_lock(&ModulesLock);
+  for (const LTRTModule *Module = ModulesHead; Module && !Ret;
+       Module = Module->Next) {
+    // There are no counts in the `coverage` mode
+    if (!Module->Counters)
+      continue;
+
+    // The names are NUL-separated, in slot order
+    const char *Name = Module->Names;
+    const char *NamesEnd = Module->Names + Module->NamesSize;
+    for (uint64_t Slot = 0; Slot < Module->NumCounters && Name < NamesEnd;
+         Slot++) {
+      uint64_t Count =
+          __atomic_load_n(&Module->Counters[Slot], __ATOMIC_RELAXED);
+      if (printf("%-20s %-10lu\n", Name, (unsigned long)Count) < 0) {
+        Ret = -1;
+        break;
+      }
+      Name += strlen(Name) + 1;
+    }
+  }
+  pthread_mutex_unlock(&ModulesLock);
+
+  if (fflush(stdout))
+    Ret = -1;
+  return Ret;
+}
+
+LT_RT_API int lt_rt_patch(void) {
+  pthread_mutex_lock(&PatchLock);
+  int Ret = setPatched(1);
+  pthread_mutex_unlock(&PatchLock);
+  return Ret;
+}
+
+LT_RT_API int lt_rt_unpatch(void) {
+  pthread_mutex_lock(&PatchLock);
+  int Ret = setPatched(0);
+  pthread_mutex_unlock(&PatchLock);
+  return Ret;
+}
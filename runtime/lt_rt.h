@@ -0,0 +1,324 @@
+//==============================================================================
+// FILE:
+//    lt_rt.h
+//
+// DESCRIPTION:
+//    The interface of lt_rt, the runtime library for the llvm-tutor
+//    instrumentation passes. It consists of:
+//      * the ABI used by the instrumented code (functions prefixed with
+//        `__lt_rt_`) - these calls are injected by the passes and should not be
+//        used directly
+//      * the public C API (functions prefixed with `lt_rt_`) that
+//        instrumented programs can call
+//
+//    lt_rt is configured through the following environment variables:
+//      * LT_PROFILE_FILE - the profile file (`default.ltprof` by default).
+//        Every `%p` is replaced with the process ID. Processes forked by an
+//        instrumented program reset their counters and write their own
+//        profile (`<LT_PROFILE_FILE>.<pid>` if there's no `%p`), which can be
+//        merged with lt-merge.
+//      * LT_RT_FLUSH_INTERVAL_MS - if set, a background thread writes a
+//        snapshot of the counters every LT_RT_FLUSH_INTERVAL_MS milliseconds
+//      * LT_RT_FLUSH_SIGNAL - if set (e.g. to `USR1`, `SIGUSR1` or `10`), a
+//        snapshot is written every time the process receives that signal
+//      * LT_RT_CLOCK - the clock used in the `timing` and `trace` modes:
+//        `tsc` (the time stamp counter, x86 only) or `monotonic`
+//        (clock_gettime). By default, the TSC is used if it's invariant (i.e.
+//        ticks at a constant rate across all cores and power states).
+//      * LT_TRACE_FILE - the trace file (`default.lttrace` by default).
+//        `%p` is replaced as in LT_PROFILE_FILE and forked processes start
+//        their own trace (`<LT_TRACE_FILE>.<pid>` if there's no `%p`).
+//      * LT_RT_TRACE_BUFFER_SIZE - the number of trace events buffered per
+//        thread (rounded up to a power of 2, 65536 by default)
+//      * LT_RT_TRACE_FLUSH - what happens when a thread's trace buffer is
+//        full: `exit` (the default) - the oldest events are overwritten and
+//        the buffer is only written when the thread exits, or `full` - the
+//        thread writes the buffer to the trace file and starts over (no events
+//        are lost, but the thread stalls while writing)
+//      * LT_RT_PATCH - `1` to patch the sleds of the modules instrumented with
+//        `inject-func-call<trace=patchable>` at startup (i.e. to start
+//        tracing right away), `0` (the default) to leave them disabled
+//      * LT_RT_PATCH_SIGNAL - if set (e.g. to `USR2`), the sleds are patched
+//        (or unpatched, if they're patched already) every time the process
+//        receives that signal, i.e. tracing can be toggled in a live process
+//      * LT_RT_REPORT - `text` to also print the call counts to stdout when
+//        the process exits (as lt_rt_print_report does)
+//
+// License: MIT
+//==============================================================================
+#ifndef LLVM_TUTOR_LT_RT_H
+#define LLVM_TUTOR_LT_RT_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LT_RT_FLUSH_INTERVAL_ENV_VAR "LT_RT_FLUSH_INTERVAL_MS"
+#define LT_RT_FLUSH_SIGNAL_ENV_VAR "LT_RT_FLUSH_SIGNAL"
+#define LT_RT_CLOCK_ENV_VAR "LT_RT_CLOCK"
+#define LT_RT_TRACE_BUFFER_SIZE_ENV_VAR "LT_RT_TRACE_BUFFER_SIZE"
+#define LT_RT_TRACE_FLUSH_ENV_VAR "LT_RT_TRACE_FLUSH"
+#define LT_RT_PATCH_ENV_VAR "LT_RT_PATCH"
+#define LT_RT_PATCH_SIGNAL_ENV_VAR "LT_RT_PATCH_SIGNAL"
+#define LT_RT_REPORT_ENV_VAR "LT_RT_REPORT"
+
+//------------------------------------------------------------------------------
+// ABI used by the instrumented code
+//------------------------------------------------------------------------------
+// The maximum number of distinct targets recorded per indirect call site
+#define LT_RT_MAX_INDIRECT_TARGETS 4
+
+// A call site instrumented in the `edges` mode
+typedef struct LTRTCallSite {
+  // The slot of the calling function
+  uint64_t Caller;
+  // The index of this call site within the caller (in instruction order)
+  uint64_t Ordinal;
+  // The name of the callee, NULL for indirect calls
+  const char *Callee;
+  // The index into LTRTModule::SiteCounters (direct calls) or
+  // LTRTModule::IndirectTargets (indirect calls)
+  uint64_t Index;
+} LTRTCallSite;
+
+// The targets reached from one indirect call site, tracked with the
+// Space-Saving algorithm. Entries are claimed in the order in which the
+// targets are first seen. Once the table is full, a call to a target that is
+// not in it takes over the entry with the smallest count: the entry is
+// credited with that count + 1 and the inherited part is recorded as its
+// error. Counts[I] - Errors[I] is then the number of calls made to Targets[I]
+// since it took over the entry, and Counts[I] bounds that number from above.
+// A target that receives more than 1/LT_RT_MAX_INDIRECT_TARGETS of the calls
+// is guaranteed to be in the table. The calls counted for evicted targets are moved to Other,
+// so that the counts (minus the errors) still add up to the number of calls
+// made from the site.
+typedef struct LTRTIndirectTargets {
+  void *Targets[LT_RT_MAX_INDIRECT_TARGETS];
+  uint64_t Counts[LT_RT_MAX_INDIRECT_TARGETS];
+  uint64_t Errors[LT_RT_MAX_INDIRECT_TARGETS];
+  uint64_t Other;
+} LTRTIndirectTargets;
+
+// Marks the CFG edges that are not instrumented (i.e. that are on the spanning
+// tree, see CFGSpanningTree.h)
+#define LT_RT_NO_COUNTER UINT64_MAX
+
+// An edge of the CFG of a function instrumented in the `blocks` mode
+typedef struct LTRTCFGEdge {
+  // The indices of the source and the destination blocks. NumBlocks (of the
+  // function) stands for the virtual node, i.e. the function entry (as Src)
+  // and the function exit (as Dst).
+  uint64_t Src;
+  uint64_t Dst;
+  // The index into LTRTModule::BlockCounters or LT_RT_NO_COUNTER
+  uint64_t Counter;
+} LTRTCFGEdge;
+
+// A function instrumented in the `blocks` mode
+typedef struct LTRTCFGFunction {
+  // The slot of the function
+  uint64_t Function;
+  uint64_t NumBlocks;
+  // The edges of this function are CFGEdges[FirstEdge, FirstEdge + NumEdges)
+  uint64_t FirstEdge;
+  uint64_t NumEdges;
+} LTRTCFGFunction;
+
+// The time spent in a function instrumented in the `timing` mode, in the units
+// of the lt_rt clock (see LTProfFunctionTimesHeader::Unit)
+typedef struct LTRTFunctionTimes {
+  // Including the time spent in the callees
+  uint64_t Inclusive;
+  // Excluding the time spent in the (timed) callees
+  uint64_t Exclusive;
+} LTRTFunctionTimes;
+
+// LTRTModule::Flags - the modes that require work from the runtime
+#define LT_RT_MODULE_TIMING 0x1
+#define LT_RT_MODULE_CCT 0x2
+// Export the live counters through shared memory (`dynamic-cc<shm>`). The
+// counter table of such a module has to be aligned to (and padded to a
+// multiple of) LT_RT_SHM_ALIGNMENT bytes, i.e. to cover whole pages.
+#define LT_RT_MODULE_SHM 0x4
+#define LT_RT_SHM_ALIGNMENT 65536
+// Only record which functions (or blocks) were executed
+// (`dynamic-cc<coverage>`). Such a module has no counter table - lt_rt
+// writes an LT_PROF_COVERAGE record instead of its function counts.
+#define LT_RT_MODULE_COVERAGE 0x8
+
+// The tables of one instrumented module. Every instrumented module defines one
+// instance of this struct (`dcc_module`) and registers it from a module
+// constructor. The layout has to match the struct generated by
+// DynamicCallCounter.
+typedef struct LTRTModule {
+  // Used by the runtime to chain the registered modules
+  struct LTRTModule *Next;
+  // `dcc_counters` (NULL in the `coverage` mode)
+  uint64_t *Counters;
+  // `dcc_names`
+  const char *Names;
+  uint64_t NumCounters;
+  uint64_t NamesSize;
+  // The following are only set in the `edges` mode (NULL/0 otherwise):
+  // `dcc_functions` - the addresses of the instrumented functions (slot
+  // order), used to name the targets of indirect calls
+  void *const *Functions;
+  // `dcc_call_sites`
+  const LTRTCallSite *Sites;
+  uint64_t NumSites;
+  // `dcc_site_counters` - the counters for direct call sites
+  uint64_t *SiteCounters;
+  // `dcc_indirect_targets` - the targets of indirect call sites
+  LTRTIndirectTargets *IndirectTargets;
+  // The following are only set in the `blocks` mode (NULL/0 otherwise):
+  // `dcc_cfg_functions`
+  const LTRTCFGFunction *CFGFunctions;
+  uint64_t NumCFGFunctions;
+  // `dcc_cfg_edges`
+  const LTRTCFGEdge *CFGEdges;
+  // `dcc_block_counters` - the counters for the instrumented CFG edges
+  uint64_t *BlockCounters;
+  // Only set in the `timing` and `cct` modes (NULL otherwise):
+  // `dcc_function_times` - one entry per slot. The address of the entry also
+  // identifies the function in the shadow stack and the calling-context tree.
+  LTRTFunctionTimes *Times;
+  // LT_RT_MODULE_* flags
+  uint64_t Flags;
+  // The following are only set in the `coverage` mode (NULL otherwise):
+  // `dcc_coverage` - one byte per function (slot order) or, with
+  // `coverage=blocks`, per block (function by function, in layout order).
+  // The instrumented code sets a byte to 1 when it executes the function or
+  // the block.
+  uint8_t *Coverage;
+  // `dcc_coverage_blocks` - the number of blocks of every function (slot
+  // order). NULL for function coverage.
+  const uint64_t *CoverageBlocks;
+  // Only set in the `tls` mode (NULL otherwise):
+  // `dcc_reset_thread_counters` - zeroes the thread-local copy of Counters of
+  // the calling thread. Called in forked children, which inherit the copy of
+  // the forking thread (i.e. counts that the parent hasn't merged yet).
+  void (*ResetThreadCounters)(void);
+} LTRTModule;
+
+// Registers Module with the runtime. Module has to stay alive until the
+// process exits.
+void __lt_rt_register_module(LTRTModule *Module);
+
+// Records a call to Target from the indirect call site described by Site.
+// Thread-safe.
+void __lt_rt_record_indirect_call(LTRTIndirectTargets *Site, void *Target);
+
+// The function names of one module instrumented with `inject-func-call<trace>`
+// (`ifc_trace_module`). The layout has to match the struct generated by
+// InjectFuncCall.
+typedef struct LTRTTraceModule {
+  // `ifc_names` - the NUL-separated names of the traced functions (in slot
+  // order)
+  const char *Names;
+  uint64_t NumFunctions;
+  uint64_t NamesSize;
+  // Set by the runtime - the ID of the function in slot 0 (IDs are unique
+  // across all modules of a process)
+  uint32_t FirstId;
+} LTRTTraceModule;
+
+// Registers Module with the runtime and writes its function names to the trace
+// file. Module has to stay alive until the process exits.
+void __lt_rt_register_trace_module(LTRTTraceModule *Module);
+
+// Appends a function entry event (for the function in Slot of Module, which
+// takes NumArgs arguments) to the calling thread's trace buffer. Lock-free.
+void __lt_rt_trace_enter(LTRTTraceModule *Module, uint32_t Slot,
+                         uint32_t NumArgs);
+
+// Appends a function exit event (for the function in Slot of Module) to the
+// calling thread's trace buffer. Called before every `ret` and `resume` in
+// the `trace=entry-exit` mode. Lock-free.
+void __lt_rt_trace_exit(LTRTTraceModule *Module, uint32_t Slot);
+
+// Appends the value of argument Index of the function in Slot of Module to
+// the calling thread's trace buffer. Called right after __lt_rt_trace_enter
+// for every argument captured with `inject-func-call<args=FILE>`. Integers are
+// widened to 64 bits by the caller. Lock-free.
+void __lt_rt_trace_arg(LTRTTraceModule *Module, uint32_t Slot, uint32_t Index,
+                       uint32_t IsPointer, uint64_t Value);
+
+// A module instrumented with `inject-func-call<trace=patchable>`
+// (`ifc_patchable_module`). Instead of calling the runtime, the traced
+// functions contain XRay sleds (emitted by the backend, see
+// https://llvm.org/docs/XRay.html) - short sequences of instructions that
+// skip themselves until the runtime patches them into calls to its
+// trampoline. The layout has to match the struct generated by InjectFuncCall.
+typedef struct LTRTPatchableModule {
+  // The function names (FirstId is set by the runtime)
+  LTRTTraceModule Trace;
+  // `ifc_functions` - the addresses of the traced functions (in slot order),
+  // used to map the sleds to the functions
+  void *const *Functions;
+  // `ifc_num_args` - the number of arguments of the traced functions (in slot
+  // order)
+  const uint32_t *NumArgs;
+  // The sled table of the executable or shared object that contains this
+  // module (the `xray_instr_map` section, shared by all of its modules)
+  const void *SledsBegin;
+  const void *SledsEnd;
+  // Set by the runtime - the address of the trampoline. The patched sleds
+  // call it indirectly through this field (the trampoline itself might be
+  // too far away for a direct call).
+  void *Trampoline;
+} LTRTPatchableModule;
+
+// Registers Module with the runtime (as __lt_rt_register_trace_module) and
+// records the locations of its sleds. The sleds are patched right away if
+// tracing is enabled. Module has to stay alive until the process exits.
+void __lt_rt_register_patchable_module(LTRTPatchableModule *Module);
+
+// Called on entry to a function instrumented in the `timing` or `cct` mode.
+// Times is the entry for that function in LTRTModule::Times and Frame is its
+// frame address, which identifies the activation.
+void __lt_rt_enter_function(LTRTFunctionTimes *Times, void *Frame);
+
+// Called before every return from a function instrumented in the `timing` or
+// `cct` mode. Times and Frame have to be the values passed to
+// __lt_rt_enter_function.
+void __lt_rt_exit_function(LTRTFunctionTimes *Times, void *Frame);
+
+// Called when a function instrumented in the `timing` or `cct` mode regains
+// control other than through a return from a callee, i.e. in landing pads and
+// after calls to `setjmp`. Times and Frame have to be the values passed to
+// __lt_rt_enter_function. Accounts for the callees that were left by
+// unwinding or by `longjmp`.
+void __lt_rt_unwind_to(LTRTFunctionTimes *Times, void *Frame);
+
+//------------------------------------------------------------------------------
+// Public API
+//------------------------------------------------------------------------------
+// Atomically replaces the profile file with a snapshot of the counters of all
+// registered modules. The counters are not reset. Returns 0 on success.
+int lt_rt_flush(void);
+
+// Prints the call counts of all registered modules to stdout, in the format
+// used by `dynamic-cc` without options (i.e. without a profile file or
+// dcc-prof). The counters are not reset. Returns 0 on success.
+int lt_rt_print_report(void);
+
+// Enables tracing in the modules instrumented with
+// `inject-func-call<trace=patchable>`, i.e. patches their sleds into calls to
+// the runtime. The same applies to the modules registered later. Thread-safe
+// (the other threads keep running while the code is patched). Only supported
+// on x86-64. Returns 0 on success.
+int lt_rt_patch(void);
+
+// Disables tracing in the modules instrumented with
+// `inject-func-call<trace=patchable>`, i.e. restores their sleds. Disabled
+// sleds cost a jump over a few bytes on entry (and nothing on exit). Returns 0
+// on success.
+int lt_rt_unpatch(void);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // LLVM_TUTOR_LT_RT_H
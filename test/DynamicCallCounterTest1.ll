@@ -8,7 +8,9 @@
 ; Instrument this file with DynamicCallCounter, run it and verify that it
 ; generates the expected output.
 
-; CHECK: bar                  2
-; CHECK-NEXT: main                 1
-; CHECK-NEXT: foo                  13
+; The counters are printed in slot order, i.e. in the order in which the
+; functions are defined in the input module.
+; CHECK: foo                  13
+; CHECK-NEXT: bar                  2
 ; CHECK-NEXT: fez                  1
+; CHECK-NEXT: main                 1
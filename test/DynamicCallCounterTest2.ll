@@ -3,9 +3,10 @@
 ; Instrument this file with DynamicCallCounter and verify that the inserted code
 ; is correct.
 
-; The global variables inserted by the pass
-; CHECK: @CounterFor_foo = common global i32 0, align 4
-; CHECK-NEXT: @0 = private unnamed_addr constant [4 x i8] c"foo\00", align 1
+; The global variables inserted by the pass: one counter table and one name
+; table (each in a dedicated section) for the whole module
+; CHECK: @dcc_counters = internal global [2 x i64] zeroinitializer, section "lt_dcc_cnts", align 8
+; CHECK-NEXT: @dcc_names = internal constant [8 x i8] c"foo\00bar\00", section "lt_dcc_names", align 1
 ; CHECK-NEXT: @ResultFormatStrIR = global [14 x i8]
 ; CHECK-NEXT: @ResultHeaderStrIR = global [225 x i8]
 ; CHECK-NEXT: @llvm.global_dtors = appending global
@@ -13,10 +14,21 @@
 
 define void @foo() {
 ; CHECK-LABEL: @foo(
-; Call-counting instructions inserted by the pass
-; CHECK-NEXT:    [[TMP1:%.*]] = load i32, ptr @CounterFor_foo
-; CHECK-NEXT:    [[TMP2:%.*]] = add i32 1, [[TMP1]]
-; CHECK-NEXT:    store i32 [[TMP2]], ptr @CounterFor_foo
+; Call-counting instructions inserted by the pass (`foo` is in slot 0)
+; CHECK-NEXT:    [[TMP1:%.*]] = load i64, ptr @dcc_counters
+; CHECK-NEXT:    [[TMP2:%.*]] = add i64 1, [[TMP1]]
+; CHECK-NEXT:    store i64 [[TMP2]], ptr @dcc_counters
+; CHECK-NEXT:    ret void
+;
+  ret void
+}
+
+define void @bar() {
+; CHECK-LABEL: @bar(
+; Call-counting instructions inserted by the pass (`bar` is in slot 1)
+; CHECK-NEXT:    [[TMP1:%.*]] = load i64, ptr getelementptr inbounds {{.*}}@dcc_counters, i64 {{(0, i64 1|8)}})
+; CHECK-NEXT:    [[TMP2:%.*]] = add i64 1, [[TMP1]]
+; CHECK-NEXT:    store i64 [[TMP2]], ptr getelementptr inbounds {{.*}}@dcc_counters, i64 {{(0, i64 1|8)}})
 ; CHECK-NEXT:    ret void
 ;
   ret void
@@ -30,8 +42,11 @@ define void @foo() {
 ; CHECK-NEXT: enter:
 ; CHECK-NEXT:  %0 = call i32 (ptr, ...) @printf
 ; CHECK-SAME: @ResultHeaderStrIR
-; CHECK-NEXT:  %1 = load i32, ptr @CounterFor_foo
+; CHECK-NEXT:  %1 = load i64, ptr @dcc_counters
 ; CHECK-NEXT:  %2 = call i32 (ptr, ...) @printf
-; CHECK-SAME: @ResultFormatStrIR
+; CHECK-SAME: @ResultFormatStrIR, ptr @dcc_names, i64 %1
+; CHECK-NEXT:  %3 = load i64, ptr getelementptr inbounds {{.*}}@dcc_counters
+; CHECK-NEXT:  %4 = call i32 (ptr, ...) @printf
+; CHECK-SAME: @ResultFormatStrIR, ptr getelementptr inbounds {{.*}}@dcc_names, i64 {{(0, i64 4|4)}}), i64 %3
 ; CHECK-NEXT:  ret void
 ; CHECK-NEXT: }
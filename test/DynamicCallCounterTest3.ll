@@ -2,7 +2,8 @@
 
 declare void @foo()
 
-; CHECK-NOT: @CounterFor_foo
+; CHECK-NOT: @dcc_counters
+; CHECK-NOT: @dcc_names
 ; CHECK-NOT: @ResultFormatStrIR = global [14 x i8]
 ; CHECK-NOT: @ResultHeaderStrIR = global [225 x i8]
 
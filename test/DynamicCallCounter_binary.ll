@@ -0,0 +1,30 @@
+; RUN:  opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<binary>,verify"  -S %s | FileCheck %s
+
+; Instrument this file with DynamicCallCounter in the `binary` mode and verify
+; that the inserted code writes the counter table to a file instead of
+; printing it.
+
+; The record header: magic, version, kind, payload size (16 + 1 x 8 + 8), the
+; number of counters and the size of the name table
+; CHECK: @dcc_profile_header = private constant { i64, i32, i32, i64, i64, i64 } { i64 77306497356876, i32 1, i32 1, i64 32, i64 1, i64 4 }
+; The name table has to be padded to 8 bytes
+; CHECK: @dcc_profile_padding = private constant [4 x i8] zeroinitializer
+; CHECK: @llvm.global_dtors = appending global {{.*}} @dcc_write_profile
+; CHECK-NOT: @printf_wrapper
+
+define void @foo() {
+  ret void
+}
+
+; CHECK-LABEL: define internal void @dcc_write_profile()
+; CHECK-NEXT:  enter:
+; CHECK-NEXT:    [[ENV:%.*]] = call ptr @getenv(ptr @dcc_env_var)
+; CHECK-NEXT:    [[ISNULL:%.*]] = icmp eq ptr [[ENV]], null
+; CHECK-NEXT:    [[PATH:%.*]] = select i1 [[ISNULL]], ptr @dcc_default_file, ptr [[ENV]]
+; CHECK-NEXT:    [[FILE:%.*]] = call ptr @fopen(ptr [[PATH]], ptr @dcc_file_mode)
+; CHECK:       write:
+; CHECK-NEXT:    call i64 @fwrite(ptr @dcc_profile_header, i64 40, i64 1, ptr [[FILE]])
+; CHECK-NEXT:    call i64 @fwrite(ptr @dcc_counters, i64 8, i64 1, ptr [[FILE]])
+; CHECK-NEXT:    call i64 @fwrite(ptr @dcc_names, i64 1, i64 4, ptr [[FILE]])
+; CHECK-NEXT:    call i64 @fwrite(ptr @dcc_profile_padding, i64 1, i64 4, ptr [[FILE]])
+; CHECK-NEXT:    call i32 @fclose(ptr [[FILE]])
@@ -0,0 +1,32 @@
+; RUN: rm -f %t.ltprof
+; RUN: opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<binary>,verify" %S/Inputs/CallCounterInput.ll -o %t.bin
+; RUN: env LT_PROFILE_FILE=%t.ltprof lli %t.bin
+; RUN: ../bin/dcc-prof %t.ltprof | FileCheck %s --check-prefix=TEXT
+; RUN: ../bin/dcc-prof --sort=count --format=csv %t.ltprof | FileCheck %s --check-prefix=CSV
+; RUN: ../bin/dcc-prof --sort=name --format=json %t.ltprof | FileCheck %s --check-prefix=JSON
+
+; Instrument this file with DynamicCallCounter in the `binary` mode, run it and
+; verify (with dcc-prof) that the generated profile contains the expected
+; counts.
+
+; TEXT: NAME                 #N DIRECT CALLS
+; TEXT: foo                  13
+; TEXT-NEXT: bar                  2
+; TEXT-NEXT: fez                  1
+; TEXT-NEXT: main                 1
+
+; CSV: name,count
+; CSV-NEXT: foo,13
+; CSV-NEXT: bar,2
+; CSV-NEXT: fez,1
+; CSV-NEXT: main,1
+
+; JSON: "functions": [
+; JSON: "name": "bar",
+; JSON-NEXT: "count": 2
+; JSON: "name": "fez",
+; JSON-NEXT: "count": 1
+; JSON: "name": "foo",
+; JSON-NEXT: "count": 13
+; JSON: "name": "main",
+; JSON-NEXT: "count": 1
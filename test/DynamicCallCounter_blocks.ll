@@ -0,0 +1,67 @@
+; RUN:  opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<blocks=all>,verify"  -S %s | FileCheck %s --check-prefix=ALL
+; RUN:  opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<blocks>,verify"  -S %s | FileCheck %s --check-prefix=TREE
+
+; Instrument this file with DynamicCallCounter in the `blocks=all` and the
+; `blocks` modes. In the former, every CFG edge gets a counter. In the latter,
+; only the edges that are not in the spanning tree do.
+
+; The extended CFG of @foo has 4 nodes (3 blocks and the virtual entry/exit
+; node) and 5 edges: entry (virtual) -> 0, 0 -> 1, 0 -> 2, 1 -> 2 and
+; 2 -> exit (virtual). The virtual node is represented by the number of
+; blocks, i.e. 3.
+; ALL-DAG: @dcc_cfg_functions = internal constant [1 x { i64, i64, i64, i64 }] [{ i64, i64, i64, i64 } { i64 0, i64 3, i64 0, i64 5 }]
+; ALL-DAG: @dcc_cfg_edges = internal constant [5 x { i64, i64, i64 }] [{ i64, i64, i64 } { i64 3, i64 0, i64 0 }, { i64, i64, i64 } { i64 0, i64 1, i64 1 }, { i64, i64, i64 } { i64 0, i64 2, i64 2 }, { i64, i64, i64 } { i64 1, i64 2, i64 3 }, { i64, i64, i64 } { i64 2, i64 3, i64 4 }]
+; ALL-DAG: @dcc_block_counters = internal global [5 x i64] zeroinitializer, align 8
+; ALL-DAG: @dcc_module = internal global {{.*}} { {{.*}}, ptr @dcc_cfg_functions, i64 1, ptr @dcc_cfg_edges, ptr @dcc_block_counters, ptr null, i64 0, ptr null, ptr null, ptr null }, align 8
+
+; With the spanning tree, only 5 - (4 - 1) = 2 edges need a counter. The
+; other edges are marked with UINT64_MAX.
+; TREE-DAG: @dcc_cfg_edges = internal constant [5 x { i64, i64, i64 }] [{{.*}}i64 -1{{.*}}]
+; TREE-DAG: @dcc_block_counters = internal global [2 x i64] zeroinitializer, align 8
+
+define i32 @foo(i1 %c) {
+; ALL-LABEL: @foo(
+; ALL-NEXT:  entry:
+; The function entry counter
+; ALL-NEXT:    [[TMP1:%.*]] = load i64, ptr @dcc_counters
+; ALL-NEXT:    [[TMP2:%.*]] = add i64 1, [[TMP1]]
+; ALL-NEXT:    store i64 [[TMP2]], ptr @dcc_counters
+; entry (virtual) -> 0
+; ALL-NEXT:    [[TMP3:%.*]] = load i64, ptr @dcc_block_counters
+; ALL-NEXT:    [[TMP4:%.*]] = add i64 1, [[TMP3]]
+; ALL-NEXT:    store i64 [[TMP4]], ptr @dcc_block_counters
+; ALL-NEXT:    br i1 %c, label %then, label %[[CRIT:.*]]
+; 0 -> 2 is a critical edge, so it's split
+; ALL:       [[CRIT]]:
+; ALL-NEXT:    load i64, ptr {{.*}}@dcc_block_counters
+; ALL-NEXT:    add i64 1
+; ALL-NEXT:    store i64
+; ALL-NEXT:    br label %join
+; 0 -> 1 (at the top of the destination) and 1 -> 2 (before the terminator of
+; the source)
+; ALL:       then:
+; ALL-NEXT:    load i64, ptr {{.*}}@dcc_block_counters
+; ALL-NEXT:    add i64 1
+; ALL-NEXT:    store i64
+; ALL-NEXT:    load i64, ptr {{.*}}@dcc_block_counters
+; ALL-NEXT:    add i64 1
+; ALL-NEXT:    store i64
+; ALL-NEXT:    br label %join
+; 2 -> exit (virtual)
+; ALL:       join:
+; ALL-NEXT:    [[RES:%.*]] = phi i32
+; ALL-NEXT:    load i64, ptr {{.*}}@dcc_block_counters
+; ALL-NEXT:    add i64 1
+; ALL-NEXT:    store i64
+; ALL-NEXT:    ret i32 [[RES]]
+;
+entry:
+  br i1 %c, label %then, label %join
+
+then:
+  br label %join
+
+join:
+  %res = phi i32 [ 1, %then ], [ 0, %entry ]
+  ret i32 %res
+}
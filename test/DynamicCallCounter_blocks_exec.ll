@@ -0,0 +1,45 @@
+; RUN: %clang -S -emit-llvm %S/../inputs/input_for_cc_blocks.c -o %t.ll
+; RUN: opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<blocks>,verify" %t.ll -o %t.tree.bc
+; RUN: opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<blocks=all>,verify" %t.ll -o %t.all.bc
+; RUN: opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<blocks=all;no-promote>,verify" %t.ll -o %t.nopromote.bc
+; RUN: %clang %t.tree.bc -L%shlibdir -llt_rt -Wl,-rpath,%shlibdir -o %t.tree.bin
+; RUN: %clang %t.all.bc -L%shlibdir -llt_rt -Wl,-rpath,%shlibdir -o %t.all.bin
+; RUN: %clang %t.nopromote.bc -L%shlibdir -llt_rt -Wl,-rpath,%shlibdir -o %t.nopromote.bin
+; RUN: rm -f %t.tree.ltprof %t.all.ltprof %t.nopromote.ltprof
+; RUN: env LT_PROFILE_FILE=%t.tree.ltprof %t.tree.bin | FileCheck %s --check-prefix=OUTPUT
+; RUN: env LT_PROFILE_FILE=%t.all.ltprof %t.all.bin | FileCheck %s --check-prefix=OUTPUT
+; RUN: env LT_PROFILE_FILE=%t.nopromote.ltprof %t.nopromote.bin | FileCheck %s --check-prefix=OUTPUT
+
+; Verify that the block and edge counts reconstructed from the spanning tree
+; counters match the counts from instrumenting every edge
+; RUN: ../bin/dcc-prof --blocks --format=csv %t.tree.ltprof > %t.tree.blocks
+; RUN: ../bin/dcc-prof --blocks --format=csv %t.all.ltprof > %t.all.blocks
+; RUN: diff %t.tree.blocks %t.all.blocks
+; RUN: ../bin/dcc-prof --cfg-edges --format=csv %t.tree.ltprof > %t.tree.edges
+; RUN: ../bin/dcc-prof --cfg-edges --format=csv %t.all.ltprof > %t.all.edges
+; RUN: diff %t.tree.edges %t.all.edges
+
+; Verify that promoting the counters out of the loops doesn't change the
+; counts either
+; RUN: ../bin/dcc-prof --cfg-edges --format=csv %t.nopromote.ltprof > %t.nopromote.edges
+; RUN: diff %t.nopromote.edges %t.all.edges
+
+; Sanity-check the counts. The entry block of every function executes as
+; many times as the function is called: `classify` 51 times (`argc` is 1) and
+; `collatz` for every `ii` that is not a multiple of 7, i.e. 43 times.
+; RUN: FileCheck %s --input-file=%t.tree.blocks
+; RUN: FileCheck %s --input-file=%t.tree.edges --check-prefix=EDGES
+
+; Instrumenting the program mustn't change its behaviour
+; OUTPUT: 1016
+
+; CHECK: function,block,count
+; CHECK-DAG: classify,0,51
+; CHECK-DAG: collatz,0,43
+; CHECK-DAG: main,0,1
+
+; EDGES: function,src,dst,count
+; EDGES-DAG: classify,entry,0,51
+; EDGES-DAG: collatz,entry,0,43
+; EDGES-DAG: main,entry,0,1
+; EDGES-DAG: main,{{[0-9]+}},exit,1
@@ -0,0 +1,31 @@
+; RUN:  opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<cct>,verify"  -S %s | FileCheck %s
+; RUN:  opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<cct;timing>,verify"  -S %s | FileCheck %s --check-prefix=BOTH
+
+; Instrument this file with DynamicCallCounter in the `cct` mode and verify
+; that it injects the same lt_rt hooks as the `timing` mode. The modes are
+; told apart by the flags in the module descriptor (LT_RT_MODULE_CCT and
+; LT_RT_MODULE_TIMING).
+
+; CHECK-DAG: @dcc_function_times = internal global [2 x { i64, i64 }] zeroinitializer, align 8
+; CHECK-DAG: @dcc_module = internal global {{.*}} { {{.*}}, ptr @dcc_function_times, i64 2, ptr null, ptr null, ptr null }, align 8
+; BOTH-DAG: @dcc_module = internal global {{.*}} { {{.*}}, ptr @dcc_function_times, i64 3, ptr null, ptr null, ptr null }, align 8
+
+define void @foo() {
+; CHECK-LABEL: @foo(
+; CHECK:         [[FRAME:%.*]] = call ptr @llvm.frameaddress.p0(i32 0)
+; CHECK-NEXT:    call void @__lt_rt_enter_function(ptr [[TIMES:.*@dcc_function_times.*]], ptr [[FRAME]])
+; CHECK-NEXT:    call void @__lt_rt_exit_function(ptr [[TIMES]], ptr [[FRAME]])
+; CHECK-NEXT:    ret void
+  ret void
+}
+
+define void @bar() {
+; CHECK-LABEL: @bar(
+; CHECK:         [[FRAME:%.*]] = call ptr @llvm.frameaddress.p0(i32 0)
+; CHECK-NEXT:    call void @__lt_rt_enter_function(ptr [[TIMES:.*@dcc_function_times.*]], ptr [[FRAME]])
+; CHECK-NEXT:    call void @foo()
+; CHECK-NEXT:    call void @__lt_rt_exit_function(ptr [[TIMES]], ptr [[FRAME]])
+; CHECK-NEXT:    ret void
+  call void @foo()
+  ret void
+}
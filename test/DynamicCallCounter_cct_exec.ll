@@ -0,0 +1,23 @@
+; RUN: %clang -S -emit-llvm %S/../inputs/input_for_cc_cct.c -o - \
+; RUN:   | opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<cct>,verify" -o %t.bc
+; RUN: %clang -pthread %t.bc -L%shlibdir -llt_rt -Wl,-rpath,%shlibdir -o %t.bin
+; RUN: rm -f %t.ltprof
+; RUN: env LT_PROFILE_FILE=%t.ltprof %t.bin
+; RUN: ../bin/dcc-prof --folded %t.ltprof | FileCheck %s
+
+; Instrument a multi-threaded program with DynamicCallCounter in the `cct`
+; mode, run it and verify the recorded calling contexts. `leaf` is entered 6
+; times, but through 4 distinct call paths. The calling-context tree of every
+; thread starts at the thread's entry point (`main` and `worker`).
+
+; CHECK: main 1
+; CHECK-NEXT: main;a 3
+; CHECK-NEXT: main;a;leaf 3
+; CHECK-NEXT: main;b 1
+; CHECK-NEXT: main;b;a 1
+; CHECK-NEXT: main;b;a;leaf 1
+; CHECK-NEXT: main;b;leaf 2
+; CHECK-NEXT: worker 1
+; CHECK-NEXT: worker;a 1
+; CHECK-NEXT: worker;a;leaf 1
+; CHECK-NOT: {{.}}
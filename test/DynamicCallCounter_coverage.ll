@@ -0,0 +1,53 @@
+; RUN:  opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<coverage>,verify"  -S %s | FileCheck %s
+; RUN:  opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<coverage=blocks>,verify"  -S %s | FileCheck %s --check-prefix=BLOCKS
+; RUN:  not opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<coverage;edges>"  -disable-output %s 2>&1 | FileCheck %s --check-prefix=INVALID
+
+; Instrument this file with DynamicCallCounter in the `coverage` mode and
+; verify that there are no counters - every function (or, with
+; `coverage=blocks`, every block) just stores 1 into its byte of
+; `dcc_coverage` (without loading it first) - and that the module is
+; registered with lt_rt with the coverage flag (0x8).
+
+; CHECK-NOT: @dcc_counters
+; CHECK: @dcc_coverage = internal global [2 x i8] zeroinitializer
+; CHECK: @dcc_module = internal global {{.*}} { ptr null, ptr null, ptr @dcc_names, i64 2, i64 8, {{.*}}, i64 8, ptr @dcc_coverage, ptr null, ptr null }, align 8
+; CHECK: @llvm.global_ctors = appending global {{.*}} @dcc_register_module
+
+; BLOCKS: @dcc_coverage = internal global [4 x i8] zeroinitializer
+; BLOCKS: @dcc_coverage_blocks = internal constant [2 x i64] [i64 1, i64 3], align 8
+; BLOCKS: @dcc_module = internal global {{.*}} i64 8, ptr @dcc_coverage, ptr @dcc_coverage_blocks, ptr null }, align 8
+
+define void @foo() {
+  ret void
+}
+
+define void @bar(i1 %c) {
+entry:
+  br i1 %c, label %then, label %exit
+then:
+  call void @foo()
+  br label %exit
+exit:
+  ret void
+}
+
+; CHECK-LABEL: define void @foo()
+; CHECK-NEXT:    store atomic i8 1, ptr @dcc_coverage monotonic, align 1
+; CHECK-NEXT:    ret void
+
+; CHECK-LABEL: define void @bar(i1 %c)
+; CHECK-NEXT:  entry:
+; CHECK-NEXT:    store atomic i8 1, ptr getelementptr inbounds {{.*}}@dcc_coverage, i64 {{(0, i64 1|1)}}) monotonic, align 1
+; CHECK-NEXT:    br i1 %c
+; CHECK-NOT:     @dcc_coverage
+
+; BLOCKS-LABEL: define void @bar(i1 %c)
+; BLOCKS-NEXT:  entry:
+; BLOCKS-NEXT:    store atomic i8 1, ptr getelementptr inbounds {{.*}}@dcc_coverage, i64 {{(0, i64 1|1)}}) monotonic, align 1
+; BLOCKS:       then:
+; BLOCKS-NEXT:    store atomic i8 1, ptr getelementptr inbounds {{.*}}@dcc_coverage, i64 {{(0, i64 2|2)}}) monotonic, align 1
+; BLOCKS:       exit:
+; BLOCKS-NEXT:    store atomic i8 1, ptr getelementptr inbounds {{.*}}@dcc_coverage, i64 {{(0, i64 3|3)}}) monotonic, align 1
+; BLOCKS-NOT:     load
+
+; INVALID: dynamic-cc parameter 'coverage' can't be combined with 'edges'
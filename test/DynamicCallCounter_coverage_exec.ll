@@ -0,0 +1,67 @@
+; RUN: %clang -S -emit-llvm %S/../inputs/input_for_cc_coverage.c -o %t.ll
+; RUN: opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<coverage>,verify" %t.ll -o %t.funcs.bc
+; RUN: opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<coverage=blocks>,verify" %t.ll -o %t.blocks.bc
+; RUN: %clang %t.funcs.bc -L%shlibdir -llt_rt -Wl,-rpath,%shlibdir -o %t.funcs.bin
+; RUN: %clang %t.blocks.bc -L%shlibdir -llt_rt -Wl,-rpath,%shlibdir -o %t.blocks.bin
+; RUN: rm -f %t.*.ltprof
+
+; Run both binaries twice - without arguments (`fast` is called) and with an
+; argument (`slow` is called)
+; RUN: env LT_PROFILE_FILE=%t.funcs.1.ltprof %t.funcs.bin | FileCheck %s --check-prefix=OUTPUT1
+; RUN: env LT_PROFILE_FILE=%t.funcs.2.ltprof %t.funcs.bin x | FileCheck %s --check-prefix=OUTPUT2
+; RUN: env LT_PROFILE_FILE=%t.blocks.1.ltprof %t.blocks.bin | FileCheck %s --check-prefix=OUTPUT1
+; RUN: env LT_PROFILE_FILE=%t.blocks.2.ltprof %t.blocks.bin x | FileCheck %s --check-prefix=OUTPUT2
+
+; RUN: ../bin/dcc-prof --coverage %t.funcs.1.ltprof | FileCheck %s --check-prefix=RUN1
+; RUN: ../bin/dcc-prof --coverage %t.funcs.2.ltprof | FileCheck %s --check-prefix=RUN2
+; RUN: ../bin/dcc-prof --coverage --format=csv %t.blocks.1.ltprof | FileCheck %s --check-prefix=BLOCKS1
+
+; Verify that lt-merge computes the union of the two runs
+; RUN: ../bin/lt-merge -o %t.funcs.ltprof %t.funcs.1.ltprof %t.funcs.2.ltprof
+; RUN: ../bin/lt-merge -o %t.blocks.ltprof %t.blocks.1.ltprof %t.blocks.2.ltprof
+; RUN: ../bin/dcc-prof --coverage %t.funcs.ltprof | FileCheck %s --check-prefix=MERGED
+; RUN: ../bin/dcc-prof --coverage --format=csv %t.blocks.ltprof | FileCheck %s --check-prefix=BLOCKS
+
+; Function and block coverage maps of the same module can't be merged
+; RUN: not ../bin/lt-merge -o %t.bad.ltprof %t.funcs.1.ltprof %t.blocks.1.ltprof 2>&1 | FileCheck %s --check-prefix=MISMATCH
+
+; Instrumenting the program mustn't change its behaviour
+; OUTPUT1: 2
+; OUTPUT2: 178
+
+; RUN1:      LLVM-TUTOR: coverage
+; RUN1:      NAME                 COVERED
+; RUN1-NEXT: -------------------------------------------------
+; RUN1-NEXT: fast                 yes
+; RUN1-NEXT: slow                 no
+; RUN1-NEXT: unused               no
+; RUN1-NEXT: main                 yes
+; RUN1-NEXT: -------------------------------------------------
+; RUN1-NEXT: functions: 2/4 (50.0%)
+
+; RUN2:      fast                 no
+; RUN2-NEXT: slow                 yes
+; RUN2-NEXT: unused               no
+; RUN2-NEXT: main                 yes
+
+; `main` has 4 blocks at -O0 (the entry, both branches and the join block)
+; BLOCKS1:      name,covered,covered_blocks,blocks
+; BLOCKS1-NEXT: fast,1,1,1
+; BLOCKS1-NEXT: slow,0,0,{{[0-9]+}}
+; BLOCKS1-NEXT: unused,0,0,1
+; BLOCKS1-NEXT: main,1,3,4
+
+; MERGED:      fast                 yes
+; MERGED-NEXT: slow                 yes
+; MERGED-NEXT: unused               no
+; MERGED-NEXT: main                 yes
+; MERGED-NEXT: -------------------------------------------------
+; MERGED-NEXT: functions: 3/4 (75.0%)
+
+; BLOCKS:      name,covered,covered_blocks,blocks
+; BLOCKS-NEXT: fast,1,1,1
+; BLOCKS-NEXT: slow,1,[[SLOW:[0-9]+]],[[SLOW]]
+; BLOCKS-NEXT: unused,0,0,1
+; BLOCKS-NEXT: main,1,4,4
+
+; MISMATCH: Error merging profile: {{.*}}: the coverage map of 'fast' doesn't match the other profiles
@@ -0,0 +1,45 @@
+; RUN:  opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<edges>,verify"  -S %s | FileCheck %s
+
+; Instrument this file with DynamicCallCounter in the `edges` mode and verify
+; that every call site (apart from intrinsics) is instrumented: direct calls
+; with a counter, indirect calls with a call into the lt_rt runtime library.
+
+; The function table, the call site descriptors (caller slot, index within the
+; caller, callee name, index into the site tables) and the site tables
+; CHECK-DAG: @dcc_functions = internal constant [2 x ptr] [ptr @foo, ptr @bar]
+; CHECK-DAG: @dcc_callee_name = private unnamed_addr constant [4 x i8] c"foo\00", align 1
+; CHECK-DAG: @dcc_call_sites = internal constant [2 x { i64, i64, ptr, i64 }] [{ i64, i64, ptr, i64 } { i64 1, i64 0, ptr @dcc_callee_name, i64 0 }, { i64, i64, ptr, i64 } { i64 1, i64 1, ptr null, i64 0 }]
+; CHECK-DAG: @dcc_site_counters = internal global [1 x i64] zeroinitializer, align 8
+; CHECK-DAG: @dcc_indirect_targets = internal global [1 x { [4 x ptr], [4 x i64], [4 x i64], i64 }] zeroinitializer, align 8
+; CHECK-DAG: @dcc_module = internal global { ptr, ptr, ptr, i64, i64, ptr, ptr, i64, ptr, ptr, ptr, i64, ptr, ptr, ptr, i64, ptr, ptr, ptr } { ptr null, ptr @dcc_counters, ptr @dcc_names, i64 2, i64 8, ptr @dcc_functions, ptr @dcc_call_sites, i64 2, ptr @dcc_site_counters, ptr @dcc_indirect_targets, ptr null, i64 0, ptr null, ptr null, ptr null, i64 0, ptr null, ptr null, ptr null }, align 8
+; CHECK-DAG: @llvm.global_ctors = appending global {{.*}} @dcc_register_module
+
+declare void @llvm.donothing()
+
+define void @foo() {
+  ret void
+}
+
+define void @bar(ptr %fptr) {
+; CHECK-LABEL: @bar(
+; The function entry counter
+; CHECK-NEXT:    [[TMP1:%.*]] = load i64, ptr getelementptr inbounds {{.*}}@dcc_counters
+; CHECK-NEXT:    [[TMP2:%.*]] = add i64 1, [[TMP1]]
+; CHECK-NEXT:    store i64 [[TMP2]], ptr getelementptr inbounds {{.*}}@dcc_counters
+; The direct call site counter
+; CHECK-NEXT:    [[TMP3:%.*]] = load i64, ptr @dcc_site_counters
+; CHECK-NEXT:    [[TMP4:%.*]] = add i64 1, [[TMP3]]
+; CHECK-NEXT:    store i64 [[TMP4]], ptr @dcc_site_counters
+; CHECK-NEXT:    call void @foo()
+; The indirect call site
+; CHECK-NEXT:    call void @__lt_rt_record_indirect_call(ptr @dcc_indirect_targets, ptr %fptr)
+; CHECK-NEXT:    call void %fptr()
+; Intrinsics are not instrumented
+; CHECK-NEXT:    call void @llvm.donothing()
+; CHECK-NEXT:    ret void
+;
+  call void @foo()
+  call void %fptr()
+  call void @llvm.donothing()
+  ret void
+}
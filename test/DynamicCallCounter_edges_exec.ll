@@ -0,0 +1,31 @@
+; RUN: %clang -S -emit-llvm %S/../inputs/input_for_cc_edges.c -o - \
+; RUN:   | opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<edges>,verify" -o %t.bc
+; RUN: %clang %t.bc -L%shlibdir -llt_rt -Wl,-rpath,%shlibdir -o %t.bin
+; RUN: rm -f %t.ltprof
+; RUN: env LT_PROFILE_FILE=%t.ltprof %t.bin
+; RUN: ../bin/dcc-prof --call-graph --format=csv %t.ltprof | FileCheck %s
+; RUN: ../bin/dcc-prof --call-graph --format=dot %t.ltprof | FileCheck %s --check-prefix=DOT
+
+; Instrument a program with direct and indirect calls with DynamicCallCounter
+; in the `edges` mode, run it and verify the recorded call graph. `dispatch`
+; reaches 7 distinct targets from its only call site, but only 4 are recorded:
+; `foo`, `bar`, `t1` and `t2` claim the table, then `t3`, `t4` and `t5` take
+; over the entries with the smallest count (`bar`, `t1` and `t2`). The calls
+; to `bar`, `t1` and `t2` are attributed to "<other>".
+
+; CHECK: caller,site,callee,indirect,count
+; CHECK-DAG: bar,0,foo,0,2
+; CHECK-DAG: dispatch,0,foo,1,2
+; CHECK-DAG: dispatch,0,t3,1,1
+; CHECK-DAG: dispatch,0,t4,1,1
+; CHECK-DAG: dispatch,0,t5,1,1
+; CHECK-DAG: dispatch,0,<other>,1,3
+; CHECK-DAG: main,0,dispatch,0,8
+; CHECK-DAG: main,1,bar,0,1
+
+; Edges from different call sites are merged
+; DOT: digraph "call graph" {
+; DOT-DAG: "main" -> "dispatch" [label="8", weight=8];
+; DOT-DAG: "main" -> "bar" [label="1", weight=1];
+; DOT-DAG: "dispatch" -> "<other>" [label="3", weight=3];
+; DOT: }
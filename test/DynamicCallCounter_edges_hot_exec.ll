@@ -0,0 +1,26 @@
+; RUN: %clang -S -emit-llvm %S/../inputs/input_for_cc_edges_hot.c -o - \
+; RUN:   | opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<edges>,verify" -o %t.bc
+; RUN: %clang %t.bc -L%shlibdir -llt_rt -Wl,-rpath,%shlibdir -o %t.bin
+; RUN: rm -f %t.ltprof
+; RUN: env LT_PROFILE_FILE=%t.ltprof %t.bin
+; RUN: ../bin/dcc-prof --call-graph --format=csv %t.ltprof | FileCheck %s
+
+; Instrument a program with one hot indirect call target with
+; DynamicCallCounter in the `edges` mode, run it and verify that the hot
+; target survives a stream of distinct cold targets. `dispatch` makes 100
+; calls, 28 of which go to `hot`:
+;   * the `warm` targets (8 calls each) outnumber `hot` (4 calls), so `hot` is
+;     the first target evicted by the stream of `cold` targets
+;   * from its 2nd call in the last loop onwards, `hot` keeps its entry - it
+;     is called more often than the `cold` targets take over the other entries
+;     (every entry taken over inherits the count of the evicted target)
+; Only the 23 calls made to `hot` since it reclaimed its entry are attributed
+; to it, the remaining calls are attributed to "<other>".
+
+; CHECK: caller,site,callee,indirect,count
+; CHECK-DAG: dispatch,0,hot,1,23
+; CHECK-DAG: dispatch,0,c5,1,1
+; CHECK-DAG: dispatch,0,c6,1,1
+; CHECK-DAG: dispatch,0,c7,1,1
+; CHECK-DAG: dispatch,0,<other>,1,74
+; CHECK-DAG: main,0,dispatch,0,4
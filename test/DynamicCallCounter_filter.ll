@@ -0,0 +1,20 @@
+; RUN: echo "fez" > %t.deny
+; RUN: opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<deny=%t.deny;min-size=2>,verify" %S/Inputs/CallCounterInput.ll -o %t.bin 2>&1 \
+; RUN:   | FileCheck %s --check-prefix=REMARK
+; RUN: lli %t.bin | FileCheck %s
+; RUN: not opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<min-entry-count=-1>" -disable-output %s 2>&1 \
+; RUN:  | FileCheck %s --check-prefix=INVALID
+
+; Instrument Inputs/CallCounterInput.ll with DynamicCallCounter, skipping
+; @fez (denied) and @foo (a single `ret`), run it and verify that only the
+; remaining functions are counted. The calls from @fez to @bar are still
+; counted - the counters are updated by the callees.
+
+; REMARK: remark: dynamic-cc: instrumented 2 function(s), skipped 2 (1 denied, 1 smaller than 2 instructions)
+
+; CHECK: bar                  2
+; CHECK-NEXT: main                 1
+; CHECK-NOT: foo
+; CHECK-NOT: fez
+
+; INVALID: invalid dynamic-cc min-entry-count value '-1'
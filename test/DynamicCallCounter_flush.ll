@@ -0,0 +1,30 @@
+; RUN:  opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<flush>,verify"  -S %s | FileCheck %s
+
+; Instrument this file with DynamicCallCounter in the `flush` mode and verify
+; that the counter table is registered with the lt_rt runtime library (which
+; writes the profile) rather than reported from a module destructor.
+
+; The module descriptor: `next`, the counter table, the name table, the number
+; of counters and the size of the name table. The call site tables are only
+; used in the `edges` mode, the CFG tables in the `blocks` mode and the
+; function times in the `timing` and `cct` modes. The last field holds the
+; flags for the `timing` and `cct` modes.
+; CHECK: @dcc_module = internal global { ptr, ptr, ptr, i64, i64, ptr, ptr, i64, ptr, ptr, ptr, i64, ptr, ptr, ptr, i64, ptr, ptr, ptr } { ptr null, ptr @dcc_counters, ptr @dcc_names, i64 2, i64 8, ptr null, ptr null, i64 0, ptr null, ptr null, ptr null, i64 0, ptr null, ptr null, ptr null, i64 0, ptr null, ptr null, ptr null }, align 8
+; CHECK: @llvm.global_ctors = appending global {{.*}} @dcc_register_module
+; CHECK-NOT: @llvm.global_dtors
+; CHECK-NOT: @printf_wrapper
+; CHECK-NOT: @dcc_write_profile
+
+define void @foo() {
+  ret void
+}
+
+define void @bar() {
+  call void @foo()
+  ret void
+}
+
+; CHECK-LABEL: define internal void @dcc_register_module()
+; CHECK-NEXT:  enter:
+; CHECK-NEXT:    call void @__lt_rt_register_module(ptr @dcc_module)
+; CHECK-NEXT:    ret void
@@ -0,0 +1,27 @@
+; RUN: %clang -S -emit-llvm %S/../inputs/input_for_cc_flush.c -o - \
+; RUN:   | opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<flush>,verify" -o %t.bc
+; RUN: %clang %t.bc -L%shlibdir -llt_rt -Wl,-rpath,%shlibdir -o %t.bin
+
+; RUN: rm -f %t.api.ltprof
+; RUN: env LT_PROFILE_FILE=%t.api.ltprof %t.bin api
+; RUN: ../bin/dcc-prof %t.api.ltprof | FileCheck %s
+
+; RUN: rm -f %t.signal.ltprof
+; RUN: env LT_PROFILE_FILE=%t.signal.ltprof LT_RT_FLUSH_SIGNAL=USR1 %t.bin signal
+; RUN: ../bin/dcc-prof %t.signal.ltprof | FileCheck %s
+
+; RUN: rm -f %t.interval.ltprof
+; RUN: env LT_PROFILE_FILE=%t.interval.ltprof LT_RT_FLUSH_INTERVAL_MS=20 %t.bin interval
+; RUN: ../bin/dcc-prof %t.interval.ltprof | FileCheck %s --check-prefix=INTERVAL
+
+; Instrument a program that never exits cleanly with DynamicCallCounter in the
+; `flush` mode and verify that lt_rt writes snapshots of the counters on
+; demand, on a signal and periodically. `foo` is called 3 times before the
+; first snapshot and twice afterwards. The periodic flusher might write
+; another snapshot after the last call to `foo`.
+
+; CHECK: foo                  3
+; CHECK: main                 1
+
+; INTERVAL: foo                  {{3|5}}
+; INTERVAL: main                 1
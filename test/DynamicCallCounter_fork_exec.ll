@@ -0,0 +1,44 @@
+; RUN: %clang -S -emit-llvm %S/../inputs/input_for_cc_fork.c -o - \
+; RUN:   | opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<flush>,verify" -o %t.bc
+; RUN: %clang %t.bc -L%shlibdir -llt_rt -Wl,-rpath,%shlibdir -o %t.bin
+
+; Every child writes <profile>.<pid>
+; RUN: rm -rf %t.dir && mkdir %t.dir
+; RUN: env LT_PROFILE_FILE=%t.dir/prof.ltprof %t.bin
+; RUN: ls %t.dir | FileCheck %s --check-prefix=FILES
+; RUN: ../bin/dcc-prof --sort=name %t.dir/prof.ltprof | FileCheck %s --check-prefix=PARENT
+; RUN: ../bin/lt-merge -o %t.merged.ltprof %t.dir/prof.ltprof*
+; RUN: ../bin/dcc-prof --sort=name %t.merged.ltprof | FileCheck %s --check-prefix=MERGED
+
+; With `%p` in the file name, every process writes <profile with %p replaced>
+; RUN: rm -rf %t.pid && mkdir %t.pid
+; RUN: env LT_PROFILE_FILE=%t.pid/prof.%%p.ltprof %t.bin
+; RUN: ls %t.pid | FileCheck %s --check-prefix=PID-FILES
+; RUN: ls %t.pid/prof.*.ltprof > %t.list
+; RUN: ../bin/lt-merge -o %t.merged2.ltprof --input-files=%t.list
+; RUN: ../bin/dcc-prof --sort=name %t.merged2.ltprof | FileCheck %s --check-prefix=MERGED
+
+; Instrument a program that forks 3 children with DynamicCallCounter in the
+; `flush` mode and verify that lt_rt resets the counters in the children (i.e.
+; every profile only contains the calls made by its process) and that
+; lt-merge adds up the counts from all processes.
+
+; FILES: prof.ltprof
+; FILES-NEXT: prof.ltprof.{{[0-9]+}}
+; FILES-NEXT: prof.ltprof.{{[0-9]+}}
+; FILES-NEXT: prof.ltprof.{{[0-9]+}}
+; FILES-NOT: {{.}}
+
+; PARENT: bar                  0
+; PARENT: foo                  3
+; PARENT: main                 1
+
+; PID-FILES: prof.{{[0-9]+}}.ltprof
+; PID-FILES-NEXT: prof.{{[0-9]+}}.ltprof
+; PID-FILES-NEXT: prof.{{[0-9]+}}.ltprof
+; PID-FILES-NEXT: prof.{{[0-9]+}}.ltprof
+; PID-FILES-NOT: {{.}}
+
+; MERGED: bar                  6
+; MERGED: foo                  6
+; MERGED: main                 1
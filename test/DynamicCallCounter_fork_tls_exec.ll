@@ -0,0 +1,31 @@
+; RUN: %clang -S -emit-llvm %S/../inputs/input_for_cc_fork.c -o - \
+; RUN:   | opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<tls;flush>,verify" -o %t.bc
+; RUN: %clang %t.bc -L%shlibdir -llt_rt -Wl,-rpath,%shlibdir -o %t.bin
+
+; Every child writes <profile>.<pid>
+; RUN: rm -rf %t.dir && mkdir %t.dir
+; RUN: env LT_PROFILE_FILE=%t.dir/prof.ltprof %t.bin
+; RUN: ls %t.dir | FileCheck %s --check-prefix=FILES
+; RUN: ../bin/dcc-prof --sort=name %t.dir/prof.ltprof | FileCheck %s --check-prefix=PARENT
+; RUN: ../bin/lt-merge -o %t.merged.ltprof %t.dir/prof.ltprof*
+; RUN: ../bin/dcc-prof --sort=name %t.merged.ltprof | FileCheck %s --check-prefix=MERGED
+
+; Same as DynamicCallCounter_fork_exec.ll, but in the `tls` mode. The parent
+; calls `main` and `foo` (twice) before it forks, i.e. these counts are still
+; in the thread-local copy of the counters that every child inherits. lt_rt
+; has to reset that copy as well, otherwise the children would report the
+; calls made by the parent.
+
+; FILES: prof.ltprof
+; FILES-NEXT: prof.ltprof.{{[0-9]+}}
+; FILES-NEXT: prof.ltprof.{{[0-9]+}}
+; FILES-NEXT: prof.ltprof.{{[0-9]+}}
+; FILES-NOT: {{.}}
+
+; PARENT: bar                  0
+; PARENT: foo                  3
+; PARENT: main                 1
+
+; MERGED: bar                  6
+; MERGED: foo                  6
+; MERGED: main                 1
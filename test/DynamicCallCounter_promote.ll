@@ -0,0 +1,46 @@
+; RUN:  opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<edges>,verify"  -S %s | FileCheck %s
+; RUN:  opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<edges;no-promote>,verify"  -S %s | FileCheck %s --check-prefix=NOPROMOTE
+
+; Instrument this file with DynamicCallCounter in the `edges` mode and verify
+; that the counter of the call site inside the loop is kept in a register
+; (i.e. promoted) and only written back when the loop exits. With
+; `no-promote`, the counter is updated in memory on every iteration.
+
+declare void @foo()
+
+define void @bar(i32 %n) {
+; CHECK-LABEL: @bar(
+; CHECK:       loop:
+; CHECK-NEXT:    [[DELTA:%.*]] = phi i64 {{.*}}[ 0, %entry ]
+; CHECK-NEXT:    %i = phi i32
+; CHECK-NEXT:    [[INC:%.*]] = add i64 1, [[DELTA]]
+; CHECK-NEXT:    call void @foo()
+; CHECK:       exit:
+; CHECK-NEXT:    [[TMP1:%.*]] = load i64, ptr @dcc_site_counters
+; CHECK-NEXT:    [[TMP2:%.*]] = add i64 [[INC]], [[TMP1]]
+; CHECK-NEXT:    store i64 [[TMP2]], ptr @dcc_site_counters
+; CHECK-NEXT:    ret void
+;
+; NOPROMOTE-LABEL: @bar(
+; NOPROMOTE:       loop:
+; NOPROMOTE-NEXT:    %i = phi i32
+; NOPROMOTE-NEXT:    [[TMP1:%.*]] = load i64, ptr @dcc_site_counters
+; NOPROMOTE-NEXT:    [[TMP2:%.*]] = add i64 1, [[TMP1]]
+; NOPROMOTE-NEXT:    store i64 [[TMP2]], ptr @dcc_site_counters
+; NOPROMOTE-NEXT:    call void @foo()
+; NOPROMOTE:       exit:
+; NOPROMOTE-NEXT:    ret void
+;
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i1, %loop ]
+  call void @foo()
+  %i1 = add i32 %i, 1
+  %done = icmp eq i32 %i1, %n
+  br i1 %done, label %exit, label %loop
+
+exit:
+  ret void
+}
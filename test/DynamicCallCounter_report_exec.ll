@@ -0,0 +1,20 @@
+; RUN: %clang -S -emit-llvm %S/../inputs/input_for_cc.c -o - \
+; RUN:   | opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<flush>,verify" -o %t.bc
+; RUN: %clang %t.bc -L%shlibdir -llt_rt -Wl,-rpath,%shlibdir -o %t.bin
+; RUN: env LT_PROFILE_FILE=%t.ltprof LT_RT_REPORT=text %t.bin | FileCheck %s
+; RUN: ../bin/dcc-prof %t.ltprof | FileCheck %s
+; RUN: env LT_PROFILE_FILE=%t.ltprof %t.bin | FileCheck %s --check-prefix=NONE --allow-empty
+
+; Instrument input_for_cc.c with DynamicCallCounter in the `flush` mode and
+; verify that, with LT_RT_REPORT=text, lt_rt prints the same report as the
+; code injected by `dynamic-cc` without options (next to writing the
+; profile). Nothing is printed by default.
+
+; CHECK: LLVM-TUTOR: dynamic analysis results
+; CHECK: NAME                 #N DIRECT CALLS
+; CHECK: foo                  13
+; CHECK-NEXT: bar                  2
+; CHECK-NEXT: fez                  1
+; CHECK-NEXT: main                 1
+
+; NONE-NOT: {{.}}
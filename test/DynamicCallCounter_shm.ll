@@ -0,0 +1,29 @@
+; RUN:  opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<shm>,verify"  -S %s | FileCheck %s
+; RUN:  not opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<shm;tls>"  -disable-output %s 2>&1 | FileCheck %s --check-prefix=INVALID
+
+; Instrument this file with DynamicCallCounter in the `shm` mode and verify
+; that the counter table covers whole 64KiB blocks (8192 counters) outside of
+; the `lt_dcc_cnts` section, that the module is registered with lt_rt with
+; the shm flag (0x4) and that the counters are incremented as usual.
+
+; CHECK: @dcc_counters = internal global [8192 x i64] zeroinitializer, align 65536
+; CHECK: @dcc_module = internal global {{.*}} { ptr null, ptr @dcc_counters, ptr @dcc_names, i64 2, i64 8, {{.*}}, i64 4, ptr null, ptr null, ptr null }, align 8
+; CHECK: @llvm.global_ctors = appending global {{.*}} @dcc_register_module
+; CHECK-NOT: @llvm.global_dtors
+
+define void @foo() {
+  ret void
+}
+
+define void @bar() {
+  call void @foo()
+  ret void
+}
+
+; CHECK-LABEL: define void @foo()
+; CHECK-NEXT:    [[COUNT:%.*]] = load i64, ptr @dcc_counters
+; CHECK-NEXT:    [[INC:%.*]] = add i64 1, [[COUNT]]
+; CHECK-NEXT:    store i64 [[INC]], ptr @dcc_counters
+; CHECK-NEXT:    ret void
+
+; INVALID: dynamic-cc parameter 'shm' can't be combined with 'tls'
@@ -0,0 +1,25 @@
+; RUN: %clang -S -emit-llvm %S/../inputs/input_for_cc_shm.c -o - \
+; RUN:   | opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<shm>,verify" -o %t.bc
+; RUN: %clang %t.bc -L%shlibdir -llt_rt -Wl,-rpath,%shlibdir -o %t.bin
+
+; RUN: env LT_PROFILE_FILE=%t.ltprof %t.bin ../bin/lt-top --iterations=2 --interval=100 | FileCheck %s
+; RUN: ../bin/dcc-prof --sort=name %t.ltprof | FileCheck %s --check-prefix=PROFILE
+
+; Instrument a program that keeps calling `foo` with DynamicCallCounter in the
+; `shm` mode and verify that lt-top, started by that program (with its PID),
+; reads the live counts while the program is running. `bar` and `main` are
+; only called once, i.e. before the first sample. The profile is written as
+; in the `flush` mode.
+
+; CHECK:      LLVM-TUTOR: live call rates ({{.*}}, pid {{[0-9]+}})
+; CHECK:      NAME                 CALLS/S         TOTAL
+; CHECK-NEXT: -------------------------------------------------
+; CHECK-NEXT: foo                  {{[1-9][0-9]*}} {{ *}}{{[1-9][0-9]*}}
+; CHECK-NEXT: bar                  0               1
+; CHECK-NEXT: main                 0               1
+; CHECK:      LLVM-TUTOR: live call rates
+; CHECK:      foo                  {{[1-9][0-9]*}} {{ *}}{{[1-9][0-9]*}}
+
+; PROFILE: bar                  1
+; PROFILE: foo                  {{[1-9][0-9]*}}
+; PROFILE: main                 1
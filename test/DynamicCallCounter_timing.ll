@@ -0,0 +1,74 @@
+; RUN:  opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<timing>,verify"  -S %s | FileCheck %s
+
+; Instrument this file with DynamicCallCounter in the `timing` mode and verify
+; that every function calls into lt_rt on entry, before every return and
+; wherever control comes back from callees that were left by unwinding or by
+; `longjmp` (i.e. in landing pads and after `setjmp`).
+
+; One {inclusive, exclusive} pair per function, registered with lt_rt
+; CHECK-DAG: @dcc_function_times = internal global [3 x { i64, i64 }] zeroinitializer, align 8
+; CHECK-DAG: @dcc_module = internal global {{.*}} { {{.*}}, ptr @dcc_function_times, i64 1, ptr null, ptr null, ptr null }, align 8
+
+declare i32 @_setjmp(ptr) returns_twice
+declare void @may_throw()
+declare i32 @__gxx_personality_v0(...)
+
+; The hooks are injected after the static allocas and get the frame address
+; of the function. Every `ret` gets its own exit hook.
+define i32 @foo(i32 %x) {
+; CHECK-LABEL: @foo(
+; CHECK:         %a = alloca i32
+; CHECK-NEXT:    [[FRAME:%.*]] = call ptr @llvm.frameaddress.p0(i32 0)
+; CHECK-NEXT:    call void @__lt_rt_enter_function(ptr [[TIMES:.*@dcc_function_times.*]], ptr [[FRAME]])
+; CHECK:       one:
+; CHECK-NEXT:    call void @__lt_rt_exit_function(ptr [[TIMES]], ptr [[FRAME]])
+; CHECK-NEXT:    ret i32 1
+; CHECK:       two:
+; CHECK-NEXT:    call void @__lt_rt_exit_function(ptr [[TIMES]], ptr [[FRAME]])
+; CHECK-NEXT:    ret i32 2
+entry:
+  %a = alloca i32
+  store i32 %x, ptr %a
+  %c = icmp eq i32 %x, 0
+  br i1 %c, label %one, label %two
+one:
+  ret i32 1
+two:
+  ret i32 2
+}
+
+; `resume` leaves the function without the exit hook - lt_rt pops the
+; activation once the exception is caught
+define void @bar(ptr %buf) personality ptr @__gxx_personality_v0 {
+; CHECK-LABEL: @bar(
+; CHECK:         [[FRAME:%.*]] = call ptr @llvm.frameaddress.p0(i32 0)
+; CHECK-NEXT:    call void @__lt_rt_enter_function(ptr [[TIMES:.*@dcc_function_times.*]], ptr [[FRAME]])
+; CHECK-NEXT:    %r = call i32 @_setjmp(ptr %buf)
+; CHECK-NEXT:    call void @__lt_rt_unwind_to(ptr [[TIMES]], ptr [[FRAME]])
+; CHECK:       cont:
+; CHECK-NEXT:    call void @__lt_rt_exit_function(ptr [[TIMES]], ptr [[FRAME]])
+; CHECK-NEXT:    ret void
+; CHECK:       lpad:
+; CHECK-NEXT:    %lp = landingpad { ptr, i32 }
+; CHECK-NEXT:    cleanup
+; CHECK-NEXT:    call void @__lt_rt_unwind_to(ptr [[TIMES]], ptr [[FRAME]])
+; CHECK-NEXT:    resume { ptr, i32 } %lp
+entry:
+  %r = call i32 @_setjmp(ptr %buf)
+  invoke void @may_throw() to label %cont unwind label %lpad
+cont:
+  ret void
+lpad:
+  %lp = landingpad { ptr, i32 } cleanup
+  resume { ptr, i32 } %lp
+}
+
+; Nothing can go between a `musttail` call and the return
+define i32 @baz(i32 %x) {
+; CHECK-LABEL: @baz(
+; CHECK:         call void @__lt_rt_exit_function(ptr {{.*}}@dcc_function_times{{.*}}, ptr %frame)
+; CHECK-NEXT:    %r = musttail call i32 @foo(i32 %x)
+; CHECK-NEXT:    ret i32 %r
+  %r = musttail call i32 @foo(i32 %x)
+  ret i32 %r
+}
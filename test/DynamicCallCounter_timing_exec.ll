@@ -0,0 +1,30 @@
+; RUN: %clang -S -emit-llvm %S/../inputs/input_for_cc_timing.c -o - \
+; RUN:   | opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<timing>,verify" -o %t.bc
+; RUN: %clang %t.bc -L%shlibdir -llt_rt -Wl,-rpath,%shlibdir -o %t.bin
+; RUN: rm -f %t.ltprof
+; RUN: env LT_PROFILE_FILE=%t.ltprof LT_RT_CLOCK=monotonic %t.bin
+; RUN: ../bin/dcc-prof --format=csv %t.ltprof | FileCheck %s
+; RUN: ../bin/dcc-prof %t.ltprof | FileCheck %s --check-prefix=TEXT
+
+; Instrument a program that uses `longjmp` with DynamicCallCounter in the
+; `timing` mode, run it and verify the recorded times (in nanoseconds, as
+; LT_RT_CLOCK=monotonic). Every call to `wait_ms` sleeps for 10 or 20 ms. The
+; bounds below leave some slack for oversleeping.
+
+; `wait_ms` has no (timed) callees, so its inclusive and exclusive times are
+; the same. The other functions spend almost all of their time in callees.
+; CHECK: name,count,inclusive,exclusive
+; CHECK-NEXT: wait_ms,5,[[WAIT:[0-9]+]],[[WAIT]]
+; 20 ms
+; CHECK-NEXT: leaf,2,{{[23][0-9][0-9][0-9][0-9][0-9][0-9][0-9]}},{{[0-9]+}}
+; 40 ms. The activation of `mid` that was left with `longjmp` ends when
+; `setjmp` returns in `main`, i.e. the time spent in `other` is not attributed
+; to `mid`.
+; CHECK-NEXT: mid,2,{{[45][0-9][0-9][0-9][0-9][0-9][0-9][0-9]}},{{[0-9]+}}
+; 20 ms
+; CHECK-NEXT: other,1,{{[23][0-9][0-9][0-9][0-9][0-9][0-9][0-9]}},{{[0-9]+}}
+; 60 ms
+; CHECK-NEXT: main,1,{{[67][0-9][0-9][0-9][0-9][0-9][0-9][0-9]}},{{[0-9]+}}
+
+; TEXT: NAME                 #N DIRECT CALLS INCLUSIVE (ns)       EXCLUSIVE (ns)
+; TEXT: wait_ms              5
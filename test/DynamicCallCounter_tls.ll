@@ -0,0 +1,118 @@
+; RUN:  opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<tls>,verify"  -S %s | FileCheck %s
+; RUN:  opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<tls;flush>,verify"  -S %s | FileCheck %s --check-prefix=FLUSH
+
+; Instrument this file with DynamicCallCounter in the `tls` mode and verify
+; that the inserted code is correct.
+
+; The global variables inserted by the pass
+; CHECK-DAG: @dcc_counters = internal global [1 x i64] zeroinitializer, section "lt_dcc_cnts", align 8
+; CHECK-DAG: @dcc_thread_counters = internal thread_local global [1 x i64] zeroinitializer, align 8
+; CHECK-DAG: @dcc_thread_registered = internal thread_local global i8 0
+; CHECK-DAG: @dcc_thread_key = internal global i32 0
+; CHECK-DAG: @dcc_thread_node = internal thread_local global { ptr, ptr, ptr } zeroinitializer
+; CHECK-DAG: @dcc_threads = internal global ptr null
+; CHECK-DAG: @dcc_threads_lock = internal global i32 0
+; CHECK-DAG: @llvm.global_ctors = appending global {{.*}} @dcc_init_thread_counters
+; CHECK-DAG: @llvm.global_dtors = appending global {{.*}} @printf_wrapper
+
+define void @foo() {
+; CHECK-LABEL: @foo(
+; Call-counting instructions inserted by the pass - these only touch the
+; thread-local shard
+; CHECK-NEXT:    [[SHARD:%.*]] = call ptr @llvm.threadlocal.address.p0(ptr @dcc_thread_counters)
+; CHECK-NEXT:    [[PTR:%.*]] = getelementptr inbounds [1 x i64], ptr [[SHARD]], i64 0, i64 0
+; CHECK-NEXT:    [[TMP1:%.*]] = load i64, ptr [[PTR]]
+; CHECK-NEXT:    [[TMP2:%.*]] = add i64 1, [[TMP1]]
+; CHECK-NEXT:    store i64 [[TMP2]], ptr [[PTR]]
+; Register the thread-exit hook the first time this thread gets here
+; CHECK-NEXT:    [[FLAG:%.*]] = call ptr @llvm.threadlocal.address.p0(ptr @dcc_thread_registered)
+; CHECK-NEXT:    [[REG:%.*]] = load i8, ptr [[FLAG]]
+; CHECK-NEXT:    [[COND:%.*]] = icmp eq i8 [[REG]], 0
+; CHECK-NEXT:    br i1 [[COND]], label %[[THEN:.*]], label %[[TAIL:.*]], !prof
+; CHECK:       [[THEN]]:
+; CHECK-NEXT:    call void @dcc_register_thread()
+; CHECK-NEXT:    br label %[[TAIL]]
+; CHECK:       [[TAIL]]:
+; CHECK-NEXT:    ret void
+;
+  ret void
+}
+
+; The list of the registered shards is protected by a spin lock
+; CHECK-LABEL: define internal void @dcc_lock_threads()
+; CHECK:       loop:
+; CHECK-NEXT:    [[XCHG:%.*]] = cmpxchg ptr @dcc_threads_lock, i32 0, i32 1 acquire monotonic, align 4
+; CHECK-NEXT:    [[OK:%.*]] = extractvalue { i32, i1 } [[XCHG]], 1
+; CHECK-NEXT:    br i1 [[OK]], label %exit, label %loop
+; CHECK-LABEL: define internal void @dcc_unlock_threads()
+; CHECK-NEXT:  enter:
+; CHECK-NEXT:    store atomic i32 0, ptr @dcc_threads_lock release, align 4
+
+; Merging a shard into the global counters
+; CHECK-LABEL: define internal void @dcc_merge_shard(ptr
+; CHECK-SAME:    [[SHARD:%.*]])
+; CHECK:       loop:
+; CHECK-NEXT:    [[SLOT:%.*]] = phi i64
+; CHECK-NEXT:    [[SHARDPTR:%.*]] = getelementptr inbounds [1 x i64], ptr [[SHARD]], i64 0, i64 [[SLOT]]
+; CHECK-NEXT:    [[CNTPTR:%.*]] = getelementptr inbounds [1 x i64], ptr @dcc_counters, i64 0, i64 [[SLOT]]
+; CHECK-NEXT:    [[VAL:%.*]] = load i64, ptr [[SHARDPTR]]
+; CHECK-NEXT:    atomicrmw add ptr [[CNTPTR]], i64 [[VAL]] monotonic, align 8
+; CHECK-NEXT:    store i64 0, ptr [[SHARDPTR]]
+
+; The thread-exit hook merges the shard of the exiting thread (unless it has
+; already been merged) and unlinks it
+; CHECK-LABEL: define internal void @dcc_merge_thread_counters(ptr
+; CHECK:         call void @dcc_lock_threads()
+; CHECK:         [[NODESHARD:%.*]] = load ptr
+; CHECK-NEXT:    [[MERGED:%.*]] = icmp eq ptr [[NODESHARD]], null
+; CHECK-NEXT:    br i1 [[MERGED]], label %exit, label %merge
+; CHECK:       merge:
+; CHECK-NEXT:    call void @dcc_merge_shard(ptr [[NODESHARD]])
+; CHECK:       is_first:
+; CHECK-NEXT:    store ptr {{.*}}, ptr @dcc_threads
+; CHECK:       exit:
+; CHECK-NEXT:    call void @dcc_unlock_threads()
+
+; At exit, the shards of all the threads that are still registered are merged
+; CHECK-LABEL: define internal void @dcc_merge_all_threads()
+; CHECK:         call void @dcc_lock_threads()
+; CHECK-NEXT:    [[FIRST:%.*]] = load ptr, ptr @dcc_threads
+; CHECK:       loop:
+; CHECK-NEXT:    [[NODE:%.*]] = phi ptr [ [[FIRST]], %enter ]
+; CHECK:         call void @dcc_merge_shard(ptr
+; CHECK:       exit:
+; CHECK-NEXT:    store ptr null, ptr @dcc_threads
+; CHECK-NEXT:    call void @dcc_unlock_threads()
+
+; Registering a thread links its entry into the list
+; CHECK-LABEL: define internal void @dcc_register_thread()
+; CHECK:         store i8 1
+; CHECK:         call void @dcc_lock_threads()
+; CHECK:       exit:
+; CHECK:         store ptr [[NODE:[^,]*]], ptr @dcc_threads
+; CHECK-NEXT:    call void @dcc_unlock_threads()
+; CHECK:         call i32 @pthread_setspecific(i32 {{.*}}, ptr [[NODE]])
+
+; CHECK-LABEL: define internal void @dcc_init_thread_counters()
+; CHECK:         call i32 @pthread_key_create(ptr @dcc_thread_key, ptr @dcc_merge_thread_counters)
+
+; `printf_wrapper` merges the counters of the threads that are still running
+; before printing
+; CHECK-LABEL: define void @printf_wrapper()
+; CHECK-NEXT:  enter:
+; CHECK-NEXT:    call void @dcc_merge_all_threads()
+
+; With lt_rt, the module descriptor also points to a function that zeroes the
+; shard of the calling thread and resets the list of the registered shards
+; (lt_rt calls it in forked children)
+; FLUSH-DAG: @dcc_module = internal global {{.*}}, ptr null, ptr null, ptr @dcc_reset_thread_counters }, align 8
+; FLUSH-LABEL: define internal void @dcc_reset_thread_counters()
+; FLUSH-NEXT:  enter:
+; FLUSH-NEXT:    [[SHARD:%.*]] = call ptr @llvm.threadlocal.address.p0(ptr @dcc_thread_counters)
+; FLUSH-NEXT:    call void @llvm.memset.p0.i64(ptr align 8 [[SHARD]], i8 0, i64 8, i1 false)
+; FLUSH-NEXT:    store i32 0, ptr @dcc_threads_lock
+; FLUSH-NEXT:    store ptr null, ptr @dcc_threads
+; FLUSH:       link:
+; FLUSH:         store ptr [[SHARD]]
+; FLUSH-NEXT:    store ptr {{.*}}, ptr @dcc_threads
+; FLUSH-NEXT:    br label %exit
@@ -0,0 +1,13 @@
+; RUN: %clang -S -emit-llvm %S/../inputs/input_for_cc_threads.c -o - \
+; RUN:   | opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<tls>,verify" -o %t.bc
+; RUN: %clang -pthread %t.bc -o %t.bin
+; RUN: %t.bin | FileCheck %s
+
+; Instrument a multi-threaded program with DynamicCallCounter in the `tls`
+; mode, run it and verify that no updates were lost, i.e. that the counts are
+; exact: 8 threads x 100000 iterations (+1 call to foo from main).
+
+; CHECK-DAG: foo                  800001
+; CHECK-DAG: bar                  800000
+; CHECK-DAG: worker               8
+; CHECK-DAG: main                 1
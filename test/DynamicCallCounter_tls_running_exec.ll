@@ -0,0 +1,15 @@
+; RUN: %clang -S -emit-llvm %S/../inputs/input_for_cc_threads_running.c -o - \
+; RUN:   | opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<tls>,verify" -o %t.bc
+; RUN: %clang -pthread %t.bc -o %t.bin
+; RUN: %t.bin | FileCheck %s
+
+; Instrument a multi-threaded program with DynamicCallCounter in the `tls`
+; mode and run it. None of the threads has exited when `main` returns, so all
+; the counts (apart from the ones from `main`) come from the shards of threads
+; that are still running: 4 threads x 1000 iterations (+1 call to foo from
+; main).
+
+; CHECK-DAG: foo                  4001
+; CHECK-DAG: bar                  4000
+; CHECK-DAG: worker               4
+; CHECK-DAG: main                 1
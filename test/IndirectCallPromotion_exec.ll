@@ -0,0 +1,44 @@
+; RUN: %clang -S -emit-llvm %S/../inputs/input_for_icall_promotion.c -o %t.ll
+; RUN: opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<edges>" %t.ll -o %t.bc
+; RUN: %clang %t.bc -L%shlibdir -llt_rt -Wl,-rpath,%shlibdir -o %t.bin
+; RUN: rm -f %t.ltprof
+; RUN: env LT_PROFILE_FILE=%t.ltprof %t.bin | FileCheck %s --check-prefix=OUTPUT
+
+; Promote the targets of the indirect call in `apply`
+; RUN: opt -load-pass-plugin %shlibdir/libIndirectCallPromotion%shlibext -passes="indirect-call-promotion<file=%t.ltprof>,verify" -S %t.ll -o %t.promoted.ll
+; RUN: FileCheck %s --input-file=%t.promoted.ll
+; RUN: opt -load-pass-plugin %shlibdir/libIndirectCallPromotion%shlibext -passes="indirect-call-promotion<file=%t.ltprof;threshold=80>" -S %t.ll | FileCheck %s --check-prefix=THRESHOLD
+; RUN: opt -load-pass-plugin %shlibdir/libIndirectCallPromotion%shlibext -passes="indirect-call-promotion<file=%t.ltprof;max-targets=1>" -S %t.ll | FileCheck %s --check-prefix=THRESHOLD
+
+; Promoting the calls mustn't change the behaviour of the program
+; RUN: %clang %t.promoted.ll -o %t.promoted.bin
+; RUN: %t.promoted.bin | FileCheck %s --check-prefix=OUTPUT
+
+; OUTPUT: 5215
+
+; With the default threshold (30%), every target receives enough of the calls
+; that are left: `add` 80 of 100, `sub` 15 of 20 and `mul` 5 of 5
+; CHECK-LABEL: define {{.*}}i32 @apply(
+; CHECK: [[IS_ADD:%.*]] = icmp eq ptr [[FPTR:%.*]], @add
+; CHECK-NEXT: br i1 [[IS_ADD]], {{.*}}, !prof ![[ADD_WEIGHTS:[0-9]+]]
+; CHECK: call i32 @add(
+; CHECK: [[IS_SUB:%.*]] = icmp eq ptr [[FPTR]], @sub
+; CHECK-NEXT: br i1 [[IS_SUB]], {{.*}}, !prof ![[SUB_WEIGHTS:[0-9]+]]
+; CHECK: call i32 @sub(
+; CHECK: [[IS_MUL:%.*]] = icmp eq ptr [[FPTR]], @mul
+; CHECK-NEXT: br i1 [[IS_MUL]], {{.*}}, !prof ![[MUL_WEIGHTS:[0-9]+]]
+; CHECK: call i32 @mul(
+; The original call is kept as the fallback
+; CHECK: call i32 [[FPTR]](
+; CHECK-LABEL: define {{.*}}i32 @main(
+
+; CHECK-DAG: ![[ADD_WEIGHTS]] = !{!"branch_weights", i32 80, i32 20}
+; CHECK-DAG: ![[SUB_WEIGHTS]] = !{!"branch_weights", i32 15, i32 5}
+; CHECK-DAG: ![[MUL_WEIGHTS]] = !{!"branch_weights", i32 5, i32 0}
+
+; With `threshold=80`, `sub` (75% of the remaining calls) is not promoted.
+; With `max-targets=1`, only `add` is promoted.
+; THRESHOLD-LABEL: define {{.*}}i32 @apply(
+; THRESHOLD: icmp eq ptr {{.*}}, @add
+; THRESHOLD-NOT: icmp eq ptr
+; THRESHOLD-LABEL: define {{.*}}i32 @main(
@@ -0,0 +1,63 @@
+; RUN: %clang -S -emit-llvm %S/../inputs/input_for_profile_annotator.c -o %t.ll
+; RUN: opt -load-pass-plugin %shlibdir/libDynamicCallCounter%shlibext -passes="dynamic-cc<blocks>" %t.ll -o %t.bc
+; RUN: %clang %t.bc -L%shlibdir -llt_rt -Wl,-rpath,%shlibdir -o %t.bin
+; RUN: rm -f %t.ltprof
+; RUN: env LT_PROFILE_FILE=%t.ltprof %t.bin | FileCheck %s --check-prefix=OUTPUT
+
+; Annotate the module that was instrumented
+; RUN: opt -load-pass-plugin %shlibdir/libProfileAnnotator%shlibext -passes="profile-annotator<file=%t.ltprof>,verify" -S %t.ll | FileCheck %s
+
+; Annotate an updated version of the module - the profile is stale, but that's
+; only worth a warning
+; RUN: %clang -DSTALE -S -emit-llvm %S/../inputs/input_for_profile_annotator.c -o %t.stale.ll
+; RUN: opt -load-pass-plugin %shlibdir/libProfileAnnotator%shlibext -passes="profile-annotator<file=%t.ltprof>,verify" -S %t.stale.ll 2>%t.stale.err | FileCheck %s --check-prefix=STALE
+; RUN: FileCheck %s --input-file=%t.stale.err --check-prefix=WARNING
+
+; A missing profile is an error
+; RUN: not opt -load-pass-plugin %shlibdir/libProfileAnnotator%shlibext -passes="profile-annotator<file=%t.missing.ltprof>" -disable-output %t.ll 2>&1 | FileCheck %s --check-prefix=MISSING
+
+; OUTPUT: 5490
+
+; `common` is entered 90 times and `rare` 10 times. That's enough for `common`
+; to be hot. `never_called` is cold.
+; CHECK-LABEL: define {{.*}}i32 @common(
+; CHECK-SAME: #[[HOT:[0-9]+]] !prof ![[COMMON_COUNT:[0-9]+]] !section_prefix ![[HOT_PREFIX:[0-9]+]] {
+; CHECK-LABEL: define {{.*}}i32 @rare(
+; CHECK-SAME: !prof ![[RARE_COUNT:[0-9]+]]
+; CHECK-LABEL: define {{.*}}void @never_called(
+; CHECK-SAME: #[[COLD:[0-9]+]] !prof ![[NEVER_COUNT:[0-9]+]] !section_prefix ![[COLD_PREFIX:[0-9]+]] {
+
+; `main` runs once, but its loop is hot. The loop condition comes first.
+; CHECK-LABEL: define {{.*}}i32 @main(
+; CHECK-SAME: !prof ![[MAIN_COUNT:[0-9]+]] {
+; CHECK: br i1 %{{.*}}, label %{{.*}}, label %{{.*}}, !prof ![[LOOP_WEIGHTS:[0-9]+]]
+; CHECK: br i1 %{{.*}}, label %{{.*}}, label %{{.*}}, !prof ![[IF_WEIGHTS:[0-9]+]]
+
+; CHECK: attributes #[[HOT]] = { {{.*}}hot{{.*}} }
+; CHECK: attributes #[[COLD]] = { {{.*}}cold{{.*}} }
+
+; CHECK: !{i32 1, !"ProfileSummary", !{{[0-9]+}}}
+; CHECK-DAG: ![[COMMON_COUNT]] = !{!"function_entry_count", i64 90}
+; CHECK-DAG: ![[RARE_COUNT]] = !{!"function_entry_count", i64 10}
+; CHECK-DAG: ![[NEVER_COUNT]] = !{!"function_entry_count", i64 0}
+; CHECK-DAG: ![[MAIN_COUNT]] = !{!"function_entry_count", i64 1}
+; CHECK-DAG: ![[HOT_PREFIX]] = !{!"function_section_prefix", !"hot"}
+; CHECK-DAG: ![[COLD_PREFIX]] = !{!"function_section_prefix", !"unlikely"}
+; CHECK-DAG: ![[LOOP_WEIGHTS]] = !{!"branch_weights", i32 100, i32 1}
+; CHECK-DAG: ![[IF_WEIGHTS]] = !{!"branch_weights", i32 10, i32 90}
+
+; The renamed function has no profile and the CFG of `main` has changed, so
+; `main` only gets its entry count
+; STALE-LABEL: define {{.*}}i32 @common(
+; STALE-SAME: !prof
+; STALE-LABEL: define {{.*}}i32 @rarely_used(
+; STALE-NOT: !prof
+; STALE-SAME: {
+; STALE-LABEL: define {{.*}}i32 @main(
+; STALE-SAME: !prof ![[MAIN_COUNT:[0-9]+]] {
+; STALE-NOT: branch_weights
+; STALE: ![[MAIN_COUNT]] = !{!"function_entry_count", i64 1}
+
+; WARNING: warning: {{.*}}.ltprof: stale profile: 1 of 4 function(s) not found, 1 function(s) with a changed CFG (branch weights dropped)
+
+; MISSING: error: {{.*}}missing.ltprof: {{.*}}
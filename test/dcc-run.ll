@@ -0,0 +1,37 @@
+; RUN: ../bin/dcc-run %S/Inputs/CallCounterInput.ll | FileCheck %s
+
+; RUN: %clang -S -emit-llvm %S/../inputs/input_for_cc.c -o %t.ll
+; RUN: ../bin/dcc-run --format=json %S/Inputs/CallCounterInput.ll %t.ll | FileCheck %s --check-prefix=JSON
+; RUN: ../bin/dcc-run --format=csv -o %t.csv %t.ll
+; RUN: FileCheck %s --input-file=%t.csv --check-prefix=CSV
+
+; Test DynamicCallCounter when run via dcc-run, i.e. in the ORC JIT. The counts
+; are read from the JIT memory (rather than printed by the instrumented
+; module).
+
+; CHECK:      LLVM-TUTOR: dynamic analysis results ({{.*}}CallCounterInput.ll, exit code 0)
+; CHECK:      NAME                 #N DIRECT CALLS
+; CHECK-NEXT: -------------------------------------------------
+; CHECK-NEXT: foo                  13
+; CHECK-NEXT: bar                  2
+; CHECK-NEXT: fez                  1
+; CHECK-NEXT: main                 1
+
+; JSON:      "modules": [
+; JSON:      "module": "{{.*}}CallCounterInput.ll",
+; JSON-NEXT: "exit_code": 0,
+; JSON-NEXT: "functions": [
+; JSON:      "name": "foo",
+; JSON-NEXT: "count": 13
+; JSON:      "name": "main",
+; JSON-NEXT: "count": 1
+; JSON:      "module": "{{.*}}.ll",
+; JSON-NEXT: "exit_code": 0,
+; JSON:      "name": "foo",
+; JSON-NEXT: "count": 13
+
+; CSV:      module,exit_code,name,count
+; CSV-NEXT: {{.*}}.ll,0,foo,13
+; CSV-NEXT: {{.*}}.ll,0,bar,2
+; CSV-NEXT: {{.*}}.ll,0,fez,1
+; CSV-NEXT: {{.*}}.ll,0,main,1
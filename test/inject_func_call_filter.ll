@@ -0,0 +1,117 @@
+; RUN: echo "# Debugging helpers"  > %t.deny
+; RUN: echo "debug_.*"           >> %t.deny
+; RUN: echo "b[a-z]z"             > %t.allow
+; RUN: echo "foo"                >> %t.allow
+; RUN: echo "("                   > %t.bad
+
+; RUN:  opt -load-pass-plugin=%shlibdir/libInjectFuncCall%shlibext -passes="inject-func-call<trace;deny=%t.deny;min-size=3;skip-cold>,verify" -S %s 2>&1 \
+; RUN:  | FileCheck %s --check-prefix=TRACE
+; RUN:  opt -load-pass-plugin=%shlibdir/libInjectFuncCall%shlibext -passes="inject-func-call<allow=%t.allow;deny=%t.deny>,verify" -S %s 2>&1 \
+; RUN:  | FileCheck %s --check-prefix=ALLOW
+; RUN:  opt -load-pass-plugin=%shlibdir/libInjectFuncCall%shlibext -passes="inject-func-call<only-hot;min-entry-count=100>,verify" -S %s 2>&1 \
+; RUN:  | FileCheck %s --check-prefix=HOT
+; RUN:  opt -load-pass-plugin=%shlibdir/libInjectFuncCall%shlibext -passes="inject-func-call<min-entry-count=100>,verify" -S %s 2>&1 \
+; RUN:  | FileCheck %s --check-prefix=COUNT
+; RUN: not opt -load-pass-plugin=%shlibdir/libInjectFuncCall%shlibext -passes="inject-func-call<allow=%t.missing>" -disable-output %s 2>&1 \
+; RUN:  | FileCheck %s --check-prefix=MISSING
+; RUN: not opt -load-pass-plugin=%shlibdir/libInjectFuncCall%shlibext -passes="inject-func-call<deny=%t.bad>" -disable-output %s 2>&1 \
+; RUN:  | FileCheck %s --check-prefix=BADREGEX
+; RUN: not opt -load-pass-plugin=%shlibdir/libInjectFuncCall%shlibext -passes="inject-func-call<min-size=big>" -disable-output %s 2>&1 \
+; RUN:  | FileCheck %s --check-prefix=INVALID
+
+; Verify that the function filters restrict the functions instrumented by
+; InjectFuncCall (in both modes) and that the pass reports how many functions
+; were skipped and why.
+
+; Denied: @debug_dump. Smaller than 3 instructions: @foo. Cold: @baz.
+; TRACE: remark: inject-func-call: instrumented 3 function(s), skipped 3 (1 denied, 1 cold, 1 smaller than 3 instructions)
+; TRACE: @ifc_names = internal constant [13 x i8] c"bar\00bez\00rare\00", align 1
+; TRACE-LABEL: define i32 @foo
+; TRACE-NOT:   call void @__lt_rt_trace_enter
+; TRACE-LABEL: define i32 @bar
+; TRACE-NEXT:  call void @__lt_rt_trace_enter(ptr @ifc_trace_module, i32 0, i32 2)
+; TRACE-LABEL: define i32 @baz
+; TRACE-NOT:   call void @__lt_rt_trace_enter
+; TRACE-LABEL: define i32 @bez
+; TRACE-NEXT:  call void @__lt_rt_trace_enter(ptr @ifc_trace_module, i32 1, i32 1)
+; TRACE-LABEL: define i32 @rare
+; TRACE-NEXT:  call void @__lt_rt_trace_enter(ptr @ifc_trace_module, i32 2, i32 1)
+; TRACE-LABEL: define void @debug_dump
+; TRACE-NOT:   call void @__lt_rt_trace_enter
+
+; The deny list takes precedence (`debug_.*` would not match the allow list
+; anyway), the allow list has to match the whole name (so no `bar`)
+; ALLOW: remark: inject-func-call: instrumented 3 function(s), skipped 3 (1 denied, 2 not allowed)
+; ALLOW-LABEL: define i32 @foo
+; ALLOW-NEXT:  call i32 (ptr, ...) @printf
+; ALLOW-LABEL: define i32 @bar
+; ALLOW-NOT:   call i32 (ptr, ...) @printf
+; ALLOW-LABEL: define i32 @baz
+; ALLOW-NEXT:  call i32 (ptr, ...) @printf
+; ALLOW-LABEL: define i32 @bez
+; ALLOW-NEXT:  call i32 (ptr, ...) @printf
+; ALLOW-LABEL: define i32 @rare
+; ALLOW-NOT:   call i32 (ptr, ...) @printf
+; ALLOW-LABEL: define void @debug_dump
+; ALLOW-NOT:   call i32 (ptr, ...) @printf
+
+; Only @bez is hot (and entered often enough)
+; HOT: remark: inject-func-call: instrumented 1 function(s), skipped 5 (5 not hot)
+; HOT-LABEL: define i32 @bez
+; HOT-NEXT:  call i32 (ptr, ...) @printf
+
+; Functions without an entry count are instrumented
+; COUNT: remark: inject-func-call: instrumented 5 function(s), skipped 1 (1 entered fewer than 100 times)
+; COUNT-LABEL: define i32 @rare
+; COUNT-NOT:   call i32 (ptr, ...) @printf
+; COUNT-LABEL: define void @debug_dump
+; COUNT-NEXT:  call i32 (ptr, ...) @printf
+
+; MISSING: error: inject-func-call: {{.*}}.missing: {{[Nn]}}o such file or directory
+; BADREGEX: error: inject-func-call: {{.*}}.bad:1: invalid regex '('
+; INVALID: invalid inject-func-call min-size value 'big'
+
+define i32 @foo(i32) {
+  %2 = shl nsw i32 %0, 1
+  ret i32 %2
+}
+
+define i32 @bar(i32, i32) {
+  %3 = tail call i32 @foo(i32 %1)
+  %4 = shl i32 %3, 1
+  %5 = add nsw i32 %4, %0
+  ret i32 %5
+}
+
+define i32 @baz(i32, i32, i32) cold {
+  %4 = tail call i32 @bar(i32 %0, i32 %1)
+  %5 = shl i32 %4, 1
+  %6 = mul nsw i32 %2, 3
+  %7 = add i32 %6, %0
+  %8 = add i32 %7, %5
+  ret i32 %8
+}
+
+define i32 @bez(i32) hot !prof !0 {
+  %2 = tail call i32 @foo(i32 %0)
+  %3 = tail call i32 @bar(i32 %0, i32 %2)
+  %4 = add nsw i32 %3, %2
+  %5 = tail call i32 @baz(i32 %0, i32 %4, i32 123)
+  %6 = add nsw i32 %4, %5
+  ret i32 %6
+}
+
+define i32 @rare(i32) !prof !1 {
+  %2 = tail call i32 @bez(i32 %0)
+  %3 = add nsw i32 %2, 1
+  ret i32 %3
+}
+
+define void @debug_dump(i32) {
+  %2 = tail call i32 @rare(i32 %0)
+  %3 = tail call i32 @rare(i32 %2)
+  ret void
+}
+
+!0 = !{!"function_entry_count", i64 1000}
+!1 = !{!"function_entry_count", i64 5}
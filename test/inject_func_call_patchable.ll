@@ -0,0 +1,38 @@
+; RUN:  opt -load-pass-plugin=%shlibdir/libInjectFuncCall%shlibext -passes="inject-func-call<trace=patchable>,verify" -S %s\
+; RUN:  | FileCheck %s
+
+; Verify that InjectFuncCall in the `trace=patchable` mode doesn't inject any
+; calls. Instead, it requests XRay sleds for every function and generates the
+; descriptor that lt_rt uses to find and patch them.
+
+; CHECK: @ifc_names = internal constant [8 x i8] c"foo\00bar\00", align 1
+; CHECK: @ifc_functions = internal constant [2 x ptr] [ptr @foo, ptr @bar]
+; CHECK: @ifc_num_args = internal constant [2 x i32] [i32 1, i32 2]
+; CHECK: @__start_xray_instr_map = extern_weak hidden global i8
+; CHECK: @__stop_xray_instr_map = extern_weak hidden global i8
+; CHECK: @ifc_patchable_module = internal global { { ptr, i64, i64, i32 }, ptr, ptr, ptr, ptr, ptr } { { ptr, i64, i64, i32 } { ptr @ifc_names, i64 2, i64 8, i32 0 }, ptr @ifc_functions, ptr @ifc_num_args, ptr @__start_xray_instr_map, ptr @__stop_xray_instr_map, ptr null }, align 8
+; CHECK: @llvm.global_ctors = appending global [1 x { i32, ptr, ptr }] [{ i32, ptr, ptr } { i32 0, ptr @ifc_register_trace_module, ptr null }]
+
+; CHECK-NOT:   call void @__lt_rt_trace_enter
+; CHECK-LABEL: define i32 @foo(i32 %0) #0 {
+; CHECK-NEXT:  %2 = shl nsw i32 %0, 1
+; CHECK-LABEL: define i32 @bar(i32 %0, i32 %1) #0 {
+; CHECK-NEXT:  %3 = tail call i32 @foo(i32 %1)
+
+; CHECK-LABEL: define internal void @ifc_register_trace_module()
+; CHECK:       call void @__lt_rt_register_patchable_module(ptr @ifc_patchable_module)
+; CHECK-NEXT:  ret void
+
+; CHECK: attributes #0 = { "function-instrument"="xray-always" }
+
+define i32 @foo(i32) {
+  %2 = shl nsw i32 %0, 1
+  ret i32 %2
+}
+
+define i32 @bar(i32, i32) {
+  %3 = tail call i32 @foo(i32 %1)
+  %4 = shl i32 %3, 1
+  %5 = add nsw i32 %4, %0
+  ret i32 %5
+}
@@ -0,0 +1,33 @@
+; REQUIRES: x86_64-linux
+; RUN: %clang -S -emit-llvm %S/../inputs/input_for_patchable.c -o - \
+; RUN:   | opt -load-pass-plugin %shlibdir/libInjectFuncCall%shlibext -passes="inject-func-call<trace=patchable>,verify" -o %t.bc
+; RUN: %clang %t.bc -L%shlibdir -llt_rt -Wl,-rpath,%shlibdir -o %t.bin
+; RUN: rm -f %t.lttrace
+; RUN: env LT_TRACE_FILE=%t.lttrace not %t.bin
+; RUN: ../bin/lt-trace --format=csv %t.lttrace | FileCheck %s
+; RUN: env LT_TRACE_FILE=%t.lttrace LT_RT_PATCH=1 not %t.bin
+; RUN: ../bin/lt-trace --format=csv %t.lttrace | FileCheck %s --check-prefix=ENV
+
+; Instrument input_for_patchable.c with InjectFuncCall in the `trace=patchable`
+; mode, run it and decode the recorded trace. The sleds are patched (i.e.
+; tracing is enabled) only between the calls to lt_rt_patch and lt_rt_unpatch,
+; so only the call to bar is recorded.
+
+; CHECK-NOT: Warning
+; CHECK: time,thread,event,name,args,captured
+; CHECK-NEXT: 0,1,enter,bar,2,
+; CHECK-NEXT: {{[0-9]+}},1,enter,foo,1,
+; CHECK-NEXT: {{[0-9]+}},1,exit,foo,,
+; CHECK-NEXT: {{[0-9]+}},1,exit,bar,,
+; CHECK-NOT: {{.}}
+
+; With LT_RT_PATCH=1, the sleds are patched before main is entered
+; ENV: time,thread,event,name,args,captured
+; ENV-NEXT: 0,1,enter,main,2,
+; ENV-NEXT: {{[0-9]+}},1,enter,foo,1,
+; ENV-NEXT: {{[0-9]+}},1,exit,foo,,
+; ENV-NEXT: {{[0-9]+}},1,enter,bar,2,
+; ENV-NEXT: {{[0-9]+}},1,enter,foo,1,
+; ENV-NEXT: {{[0-9]+}},1,exit,foo,,
+; ENV-NEXT: {{[0-9]+}},1,exit,bar,,
+; ENV-NOT: {{.}}
@@ -0,0 +1,65 @@
+; RUN:  opt -load-pass-plugin=%shlibdir/libInjectFuncCall%shlibext -passes="inject-func-call<trace>,verify" -S %s\
+; RUN:  | FileCheck %s
+; RUN: not opt -load-pass-plugin=%shlibdir/libInjectFuncCall%shlibext -passes="inject-func-call<bogus>" -disable-output %s 2>&1 \
+; RUN:  | FileCheck %s --check-prefix=INVALID
+
+; Verify that InjectFuncCall in the `trace` mode inserts calls to lt_rt
+; (instead of printf). The function names are stored once, in the module
+; descriptor, and every function passes its slot and its number of arguments.
+
+; The name table and the module descriptor (LTRTTraceModule in lt_rt.h)
+; CHECK: @ifc_names = internal constant [16 x i8] c"foo\00bar\00baz\00bez\00", align 1
+; CHECK-NEXT: @ifc_trace_module = internal global { ptr, i64, i64, i32 } { ptr @ifc_names, i64 4, i64 16, i32 0 }, align 8
+; CHECK-NEXT: @llvm.global_ctors = appending global [1 x { i32, ptr, ptr }] [{ i32, ptr, ptr } { i32 0, ptr @ifc_register_trace_module, ptr null }]
+; CHECK-NOT: @PrintfFormatStr
+
+; CHECK-LABEL: @foo
+; CHECK-NEXT:  call void @__lt_rt_trace_enter(ptr @ifc_trace_module, i32 0, i32 1)
+
+; CHECK-LABEL: @bar
+; CHECK-NEXT:  call void @__lt_rt_trace_enter(ptr @ifc_trace_module, i32 1, i32 2)
+
+; CHECK-LABEL: @baz
+; CHECK-NEXT:  call void @__lt_rt_trace_enter(ptr @ifc_trace_module, i32 2, i32 3)
+
+; CHECK-LABEL: @bez
+; CHECK-NEXT:  call void @__lt_rt_trace_enter(ptr @ifc_trace_module, i32 3, i32 1)
+
+; CHECK-LABEL: define internal void @ifc_register_trace_module()
+; CHECK-NEXT:  enter:
+; CHECK-NEXT:    call void @__lt_rt_register_trace_module(ptr @ifc_trace_module)
+
+; CHECK-NOT: @printf
+; CHECK-NOT: @__lt_rt_trace_exit
+
+; INVALID: invalid inject-func-call pass parameter 'bogus'
+
+define i32 @foo(i32) {
+  %2 = shl nsw i32 %0, 1
+  ret i32 %2
+}
+
+define i32 @bar(i32, i32) {
+  %3 = tail call i32 @foo(i32 %1)
+  %4 = shl i32 %3, 1
+  %5 = add nsw i32 %4, %0
+  ret i32 %5
+}
+
+define i32 @baz(i32, i32, i32) {
+  %4 = tail call i32 @bar(i32 %0, i32 %1)
+  %5 = shl i32 %4, 1
+  %6 = mul nsw i32 %2, 3
+  %7 = add i32 %6, %0
+  %8 = add i32 %7, %5
+  ret i32 %8
+}
+
+define i32 @bez(i32) {
+  %2 = tail call i32 @foo(i32 %0)
+  %3 = tail call i32 @bar(i32 %0, i32 %2)
+  %4 = add nsw i32 %3, %2
+  %5 = tail call i32 @baz(i32 %0, i32 %4, i32 123)
+  %6 = add nsw i32 %4, %5
+  ret i32 %6
+}
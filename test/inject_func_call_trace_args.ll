@@ -0,0 +1,62 @@
+; RUN: echo "# function  arguments" > %t.args
+; RUN: echo "copy 0 2"            >> %t.args
+; RUN: echo "flags 0 1 2"         >> %t.args
+; RUN: echo "not_defined 7"       >> %t.args
+; RUN: echo "copy 3"               > %t.range
+; RUN: echo "scale 0"              > %t.type
+; RUN: echo "copy"                 > %t.syntax
+
+; RUN:  opt -load-pass-plugin=%shlibdir/libInjectFuncCall%shlibext -passes="inject-func-call<trace;args=%t.args>,verify" -S %s\
+; RUN:  | FileCheck %s
+; RUN: not opt -load-pass-plugin=%shlibdir/libInjectFuncCall%shlibext -passes="inject-func-call<trace;args=%t.range>" -disable-output %s 2>&1 \
+; RUN:  | FileCheck %s --check-prefix=RANGE
+; RUN: not opt -load-pass-plugin=%shlibdir/libInjectFuncCall%shlibext -passes="inject-func-call<trace;args=%t.type>" -disable-output %s 2>&1 \
+; RUN:  | FileCheck %s --check-prefix=TYPE
+; RUN: not opt -load-pass-plugin=%shlibdir/libInjectFuncCall%shlibext -passes="inject-func-call<trace;args=%t.syntax>" -disable-output %s 2>&1 \
+; RUN:  | FileCheck %s --check-prefix=SYNTAX
+; RUN: not opt -load-pass-plugin=%shlibdir/libInjectFuncCall%shlibext -passes="inject-func-call<args=%t.args>" -disable-output %s 2>&1 \
+; RUN:  | FileCheck %s --check-prefix=INVALID
+
+; Verify that with `args=FILE`, InjectFuncCall records the values of the
+; selected arguments right after the function entry. Integers are widened to
+; 64 bits (sign-extended unless they are booleans or `zeroext`), pointers
+; are converted to integers.
+
+; CHECK-LABEL: define void @copy
+; CHECK-NEXT:  call void @__lt_rt_trace_enter(ptr @ifc_trace_module, i32 0, i32 3)
+; CHECK-NEXT:  [[DST:%[0-9]+]] = ptrtoint ptr %0 to i64
+; CHECK-NEXT:  call void @__lt_rt_trace_arg(ptr @ifc_trace_module, i32 0, i32 0, i32 1, i64 [[DST]])
+; CHECK-NEXT:  call void @__lt_rt_trace_arg(ptr @ifc_trace_module, i32 0, i32 2, i32 0, i64 %2)
+; CHECK-NEXT:  ret void
+
+; CHECK-LABEL: define i32 @flags
+; CHECK-NEXT:  call void @__lt_rt_trace_enter(ptr @ifc_trace_module, i32 1, i32 3)
+; CHECK-NEXT:  [[A:%[0-9]+]] = sext i32 %0 to i64
+; CHECK-NEXT:  call void @__lt_rt_trace_arg(ptr @ifc_trace_module, i32 1, i32 0, i32 0, i64 [[A]])
+; CHECK-NEXT:  [[B:%[0-9]+]] = zext i8 %1 to i64
+; CHECK-NEXT:  call void @__lt_rt_trace_arg(ptr @ifc_trace_module, i32 1, i32 1, i32 0, i64 [[B]])
+; CHECK-NEXT:  [[C:%[0-9]+]] = zext i1 %2 to i64
+; CHECK-NEXT:  call void @__lt_rt_trace_arg(ptr @ifc_trace_module, i32 1, i32 2, i32 0, i64 [[C]])
+
+; CHECK-LABEL: define double @scale
+; CHECK-NEXT:  call void @__lt_rt_trace_enter(ptr @ifc_trace_module, i32 2, i32 1)
+; CHECK-NEXT:  fmul
+
+; RANGE: error: inject-func-call: {{.*}}.range:1: 'copy' has no argument 3
+; TYPE: error: inject-func-call: {{.*}}.type:1: argument 0 of 'scale' is not an integer or a pointer
+; SYNTAX: error: inject-func-call: {{.*}}.syntax:1: expected '<function> <argument index>...'
+; INVALID: inject-func-call parameter 'args' requires 'trace' or 'trace=entry-exit'
+
+define void @copy(ptr, ptr, i64) {
+  ret void
+}
+
+define i32 @flags(i32, i8 zeroext, i1) {
+  %4 = add i32 %0, 1
+  ret i32 %4
+}
+
+define double @scale(double) {
+  %2 = fmul double %0, 2.0
+  ret double %2
+}
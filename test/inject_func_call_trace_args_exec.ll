@@ -0,0 +1,31 @@
+; RUN: echo "copy_buffer 0 2" > %t.args
+; RUN: echo "sum 1"          >> %t.args
+; RUN: %clang -S -emit-llvm %S/../inputs/input_for_trace_args.c -o - \
+; RUN:   | opt -load-pass-plugin %shlibdir/libInjectFuncCall%shlibext -passes="inject-func-call<trace;args=%t.args>,verify" -o %t.bc
+; RUN: %clang %t.bc -L%shlibdir -llt_rt -Wl,-rpath,%shlibdir -o %t.bin
+; RUN: rm -f %t.lttrace
+; RUN: env LT_TRACE_FILE=%t.lttrace not %t.bin
+; RUN: ../bin/lt-trace --format=csv %t.lttrace | FileCheck %s
+; RUN: ../bin/lt-trace --format=chrome %t.lttrace | FileCheck %s --check-prefix=CHROME
+
+; Instrument input_for_trace_args.c with InjectFuncCall, capturing the buffer
+; and the size passed to copy_buffer and the count passed to sum. Run it and
+; verify the decoded values.
+
+; CHECK: time,thread,event,name,args,captured
+; CHECK-NEXT: 0,1,enter,main,0,
+; CHECK-NEXT: {{[0-9]+}},1,enter,copy_buffer,3,arg0=0x{{[0-9a-f]+}} arg2=11
+; CHECK-NEXT: {{[0-9]+}},1,enter,copy_buffer,3,arg0=0x{{[0-9a-f]+}} arg2=64
+; CHECK-NEXT: {{[0-9]+}},1,enter,sum,2,arg1=4
+; CHECK-NEXT: {{[0-9]+}},1,enter,sum,2,arg1=-1
+; CHECK-NOT: {{.}}
+
+; CHROME:      "name": "copy_buffer",
+; CHROME:      "args": {
+; CHROME-NEXT: "num_args": 3,
+; CHROME-NEXT: "arg0": "0x{{[0-9a-f]+}}",
+; CHROME-NEXT: "arg2": 11
+; CHROME:      "name": "sum",
+; CHROME:      "args": {
+; CHROME-NEXT: "num_args": 2,
+; CHROME-NEXT: "arg1": 4
@@ -0,0 +1,32 @@
+; RUN: %clang -S -emit-llvm %S/../inputs/input_for_hello.c -o - \
+; RUN:   | opt -load-pass-plugin %shlibdir/libInjectFuncCall%shlibext -passes="inject-func-call<trace>,verify" -o %t.bc
+; RUN: %clang %t.bc -L%shlibdir -llt_rt -Wl,-rpath,%shlibdir -o %t.bin
+; RUN: rm -f %t.lttrace
+; RUN: env LT_TRACE_FILE=%t.lttrace not %t.bin
+; RUN: ../bin/lt-trace --format=csv %t.lttrace | FileCheck %s
+; RUN: env LT_TRACE_FILE=%t.lttrace LT_RT_TRACE_BUFFER_SIZE=4 not %t.bin
+; RUN: ../bin/lt-trace --format=csv %t.lttrace 2>&1 | FileCheck %s --check-prefix=WRAPPED
+
+; Instrument input_for_hello.c with InjectFuncCall in the `trace` mode, run it
+; and decode the recorded trace. The functions are entered in the same order
+; as in inject_func_call_exec.ll. The times are relative to the first event,
+; so only the first one is predictable.
+
+; CHECK: time,thread,event,name,args,captured
+; CHECK-NEXT: 0,1,enter,main,2,
+; CHECK-NEXT: {{[0-9]+}},1,enter,foo,1,
+; CHECK-NEXT: {{[0-9]+}},1,enter,bar,2,
+; CHECK-NEXT: {{[0-9]+}},1,enter,foo,1,
+; CHECK-NEXT: {{[0-9]+}},1,enter,fez,3,
+; CHECK-NEXT: {{[0-9]+}},1,enter,bar,2,
+; CHECK-NEXT: {{[0-9]+}},1,enter,foo,1,
+; CHECK-NOT: {{.}}
+
+; With a 4-entry ring buffer, only the 4 most recent events are kept
+; WRAPPED: Warning: thread 1: 3 event(s) were overwritten
+; WRAPPED: time,thread,event,name,args,captured
+; WRAPPED-NEXT: 0,1,enter,foo,1,
+; WRAPPED-NEXT: {{[0-9]+}},1,enter,fez,3,
+; WRAPPED-NEXT: {{[0-9]+}},1,enter,bar,2,
+; WRAPPED-NEXT: {{[0-9]+}},1,enter,foo,1,
+; WRAPPED-NOT: {{.}}
@@ -0,0 +1,64 @@
+; RUN:  opt -load-pass-plugin=%shlibdir/libInjectFuncCall%shlibext -passes="inject-func-call<trace=entry-exit>,verify" -S %s\
+; RUN:  | FileCheck %s
+
+; Verify that InjectFuncCall in the `trace=entry-exit` mode records an exit
+; before every `ret` and `resume`. Nothing can be inserted between a
+; `musttail` call and the following `ret`, so in that case the exit is
+; recorded before the call.
+
+; CHECK-LABEL: define i32 @tail
+; CHECK-NEXT:  call void @__lt_rt_trace_enter(ptr @ifc_trace_module, i32 0, i32 1)
+; CHECK-NEXT:  call void @__lt_rt_trace_exit(ptr @ifc_trace_module, i32 0)
+; CHECK-NEXT:  %r = musttail call i32 @callee(i32 %x)
+; CHECK-NEXT:  ret i32 %r
+
+; CHECK-LABEL: define i32 @callee
+; CHECK-NEXT:  call void @__lt_rt_trace_enter(ptr @ifc_trace_module, i32 1, i32 1)
+; CHECK:       a:
+; CHECK-NEXT:  call void @__lt_rt_trace_exit(ptr @ifc_trace_module, i32 1)
+; CHECK-NEXT:  ret i32 1
+; CHECK:       b:
+; CHECK-NEXT:  call void @__lt_rt_trace_exit(ptr @ifc_trace_module, i32 1)
+; CHECK-NEXT:  ret i32 2
+
+; CHECK-LABEL: define void @with_cleanup
+; CHECK-NEXT:  entry:
+; CHECK-NEXT:  call void @__lt_rt_trace_enter(ptr @ifc_trace_module, i32 2, i32 0)
+; CHECK:       ok:
+; CHECK-NEXT:  call void @__lt_rt_trace_exit(ptr @ifc_trace_module, i32 2)
+; CHECK-NEXT:  ret void
+; CHECK:       lpad:
+; CHECK:       call void @cleanup()
+; CHECK-NEXT:  call void @__lt_rt_trace_exit(ptr @ifc_trace_module, i32 2)
+; CHECK-NEXT:  resume { ptr, i32 } %lp
+
+; CHECK: declare void @__lt_rt_trace_exit(ptr, i32)
+
+declare i32 @__gxx_personality_v0(...)
+declare void @may_throw()
+declare void @cleanup()
+
+define i32 @tail(i32 %x) {
+  %r = musttail call i32 @callee(i32 %x)
+  ret i32 %r
+}
+
+define i32 @callee(i32 %x) {
+  %c = icmp eq i32 %x, 0
+  br i1 %c, label %a, label %b
+a:
+  ret i32 1
+b:
+  ret i32 2
+}
+
+define void @with_cleanup() personality ptr @__gxx_personality_v0 {
+entry:
+  invoke void @may_throw() to label %ok unwind label %lpad
+ok:
+  ret void
+lpad:
+  %lp = landingpad { ptr, i32 } cleanup
+  call void @cleanup()
+  resume { ptr, i32 } %lp
+}
@@ -0,0 +1,51 @@
+; RUN: %clang -S -emit-llvm %S/../inputs/input_for_hello.c -o - \
+; RUN:   | opt -load-pass-plugin %shlibdir/libInjectFuncCall%shlibext -passes="inject-func-call<trace=entry-exit>,verify" -o %t.bc
+; RUN: %clang %t.bc -L%shlibdir -llt_rt -Wl,-rpath,%shlibdir -o %t.bin
+; RUN: rm -f %t.lttrace
+; RUN: env LT_TRACE_FILE=%t.lttrace not %t.bin
+; RUN: ../bin/lt-trace --format=csv %t.lttrace | FileCheck %s
+; RUN: ../bin/lt-trace --format=chrome %t.lttrace | FileCheck %s --check-prefix=CHROME
+; RUN: env LT_TRACE_FILE=%t.lttrace LT_RT_TRACE_BUFFER_SIZE=2 LT_RT_TRACE_FLUSH=full not %t.bin
+; RUN: ../bin/lt-trace --format=csv %t.lttrace 2>&1 | FileCheck %s
+
+; Instrument input_for_hello.c with InjectFuncCall in the `trace=entry-exit`
+; mode, run it and decode the recorded trace. With LT_RT_TRACE_FLUSH=full,
+; the (tiny) buffer is written whenever it fills up, so no events are lost.
+
+; CHECK-NOT: Warning
+; CHECK: time,thread,event,name,args,captured
+; CHECK-NEXT: 0,1,enter,main,2,
+; CHECK-NEXT: {{[0-9]+}},1,enter,foo,1,
+; CHECK-NEXT: {{[0-9]+}},1,exit,foo,,
+; CHECK-NEXT: {{[0-9]+}},1,enter,bar,2,
+; CHECK-NEXT: {{[0-9]+}},1,enter,foo,1,
+; CHECK-NEXT: {{[0-9]+}},1,exit,foo,,
+; CHECK-NEXT: {{[0-9]+}},1,exit,bar,,
+; CHECK-NEXT: {{[0-9]+}},1,enter,fez,3,
+; CHECK-NEXT: {{[0-9]+}},1,enter,bar,2,
+; CHECK-NEXT: {{[0-9]+}},1,enter,foo,1,
+; CHECK-NEXT: {{[0-9]+}},1,exit,foo,,
+; CHECK-NEXT: {{[0-9]+}},1,exit,bar,,
+; CHECK-NEXT: {{[0-9]+}},1,exit,fez,,
+; CHECK-NEXT: {{[0-9]+}},1,exit,main,,
+; CHECK-NOT: {{.}}
+
+; In the Chrome Trace Event format, every call becomes a "complete" event
+; (emitted when the call ends)
+; CHROME:      "traceEvents": [
+; CHROME:      "name": "thread 1"
+; CHROME:      "name": "foo",
+; CHROME-NEXT: "ph": "X",
+; CHROME:      "name": "foo",
+; CHROME:      "name": "bar",
+; CHROME:      "name": "foo",
+; CHROME:      "name": "bar",
+; CHROME:      "name": "fez",
+; CHROME:      "name": "main",
+; CHROME-NEXT: "ph": "X",
+; CHROME-NEXT: "ts": 0,
+; CHROME-NEXT: "dur": {{[0-9.]+}},
+; CHROME-NEXT: "pid": 1,
+; CHROME-NEXT: "tid": 1,
+; CHROME-NEXT: "args": {
+; CHROME-NEXT: "num_args": 2
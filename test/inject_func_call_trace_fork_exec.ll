@@ -0,0 +1,43 @@
+; RUN: %clang -S -emit-llvm %S/../inputs/input_for_trace_fork.c -o - \
+; RUN:   | opt -load-pass-plugin %shlibdir/libInjectFuncCall%shlibext -passes="inject-func-call<trace=entry-exit>,verify" -o %t.bc
+; RUN: %clang %t.bc -L%shlibdir -llt_rt -Wl,-rpath,%shlibdir -o %t.bin
+
+; The child writes <trace>.<pid>
+; RUN: rm -rf %t.dir && mkdir %t.dir
+; RUN: env LT_TRACE_FILE=%t.dir/trace.lttrace %t.bin
+; RUN: ls %t.dir | FileCheck %s --check-prefix=FILES
+; RUN: ../bin/lt-trace --format=csv %t.dir/trace.lttrace | FileCheck %s --check-prefix=PARENT
+; RUN: ../bin/lt-trace --format=csv %t.dir/trace.lttrace.* | FileCheck %s --check-prefix=CHILD
+
+; With `%p` in the file name, every process writes <trace with %p replaced>
+; RUN: rm -rf %t.pid && mkdir %t.pid
+; RUN: env LT_TRACE_FILE=%t.pid/trace.%%p.lttrace %t.bin
+; RUN: ls %t.pid | FileCheck %s --check-prefix=PID-FILES
+
+; Instrument a program that forks with InjectFuncCall in the
+; `trace=entry-exit` mode and verify that lt_rt starts a new trace in the
+; child: the child's trace only contains the events recorded after fork()
+; (`main` was entered before, so only `bar` is there) and the parent's trace
+; doesn't contain any of them.
+
+; FILES: trace.lttrace
+; FILES-NEXT: trace.lttrace.{{[0-9]+}}
+; FILES-NOT: {{.}}
+
+; PARENT: time,thread,event,name,args,captured
+; PARENT-NEXT: 0,1,enter,main,0,
+; PARENT-NEXT: {{[0-9]+}},1,enter,foo,0,
+; PARENT-NEXT: {{[0-9]+}},1,exit,foo,,
+; PARENT-NEXT: {{[0-9]+}},1,enter,foo,0,
+; PARENT-NEXT: {{[0-9]+}},1,exit,foo,,
+; PARENT-NEXT: {{[0-9]+}},1,exit,main,,
+; PARENT-NOT: {{.}}
+
+; CHILD: time,thread,event,name,args,captured
+; CHILD-NEXT: 0,1,enter,bar,0,
+; CHILD-NEXT: {{[0-9]+}},1,exit,bar,,
+; CHILD-NOT: {{.}}
+
+; PID-FILES: trace.{{[0-9]+}}.lttrace
+; PID-FILES-NEXT: trace.{{[0-9]+}}.lttrace
+; PID-FILES-NOT: {{.}}
@@ -61,3 +61,8 @@ llvm_config.add_tool_substitutions(tools, config.llvm_tools_dir)
 config.substitutions.append(('%shlibext', config.llvm_shlib_ext))
 # The LIT variable to hold the location of plugins/libraries
 config.substitutions.append(('%shlibdir', config.llvm_shlib_dir))
+
+# The runtime can only patch the sleds inserted by `inject-func-call<trace=
+# patchable>` on x86-64 Linux
+if platform.system() == 'Linux' and platform.machine() in ('x86_64', 'AMD64'):
+    config.available_features.add('x86_64-linux')
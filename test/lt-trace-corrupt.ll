@@ -0,0 +1,14 @@
+; RUN: printf 'LTPROF\0\0\1\0\0\0\6\0\0\0\40\0\0\0\0\0\0\0' > %t.huge.lttrace
+; RUN: printf '\360\377\377\377\0\0\0\0\4\0\0\0\0\0\0\0\10\0\0\0\0\0\0\0a\0b\0c\0d\0' >> %t.huge.lttrace
+; RUN: not ../bin/lt-trace %t.huge.lttrace 2>&1 | FileCheck %s --check-prefix=HUGE
+; RUN: printf 'LTPROF\0\0\1\0\0\0\6\0\0\0\40\0\0\0\0\0\0\0' > %t.names.lttrace
+; RUN: printf '\0\0\0\0\0\0\0\0\11\0\0\0\0\0\0\0\10\0\0\0\0\0\0\0a\0b\0c\0d\0' >> %t.names.lttrace
+; RUN: not ../bin/lt-trace %t.names.lttrace 2>&1 | FileCheck %s --check-prefix=NAMES
+
+; Test that lt-trace rejects function tables that can't be valid before
+; allocating anything for them: function IDs far beyond the number of
+; functions in any real program and more functions than there is room for in
+; the name table.
+
+; HUGE: Error reading trace: {{.*}}.huge.lttrace: malformed profile: bad function IDs 4294967280+4
+; NAMES: Error reading trace: {{.*}}.names.lttrace: malformed profile: 9 functions in a 8-byte name table
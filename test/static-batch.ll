@@ -0,0 +1,31 @@
+; RUN: rm -rf %t && mkdir -p %t/a/b
+; RUN: cp %S/Inputs/CallCounterInput.ll %t/a/x.ll
+; RUN: cp %S/Inputs/CallCounterInput.ll %t/a/b/y.ll
+; RUN: cp %S/Inputs/CallCounterInput.ll %t/a/b/z.ll
+; RUN: echo %t/a/x.ll > %t/list.txt
+
+; RUN: ../bin/static -j 2 %t/a/x.ll %t/a/b/y.ll 2>&1 | FileCheck %s --check-prefix=TWO
+; RUN: ../bin/static -j 4 '%t/a/**/*.ll' 2>&1 | FileCheck %s --check-prefix=THREE
+; RUN: ../bin/static -j 1 '%t/a/**/*.ll' 2>&1 | FileCheck %s --check-prefix=THREE
+; RUN: ../bin/static '%t/a/*.ll' 2>&1 | FileCheck %s --check-prefix=ONE
+; RUN: ../bin/static '%t/a/b/*.ll' --input-files=%t/list.txt 2>&1 | FileCheck %s --check-prefix=THREE
+; RUN: not ../bin/static '%t/a/*.bc' 2>&1 | FileCheck %s --check-prefix=NOMATCH
+
+; Test the batch mode of static: the counts from all input modules (passed on
+; the command line, as glob patterns and through --input-files) are added up.
+; `*` only matches within a directory, `**` matches any number of them. The
+; report doesn't depend on the number of threads.
+
+; ONE:      foo                  3
+; ONE-NEXT: bar                  2
+; ONE-NEXT: fez                  1
+
+; TWO:      foo                  6
+; TWO-NEXT: bar                  4
+; TWO-NEXT: fez                  2
+
+; THREE:      foo                  9
+; THREE-NEXT: bar                  6
+; THREE-NEXT: fez                  3
+
+; NOMATCH: Error: no files match '{{.*}}/a/*.bc'
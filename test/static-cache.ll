@@ -0,0 +1,27 @@
+; RUN: rm -rf %t && mkdir -p %t
+; RUN: cp %S/Inputs/CallCounterInput.ll %t/x.ll
+; RUN: cp %S/Inputs/CallCounterInput.ll %t/y.ll
+; RUN: echo "; y" >> %t/y.ll
+
+; RUN: ../bin/static --cache-dir=%t/cache %t/x.ll %t/y.ll 2>&1 | FileCheck %s --check-prefixes=CHECK,COLD
+; RUN: ../bin/static --cache-dir=%t/cache -j 2 %t/x.ll %t/y.ll 2>&1 | FileCheck %s --check-prefixes=CHECK,WARM
+; RUN: echo "; changed" >> %t/y.ll
+; RUN: ../bin/static --cache-dir=%t/cache %t/x.ll %t/y.ll 2>&1 | FileCheck %s --check-prefixes=CHECK,CHANGED
+; RUN: ../bin/static --cache-dir=%t/cache --cache-size=1 %t/x.ll %t/y.ll 2>&1 | FileCheck %s --check-prefixes=CHECK,WARM
+; RUN: ../bin/static --cache-dir=%t/cache %t/x.ll %t/y.ll 2>&1 | FileCheck %s --check-prefixes=CHECK,COLD
+; RUN: not ../bin/static --cache-dir=%t/cache --cache-size=abc %t/x.ll 2>&1 | FileCheck %s --check-prefix=BADSIZE
+
+; Test the result cache of static: the counts are the same whether they come
+; from the cache or not. Only the modules that changed since the previous run
+; are analysed again. With a tiny `--cache-size`, all entries are evicted
+; once the run is over.
+
+; CHECK:      foo                  6
+; CHECK-NEXT: bar                  4
+; CHECK-NEXT: fez                  2
+
+; COLD:    cache: 0 hit(s), 2 miss(es)
+; WARM:    cache: 2 hit(s), 0 miss(es)
+; CHANGED: cache: 1 hit(s), 1 miss(es)
+
+; BADSIZE: Error: invalid --cache-size:
@@ -0,0 +1,16 @@
+; RUN: opt %S/Inputs/CallCounterInput.ll -o %t.bc
+; RUN: ../bin/static %t.bc 2>&1 | FileCheck %s
+; RUN: ../bin/static --eager %t.bc 2>&1 | FileCheck %s
+; RUN: head -c 64 %t.bc > %t.truncated.bc
+; RUN: not ../bin/static %t.truncated.bc 2>&1 | FileCheck %s --check-prefix=TRUNCATED
+
+; Test the lazy bitcode loading in static: the counts must match the ones
+; from parsing the whole module up front (`--eager`). Errors hit while
+; loading the function bodies are reported like parse errors.
+
+; CHECK:      foo                  3
+; CHECK-NEXT: bar                  2
+; CHECK-NEXT: fez                  1
+
+; TRUNCATED: Error reading bitcode file: {{.*}}.truncated.bc
+; TRUNCATED: {{.*}}.truncated.bc: error:
@@ -0,0 +1,612 @@
+//========================================================================
+// FILE:
+//    MergeMain.cpp
+//
+// DESCRIPTION:
+//    A command-line tool that merges binary profiles generated by the
+//    llvm-tutor instrumentation passes into one profile, e.g. the profiles
+//    written by the processes forked by an instrumented program (see lt_rt.h)
+//    or by multiple runs of the same program. The counts of the same
+//    function, call edge, block and calling context are added up. The times
+//    recorded by `dynamic-cc<timing>` are added up as well. The coverage
+//    bitmaps written in the `dynamic-cc<coverage>` mode are unioned, i.e. a
+//    function (or block) is covered if it was executed in any of the runs.
+//
+//    The modules are identified by their function names, i.e. the same
+//    module in different profiles is merged into one module. Call edges,
+//    block counts and calling contexts are identified by the function names.
+//    Functions with different CFGs (e.g. from different versions of the
+//    program) can't be merged, and neither can coverage bitmaps with
+//    different block counts.
+//
+//    The inputs are read one at a time and only the merged counts are kept
+//    in memory. Merging thousands of profiles takes as much memory as the
+//    largest input plus the merged profile. Traces (see `lt-trace`) are not
+//    supported - their records are skipped with a warning.
+//
+// USAGE:
+//    # First, generate the profiles, e.g. with a program that forks:
+//      LT_PROFILE_FILE=prof.%p.ltprof ./instrumented
+//    # Now you can run this tool as follows:
+//      <BUILD/DIR>/bin/lt-merge -o merged.ltprof prof.*.ltprof
+//      <BUILD/DIR>/bin/lt-merge -o merged.ltprof --input-files=profiles.txt
+//      <BUILD/DIR>/bin/dcc-prof merged.ltprof
+//
+// License: MIT
+//========================================================================
+#include "ProfileFormat.h"
+#include "ProfileReader.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/StringSaver.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <tuple>
+
+using namespace llvm;
+
+//===----------------------------------------------------------------------===//
+// Command line options
+//===----------------------------------------------------------------------===//
+static cl::OptionCategory MergeCategory{"profile merger options"};
+
+static cl::list<std::string> InputProfiles{cl::Positional,
+                                           cl::desc{"<Profiles to merge>"},
+                                           cl::ZeroOrMore,
+                                           cl::cat{MergeCategory}};
+
+static cl::opt<std::string> InputFileList{
+    "input-files",
+    cl::desc{"A file with the names of more profiles to merge (one per line, "
+             "for when there are too many for the command line)"},
+    cl::value_desc{"filename"}, cl::init(""), cl::cat{MergeCategory}};
+
+static cl::opt<std::string> OutputProfile{
+    "o", cl::desc{"The merged profile"}, cl::value_desc{"filename"},
+    cl::Required, cl::cat{MergeCategory}};
+
+//===----------------------------------------------------------------------===//
+// lt-merge - implementation
+//===----------------------------------------------------------------------===//
+namespace {
+// The merged function counts (and times) of one module
+struct MergedModule {
+  std::vector<StringRef> Names;
+  std::vector<uint64_t> Counters;
+  // Empty unless one of the inputs contains the times of this module
+  std::vector<ProfileModuleRecord::FunctionTimes> Times;
+  bool TimesInCycles = false;
+};
+
+// The merged block and CFG edge counts of one function
+struct MergedBlocks {
+  std::vector<uint64_t> Blocks;
+  std::vector<ProfileBlockCounts::Edge> Edges;
+};
+
+// The merged coverage bitmap of one module (one byte per bit, to keep the
+// union simple)
+struct MergedCoverage {
+  std::vector<StringRef> Names;
+  std::vector<uint64_t> NumBlocks;
+  std::vector<uint8_t> Covered;
+};
+
+// Accumulates the counts from the input profiles. All names are interned, so
+// that nothing refers to the inputs once they have been merged.
+class ProfileMerger {
+public:
+  Error merge(const Profile &Prof);
+  void write(raw_ostream &OS) const;
+
+private:
+  Error mergeModule(const ProfileModuleRecord &Module);
+  Error mergeBlocks(const ProfileBlockCounts &Function);
+  Error mergeCoverage(const ProfileCoverage &Module);
+  void mergeContexts(ArrayRef<ProfileContextNode> Nodes);
+
+  void writeModule(raw_ostream &OS, const MergedModule &Module) const;
+  void writeCallEdges(raw_ostream &OS) const;
+  void writeBlockCounts(raw_ostream &OS) const;
+  void writeCoverage(raw_ostream &OS, const MergedCoverage &Module) const;
+  void writeCallingContexts(raw_ostream &OS) const;
+
+  BumpPtrAllocator Alloc;
+  UniqueStringSaver Saver{Alloc};
+
+  std::vector<MergedModule> Modules;
+  // Maps the name table of a module (the NUL-separated names) to its index
+  // in Modules
+  StringMap<size_t> ModuleIndices;
+
+  std::vector<MergedCoverage> Coverage;
+  // Maps the name table of a module to its index in Coverage
+  StringMap<size_t> CoverageIndices;
+
+  // (caller, callee, call site, LT_PROF_EDGE_* flags) -> count
+  MapVector<std::tuple<StringRef, StringRef, uint64_t, uint64_t>, uint64_t>
+      CallEdges;
+
+  MapVector<StringRef, MergedBlocks> BlockCounts;
+
+  // The nodes of the merged calling-context trees (in the order in which
+  // they were first seen, i.e. parents before children)
+  std::vector<ProfileContextNode> Contexts;
+  // (the index of the parent node, function) -> the index of the node
+  DenseMap<std::pair<uint64_t, StringRef>, uint64_t> ContextIndices;
+};
+} // namespace
+
+// Returns the NUL-separated names, which identify a module
+static std::string getModuleKey(ArrayRef<StringRef> Names) {
+  std::string Key;
+  for (StringRef Name : Names) {
+    Key += Name;
+    Key += '\0';
+  }
+  return Key;
+}
+
+Error ProfileMerger::mergeModule(const ProfileModuleRecord &Module) {
+  std::string Key = getModuleKey(Module.Names);
+
+  auto [It, Inserted] = ModuleIndices.try_emplace(Key, Modules.size());
+  if (Inserted) {
+    MergedModule &New = Modules.emplace_back();
+    for (StringRef Name : Module.Names)
+      New.Names.push_back(Saver.save(Name));
+    New.Counters.resize(Module.Counters.size());
+  }
+
+  MergedModule &Merged = Modules[It->second];
+  for (size_t Idx = 0; Idx < Module.Counters.size(); Idx++)
+    Merged.Counters[Idx] += Module.Counters[Idx];
+
+  if (Module.Times.empty())
+    return Error::success();
+  if (Merged.Times.empty()) {
+    Merged.Times.resize(Module.Times.size());
+    Merged.TimesInCycles = Module.TimesInCycles;
+  } else if (Merged.TimesInCycles != Module.TimesInCycles) {
+    return make_error<StringError>(
+        "the times of '" + Module.Names.front() +
+            "' were measured with a different clock (see LT_RT_CLOCK)",
+        inconvertibleErrorCode());
+  }
+
+  for (size_t Idx = 0; Idx < Module.Times.size(); Idx++) {
+    Merged.Times[Idx].Inclusive += Module.Times[Idx].Inclusive;
+    Merged.Times[Idx].Exclusive += Module.Times[Idx].Exclusive;
+  }
+  return Error::success();
+}
+
+Error ProfileMerger::mergeBlocks(const ProfileBlockCounts &Function) {
+  auto [It, Inserted] =
+      BlockCounts.insert({Saver.save(Function.Function), MergedBlocks{}});
+  MergedBlocks &Merged = It->second;
+  if (Inserted) {
+    Merged.Blocks.assign(Function.Blocks.begin(), Function.Blocks.end());
+    Merged.Edges = Function.Edges;
+    return Error::success();
+  }
+
+  auto SameEdge = [](const ProfileBlockCounts::Edge &A,
+                     const ProfileBlockCounts::Edge &B) {
+    return A.Src == B.Src && A.Dst == B.Dst;
+  };
+  if (Merged.Blocks.size() != Function.Blocks.size() ||
+      Merged.Edges.size() != Function.Edges.size() ||
+      !std::equal(Merged.Edges.begin(), Merged.Edges.end(),
+                  Function.Edges.begin(), SameEdge))
+    return make_error<StringError>(
+        formatv("the CFG of '{0}' doesn't match the other profiles",
+                Function.Function)
+            .str(),
+        inconvertibleErrorCode());
+
+  for (size_t Idx = 0; Idx < Function.Blocks.size(); Idx++)
+    Merged.Blocks[Idx] += Function.Blocks[Idx];
+  for (size_t Idx = 0; Idx < Function.Edges.size(); Idx++)
+    Merged.Edges[Idx].Count += Function.Edges[Idx].Count;
+  return Error::success();
+}
+
+Error ProfileMerger::mergeCoverage(const ProfileCoverage &Module) {
+  auto [It, Inserted] = CoverageIndices.try_emplace(
+      getModuleKey(Module.Names), Coverage.size());
+  if (Inserted) {
+    MergedCoverage &New = Coverage.emplace_back();
+    for (StringRef Name : Module.Names)
+      New.Names.push_back(Saver.save(Name));
+    New.NumBlocks = Module.NumBlocks;
+    New.Covered.resize(Module.NumBits);
+  }
+
+  MergedCoverage &Merged = Coverage[It->second];
+  if (Merged.NumBlocks != Module.NumBlocks)
+    return make_error<StringError>(
+        formatv("the coverage map of '{0}' doesn't match the other profiles",
+                Module.Names.front())
+            .str(),
+        inconvertibleErrorCode());
+
+  for (uint64_t Bit = 0; Bit < Module.NumBits; Bit++)
+    Merged.Covered[Bit] |= Module.isCovered(Bit);
+  return Error::success();
+}
+
+void ProfileMerger::mergeContexts(ArrayRef<ProfileContextNode> Nodes) {
+  // The index of the merged node for every node of the input (parents come
+  // before their children)
+  std::vector<uint64_t> MergedIndices;
+  MergedIndices.reserve(Nodes.size());
+  for (const ProfileContextNode &Node : Nodes) {
+    uint64_t Parent = Node.Parent == ProfileContextNode::NoParent
+                          ? ProfileContextNode::NoParent
+                          : MergedIndices[Node.Parent];
+    auto [It, Inserted] = ContextIndices.insert(
+        {{Parent, Saver.save(Node.Function)}, Contexts.size()});
+    if (Inserted)
+      Contexts.push_back({Parent, It->first.second, 0});
+    Contexts[It->second].Count += Node.Count;
+    MergedIndices.push_back(It->second);
+  }
+}
+
+Error ProfileMerger::merge(const Profile &Prof) {
+  for (const ProfileModuleRecord &Module : Prof.Modules)
+    if (Error Err = mergeModule(Module))
+      return Err;
+
+  for (const ProfileCallEdge &Edge : Prof.CallEdges)
+    CallEdges[{Saver.save(Edge.Caller), Saver.save(Edge.Callee), Edge.Site,
+               Edge.Indirect ? LT_PROF_EDGE_INDIRECT : 0}] += Edge.Count;
+
+  for (const ProfileBlockCounts &Function : Prof.BlockCounts)
+    if (Error Err = mergeBlocks(Function))
+      return Err;
+
+  for (const ProfileCoverage &Module : Prof.Coverage)
+    if (Error Err = mergeCoverage(Module))
+      return Err;
+
+  mergeContexts(Prof.CallingContexts);
+  return Error::success();
+}
+
+//===----------------------------------------------------------------------===//
+// Writing the merged profile (see ProfileFormat.h)
+//===----------------------------------------------------------------------===//
+template <typename T> static void writeValue(raw_ostream &OS, const T &Value) {
+  OS.write(reinterpret_cast<const char *>(&Value), sizeof(Value));
+}
+
+static void writeRecordHeader(raw_ostream &OS, LTProfRecordKind Kind,
+                              uint64_t Size) {
+  LTProfRecordHeader Header;
+  Header.Magic = LT_PROF_MAGIC;
+  Header.Version = LT_PROF_VERSION;
+  Header.Kind = Kind;
+  Header.Size = Size;
+  writeValue(OS, Header);
+}
+
+static uint64_t getPadding(uint64_t Size) { return (8 - Size % 8) % 8; }
+
+namespace {
+// A table of NUL-terminated names, every name is stored once
+class NameTable {
+public:
+  uint64_t getOffset(StringRef Name) {
+    auto [It, Inserted] = Offsets.insert({Name, Data.size()});
+    if (Inserted) {
+      Data += Name;
+      Data += '\0';
+    }
+    return It->second;
+  }
+
+  uint64_t size() const { return Data.size(); }
+  StringRef data() const { return Data; }
+
+  // Writes the table, padded to a multiple of 8 bytes
+  void write(raw_ostream &OS) const {
+    OS << Data;
+    OS.write_zeros(getPadding(Data.size()));
+  }
+
+private:
+  std::string Data;
+  DenseMap<StringRef, uint64_t> Offsets;
+};
+} // namespace
+
+void ProfileMerger::writeModule(raw_ostream &OS,
+                                const MergedModule &Module) const {
+  NameTable Names;
+  for (StringRef Name : Module.Names)
+    Names.getOffset(Name);
+
+  LTProfFunctionCountsHeader CountsHeader;
+  CountsHeader.NumCounters = Module.Counters.size();
+  CountsHeader.NamesSize = Names.size();
+  writeRecordHeader(OS, LT_PROF_FUNCTION_COUNTS,
+                    sizeof(CountsHeader) +
+                        Module.Counters.size() * sizeof(uint64_t) +
+                        Names.size() + getPadding(Names.size()));
+  writeValue(OS, CountsHeader);
+  for (uint64_t Count : Module.Counters)
+    writeValue(OS, Count);
+  Names.write(OS);
+
+  if (Module.Times.empty())
+    return;
+
+  LTProfFunctionTimesHeader TimesHeader;
+  TimesHeader.NumFunctions = Module.Times.size();
+  TimesHeader.Unit = Module.TimesInCycles ? LT_PROF_TIME_CYCLES
+                                          : LT_PROF_TIME_NANOSECONDS;
+  writeRecordHeader(OS, LT_PROF_FUNCTION_TIMES,
+                    sizeof(TimesHeader) +
+                        Module.Times.size() * sizeof(LTProfFunctionTimes));
+  writeValue(OS, TimesHeader);
+  for (auto &Times : Module.Times) {
+    LTProfFunctionTimes Entry;
+    Entry.Inclusive = Times.Inclusive;
+    Entry.Exclusive = Times.Exclusive;
+    writeValue(OS, Entry);
+  }
+}
+
+void ProfileMerger::writeCoverage(raw_ostream &OS,
+                                  const MergedCoverage &Module) const {
+  NameTable Names;
+  for (StringRef Name : Module.Names)
+    Names.getOffset(Name);
+
+  // Pack the bits again
+  std::vector<uint8_t> Bitmap((Module.Covered.size() + 7) / 8);
+  for (uint64_t Bit = 0; Bit < Module.Covered.size(); Bit++)
+    Bitmap[Bit / 8] |= Module.Covered[Bit] << Bit % 8;
+
+  LTProfCoverageHeader CoverageHeader;
+  CoverageHeader.NumFunctions = Module.Names.size();
+  CoverageHeader.NumBlocks =
+      Module.NumBlocks.empty() ? 0 : Module.Covered.size();
+  CoverageHeader.NamesSize = Names.size();
+  uint64_t Size = Module.NumBlocks.size() * sizeof(uint64_t) + Bitmap.size() +
+                  Names.size();
+  writeRecordHeader(OS, LT_PROF_COVERAGE,
+                    sizeof(CoverageHeader) + Size + getPadding(Size));
+  writeValue(OS, CoverageHeader);
+  for (uint64_t NumBlocks : Module.NumBlocks)
+    writeValue(OS, NumBlocks);
+  OS.write(reinterpret_cast<const char *>(Bitmap.data()), Bitmap.size());
+  OS << Names.data();
+  OS.write_zeros(getPadding(Size));
+}
+
+void ProfileMerger::writeCallEdges(raw_ostream &OS) const {
+  NameTable Names;
+  std::vector<LTProfCallEdge> Edges;
+  for (auto &[Key, Count] : CallEdges) {
+    auto [Caller, Callee, Site, Flags] = Key;
+    LTProfCallEdge Edge;
+    Edge.Caller = Names.getOffset(Caller);
+    Edge.Callee = Names.getOffset(Callee);
+    Edge.Site = Site;
+    Edge.Flags = Flags;
+    Edge.Count = Count;
+    Edges.push_back(Edge);
+  }
+
+  LTProfCallEdgesHeader EdgesHeader;
+  EdgesHeader.NumEdges = Edges.size();
+  EdgesHeader.NamesSize = Names.size();
+  writeRecordHeader(OS, LT_PROF_CALL_EDGES,
+                    sizeof(EdgesHeader) +
+                        Edges.size() * sizeof(LTProfCallEdge) + Names.size() +
+                        getPadding(Names.size()));
+  writeValue(OS, EdgesHeader);
+  for (const LTProfCallEdge &Edge : Edges)
+    writeValue(OS, Edge);
+  Names.write(OS);
+}
+
+void ProfileMerger::writeBlockCounts(raw_ostream &OS) const {
+  NameTable Names;
+  LTProfBlockCountsHeader BlocksHeader;
+  BlocksHeader.NumFunctions = BlockCounts.size();
+  BlocksHeader.NumBlocks = 0;
+  BlocksHeader.NumEdges = 0;
+  for (auto &[Name, Function] : BlockCounts) {
+    Names.getOffset(Name);
+    BlocksHeader.NumBlocks += Function.Blocks.size();
+    BlocksHeader.NumEdges += Function.Edges.size();
+  }
+  BlocksHeader.NamesSize = Names.size();
+
+  writeRecordHeader(
+      OS, LT_PROF_BLOCK_COUNTS,
+      sizeof(BlocksHeader) +
+          BlocksHeader.NumFunctions * sizeof(LTProfBlockFunction) +
+          BlocksHeader.NumBlocks * sizeof(uint64_t) +
+          BlocksHeader.NumEdges * sizeof(LTProfBlockEdge) + Names.size() +
+          getPadding(Names.size()));
+  writeValue(OS, BlocksHeader);
+  for (auto &[Name, Function] : BlockCounts) {
+    LTProfBlockFunction Entry;
+    Entry.Name = Names.getOffset(Name);
+    Entry.NumBlocks = Function.Blocks.size();
+    Entry.NumEdges = Function.Edges.size();
+    writeValue(OS, Entry);
+  }
+  for (auto &Entry : BlockCounts)
+    for (uint64_t Count : Entry.second.Blocks)
+      writeValue(OS, Count);
+  for (auto &Entry : BlockCounts)
+    for (const ProfileBlockCounts::Edge &Edge : Entry.second.Edges) {
+      LTProfBlockEdge Record;
+      Record.Src = Edge.Src;
+      Record.Dst = Edge.Dst;
+      Record.Count = Edge.Count;
+      writeValue(OS, Record);
+    }
+  Names.write(OS);
+}
+
+void ProfileMerger::writeCallingContexts(raw_ostream &OS) const {
+  // Contexts lists the parents before their children, but the children of a
+  // node aren't necessarily contiguous. Renumber the nodes in preorder.
+  std::vector<std::vector<uint64_t>> Children(Contexts.size());
+  std::vector<uint64_t> Roots;
+  for (uint64_t Idx = 0; Idx < Contexts.size(); Idx++) {
+    uint64_t Parent = Contexts[Idx].Parent;
+    (Parent == ProfileContextNode::NoParent ? Roots : Children[Parent])
+        .push_back(Idx);
+  }
+
+  NameTable Names;
+  std::vector<LTProfContextNode> Nodes;
+  // (the index in Contexts, the new index of its parent)
+  std::vector<std::pair<uint64_t, uint64_t>> Worklist;
+  for (uint64_t Root : llvm::reverse(Roots))
+    Worklist.push_back({Root, LT_PROF_NO_PARENT});
+  while (!Worklist.empty()) {
+    auto [Idx, Parent] = Worklist.back();
+    Worklist.pop_back();
+
+    LTProfContextNode Node;
+    Node.Parent = Parent;
+    Node.Name = Names.getOffset(Contexts[Idx].Function);
+    Node.Count = Contexts[Idx].Count;
+    uint64_t NewIdx = Nodes.size();
+    Nodes.push_back(Node);
+    for (uint64_t Child : llvm::reverse(Children[Idx]))
+      Worklist.push_back({Child, NewIdx});
+  }
+
+  LTProfContextsHeader ContextsHeader;
+  ContextsHeader.NumNodes = Nodes.size();
+  ContextsHeader.NamesSize = Names.size();
+  writeRecordHeader(OS, LT_PROF_CALLING_CONTEXTS,
+                    sizeof(ContextsHeader) +
+                        Nodes.size() * sizeof(LTProfContextNode) +
+                        Names.size() + getPadding(Names.size()));
+  writeValue(OS, ContextsHeader);
+  for (const LTProfContextNode &Node : Nodes)
+    writeValue(OS, Node);
+  Names.write(OS);
+}
+
+// Writes the records in the order used by lt_rt: the function counts (and
+// times) or the coverage of every module, then the call edges, the block
+// counts and the calling contexts (each merged into a single record)
+void ProfileMerger::write(raw_ostream &OS) const {
+  for (const MergedModule &Module : Modules)
+    writeModule(OS, Module);
+  for (const MergedCoverage &Module : Coverage)
+    writeCoverage(OS, Module);
+  if (!CallEdges.empty())
+    writeCallEdges(OS);
+  if (!BlockCounts.empty())
+    writeBlockCounts(OS);
+  if (!Contexts.empty())
+    writeCallingContexts(OS);
+}
+
+//===----------------------------------------------------------------------===//
+// Main driver code.
+//===----------------------------------------------------------------------===//
+int main(int Argc, char **Argv) {
+  // Hide all options apart from the ones specific to this tool
+  cl::HideUnrelatedOptions(MergeCategory);
+
+  cl::ParseCommandLineOptions(Argc, Argv,
+                              "Merges binary profiles generated by the "
+                              "llvm-tutor instrumentation passes\n");
+
+  // Makes sure llvm_shutdown() is called (which cleans up LLVM objects)
+  //  http://llvm.org/docs/ProgrammersManual.html#ending-execution-with-llvm-shutdown
+  llvm_shutdown_obj SDO;
+
+  std::vector<std::string> Inputs(InputProfiles.begin(), InputProfiles.end());
+  if (!InputFileList.empty()) {
+    auto List = MemoryBuffer::getFile(InputFileList, /*IsText=*/true);
+    if (!List) {
+      errs() << "Error reading input list: " << InputFileList << ": "
+             << List.getError().message() << "\n";
+      return -1;
+    }
+
+    SmallVector<StringRef, 0> Lines;
+    (*List)->getBuffer().split(Lines, '\n');
+    for (StringRef Line : Lines) {
+      Line = Line.trim();
+      if (!Line.empty())
+        Inputs.push_back(Line.str());
+    }
+  }
+
+  if (Inputs.empty()) {
+    errs() << "Error: no input profiles\n";
+    return -1;
+  }
+
+  // Only one input is mapped at a time
+  ProfileMerger Merger;
+  for (const std::string &Input : Inputs) {
+    auto Buffer = MemoryBuffer::getFile(Input, /*IsText=*/false,
+                                        /*RequiresNullTerminator=*/false);
+    if (!Buffer) {
+      errs() << "Error reading profile: " << Input << ": "
+             << Buffer.getError().message() << "\n";
+      return -1;
+    }
+
+    auto Prof = readProfile((*Buffer)->getMemBufferRef());
+    if (!Prof) {
+      errs() << "Error reading profile: " << Input << ": "
+             << toString(Prof.takeError()) << "\n";
+      return -1;
+    }
+
+    if (!Prof->TraceFunctions.empty() || !Prof->TraceThreads.empty())
+      errs() << "Warning: " << Input << ": skipping the trace records\n";
+
+    if (Error Err = Merger.merge(*Prof)) {
+      errs() << "Error merging profile: " << Input << ": "
+             << toString(std::move(Err)) << "\n";
+      return -1;
+    }
+  }
+
+  std::error_code EC;
+  ToolOutputFile Out(OutputProfile, EC, sys::fs::OF_None);
+  if (EC) {
+    errs() << "Error writing profile: " << OutputProfile << ": "
+           << EC.message() << "\n";
+    return -1;
+  }
+
+  Merger.write(Out.os());
+  Out.os().close();
+  if (Out.os().has_error()) {
+    errs() << "Error writing profile: " << OutputProfile << ": "
+           << Out.os().error().message() << "\n";
+    Out.os().clear_error();
+    return -1;
+  }
+
+  Out.keep();
+  return 0;
+}
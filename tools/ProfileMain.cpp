@@ -0,0 +1,736 @@
+//========================================================================
+// FILE:
+//    ProfileMain.cpp
+//
+// DESCRIPTION:
+//    A command-line tool that reads binary profiles generated by the
+//    llvm-tutor instrumentation passes (e.g. `dynamic-cc<binary>`) and prints
+//    them as text, CSV or JSON. The input file is memory-mapped and the
+//    counters are read in place. With `--call-graph`, prints the dynamic call
+//    graph recorded by `dynamic-cc<edges>` instead (also supports DOT). With
+//    `--blocks` (`--cfg-edges`), prints the basic block (CFG edge) counts
+//    recorded by `dynamic-cc<blocks>`. The function counts include the
+//    inclusive and exclusive time per function if the profile was recorded
+//    with `dynamic-cc<timing>`. With `--folded`, prints the calling contexts
+//    recorded by `dynamic-cc<cct>` as folded stacks (one `main;foo;bar <count>`
+//    line per context), which can be fed straight into flame graph tools.
+//    With `--coverage`, prints which functions (and how many of their blocks)
+//    were executed according to `dynamic-cc<coverage>`.
+//
+// USAGE:
+//    # First, generate a profile:
+//      opt -load-pass-plugin <BUILD_DIR>/lib/libDynamicCallCounter.so `\`
+//        -passes="dynamic-cc<binary>" <input-llvm-file> -o instrumented.bin
+//      LT_PROFILE_FILE=prof.ltprof lli instrumented.bin
+//    # Now you can run this tool as follows:
+//      <BUILD/DIR>/bin/dcc-prof prof.ltprof
+//      <BUILD/DIR>/bin/dcc-prof --sort=count --format=csv prof.ltprof
+//      <BUILD/DIR>/bin/dcc-prof --sort=time prof.ltprof
+//      <BUILD/DIR>/bin/dcc-prof --call-graph --format=dot prof.ltprof
+//      <BUILD/DIR>/bin/dcc-prof --blocks --format=csv prof.ltprof
+//      <BUILD/DIR>/bin/dcc-prof --folded prof.ltprof | flamegraph.pl > cct.svg
+//      <BUILD/DIR>/bin/dcc-prof --coverage prof.ltprof
+//
+// License: MIT
+//========================================================================
+#include "ProfileReader.h"
+
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <map>
+
+using namespace llvm;
+
+//===----------------------------------------------------------------------===//
+// Command line options
+//===----------------------------------------------------------------------===//
+static cl::OptionCategory ProfileCategory{"profile reader options"};
+
+static cl::opt<std::string> InputProfile{cl::Positional,
+                                         cl::desc{"<Profile to read>"},
+                                         cl::value_desc{"profile filename"},
+                                         cl::init(""),
+                                         cl::Required,
+                                         cl::cat{ProfileCategory}};
+
+enum class OutputFormat { Text, CSV, JSON, DOT };
+static cl::opt<OutputFormat> Format{
+    "format", cl::desc{"Output format"},
+    cl::values(clEnumValN(OutputFormat::Text, "text", "Human readable table"),
+               clEnumValN(OutputFormat::CSV, "csv", "Comma-separated values"),
+               clEnumValN(OutputFormat::JSON, "json", "JSON"),
+               clEnumValN(OutputFormat::DOT, "dot",
+                          "Graphviz DOT (--call-graph only)")),
+    cl::init(OutputFormat::Text), cl::cat{ProfileCategory}};
+
+enum class SortOrder { None, Count, Name, Time };
+static cl::opt<SortOrder> Sort{
+    "sort", cl::desc{"Sort order"},
+    cl::values(clEnumValN(SortOrder::None, "none",
+                          "The order in the profile (i.e. slot order)"),
+               clEnumValN(SortOrder::Count, "count",
+                          "By the number of calls (descending)"),
+               clEnumValN(SortOrder::Name, "name", "By function name"),
+               clEnumValN(SortOrder::Time, "time",
+                          "By exclusive time (descending, function counts "
+                          "only)")),
+    cl::init(SortOrder::None), cl::cat{ProfileCategory}};
+
+static cl::opt<bool> CallGraph{
+    "call-graph",
+    cl::desc{"Print the dynamic call graph (requires a profile generated with "
+             "dynamic-cc<edges>)"},
+    cl::init(false), cl::cat{ProfileCategory}};
+
+static cl::opt<bool> Blocks{
+    "blocks",
+    cl::desc{"Print the basic block counts (requires a profile generated with "
+             "dynamic-cc<blocks>)"},
+    cl::init(false), cl::cat{ProfileCategory}};
+
+static cl::opt<bool> CFGEdges{
+    "cfg-edges",
+    cl::desc{"Print the CFG edge counts (requires a profile generated with "
+             "dynamic-cc<blocks>)"},
+    cl::init(false), cl::cat{ProfileCategory}};
+
+static cl::opt<bool> Folded{
+    "folded",
+    cl::desc{"Print the calling contexts as folded stacks (requires a profile "
+             "generated with dynamic-cc<cct>)"},
+    cl::init(false), cl::cat{ProfileCategory}};
+
+static cl::opt<bool> Coverage{
+    "coverage",
+    cl::desc{"Print the function and block coverage (requires a profile "
+             "generated with dynamic-cc<coverage>)"},
+    cl::init(false), cl::cat{ProfileCategory}};
+
+//===----------------------------------------------------------------------===//
+// dcc-prof - implementation
+//===----------------------------------------------------------------------===//
+struct FunctionCount {
+  StringRef Name;
+  uint64_t Count;
+  // The time spent in the function (`dynamic-cc<timing>` only)
+  uint64_t Inclusive = 0;
+  uint64_t Exclusive = 0;
+};
+
+// TimeUnit is the unit of the times ("cycles" or "ns") or null if the profile
+// doesn't contain any
+static void printText(raw_ostream &OS, ArrayRef<FunctionCount> Counts,
+                      const char *TimeUnit) {
+  OS << "=================================================\n";
+  OS << "LLVM-TUTOR: dynamic analysis results\n";
+  OS << "=================================================\n";
+  const char *Str1 = "NAME";
+  const char *Str2 = "#N DIRECT CALLS";
+  if (!TimeUnit) {
+    OS << format("%-20s %-10s\n", Str1, Str2);
+    OS << "-------------------------------------------------\n";
+    for (auto &FC : Counts)
+      OS << format("%-20s %-10lu\n", FC.Name.str().c_str(), FC.Count);
+    return;
+  }
+
+  std::string Str3 = formatv("INCLUSIVE ({0})", TimeUnit).str();
+  std::string Str4 = formatv("EXCLUSIVE ({0})", TimeUnit).str();
+  OS << format("%-20s %-15s %-20s %-20s\n", Str1, Str2, Str3.c_str(),
+               Str4.c_str());
+  OS << "-------------------------------------------------\n";
+  for (auto &FC : Counts)
+    OS << format("%-20s %-15lu %-20lu %lu\n", FC.Name.str().c_str(), FC.Count,
+                 FC.Inclusive, FC.Exclusive);
+}
+
+static void printCSV(raw_ostream &OS, ArrayRef<FunctionCount> Counts,
+                     const char *TimeUnit) {
+  OS << (TimeUnit ? "name,count,inclusive,exclusive\n" : "name,count\n");
+  for (auto &FC : Counts) {
+    OS << FC.Name << "," << FC.Count;
+    if (TimeUnit)
+      OS << "," << FC.Inclusive << "," << FC.Exclusive;
+    OS << "\n";
+  }
+}
+
+static void printJSON(raw_ostream &OS, ArrayRef<FunctionCount> Counts,
+                      const char *TimeUnit) {
+  json::OStream J(OS, /*IndentSize=*/2);
+  J.object([&] {
+    if (TimeUnit)
+      J.attribute("time_unit", TimeUnit);
+    J.attributeArray("functions", [&] {
+      for (auto &FC : Counts)
+        J.object([&] {
+          J.attribute("name", FC.Name);
+          J.attribute("count", FC.Count);
+          if (TimeUnit) {
+            J.attribute("inclusive", FC.Inclusive);
+            J.attribute("exclusive", FC.Exclusive);
+          }
+        });
+    });
+  });
+  OS << "\n";
+}
+
+static void printCallGraphText(raw_ostream &OS,
+                               ArrayRef<ProfileCallEdge> Edges) {
+  OS << "=================================================\n";
+  OS << "LLVM-TUTOR: dynamic call graph\n";
+  OS << "=================================================\n";
+  const char *Str1 = "CALLER";
+  const char *Str2 = "SITE";
+  const char *Str3 = "CALLEE";
+  const char *Str4 = "#N CALLS";
+  OS << format("%-20s %-6s %-20s %-10s\n", Str1, Str2, Str3, Str4);
+  OS << "-------------------------------------------------\n";
+  for (auto &Edge : Edges)
+    OS << format("%-20s %-6lu %-20s %lu%s\n", Edge.Caller.str().c_str(),
+                 Edge.Site, Edge.Callee.str().c_str(), Edge.Count,
+                 Edge.Indirect ? " (indirect)" : "");
+}
+
+static void printCallGraphCSV(raw_ostream &OS,
+                              ArrayRef<ProfileCallEdge> Edges) {
+  OS << "caller,site,callee,indirect,count\n";
+  for (auto &Edge : Edges)
+    OS << Edge.Caller << "," << Edge.Site << "," << Edge.Callee << ","
+       << (Edge.Indirect ? "1" : "0") << "," << Edge.Count << "\n";
+}
+
+static void printCallGraphJSON(raw_ostream &OS,
+                               ArrayRef<ProfileCallEdge> Edges) {
+  json::OStream J(OS, /*IndentSize=*/2);
+  J.object([&] {
+    J.attributeArray("call_edges", [&] {
+      for (auto &Edge : Edges)
+        J.object([&] {
+          J.attribute("caller", Edge.Caller);
+          J.attribute("site", Edge.Site);
+          J.attribute("callee", Edge.Callee);
+          J.attribute("indirect", Edge.Indirect);
+          J.attribute("count", Edge.Count);
+        });
+    });
+  });
+  OS << "\n";
+}
+
+// Prints Name as a quoted DOT identifier
+static void printDOTName(raw_ostream &OS, StringRef Name) {
+  OS << '"';
+  for (char C : Name) {
+    if (C == '"' || C == '\\')
+      OS << '\\';
+    OS << C;
+  }
+  OS << '"';
+}
+
+// Prints one DOT edge per caller/callee pair (the counts of all the call sites
+// that connect the two are added up)
+static void printCallGraphDOT(raw_ostream &OS,
+                              ArrayRef<ProfileCallEdge> Edges) {
+  MapVector<std::pair<StringRef, StringRef>, uint64_t> Weights;
+  for (auto &Edge : Edges)
+    Weights[{Edge.Caller, Edge.Callee}] += Edge.Count;
+
+  OS << "digraph \"call graph\" {\n";
+  for (auto &[CallerAndCallee, Weight] : Weights) {
+    OS << "  ";
+    printDOTName(OS, CallerAndCallee.first);
+    OS << " -> ";
+    printDOTName(OS, CallerAndCallee.second);
+    OS << " [label=\"" << Weight << "\", weight=" << Weight << "];\n";
+  }
+  OS << "}\n";
+}
+
+// A basic block or a CFG edge count. Blocks are identified by their index
+// in the layout order of the function. The function entry and exit are
+// represented with "entry" and "exit", respectively.
+struct CFGCount {
+  StringRef Function;
+  std::string Src;
+  // Empty for block counts
+  std::string Dst;
+  uint64_t Count;
+};
+
+static void printCFGCountsText(raw_ostream &OS, ArrayRef<CFGCount> Counts,
+                               bool IsEdges) {
+  OS << "=================================================\n";
+  OS << "LLVM-TUTOR: " << (IsEdges ? "CFG edge" : "basic block")
+     << " counts\n";
+  OS << "=================================================\n";
+  const char *Str1 = "FUNCTION";
+  const char *Str2 = IsEdges ? "EDGE" : "BLOCK";
+  const char *Str3 = "#N EXECUTIONS";
+  OS << format("%-20s %-16s %-10s\n", Str1, Str2, Str3);
+  OS << "-------------------------------------------------\n";
+  for (auto &C : Counts) {
+    std::string Node = IsEdges ? C.Src + " -> " + C.Dst : C.Src;
+    OS << format("%-20s %-16s %lu\n", C.Function.str().c_str(), Node.c_str(),
+                 C.Count);
+  }
+}
+
+static void printCFGCountsCSV(raw_ostream &OS, ArrayRef<CFGCount> Counts,
+                              bool IsEdges) {
+  OS << (IsEdges ? "function,src,dst,count\n" : "function,block,count\n");
+  for (auto &C : Counts) {
+    OS << C.Function << "," << C.Src;
+    if (IsEdges)
+      OS << "," << C.Dst;
+    OS << "," << C.Count << "\n";
+  }
+}
+
+static void printCFGCountsJSON(raw_ostream &OS, ArrayRef<CFGCount> Counts,
+                               bool IsEdges) {
+  json::OStream J(OS, /*IndentSize=*/2);
+  J.object([&] {
+    J.attributeArray(IsEdges ? "cfg_edges" : "blocks", [&] {
+      for (auto &C : Counts)
+        J.object([&] {
+          J.attribute("function", C.Function);
+          if (IsEdges) {
+            J.attribute("src", C.Src);
+            J.attribute("dst", C.Dst);
+          } else {
+            J.attribute("block", C.Src);
+          }
+          J.attribute("count", C.Count);
+        });
+    });
+  });
+  OS << "\n";
+}
+
+// The coverage of one function. NumBlocks is 0 unless the profile was
+// generated with `dynamic-cc<coverage=blocks>`.
+struct FunctionCoverage {
+  StringRef Name;
+  bool Covered;
+  uint64_t CoveredBlocks;
+  uint64_t NumBlocks;
+};
+
+// Flattens the coverage bitmaps of all modules
+static std::vector<FunctionCoverage>
+getFunctionCoverage(ArrayRef<ProfileCoverage> Modules) {
+  std::vector<FunctionCoverage> Functions;
+  for (const ProfileCoverage &Module : Modules) {
+    if (Module.NumBlocks.empty()) {
+      for (uint64_t Slot = 0; Slot < Module.Names.size(); Slot++)
+        Functions.push_back(
+            {Module.Names[Slot], Module.isCovered(Slot), 0, 0});
+      continue;
+    }
+
+    // The entry block comes first, i.e. a function is covered iff its first
+    // block is
+    uint64_t Bit = 0;
+    for (size_t Slot = 0; Slot < Module.Names.size(); Slot++) {
+      uint64_t NumBlocks = Module.NumBlocks[Slot];
+      FunctionCoverage FC = {Module.Names[Slot],
+                             NumBlocks && Module.isCovered(Bit), 0, NumBlocks};
+      for (uint64_t Idx = 0; Idx < NumBlocks; Idx++)
+        FC.CoveredBlocks += Module.isCovered(Bit + Idx);
+      Bit += NumBlocks;
+      Functions.push_back(FC);
+    }
+  }
+  return Functions;
+}
+
+// Formats e.g. "3/4 (75.0%)"
+static std::string formatRatio(uint64_t Part, uint64_t Whole) {
+  return formatv("{0}/{1} ({2:F1}%)", Part, Whole,
+                 Whole ? 100.0 * Part / Whole : 0.0)
+      .str();
+}
+
+static void printCoverageText(raw_ostream &OS,
+                              ArrayRef<FunctionCoverage> Functions) {
+  bool HasBlocks = any_of(Functions, [](const FunctionCoverage &FC) {
+    return FC.NumBlocks != 0;
+  });
+
+  OS << "=================================================\n";
+  OS << "LLVM-TUTOR: coverage\n";
+  OS << "=================================================\n";
+  const char *Str1 = "NAME";
+  const char *Str2 = "COVERED";
+  const char *Str3 = "BLOCKS";
+  if (HasBlocks)
+    OS << format("%-20s %-10s %-10s\n", Str1, Str2, Str3);
+  else
+    OS << format("%-20s %-10s\n", Str1, Str2);
+  OS << "-------------------------------------------------\n";
+
+  uint64_t NumCovered = 0, NumBlocks = 0, NumCoveredBlocks = 0;
+  for (const FunctionCoverage &FC : Functions) {
+    const char *Covered = FC.Covered ? "yes" : "no";
+    if (HasBlocks && FC.NumBlocks)
+      OS << format("%-20s %-10s %lu/%lu\n", FC.Name.str().c_str(), Covered,
+                   FC.CoveredBlocks, FC.NumBlocks);
+    else if (HasBlocks)
+      OS << format("%-20s %-10s -\n", FC.Name.str().c_str(), Covered);
+    else
+      OS << format("%-20s %-10s\n", FC.Name.str().c_str(), Covered);
+    NumCovered += FC.Covered;
+    NumBlocks += FC.NumBlocks;
+    NumCoveredBlocks += FC.CoveredBlocks;
+  }
+
+  OS << "-------------------------------------------------\n";
+  OS << "functions: " << formatRatio(NumCovered, Functions.size()) << "\n";
+  if (HasBlocks)
+    OS << "blocks: " << formatRatio(NumCoveredBlocks, NumBlocks) << "\n";
+}
+
+static void printCoverageCSV(raw_ostream &OS,
+                             ArrayRef<FunctionCoverage> Functions) {
+  OS << "name,covered,covered_blocks,blocks\n";
+  for (const FunctionCoverage &FC : Functions)
+    OS << FC.Name << "," << (FC.Covered ? 1 : 0) << "," << FC.CoveredBlocks
+       << "," << FC.NumBlocks << "\n";
+}
+
+static void printCoverageJSON(raw_ostream &OS,
+                              ArrayRef<FunctionCoverage> Functions) {
+  json::OStream J(OS, /*IndentSize=*/2);
+  J.object([&] {
+    J.attributeArray("functions", [&] {
+      for (const FunctionCoverage &FC : Functions)
+        J.object([&] {
+          J.attribute("name", FC.Name);
+          J.attribute("covered", FC.Covered);
+          if (FC.NumBlocks) {
+            J.attribute("covered_blocks", FC.CoveredBlocks);
+            J.attribute("blocks", FC.NumBlocks);
+          }
+        });
+    });
+  });
+  OS << "\n";
+}
+
+// Flattens the block (or, if IsEdges is true, the CFG edge) counts of all
+// functions
+static std::vector<CFGCount>
+getCFGCounts(ArrayRef<ProfileBlockCounts> Functions, bool IsEdges) {
+  std::vector<CFGCount> Counts;
+  for (auto &F : Functions) {
+    uint64_t NumBlocks = F.Blocks.size();
+    auto GetNodeName = [NumBlocks](uint64_t Idx, const char *Virtual) {
+      return Idx == NumBlocks ? std::string(Virtual) : std::to_string(Idx);
+    };
+
+    if (!IsEdges) {
+      for (uint64_t Idx = 0; Idx < NumBlocks; Idx++)
+        Counts.push_back({F.Function, std::to_string(Idx), "", F.Blocks[Idx]});
+      continue;
+    }
+
+    for (auto &Edge : F.Edges)
+      Counts.push_back({F.Function, GetNodeName(Edge.Src, "entry"),
+                        GetNodeName(Edge.Dst, "exit"), Edge.Count});
+  }
+  return Counts;
+}
+
+// A calling context (the functions on the call path, outermost first,
+// separated with `;`) and the number of times it was entered
+using FoldedStack = std::pair<std::string, uint64_t>;
+
+// Folds the calling-context trees into one line per distinct call path. The
+// trees of different threads are merged.
+static std::vector<FoldedStack>
+getFoldedStacks(ArrayRef<ProfileContextNode> Nodes) {
+  std::vector<std::string> Paths;
+  std::map<std::string, uint64_t> Counts;
+  for (auto &Node : Nodes) {
+    // The parent always precedes its children
+    if (Node.Parent == ProfileContextNode::NoParent)
+      Paths.push_back(Node.Function.str());
+    else
+      Paths.push_back(Paths[Node.Parent] + ";" + Node.Function.str());
+    Counts[Paths.back()] += Node.Count;
+  }
+  return {Counts.begin(), Counts.end()};
+}
+
+static void printFolded(raw_ostream &OS, ArrayRef<FoldedStack> Stacks) {
+  for (auto &[Path, Count] : Stacks)
+    OS << Path << " " << Count << "\n";
+}
+
+//===----------------------------------------------------------------------===//
+// Main driver code.
+//===----------------------------------------------------------------------===//
+int main(int Argc, char **Argv) {
+  // Hide all options apart from the ones specific to this tool
+  cl::HideUnrelatedOptions(ProfileCategory);
+
+  cl::ParseCommandLineOptions(Argc, Argv,
+                              "Prints binary profiles generated by the "
+                              "llvm-tutor instrumentation passes\n");
+
+  // Makes sure llvm_shutdown() is called (which cleans up LLVM objects)
+  //  http://llvm.org/docs/ProgrammersManual.html#ending-execution-with-llvm-shutdown
+  llvm_shutdown_obj SDO;
+
+  // Memory-map the input file (a null terminator is not needed, so
+  // MemoryBuffer is free to mmap files of any size)
+  auto Buffer = MemoryBuffer::getFile(InputProfile, /*IsText=*/false,
+                                      /*RequiresNullTerminator=*/false);
+  if (!Buffer) {
+    errs() << "Error reading profile: " << InputProfile << ": "
+           << Buffer.getError().message() << "\n";
+    return -1;
+  }
+
+  auto Prof = readProfile((*Buffer)->getMemBufferRef());
+  if (!Prof) {
+    errs() << "Error reading profile: " << InputProfile << ": "
+           << toString(Prof.takeError()) << "\n";
+    return -1;
+  }
+
+  if (Sort == SortOrder::Time &&
+      (CallGraph || Blocks || CFGEdges || Folded || Coverage)) {
+    errs() << "Error: --sort=time only applies to function counts\n";
+    return -1;
+  }
+
+  if (Folded) {
+    if (Format != OutputFormat::Text) {
+      errs() << "Error: --folded doesn't support --format\n";
+      return -1;
+    }
+
+    // Sorted by the call path already
+    std::vector<FoldedStack> Stacks = getFoldedStacks(Prof->CallingContexts);
+    switch (Sort) {
+    case SortOrder::None:
+    case SortOrder::Name:
+      break;
+    case SortOrder::Count:
+      llvm::stable_sort(Stacks, [](const FoldedStack &A,
+                                   const FoldedStack &B) {
+        return A.second > B.second;
+      });
+      break;
+    case SortOrder::Time:
+      llvm_unreachable("Rejected above");
+    }
+
+    printFolded(outs(), Stacks);
+    return 0;
+  }
+
+  if (CallGraph) {
+    std::vector<ProfileCallEdge> Edges = Prof->CallEdges;
+    switch (Sort) {
+    case SortOrder::None:
+      break;
+    case SortOrder::Count:
+      llvm::stable_sort(Edges, [](const ProfileCallEdge &A,
+                                  const ProfileCallEdge &B) {
+        return A.Count > B.Count;
+      });
+      break;
+    case SortOrder::Name:
+      llvm::stable_sort(Edges, [](const ProfileCallEdge &A,
+                                  const ProfileCallEdge &B) {
+        return std::tie(A.Caller, A.Site, A.Callee) <
+               std::tie(B.Caller, B.Site, B.Callee);
+      });
+      break;
+    case SortOrder::Time:
+      llvm_unreachable("Rejected above");
+    }
+
+    switch (Format) {
+    case OutputFormat::Text:
+      printCallGraphText(outs(), Edges);
+      break;
+    case OutputFormat::CSV:
+      printCallGraphCSV(outs(), Edges);
+      break;
+    case OutputFormat::JSON:
+      printCallGraphJSON(outs(), Edges);
+      break;
+    case OutputFormat::DOT:
+      printCallGraphDOT(outs(), Edges);
+      break;
+    }
+
+    return 0;
+  }
+
+  if (Coverage) {
+    if (Format == OutputFormat::DOT) {
+      errs() << "Error: --format=dot requires --call-graph\n";
+      return -1;
+    }
+
+    std::vector<FunctionCoverage> Functions =
+        getFunctionCoverage(Prof->Coverage);
+    switch (Sort) {
+    case SortOrder::None:
+      break;
+    case SortOrder::Count:
+      // The covered functions (and blocks) first
+      llvm::stable_sort(Functions, [](const FunctionCoverage &A,
+                                      const FunctionCoverage &B) {
+        return std::make_pair(A.Covered, A.CoveredBlocks) >
+               std::make_pair(B.Covered, B.CoveredBlocks);
+      });
+      break;
+    case SortOrder::Name:
+      llvm::stable_sort(Functions, [](const FunctionCoverage &A,
+                                      const FunctionCoverage &B) {
+        return A.Name < B.Name;
+      });
+      break;
+    case SortOrder::Time:
+      llvm_unreachable("Rejected above");
+    }
+
+    switch (Format) {
+    case OutputFormat::Text:
+      printCoverageText(outs(), Functions);
+      break;
+    case OutputFormat::CSV:
+      printCoverageCSV(outs(), Functions);
+      break;
+    case OutputFormat::JSON:
+      printCoverageJSON(outs(), Functions);
+      break;
+    case OutputFormat::DOT:
+      llvm_unreachable("Rejected above");
+    }
+
+    return 0;
+  }
+
+  if (Blocks || CFGEdges) {
+    if (Format == OutputFormat::DOT) {
+      errs() << "Error: --format=dot requires --call-graph\n";
+      return -1;
+    }
+
+    bool IsEdges = CFGEdges;
+    std::vector<CFGCount> Counts = getCFGCounts(Prof->BlockCounts, IsEdges);
+    switch (Sort) {
+    case SortOrder::None:
+      break;
+    case SortOrder::Count:
+      llvm::stable_sort(Counts, [](const CFGCount &A, const CFGCount &B) {
+        return A.Count > B.Count;
+      });
+      break;
+    case SortOrder::Name:
+      // Keep the layout order within every function
+      llvm::stable_sort(Counts, [](const CFGCount &A, const CFGCount &B) {
+        return A.Function < B.Function;
+      });
+      break;
+    case SortOrder::Time:
+      llvm_unreachable("Rejected above");
+    }
+
+    switch (Format) {
+    case OutputFormat::Text:
+      printCFGCountsText(outs(), Counts, IsEdges);
+      break;
+    case OutputFormat::CSV:
+      printCFGCountsCSV(outs(), Counts, IsEdges);
+      break;
+    case OutputFormat::JSON:
+      printCFGCountsJSON(outs(), Counts, IsEdges);
+      break;
+    case OutputFormat::DOT:
+      llvm_unreachable("Handled above");
+    }
+
+    return 0;
+  }
+
+  if (Format == OutputFormat::DOT) {
+    errs() << "Error: --format=dot requires --call-graph\n";
+    return -1;
+  }
+
+  // Flatten the per-module records. All modules of one process are timed
+  // with the same clock.
+  std::vector<FunctionCount> Counts;
+  const char *TimeUnit = nullptr;
+  for (auto &Module : Prof->Modules) {
+    for (auto [Name, Count] : zip(Module.Names, Module.Counters))
+      Counts.push_back({Name, Count});
+
+    if (Module.Times.empty())
+      continue;
+    TimeUnit = Module.TimesInCycles ? "cycles" : "ns";
+    MutableArrayRef<FunctionCount> ModuleCounts(Counts);
+    for (auto [FC, Times] :
+         zip(ModuleCounts.take_back(Module.Times.size()), Module.Times)) {
+      FC.Inclusive = Times.Inclusive;
+      FC.Exclusive = Times.Exclusive;
+    }
+  }
+
+  switch (Sort) {
+  case SortOrder::None:
+    break;
+  case SortOrder::Count:
+    llvm::stable_sort(Counts, [](const FunctionCount &A,
+                                 const FunctionCount &B) {
+      return A.Count > B.Count;
+    });
+    break;
+  case SortOrder::Name:
+    llvm::stable_sort(Counts, [](const FunctionCount &A,
+                                 const FunctionCount &B) {
+      return A.Name < B.Name;
+    });
+    break;
+  case SortOrder::Time:
+    llvm::stable_sort(Counts, [](const FunctionCount &A,
+                                 const FunctionCount &B) {
+      return A.Exclusive > B.Exclusive;
+    });
+    break;
+  }
+
+  switch (Format) {
+  case OutputFormat::Text:
+    printText(outs(), Counts, TimeUnit);
+    break;
+  case OutputFormat::CSV:
+    printCSV(outs(), Counts, TimeUnit);
+    break;
+  case OutputFormat::JSON:
+    printJSON(outs(), Counts, TimeUnit);
+    break;
+  case OutputFormat::DOT:
+    llvm_unreachable("Handled above");
+  }
+
+  return 0;
+}
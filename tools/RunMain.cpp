@@ -0,0 +1,298 @@
+//========================================================================
+// FILE:
+//    RunMain.cpp
+//
+// DESCRIPTION:
+//    A command-line tool that counts the function calls made by one or more
+//    programs without leaving the current process. For every input module, it
+//    runs the DynamicCallCounter pass, JIT-compiles the instrumented module
+//    with ORC (LLJIT), runs its `main` and then reads `dcc_counters` straight
+//    from JIT memory. In other words, this is what `opt -passes=dynamic-cc`
+//    followed by `lli` does, but without writing the instrumented module to
+//    disk, launching `lli` for every input and parsing the printed report.
+//
+//    The modules are run one after another, every one in its own JIT
+//    instance. The counts are printed once all modules have finished (as
+//    text, CSV or JSON). Note that the modules share the process with this
+//    tool - a module that calls `exit` (or crashes) ends the whole run.
+//
+// USAGE:
+//    # First, generate LLVM files:
+//      clang -emit-llvm <input-file> -c -o <output-llvm-file>
+//    # Now you can run this tool as follows:
+//      <BUILD/DIR>/bin/dcc-run <output-llvm-file>
+//      <BUILD/DIR>/bin/dcc-run --format=json -o counts.json *.bc
+//
+// License: MIT
+//========================================================================
+#include "DynamicCallCounter.h"
+
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/TargetProcess/TargetExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdio>
+#include <tuple>
+
+using namespace llvm;
+
+//===----------------------------------------------------------------------===//
+// Command line options
+//===----------------------------------------------------------------------===//
+static cl::OptionCategory RunCategory{"JIT call counter options"};
+
+static cl::list<std::string> InputModules{cl::Positional, cl::OneOrMore,
+                                          cl::desc{"<Modules to run>"},
+                                          cl::value_desc{"bitcode filenames"},
+                                          cl::cat{RunCategory}};
+
+static cl::opt<std::string> OutputFilename{
+    "o", cl::desc{"Output filename"}, cl::value_desc{"filename"},
+    cl::init("-"), cl::cat{RunCategory}};
+
+enum class OutputFormat { Text, CSV, JSON };
+static cl::opt<OutputFormat> Format{
+    "format", cl::desc{"Output format"},
+    cl::values(clEnumValN(OutputFormat::Text, "text", "Human readable table"),
+               clEnumValN(OutputFormat::CSV, "csv", "Comma-separated values"),
+               clEnumValN(OutputFormat::JSON, "json", "JSON")),
+    cl::init(OutputFormat::Text), cl::cat{RunCategory}};
+
+//===----------------------------------------------------------------------===//
+// dcc-run - implementation
+//===----------------------------------------------------------------------===//
+namespace {
+struct FunctionCount {
+  std::string Name;
+  uint64_t Count;
+};
+
+// The result of running one module
+struct RunResult {
+  std::string Module;
+  int ExitCode;
+  // In slot order
+  std::vector<FunctionCount> Counts;
+};
+} // namespace
+
+// Instruments M with DynamicCallCounter. The counts are left in
+// `dcc_counters` (i.e. nothing is printed when the module exits).
+static void instrument(Module &M) {
+  DynamicCallCounterOptions Opts;
+  Opts.Report = false;
+
+  ModulePassManager MPM;
+  MPM.addPass(DynamicCallCounter(Opts));
+
+  // DynamicCallCounter is a module pass that queries function analyses, so
+  // all analysis managers are required
+  LoopAnalysisManager LAM;
+  FunctionAnalysisManager FAM;
+  CGSCCAnalysisManager CGAM;
+  ModuleAnalysisManager MAM;
+  PassBuilder PB;
+  PB.registerModuleAnalyses(MAM);
+  PB.registerCGSCCAnalyses(CGAM);
+  PB.registerFunctionAnalyses(FAM);
+  PB.registerLoopAnalyses(LAM);
+  PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+  MPM.run(M, MAM);
+}
+
+// Returns the names of the instrumented functions (in slot order) and makes
+// `dcc_counters` visible to JIT symbol lookups. Returns an empty list if M
+// doesn't contain any instrumented functions.
+static std::vector<std::string> exportCounterTable(Module &M) {
+  std::vector<std::string> Names;
+  GlobalVariable *Counters = M.getNamedGlobal("dcc_counters");
+  GlobalVariable *NameTable = M.getNamedGlobal("dcc_names");
+  if (!Counters || !NameTable)
+    return Names;
+
+  StringRef RawNames =
+      cast<ConstantDataSequential>(NameTable->getInitializer())
+          ->getRawDataValues();
+  while (!RawNames.empty()) {
+    StringRef Name;
+    std::tie(Name, RawNames) = RawNames.split('\0');
+    Names.push_back(Name.str());
+  }
+
+  Counters->setLinkage(GlobalValue::ExternalLinkage);
+  return Names;
+}
+
+// Instruments, JIT-compiles and runs the module in File
+static Expected<RunResult> runModule(std::unique_ptr<Module> M,
+                                     std::unique_ptr<LLVMContext> Ctx,
+                                     StringRef File) {
+  instrument(*M);
+  std::vector<std::string> Names = exportCounterTable(*M);
+
+  // The generic IR platform runs the global constructors and destructors of
+  // the module (and the functions registered with `atexit`)
+  orc::LLJITBuilder Builder;
+  Builder.setPlatformSetUp(orc::setUpGenericLLVMIRPlatform);
+  Builder.setLinkProcessSymbolsByDefault(true);
+  Expected<std::unique_ptr<orc::LLJIT>> J = Builder.create();
+  if (!J)
+    return J.takeError();
+
+  orc::JITDylib &JD = (*J)->getMainJITDylib();
+  if (Error Err =
+          (*J)->addIRModule(orc::ThreadSafeModule(std::move(M), std::move(Ctx))))
+    return std::move(Err);
+
+  Expected<orc::ExecutorAddr> MainAddr = (*J)->lookup("main");
+  if (!MainAddr)
+    return MainAddr.takeError();
+  uint64_t *Counters = nullptr;
+  if (!Names.empty()) {
+    Expected<orc::ExecutorAddr> CountersAddr = (*J)->lookup("dcc_counters");
+    if (!CountersAddr)
+      return CountersAddr.takeError();
+    Counters = CountersAddr->toPtr<uint64_t *>();
+  }
+
+  if (Error Err = (*J)->initialize(JD))
+    return std::move(Err);
+  RunResult Result;
+  Result.Module = File.str();
+  Result.ExitCode =
+      orc::runAsMain(MainAddr->toPtr<int (*)(int, char *[])>(), {}, File);
+  if (Error Err = (*J)->deinitialize(JD))
+    return std::move(Err);
+  // The module and this tool share stdout
+  fflush(stdout);
+
+  // The destructors have run, so all counts (including the calls made by the
+  // destructors) are final
+  for (size_t Slot = 0; Slot < Names.size(); Slot++)
+    Result.Counts.push_back({Names[Slot], Counters[Slot]});
+
+  return Result;
+}
+
+static void printText(raw_ostream &OS, ArrayRef<RunResult> Results) {
+  for (const RunResult &Result : Results) {
+    OS << "=================================================\n";
+    OS << "LLVM-TUTOR: dynamic analysis results (" << Result.Module
+       << ", exit code " << Result.ExitCode << ")\n";
+    OS << "=================================================\n";
+    const char *Str1 = "NAME";
+    const char *Str2 = "#N DIRECT CALLS";
+    OS << format("%-20s %-10s\n", Str1, Str2);
+    OS << "-------------------------------------------------\n";
+    for (const FunctionCount &FC : Result.Counts)
+      OS << format("%-20s %-10lu\n", FC.Name.c_str(), FC.Count);
+  }
+}
+
+static void printCSV(raw_ostream &OS, ArrayRef<RunResult> Results) {
+  OS << "module,exit_code,name,count\n";
+  for (const RunResult &Result : Results)
+    for (const FunctionCount &FC : Result.Counts)
+      OS << Result.Module << "," << Result.ExitCode << "," << FC.Name << ","
+         << FC.Count << "\n";
+}
+
+static void printJSON(raw_ostream &OS, ArrayRef<RunResult> Results) {
+  json::OStream J(OS, /*IndentSize=*/2);
+  J.object([&] {
+    J.attributeArray("modules", [&] {
+      for (const RunResult &Result : Results)
+        J.object([&] {
+          J.attribute("module", Result.Module);
+          J.attribute("exit_code", Result.ExitCode);
+          J.attributeArray("functions", [&] {
+            for (const FunctionCount &FC : Result.Counts)
+              J.object([&] {
+                J.attribute("name", FC.Name);
+                J.attribute("count", FC.Count);
+              });
+          });
+        });
+    });
+  });
+  OS << "\n";
+}
+
+//===----------------------------------------------------------------------===//
+// Main driver code.
+//===----------------------------------------------------------------------===//
+int main(int Argc, char **Argv) {
+  // Hide all options apart from the ones specific to this tool
+  cl::HideUnrelatedOptions(RunCategory);
+
+  cl::ParseCommandLineOptions(Argc, Argv,
+                              "Counts the number of dynamic function calls "
+                              "in the input IR files (using the ORC JIT)\n");
+
+  // Makes sure llvm_shutdown() is called (which cleans up LLVM objects)
+  //  http://llvm.org/docs/ProgrammersManual.html#ending-execution-with-llvm-shutdown
+  llvm_shutdown_obj SDO;
+
+  InitializeNativeTarget();
+  InitializeNativeTargetAsmPrinter();
+
+  std::vector<RunResult> Results;
+  for (const std::string &InputModule : InputModules) {
+    // Parse the IR file passed on the command line. Every module gets its own
+    // context, which the JIT takes over.
+    SMDiagnostic Err;
+    auto Ctx = std::make_unique<LLVMContext>();
+    std::unique_ptr<Module> M = parseIRFile(InputModule, Err, *Ctx);
+    if (!M) {
+      errs() << "Error reading bitcode file: " << InputModule << "\n";
+      Err.print(Argv[0], errs());
+      return -1;
+    }
+
+    Expected<RunResult> Result =
+        runModule(std::move(M), std::move(Ctx), InputModule);
+    if (!Result) {
+      errs() << "Error running " << InputModule << ": "
+             << toString(Result.takeError()) << "\n";
+      return -1;
+    }
+    Results.push_back(std::move(*Result));
+  }
+
+  std::error_code EC;
+  ToolOutputFile Out(OutputFilename, EC, sys::fs::OF_None);
+  if (EC) {
+    errs() << "Error opening " << OutputFilename << ": " << EC.message()
+           << "\n";
+    return -1;
+  }
+
+  switch (Format) {
+  case OutputFormat::Text:
+    printText(Out.os(), Results);
+    break;
+  case OutputFormat::CSV:
+    printCSV(Out.os(), Results);
+    break;
+  case OutputFormat::JSON:
+    printJSON(Out.os(), Results);
+    break;
+  }
+  Out.keep();
+
+  return 0;
+}
@@ -4,25 +4,76 @@
 //
 // DESCRIPTION:
 //    A command-line tool that counts all static calls (i.e. calls as seen
-//    in the source code) in the input LLVM file. Internally it uses the
+//    in the source code) in the input LLVM files. Internally it uses the
 //    StaticCallCounter pass.
 //
+//    Any number of input files can be passed, either on the command line or
+//    through `--input-files` (one file per line). Inputs can also be glob
+//    patterns, which are expanded by this tool (i.e. they work even when
+//    there are too many files for the shell). In patterns, `*`, `?` and
+//    `[...]` only match within one path component and a `**` component
+//    matches any number of directories.
+//
+//    The modules are parsed and analysed in parallel (`-j`). Every worker
+//    thread has its own LLVMContext and processes one module at a time, so
+//    the workers never have to synchronise. The counts from all modules are
+//    merged by the name of the called function (in input order, i.e. the
+//    report doesn't depend on the number of threads).
+//
+//    Bitcode files are memory-mapped and loaded lazily: initially, only the
+//    module-level entities (globals, function declarations) are read. The
+//    function bodies are materialized one at a time, scanned and deleted
+//    right away, so at most one function body is in memory at any time.
+//    Textual IR files (and bitcode with `--eager`) are parsed in full and
+//    analysed through the pass manager.
+//
+//    With `--cache-dir`, the results are cached on disk, keyed by a hash of
+//    the contents of the input file. Modules that haven't changed since a
+//    previous run (of any number of `static` processes sharing the cache)
+//    are not even parsed. Every cache entry is a small binary file, written
+//    to a temporary file first and then renamed, so concurrent writers never
+//    leave a partial entry behind. Once the cache grows beyond `--cache-size`,
+//    the least recently used entries are removed.
+//
 // USAGE:
 //    # First, generate an LLVM file:
 //      clang -emit-llvm <input-file> -c -o <output-llvm-file>
 //    # Now you can run this tool as follows:
 //      <BUILD/DIR>/bin/static <output-llvm-file>
+//      <BUILD/DIR>/bin/static -j 8 'build/**/*.bc'
+//      <BUILD/DIR>/bin/static --input-files=modules.txt
+//      <BUILD/DIR>/bin/static --eager <output-llvm-file>
+//      <BUILD/DIR>/bin/static --cache-dir=cache --cache-size=64m *.bc
 //
 // License: MIT
 //========================================================================
 #include "StaticCallCounter.h"
 
+#include "llvm/ADT/MapVector.h"
+#include "llvm/Bitcode/BitcodeReader.h"
 #include "llvm/IRReader/IRReader.h"
 #include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/CachePruning.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/GlobPattern.h"
+#include "llvm/Support/LEB128.h"
 #include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
 #include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <optional>
 
 using namespace llvm;
 
@@ -31,21 +82,49 @@ using namespace llvm;
 //===----------------------------------------------------------------------===//
 static cl::OptionCategory CallCounterCategory{"call counter options"};
 
-static cl::opt<std::string> InputModule{cl::Positional,
-                                        cl::desc{"<Module to analyze>"},
-                                        cl::value_desc{"bitcode filename"},
-                                        cl::init(""),
-                                        cl::Required,
-                                        cl::cat{CallCounterCategory}};
+static cl::list<std::string> InputModules{
+    cl::Positional, cl::desc{"<Modules to analyze>"},
+    cl::value_desc{"bitcode filenames or glob patterns"}, cl::ZeroOrMore,
+    cl::cat{CallCounterCategory}};
+
+static cl::opt<std::string> InputFileList{
+    "input-files",
+    cl::desc{"A file with the names (or glob patterns) of more modules to "
+             "analyze (one per line)"},
+    cl::value_desc{"filename"}, cl::init(""), cl::cat{CallCounterCategory}};
+
+static cl::opt<unsigned> Jobs{
+    "j",
+    cl::desc{"The number of modules to analyze in parallel (0 - one per "
+             "hardware thread)"},
+    cl::init(0), cl::cat{CallCounterCategory}};
+
+static cl::opt<bool> Eager{
+    "eager",
+    cl::desc{"Parse all of every bitcode file up front (instead of loading "
+             "one function at a time)"},
+    cl::init(false), cl::cat{CallCounterCategory}};
+
+static cl::opt<std::string> CacheDir{
+    "cache-dir",
+    cl::desc{"Reuse the results for the modules that haven't changed since "
+             "a previous run (cached in this directory)"},
+    cl::value_desc{"directory"}, cl::init(""), cl::cat{CallCounterCategory}};
+
+static cl::opt<std::string> CacheSize{
+    "cache-size",
+    cl::desc{"The maximum size of the cache, e.g. 500k, 64m or 1g (the least "
+             "recently used entries are removed first)"},
+    cl::init("64m"), cl::cat{CallCounterCategory}};
 
 //===----------------------------------------------------------------------===//
 // static - implementation
 //===----------------------------------------------------------------------===//
-static void countStaticCalls(Module &M) {
-  // Create a module pass manager and add StaticCallCounterPrinter to it.
-  ModulePassManager MPM;
-  MPM.addPass(StaticCallCounterPrinter(llvm::errs()));
+// The direct calls made from one module, keyed by the name of the callee (in
+// the order in which StaticCallCounter found them)
+using ModuleCalls = std::vector<std::pair<std::string, unsigned>>;
 
+static ModuleCalls countStaticCalls(Module &M) {
   // Create an analysis manager and register StaticCallCounter with it.
   ModuleAnalysisManager MAM;
   MAM.registerPass([&] { return StaticCallCounter(); });
@@ -57,8 +136,368 @@ static void countStaticCalls(Module &M) {
   PassBuilder PB;
   PB.registerModuleAnalyses(MAM);
 
-  // Finally, run the passes registered with MPM
-  MPM.run(M, MAM);
+  // Run the analysis. The result refers to the functions in M, so copy the
+  // names before M goes away.
+  ModuleCalls Calls;
+  for (auto &[Callee, Count] : MAM.getResult<StaticCallCounter>(M))
+    Calls.push_back({Callee->getName().str(), Count});
+  return Calls;
+}
+
+// Same as countStaticCalls, but for a lazily loaded bitcode module. Every
+// function body is materialized, scanned and then deleted (there's no way to
+// dematerialize a function, but the body isn't needed again). The analysis
+// doesn't go through the pass manager, which would need the whole module.
+static Expected<ModuleCalls> countStaticCallsLazily(MemoryBufferRef Buffer,
+                                                    LLVMContext &Ctx) {
+  // The function-level metadata (e.g. debug info) is only loaded if a
+  // function refers to it
+  Expected<std::unique_ptr<Module>> M =
+      getLazyBitcodeModule(Buffer, Ctx, /*ShouldLazyLoadMetadata=*/true);
+  if (!M)
+    return M.takeError();
+
+  StaticCallCounter::Result Res;
+  for (Function &F : **M) {
+    if (Error Err = F.materialize())
+      return std::move(Err);
+    StaticCallCounter::countDirectCalls(F, Res);
+    F.deleteBody();
+  }
+
+  ModuleCalls Calls;
+  for (auto &[Callee, Count] : Res)
+    Calls.push_back({Callee->getName().str(), Count});
+  return Calls;
+}
+
+// Returns true if the path components in Path match the pattern components
+// in Pattern. A `**` component matches any number of components.
+static bool matchComponents(ArrayRef<std::optional<GlobPattern>> Pattern,
+                            ArrayRef<StringRef> Path) {
+  if (Pattern.empty())
+    return Path.empty();
+  if (!Pattern.front())
+    return matchComponents(Pattern.drop_front(), Path) ||
+           (!Path.empty() && matchComponents(Pattern, Path.drop_front()));
+  return !Path.empty() && Pattern.front()->match(Path.front()) &&
+         matchComponents(Pattern.drop_front(), Path.drop_front());
+}
+
+// Appends the regular files matching the glob pattern Pattern (in sorted
+// order) to Files
+static Error expandGlob(StringRef Pattern, std::vector<std::string> &Files) {
+  // The leading components without wildcards name the directory to search
+  SmallString<128> Root;
+  SmallVector<std::optional<GlobPattern>, 4> Components;
+  bool Recursive = false;
+  for (auto It = sys::path::begin(Pattern), End = sys::path::end(Pattern);
+       It != End; ++It) {
+    bool HasWildcard = It->find_first_of("*?[") != StringRef::npos;
+    if (Components.empty() && !HasWildcard) {
+      sys::path::append(Root, *It);
+      continue;
+    }
+
+    if (*It == "**") {
+      Components.push_back(std::nullopt);
+      Recursive = true;
+      continue;
+    }
+    Expected<GlobPattern> Component = GlobPattern::create(*It);
+    if (!Component)
+      return Component.takeError();
+    Components.push_back(std::move(*Component));
+  }
+  if (Root.empty())
+    Root = ".";
+
+  std::vector<std::string> Matches;
+  std::error_code EC;
+  for (sys::fs::recursive_directory_iterator It(Root, EC), End;
+       It != End && !EC; It.increment(EC)) {
+    // Only descend as deep as the pattern goes
+    if (!Recursive && It.level() + 1 >= static_cast<int>(Components.size()))
+      It.no_push();
+
+    StringRef RelPath = StringRef(It->path()).drop_front(Root.size());
+    SmallVector<StringRef, 8> Path;
+    for (auto C = sys::path::begin(RelPath), E = sys::path::end(RelPath);
+         C != E; ++C)
+      if (!sys::path::is_separator((*C)[0]))
+        Path.push_back(*C);
+
+    if (matchComponents(Components, Path) &&
+        sys::fs::is_regular_file(It->path()))
+      Matches.push_back(It->path());
+  }
+  if (EC)
+    return createFileError(Root, EC);
+
+  if (Matches.empty())
+    return make_error<StringError>("no files match '" + Pattern + "'",
+                                   inconvertibleErrorCode());
+  llvm::sort(Matches);
+  llvm::append_range(Files, Matches);
+  return Error::success();
+}
+
+// Expands Inputs (file names and glob patterns) into a list of files
+static Expected<std::vector<std::string>>
+expandInputs(ArrayRef<std::string> Inputs) {
+  std::vector<std::string> Files;
+  for (const std::string &Input : Inputs) {
+    if (StringRef(Input).find_first_of("*?[") == StringRef::npos) {
+      Files.push_back(Input);
+      continue;
+    }
+    if (Error Err = expandGlob(Input, Files))
+      return std::move(Err);
+  }
+  return Files;
+}
+
+//===----------------------------------------------------------------------===//
+// The result cache
+//===----------------------------------------------------------------------===//
+namespace {
+// The header of a cache entry. It's followed by NumCallees records, each a
+// ULEB128-encoded call count and the NUL-terminated name of the callee.
+struct CacheEntryHeader {
+  uint32_t Magic;
+  uint32_t Version;
+  uint64_t NumCallees;
+};
+
+constexpr uint32_t CacheMagic = 0x4353544c; // "LTSC"
+constexpr uint32_t CacheVersion = 1;
+
+// An on-disk cache that maps the contents of a module to the direct calls
+// made from it. Every entry is a separate file named after the hash of the
+// contents (pruneCache only ever removes files whose names start with
+// `llvmcache-`). The cache can be shared by any number of threads and
+// processes.
+class ResultCache {
+public:
+  explicit ResultCache(StringRef Dir) : Dir(Dir.str()) {}
+
+  static std::string getKey(MemoryBufferRef Buffer);
+  std::optional<ModuleCalls> lookup(StringRef Key);
+  void insert(StringRef Key, const ModuleCalls &Calls);
+
+  unsigned getNumHits() const { return NumHits; }
+  unsigned getNumMisses() const { return NumMisses; }
+
+private:
+  std::string getEntryPath(StringRef Key) const {
+    return (Dir + "/llvmcache-static-" + Key).str();
+  }
+
+  std::string Dir;
+  std::atomic<unsigned> NumHits{0};
+  std::atomic<unsigned> NumMisses{0};
+};
+} // namespace
+
+std::string ResultCache::getKey(MemoryBufferRef Buffer) {
+  XXH128_hash_t Hash = xxh3_128bits(arrayRefFromStringRef(Buffer.getBuffer()));
+  return formatv("v{0}-{1:x-16}{2:x-16}", CacheVersion, Hash.high64,
+                 Hash.low64)
+      .str();
+}
+
+std::optional<ModuleCalls> ResultCache::lookup(StringRef Key) {
+  std::string Path = getEntryPath(Key);
+  auto Buffer = MemoryBuffer::getFile(Path, /*IsText=*/false,
+                                      /*RequiresNullTerminator=*/false);
+  if (!Buffer) {
+    NumMisses++;
+    return std::nullopt;
+  }
+
+  // Entries that fail to decode (e.g. from a newer version of this tool) are
+  // treated as misses and overwritten
+  StringRef Data = (*Buffer)->getBuffer();
+  CacheEntryHeader Header;
+  if (Data.size() < sizeof(Header)) {
+    NumMisses++;
+    return std::nullopt;
+  }
+  std::memcpy(&Header, Data.data(), sizeof(Header));
+  Data = Data.drop_front(sizeof(Header));
+  if (Header.Magic != CacheMagic || Header.Version != CacheVersion ||
+      Header.NumCallees > Data.size()) {
+    NumMisses++;
+    return std::nullopt;
+  }
+
+  ModuleCalls Calls;
+  for (uint64_t Idx = 0; Idx < Header.NumCallees; Idx++) {
+    unsigned Size = 0;
+    const char *Error = nullptr;
+    uint64_t Count = decodeULEB128(Data.bytes_begin(), &Size,
+                                   Data.bytes_end(), &Error);
+    size_t NameEnd = Error ? StringRef::npos : Data.find('\0', Size);
+    if (NameEnd == StringRef::npos) {
+      NumMisses++;
+      return std::nullopt;
+    }
+    Calls.push_back({Data.slice(Size, NameEnd).str(),
+                     static_cast<unsigned>(Count)});
+    Data = Data.drop_front(NameEnd + 1);
+  }
+
+  // pruneCache evicts the entries with the oldest access time first. Don't
+  // rely on the file system updating it (e.g. with `noatime` mounts).
+  int FD;
+  if (!sys::fs::openFileForReadWrite(Path, FD, sys::fs::CD_OpenExisting,
+                                     sys::fs::OF_None)) {
+    sys::fs::setLastAccessAndModificationTime(FD,
+                                              std::chrono::system_clock::now());
+    sys::Process::SafelyCloseFileDescriptor(FD);
+  }
+  NumHits++;
+  return Calls;
+}
+
+void ResultCache::insert(StringRef Key, const ModuleCalls &Calls) {
+  std::string Entry;
+  raw_string_ostream OS(Entry);
+  CacheEntryHeader Header = {CacheMagic, CacheVersion, Calls.size()};
+  OS.write(reinterpret_cast<const char *>(&Header), sizeof(Header));
+  for (auto &[Name, Count] : Calls) {
+    encodeULEB128(Count, OS);
+    OS << Name << '\0';
+  }
+  OS.flush();
+
+  // Write a temporary file and rename it, so that readers only ever see
+  // complete entries. Writers racing on the same entry write the same
+  // contents, so it doesn't matter which rename wins. A cache that can't be
+  // written to only makes this tool slower, so errors are ignored.
+  int FD;
+  SmallString<128> TempPath;
+  if (sys::fs::createUniqueFile(Dir + "/static-%%%%%%%%.tmp", FD, TempPath))
+    return;
+  {
+    raw_fd_ostream TempOS(FD, /*shouldClose=*/true);
+    TempOS << Entry;
+    TempOS.close();
+    if (TempOS.has_error()) {
+      TempOS.clear_error();
+      sys::fs::remove(TempPath);
+      return;
+    }
+  }
+  if (sys::fs::rename(TempPath, getEntryPath(Key)))
+    sys::fs::remove(TempPath);
+}
+
+// The result of analysing one module
+struct ModuleResult {
+  ModuleCalls Calls;
+  // Empty unless the module couldn't be parsed
+  std::string ParseError;
+};
+
+// Loads and analyses the module in File (unless Cache already contains the
+// results for it)
+static void analyzeModule(StringRef File, LLVMContext &Ctx,
+                          const char *ToolName, ResultCache *Cache,
+                          ModuleResult &Result) {
+  raw_string_ostream ErrOS(Result.ParseError);
+
+  // Memory-map the input (a null terminator is not needed, so MemoryBuffer is
+  // free to mmap files of any size)
+  auto Buffer = MemoryBuffer::getFile(File, /*IsText=*/false,
+                                      /*RequiresNullTerminator=*/false);
+  if (!Buffer) {
+    ErrOS << ToolName << ": " << File
+          << ": error: " << Buffer.getError().message() << "\n";
+    return;
+  }
+
+  std::string Key;
+  if (Cache) {
+    Key = ResultCache::getKey((*Buffer)->getMemBufferRef());
+    if (std::optional<ModuleCalls> Calls = Cache->lookup(Key)) {
+      Result.Calls = std::move(*Calls);
+      return;
+    }
+  }
+
+  const auto *Start =
+      reinterpret_cast<const unsigned char *>((*Buffer)->getBufferStart());
+  if (!Eager && isBitcode(Start, Start + (*Buffer)->getBufferSize())) {
+    auto Calls = countStaticCallsLazily((*Buffer)->getMemBufferRef(), Ctx);
+    if (!Calls) {
+      ErrOS << ToolName << ": " << File
+            << ": error: " << toString(Calls.takeError()) << "\n";
+      return;
+    }
+    Result.Calls = std::move(*Calls);
+  } else {
+    // Textual IR can't be loaded lazily
+    SMDiagnostic Err;
+    std::unique_ptr<Module> M = parseIRFile(File, Err, Ctx);
+    if (!M) {
+      Err.print(ToolName, ErrOS);
+      return;
+    }
+    Result.Calls = countStaticCalls(*M);
+  }
+
+  if (Cache)
+    Cache->insert(Key, Result.Calls);
+}
+
+// Parses and analyses Files on up to `-j` threads. Every thread owns an
+// LLVMContext and picks the next unprocessed file whenever it's done with
+// the previous one.
+static std::vector<ModuleResult> analyzeModules(ArrayRef<std::string> Files,
+                                                const char *ToolName,
+                                                ResultCache *Cache) {
+  std::vector<ModuleResult> Results(Files.size());
+  std::atomic<size_t> NextFile{0};
+
+  auto Worker = [&] {
+    LLVMContext Ctx;
+    for (size_t Idx = NextFile++; Idx < Files.size(); Idx = NextFile++)
+      analyzeModule(Files[Idx], Ctx, ToolName, Cache, Results[Idx]);
+  };
+
+  // No point in starting more threads than there are files
+  ThreadPoolStrategy Strategy = hardware_concurrency(Jobs);
+  unsigned NumThreads = std::min<size_t>(
+      Strategy.compute_thread_count(), std::max<size_t>(Files.size(), 1));
+  if (NumThreads <= 1) {
+    Worker();
+    return Results;
+  }
+
+  DefaultThreadPool Pool(hardware_concurrency(NumThreads));
+  for (unsigned Idx = 0; Idx < NumThreads; Idx++)
+    Pool.async(Worker);
+  Pool.wait();
+  return Results;
+}
+
+// Pretty-prints the merged counts (see printStaticCCResult in
+// StaticCallCounter.cpp)
+static void printStaticCalls(raw_ostream &OS,
+                             const MapVector<StringRef, uint64_t> &Calls) {
+  OS << "=================================================\n";
+  OS << "LLVM-TUTOR: static analysis results\n";
+  OS << "=================================================\n";
+  const char *Str1 = "NAME";
+  const char *Str2 = "#N DIRECT CALLS";
+  OS << format("%-20s %-10s\n", Str1, Str2);
+  OS << "-------------------------------------------------\n";
+
+  for (auto &[Name, Count] : Calls)
+    OS << format("%-20s %-10lu\n", Name.str().c_str(), Count);
+
+  OS << "-------------------------------------------------\n\n";
 }
 
 //===----------------------------------------------------------------------===//
@@ -70,25 +509,88 @@ int main(int Argc, char **Argv) {
 
   cl::ParseCommandLineOptions(Argc, Argv,
                               "Counts the number of static function "
-                              "calls in the input IR file\n");
+                              "calls in the input IR files\n");
 
   // Makes sure llvm_shutdown() is called (which cleans up LLVM objects)
   //  http://llvm.org/docs/ProgrammersManual.html#ending-execution-with-llvm-shutdown
   llvm_shutdown_obj SDO;
 
-  // Parse the IR file passed on the command line.
-  SMDiagnostic Err;
-  LLVMContext Ctx;
-  std::unique_ptr<Module> M = parseIRFile(InputModule.getValue(), Err, Ctx);
+  std::vector<std::string> Inputs(InputModules.begin(), InputModules.end());
+  if (!InputFileList.empty()) {
+    auto List = MemoryBuffer::getFile(InputFileList, /*IsText=*/true);
+    if (!List) {
+      errs() << "Error reading input list: " << InputFileList << ": "
+             << List.getError().message() << "\n";
+      return -1;
+    }
 
-  if (!M) {
-    errs() << "Error reading bitcode file: " << InputModule << "\n";
-    Err.print(Argv[0], errs());
+    SmallVector<StringRef, 0> Lines;
+    (*List)->getBuffer().split(Lines, '\n');
+    for (StringRef Line : Lines) {
+      Line = Line.trim();
+      if (!Line.empty())
+        Inputs.push_back(Line.str());
+    }
+  }
+
+  if (Inputs.empty()) {
+    errs() << "Error: no input modules\n";
     return -1;
   }
 
-  // Run the analysis and print the results
-  countStaticCalls(*M);
+  auto Files = expandInputs(Inputs);
+  if (!Files) {
+    errs() << "Error: " << toString(Files.takeError()) << "\n";
+    return -1;
+  }
+
+  std::optional<ResultCache> Cache;
+  CachePruningPolicy Policy;
+  if (!CacheDir.empty()) {
+    // Prune on every run and only based on the size (`prune_after=0s`
+    // disables the expiration)
+    auto PolicyOrErr = parseCachePruningPolicy(
+        "prune_interval=0s:prune_after=0s:cache_size_bytes=" + CacheSize);
+    if (!PolicyOrErr) {
+      errs() << "Error: invalid --cache-size: "
+             << toString(PolicyOrErr.takeError()) << "\n";
+      return -1;
+    }
+    Policy = *PolicyOrErr;
+
+    if (std::error_code EC = sys::fs::create_directories(CacheDir)) {
+      errs() << "Error creating the cache directory: " << CacheDir << ": "
+             << EC.message() << "\n";
+      return -1;
+    }
+    Cache.emplace(CacheDir);
+  }
+
+  // Run the analysis on all modules
+  std::vector<ModuleResult> Results =
+      analyzeModules(*Files, Argv[0], Cache ? &*Cache : nullptr);
+  if (Cache)
+    pruneCache(CacheDir, Policy);
+
+  // Merge the results (in input order) and print them
+  bool Failed = false;
+  MapVector<StringRef, uint64_t> Calls;
+  for (size_t Idx = 0; Idx < Results.size(); Idx++) {
+    if (!Results[Idx].ParseError.empty()) {
+      errs() << "Error reading bitcode file: " << (*Files)[Idx] << "\n";
+      errs() << Results[Idx].ParseError;
+      Failed = true;
+      continue;
+    }
+    for (auto &[Name, Count] : Results[Idx].Calls)
+      Calls[Name] += Count;
+  }
+  if (Failed)
+    return -1;
 
+  printStaticCalls(errs(), Calls);
+  if (Cache)
+    errs() << "cache: " << Cache->getNumHits() << " hit(s), "
+           << Cache->getNumMisses() << " miss(es)\n";
   return 0;
 }
@@ -0,0 +1,310 @@
+//========================================================================
+// FILE:
+//    TopMain.cpp
+//
+// DESCRIPTION:
+//    A command-line tool that watches the live call counts of a running
+//    process instrumented with `dynamic-cc<shm>`. lt_rt exports the counter
+//    tables of such a process through a POSIX shared-memory segment (see
+//    ProfileFormat.h). This tool maps the segment (read-only), samples the
+//    counters every `--interval` milliseconds and prints the call rates (calls
+//    per second since the previous sample) of the `--top` hottest functions.
+//    The instrumented process is not stopped, signalled or slowed down in any
+//    way - the counters are read while it keeps updating them.
+//
+// USAGE:
+//    # First, start a process instrumented with `dynamic-cc<shm>`:
+//      opt -load-pass-plugin <BUILD_DIR>/lib/libDynamicCallCounter.so `\`
+//        -passes="dynamic-cc<shm>" <input-llvm-file> -o instrumented.bc
+//      clang instrumented.bc -L<BUILD_DIR>/lib -llt_rt -o instrumented
+//      ./instrumented &
+//    # Now you can run this tool as follows:
+//      <BUILD/DIR>/bin/lt-top <pid>
+//      <BUILD/DIR>/bin/lt-top --interval=5000 --top=20 <pid>
+//      <BUILD/DIR>/bin/lt-top --iterations=1 <pid>
+//
+// License: MIT
+//========================================================================
+#include "ProfileFormat.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <tuple>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace llvm;
+
+//===----------------------------------------------------------------------===//
+// Command line options
+//===----------------------------------------------------------------------===//
+static cl::OptionCategory TopCategory{"live counter reader options"};
+
+static cl::opt<unsigned> Pid{cl::Positional,
+                             cl::desc{"<PID of the process to watch>"},
+                             cl::Required, cl::cat{TopCategory}};
+
+static cl::opt<unsigned> IntervalMs{
+    "interval", cl::desc{"The time between two samples (in milliseconds)"},
+    cl::init(1000), cl::cat{TopCategory}};
+
+static cl::opt<unsigned> Top{"top",
+                             cl::desc{"The number of functions to print"},
+                             cl::init(10), cl::cat{TopCategory}};
+
+static cl::opt<unsigned> Iterations{
+    "iterations",
+    cl::desc{"Stop after printing this many samples (0 - keep going until "
+             "the process exits)"},
+    cl::init(0), cl::cat{TopCategory}};
+
+//===----------------------------------------------------------------------===//
+// lt-top - implementation
+//===----------------------------------------------------------------------===//
+namespace {
+// The counters of one module, as exported by lt_rt
+struct LiveModule {
+  std::vector<StringRef> Names;
+  const uint64_t *Counters;
+};
+
+// A read-only view of the shared-memory segment of one process
+class LiveCounters {
+public:
+  ~LiveCounters() {
+    if (Base)
+      munmap(Base, MappedSize);
+    if (FD >= 0)
+      close(FD);
+  }
+
+  Error open(unsigned Pid);
+  // Picks up the modules added since the last call
+  Error refresh();
+
+  StringRef getProgramName() const {
+    const char *Name = getHeader()->Name;
+    return StringRef(Name, strnlen(Name, sizeof(getHeader()->Name)));
+  }
+  ArrayRef<LiveModule> getModules() const { return Modules; }
+
+private:
+  const LTShmHeader *getHeader() const {
+    return reinterpret_cast<const LTShmHeader *>(Base);
+  }
+  Error map(uint64_t Size);
+
+  int FD = -1;
+  char *Base = nullptr;
+  uint64_t MappedSize = 0;
+  std::vector<LiveModule> Modules;
+  // The offset of the next module to read
+  uint64_t NextModule = 0;
+};
+} // namespace
+
+static Error makeSegmentError(const Twine &Msg) {
+  return make_error<StringError>("malformed segment: " + Msg,
+                                 inconvertibleErrorCode());
+}
+
+Error LiveCounters::map(uint64_t Size) {
+  void *NewBase = mmap(nullptr, Size, PROT_READ, MAP_SHARED, FD, 0);
+  if (NewBase == MAP_FAILED)
+    return errorCodeToError(std::error_code(errno, std::generic_category()));
+
+  if (Base) {
+    // The names have to be re-read from the new mapping
+    munmap(Base, MappedSize);
+    Modules.clear();
+    NextModule = 0;
+  }
+  Base = static_cast<char *>(NewBase);
+  MappedSize = Size;
+  return Error::success();
+}
+
+Error LiveCounters::open(unsigned Pid) {
+  std::string Name = formatv("{0}{1}", LT_SHM_NAME_PREFIX, Pid).str();
+  FD = shm_open(Name.c_str(), O_RDONLY, 0);
+  if (FD < 0)
+    return errorCodeToError(std::error_code(errno, std::generic_category()));
+
+  struct stat Stat;
+  if (fstat(FD, &Stat))
+    return errorCodeToError(std::error_code(errno, std::generic_category()));
+  if (static_cast<uint64_t>(Stat.st_size) < sizeof(LTShmHeader))
+    return makeSegmentError("truncated header");
+  if (Error Err = map(Stat.st_size))
+    return Err;
+
+  if (getHeader()->Magic != LT_SHM_MAGIC)
+    return makeSegmentError("bad magic");
+  if (getHeader()->Version != LT_SHM_VERSION)
+    return makeSegmentError(
+        formatv("unsupported version {0}", getHeader()->Version));
+  return refresh();
+}
+
+Error LiveCounters::refresh() {
+  uint64_t NumModules =
+      __atomic_load_n(&getHeader()->NumModules, __ATOMIC_ACQUIRE);
+  if (NumModules == Modules.size())
+    return Error::success();
+
+  uint64_t Size = getHeader()->Size;
+  if (Size > MappedSize)
+    if (Error Err = map(Size))
+      return Err;
+
+  if (Modules.empty())
+    NextModule = getHeader()->FirstModule;
+  while (Modules.size() < NumModules) {
+    LTShmModule Module;
+    if (NextModule > Size || Size - NextModule < sizeof(Module))
+      return makeSegmentError("truncated module");
+    std::memcpy(&Module, Base + NextModule, sizeof(Module));
+    if (Module.NamesSize > Size - NextModule - sizeof(Module) ||
+        Module.Counters > Size ||
+        Module.NumCounters > (Size - Module.Counters) / sizeof(uint64_t) ||
+        Module.Next <= NextModule)
+      return makeSegmentError("bad module");
+
+    LiveModule Live;
+    StringRef Names(Base + NextModule + sizeof(Module), Module.NamesSize);
+    while (!Names.empty()) {
+      StringRef Name;
+      std::tie(Name, Names) = Names.split('\0');
+      Live.Names.push_back(Name);
+    }
+    if (Live.Names.size() != Module.NumCounters)
+      return makeSegmentError(formatv("{0} names for {1} counters",
+                                      Live.Names.size(), Module.NumCounters));
+    Live.Counters = reinterpret_cast<const uint64_t *>(Base + Module.Counters);
+
+    Modules.push_back(std::move(Live));
+    NextModule = Module.Next;
+  }
+  return Error::success();
+}
+
+// One sample of the counters of all modules (in module and slot order)
+static std::vector<uint64_t> takeSample(ArrayRef<LiveModule> Modules) {
+  std::vector<uint64_t> Sample;
+  for (const LiveModule &Module : Modules)
+    for (size_t Slot = 0; Slot < Module.Names.size(); Slot++)
+      Sample.push_back(
+          __atomic_load_n(&Module.Counters[Slot], __ATOMIC_RELAXED));
+  return Sample;
+}
+
+struct FunctionRate {
+  StringRef Name;
+  double Rate;
+  uint64_t Total;
+};
+
+static void printRates(raw_ostream &OS, StringRef ProgramName,
+                       ArrayRef<FunctionRate> Rates) {
+  OS << "=================================================\n";
+  OS << "LLVM-TUTOR: live call rates (" << ProgramName << ", pid " << Pid
+     << ")\n";
+  OS << "=================================================\n";
+  const char *Str1 = "NAME";
+  const char *Str2 = "CALLS/S";
+  const char *Str3 = "TOTAL";
+  OS << format("%-20s %-15s %-10s\n", Str1, Str2, Str3);
+  OS << "-------------------------------------------------\n";
+  for (const FunctionRate &FR : Rates)
+    OS << format("%-20s %-15.0f %-10lu\n", FR.Name.str().c_str(), FR.Rate,
+                 FR.Total);
+  OS.flush();
+}
+
+//===----------------------------------------------------------------------===//
+// Main driver code.
+//===----------------------------------------------------------------------===//
+int main(int Argc, char **Argv) {
+  // Hide all options apart from the ones specific to this tool
+  cl::HideUnrelatedOptions(TopCategory);
+
+  cl::ParseCommandLineOptions(Argc, Argv,
+                              "Prints the live call rates of a process "
+                              "instrumented with dynamic-cc<shm>\n");
+
+  // Makes sure llvm_shutdown() is called (which cleans up LLVM objects)
+  //  http://llvm.org/docs/ProgrammersManual.html#ending-execution-with-llvm-shutdown
+  llvm_shutdown_obj SDO;
+
+  LiveCounters Live;
+  if (Error Err = Live.open(Pid)) {
+    errs() << "Error reading the live counters of process " << Pid << ": "
+           << toString(std::move(Err))
+           << " (is it instrumented with dynamic-cc<shm>?)\n";
+    return -1;
+  }
+
+  using Clock = std::chrono::steady_clock;
+  std::vector<uint64_t> Previous = takeSample(Live.getModules());
+  Clock::time_point PreviousTime = Clock::now();
+  for (unsigned Iteration = 0; !Iterations || Iteration < Iterations;
+       Iteration++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(IntervalMs));
+
+    // The segment outlives the process only if it crashed
+    if (kill(Pid, 0) && errno == ESRCH) {
+      outs() << "Process " << Pid << " has exited\n";
+      return 0;
+    }
+
+    if (Error Err = Live.refresh()) {
+      errs() << "Error reading the live counters of process " << Pid << ": "
+             << toString(std::move(Err)) << "\n";
+      return -1;
+    }
+    std::vector<uint64_t> Current = takeSample(Live.getModules());
+    Clock::time_point CurrentTime = Clock::now();
+    double Seconds =
+        std::chrono::duration<double>(CurrentTime - PreviousTime).count();
+
+    // Modules registered since the previous sample start from 0
+    std::vector<FunctionRate> Rates;
+    size_t Idx = 0;
+    for (const LiveModule &Module : Live.getModules())
+      for (StringRef Name : Module.Names) {
+        uint64_t Before = Idx < Previous.size() ? Previous[Idx] : 0;
+        uint64_t Delta = Current[Idx] - Before;
+        Rates.push_back({Name, Seconds > 0 ? Delta / Seconds : 0.0,
+                         Current[Idx]});
+        Idx++;
+      }
+
+    llvm::stable_sort(Rates, [](const FunctionRate &A, const FunctionRate &B) {
+      return std::make_tuple(B.Rate, B.Total, A.Name) <
+             std::make_tuple(A.Rate, A.Total, B.Name);
+    });
+    if (Rates.size() > Top)
+      Rates.resize(Top);
+
+    printRates(outs(), Live.getProgramName(), Rates);
+    Previous = std::move(Current);
+    PreviousTime = CurrentTime;
+  }
+
+  return 0;
+}
@@ -0,0 +1,370 @@
+//========================================================================
+// FILE:
+//    TraceMain.cpp
+//
+// DESCRIPTION:
+//    A command-line tool that decodes the function traces recorded by
+//    `inject-func-call<trace>` and prints them as text or CSV. lt_rt writes
+//    the events of every thread separately (see ProfileFormat.h), this tool
+//    merges them into a single timeline (ordered by timestamp). Times are
+//    printed relative to the first event. If a thread recorded more events
+//    than its ring buffer could hold, only the most recent ones are printed
+//    and a warning reports how many were lost.
+//
+//    With `--format=chrome`, prints the trace in the Chrome Trace Event
+//    format (JSON), which can be loaded into chrome://tracing or Perfetto
+//    (https://ui.perfetto.dev). For traces recorded with
+//    `inject-func-call<trace=entry-exit>`, every call becomes a "complete"
+//    event (i.e. with a duration) on its thread's timeline, so the viewer
+//    shows the nesting of the calls and where the time goes. Calls whose
+//    exit wasn't recorded (e.g. because the function unwound without a
+//    `resume`, called `exit` or was still running when the trace was written)
+//    end when their caller ends (or at the last event of the thread). Exits
+//    whose entry was overwritten are ignored. Traces without exit events
+//    become "instant" events.
+//
+//    The arguments captured with `inject-func-call<args=FILE>` are printed
+//    next to their function entries (integers in decimal, pointers in hex),
+//    e.g. `arg2=4096`.
+//
+// USAGE:
+//    # First, generate a trace:
+//      opt -load-pass-plugin <BUILD_DIR>/lib/libInjectFuncCall.so `\`
+//        -passes="inject-func-call<trace>" <input-llvm-file> -o traced.bc
+//      clang traced.bc -L<BUILD_DIR>/lib -llt_rt -o traced
+//      LT_TRACE_FILE=trace.lttrace ./traced
+//    # Now you can run this tool as follows:
+//      <BUILD/DIR>/bin/lt-trace trace.lttrace
+//      <BUILD/DIR>/bin/lt-trace --format=csv trace.lttrace
+//      <BUILD/DIR>/bin/lt-trace --format=chrome trace.lttrace > trace.json
+//
+// License: MIT
+//========================================================================
+#include "ProfileReader.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cmath>
+#include <map>
+
+using namespace llvm;
+
+//===----------------------------------------------------------------------===//
+// Command line options
+//===----------------------------------------------------------------------===//
+static cl::OptionCategory TraceCategory{"trace decoder options"};
+
+static cl::opt<std::string> InputTrace{cl::Positional,
+                                       cl::desc{"<Trace to read>"},
+                                       cl::value_desc{"trace filename"},
+                                       cl::init(""),
+                                       cl::Required,
+                                       cl::cat{TraceCategory}};
+
+enum class OutputFormat { Text, CSV, Chrome };
+static cl::opt<OutputFormat> Format{
+    "format", cl::desc{"Output format"},
+    cl::values(clEnumValN(OutputFormat::Text, "text", "Human readable table"),
+               clEnumValN(OutputFormat::CSV, "csv", "Comma-separated values"),
+               clEnumValN(OutputFormat::Chrome, "chrome",
+                          "Chrome Trace Event format (JSON)")),
+    cl::init(OutputFormat::Text), cl::cat{TraceCategory}};
+
+//===----------------------------------------------------------------------===//
+// lt-trace - implementation
+//===----------------------------------------------------------------------===//
+// An argument captured with `inject-func-call<args=FILE>`
+struct CapturedArg {
+  uint16_t Index;
+  bool IsPointer;
+  uint64_t Value;
+};
+
+struct TraceEntry {
+  // Relative to the first event
+  uint64_t Time;
+  uint64_t Thread;
+  // The function ID (names of static functions might be ambiguous)
+  uint32_t Function;
+  StringRef Name;
+  uint16_t NumArgs;
+  bool IsExit;
+  // Function entries only
+  SmallVector<CapturedArg, 2> Args;
+};
+
+// Returns the captured arguments of Entry as "argN=value argM=value"
+static std::string formatArgs(const TraceEntry &Entry) {
+  std::string Str;
+  raw_string_ostream OS(Str);
+  for (const CapturedArg &Arg : Entry.Args) {
+    if (!Str.empty())
+      OS << " ";
+    OS << "arg" << Arg.Index << "=";
+    if (Arg.IsPointer)
+      OS << format_hex(Arg.Value, 0);
+    else
+      OS << static_cast<int64_t>(Arg.Value);
+  }
+  return OS.str();
+}
+
+static void printText(raw_ostream &OS, ArrayRef<TraceEntry> Entries,
+                      const char *TimeUnit) {
+  OS << "=================================================\n";
+  OS << "LLVM-TUTOR: function trace\n";
+  OS << "=================================================\n";
+  std::string Str1 = (Twine("TIME (") + TimeUnit + ")").str();
+  const char *Str2 = "THREAD";
+  const char *Str3 = "EVENT";
+  const char *Str4 = "NAME";
+  const char *Str5 = "#N ARGS";
+  const char *Str6 = "CAPTURED";
+  OS << format("%-15s %-8s %-6s %-20s %-7s %s\n", Str1.c_str(), Str2, Str3,
+               Str4, Str5, Str6);
+  OS << "-------------------------------------------------\n";
+  for (auto &Entry : Entries) {
+    if (Entry.IsExit)
+      OS << format("%-15lu %-8lu exit   %s\n", Entry.Time, Entry.Thread,
+                   Entry.Name.str().c_str());
+    else if (Entry.Args.empty())
+      OS << format("%-15lu %-8lu enter  %-20s %u\n", Entry.Time, Entry.Thread,
+                   Entry.Name.str().c_str(), Entry.NumArgs);
+    else
+      OS << format("%-15lu %-8lu enter  %-20s %-7u %s\n", Entry.Time,
+                   Entry.Thread, Entry.Name.str().c_str(), Entry.NumArgs,
+                   formatArgs(Entry).c_str());
+  }
+}
+
+static void printCSV(raw_ostream &OS, ArrayRef<TraceEntry> Entries) {
+  OS << "time,thread,event,name,args,captured\n";
+  for (auto &Entry : Entries) {
+    OS << Entry.Time << "," << Entry.Thread << ","
+       << (Entry.IsExit ? "exit" : "enter") << "," << Entry.Name << ",";
+    if (!Entry.IsExit)
+      OS << Entry.NumArgs << "," << formatArgs(Entry);
+    else
+      OS << ",";
+    OS << "\n";
+  }
+}
+
+// Prints Entries in the Chrome Trace Event format. Timestamps are in
+// microseconds, Entries have to be sorted by time.
+static void printChrome(raw_ostream &OS, ArrayRef<TraceEntry> Entries,
+                        uint64_t TicksPerSecond) {
+  // Rounded to nanoseconds
+  auto ToMicroseconds = [TicksPerSecond](uint64_t Ticks) {
+    return std::round(static_cast<double>(Ticks) * 1e9 /
+                      static_cast<double>(TicksPerSecond)) /
+           1e3;
+  };
+
+  // The events of every thread, in order
+  std::map<uint64_t, std::vector<const TraceEntry *>> Threads;
+  for (auto &Entry : Entries)
+    Threads[Entry.Thread].push_back(&Entry);
+
+  json::OStream J(OS, /*IndentSize=*/1);
+  // Pointers are printed as hex strings
+  auto EmitArgs = [&J](const TraceEntry *Entry) {
+    J.attributeObject("args", [&] {
+      J.attribute("num_args", Entry->NumArgs);
+      for (const CapturedArg &Arg : Entry->Args) {
+        std::string Name = formatv("arg{0}", Arg.Index).str();
+        if (Arg.IsPointer)
+          J.attribute(Name, formatv("{0:x}", Arg.Value).str());
+        else
+          J.attribute(Name, static_cast<int64_t>(Arg.Value));
+      }
+    });
+  };
+  J.object([&] {
+    J.attribute("displayTimeUnit", "ns");
+    J.attributeArray("traceEvents", [&] {
+      for (auto &[Thread, Events] : Threads) {
+        J.object([&, Thread = Thread] {
+          J.attribute("name", "thread_name");
+          J.attribute("ph", "M");
+          J.attribute("pid", 1);
+          J.attribute("tid", static_cast<int64_t>(Thread));
+          J.attributeObject("args", [&] {
+            J.attribute("name", formatv("thread {0}", Thread).str());
+          });
+        });
+
+        // Emits a complete event for the call that began with Entry and
+        // ended at End
+        auto EmitCall = [&, Thread = Thread](const TraceEntry *Entry,
+                                             uint64_t End) {
+          J.object([&] {
+            J.attribute("name", Entry->Name);
+            J.attribute("ph", "X");
+            J.attribute("ts", ToMicroseconds(Entry->Time));
+            J.attribute("dur", ToMicroseconds(End - Entry->Time));
+            J.attribute("pid", 1);
+            J.attribute("tid", static_cast<int64_t>(Thread));
+            EmitArgs(Entry);
+          });
+        };
+
+        bool HasExits = llvm::any_of(
+            Events, [](const TraceEntry *Entry) { return Entry->IsExit; });
+        if (!HasExits) {
+          for (const TraceEntry *Entry : Events)
+            J.object([&, Thread = Thread] {
+              J.attribute("name", Entry->Name);
+              J.attribute("ph", "i");
+              J.attribute("s", "t");
+              J.attribute("ts", ToMicroseconds(Entry->Time));
+              J.attribute("pid", 1);
+              J.attribute("tid", static_cast<int64_t>(Thread));
+              EmitArgs(Entry);
+            });
+          continue;
+        }
+
+        // Match the exits with the entries
+        std::vector<const TraceEntry *> Stack;
+        for (const TraceEntry *Entry : Events) {
+          if (!Entry->IsExit) {
+            Stack.push_back(Entry);
+            continue;
+          }
+
+          auto Match = llvm::find_if(
+              llvm::reverse(Stack),
+              [Entry](const TraceEntry *E) {
+                return E->Function == Entry->Function;
+              });
+          if (Match == Stack.rend())
+            continue;
+          // The callees without exits end together with this call
+          while (Stack.back() != *Match) {
+            EmitCall(Stack.back(), Entry->Time);
+            Stack.pop_back();
+          }
+          EmitCall(Stack.back(), Entry->Time);
+          Stack.pop_back();
+        }
+        for (const TraceEntry *Entry : llvm::reverse(Stack))
+          EmitCall(Entry, Events.back()->Time);
+      }
+    });
+  });
+  OS << "\n";
+}
+
+//===----------------------------------------------------------------------===//
+// Main driver code.
+//===----------------------------------------------------------------------===//
+int main(int Argc, char **Argv) {
+  // Hide all options apart from the ones specific to this tool
+  cl::HideUnrelatedOptions(TraceCategory);
+
+  cl::ParseCommandLineOptions(Argc, Argv,
+                              "Decodes function traces recorded by "
+                              "inject-func-call<trace>\n");
+
+  // Makes sure llvm_shutdown() is called (which cleans up LLVM objects)
+  //  http://llvm.org/docs/ProgrammersManual.html#ending-execution-with-llvm-shutdown
+  llvm_shutdown_obj SDO;
+
+  // Memory-map the input file (the events are read in place)
+  auto Buffer = MemoryBuffer::getFile(InputTrace, /*IsText=*/false,
+                                      /*RequiresNullTerminator=*/false);
+  if (!Buffer) {
+    errs() << "Error reading trace: " << InputTrace << ": "
+           << Buffer.getError().message() << "\n";
+    return -1;
+  }
+
+  auto Trace = readProfile((*Buffer)->getMemBufferRef());
+  if (!Trace) {
+    errs() << "Error reading trace: " << InputTrace << ": "
+           << toString(Trace.takeError()) << "\n";
+    return -1;
+  }
+
+  // Merge the per-thread buffers. All threads of one process are timed with
+  // the same clock.
+  std::vector<TraceEntry> Entries;
+  // The index of the last function entry of every thread in Entries. The
+  // captured arguments are attached to it.
+  std::map<uint64_t, size_t> LastEntry;
+  const char *TimeUnit = "ns";
+  uint64_t TicksPerSecond = 1000000000;
+  std::map<uint64_t, uint64_t> Dropped;
+  for (auto &Thread : Trace->TraceThreads) {
+    if (Thread.InCycles)
+      TimeUnit = "cycles";
+    TicksPerSecond = Thread.TicksPerSecond;
+    if (Thread.Dropped)
+      Dropped[Thread.Thread] += Thread.Dropped;
+
+    for (auto &Event : Thread.Events) {
+      if (Event.Kind == ProfileTraceEvent::Argument ||
+          Event.Kind == ProfileTraceEvent::PointerArgument) {
+        // Arguments whose entry was overwritten are ignored
+        auto Last = LastEntry.find(Thread.Thread);
+        if (Last != LastEntry.end() &&
+            Entries[Last->second].Function == Event.Function)
+          Entries[Last->second].Args.push_back(
+              {Event.NumArgs,
+               Event.Kind == ProfileTraceEvent::PointerArgument,
+               Event.Timestamp});
+        continue;
+      }
+      if (Event.Kind != ProfileTraceEvent::Entry &&
+          Event.Kind != ProfileTraceEvent::Exit)
+        continue;
+
+      StringRef Name = "<unknown>";
+      if (Event.Function < Trace->TraceFunctions.size())
+        Name = Trace->TraceFunctions[Event.Function];
+      bool IsExit = Event.Kind == ProfileTraceEvent::Exit;
+      if (IsExit)
+        LastEntry.erase(Thread.Thread);
+      else
+        LastEntry[Thread.Thread] = Entries.size();
+      Entries.push_back({Event.Timestamp, Thread.Thread, Event.Function, Name,
+                         Event.NumArgs, IsExit, {}});
+    }
+  }
+
+  for (auto [Thread, Count] : Dropped)
+    errs() << "Warning: thread " << Thread << ": " << Count
+           << " event(s) were overwritten (see LT_RT_TRACE_BUFFER_SIZE and "
+              "LT_RT_TRACE_FLUSH)\n";
+
+  // Events with equal timestamps stay in the thread order
+  llvm::stable_sort(Entries, [](const TraceEntry &A, const TraceEntry &B) {
+    return A.Time < B.Time;
+  });
+  if (!Entries.empty()) {
+    uint64_t Start = Entries.front().Time;
+    for (auto &Entry : Entries)
+      Entry.Time -= Start;
+  }
+
+  switch (Format) {
+  case OutputFormat::Text:
+    printText(outs(), Entries, TimeUnit);
+    break;
+  case OutputFormat::CSV:
+    printCSV(outs(), Entries);
+    break;
+  case OutputFormat::Chrome:
+    printChrome(outs(), Entries, TicksPerSecond);
+    break;
+  }
+
+  return 0;
+}
@@ -0,0 +1,161 @@
+#! /bin/env bash
+# === benchmark_dcc_coverage.sh ===============================================
+#  Compare the overhead of DynamicCallCounter's coverage and counting modes
+#
+#  DESCRIPTION:
+#   This script generates a call-heavy input (a hot loop that calls small
+#   functions, some of them behind a data-dependent branch, NUM_CALLS times)
+#   and instruments it with DynamicCallCounter in the following modes:
+#     * no instrumentation (the baseline)
+#     * `dynamic-cc<flush>` and `dynamic-cc<coverage>` (one counter, or one
+#       coverage byte, per function)
+#     * `dynamic-cc<blocks=all>` and `dynamic-cc<coverage=blocks>` (one
+#       counter, or one coverage byte, per basic block)
+#   For every mode it prints the average wall time and the size of the
+#   profile. The instrumented binaries are built with -O2.
+#
+#  USAGE:
+#    export LLVM_DIR=<installation/dir/of/llvm/22>
+#    cd <llvm-tutor/source/dir>
+#    bash utils/benchmark_dcc_coverage.sh --build_dir <llvm-tutor/build/dir> `\`
+#      [--num_calls 200000000] [--num_runs 5]
+#
+# =============================================================================
+set -euo pipefail
+
+# The location of the llvm-tutor build directory
+LLVM_TUTOR_BUILD_DIR=""
+# The number of iterations of the hot loop
+NUM_CALLS=200000000
+# The number of times every binary is run
+NUM_RUNS=5
+# The modes to evaluate (counting and coverage, per function and per block)
+MODES="flush coverage blocks=all coverage=blocks"
+
+usage()
+{
+    echo "usage: benchmark_dcc_coverage -b build_dir [-c num_calls] [-r num_runs] | [-h]"
+}
+
+parse_args()
+{
+  while [ "${1:-}" != "" ]; do
+      case $1 in
+          -b | --build_dir )          shift
+                                      LLVM_TUTOR_BUILD_DIR=$1
+                                      ;;
+          -c | --num_calls )          shift
+                                      NUM_CALLS=$1
+                                      ;;
+          -r | --num_runs )           shift
+                                      NUM_RUNS=$1
+                                      ;;
+          -h | --help )               usage
+                                      exit
+                                      ;;
+          * )                         usage
+                                      exit 1
+      esac
+      shift
+  done
+
+  if [ -z "$LLVM_TUTOR_BUILD_DIR" ]; then
+    usage
+    exit 1
+  fi
+}
+
+# === generate_input ==========================================================
+#
+# Generates a C file with a hot loop that runs NUM_CALLS times. Every
+# iteration calls `step` and, depending on the (pseudo-random) state, either
+# `odd` or `even`. The functions are tiny, so the instrumentation is a large
+# part of the work done per call.
+# =============================================================================
+generate_input()
+{
+  local -r out=$1
+
+  cat > "$out" <<EOT
+#include <stdio.h>
+
+__attribute__((noinline)) unsigned step(unsigned x) {
+  return x * 1103515245u + 12345u;
+}
+
+__attribute__((noinline)) unsigned odd(unsigned x) { return x >> 3; }
+
+__attribute__((noinline)) unsigned even(unsigned x) {
+  if (x & 2)
+    return x ^ 0x5bd1e995u;
+  return x + 7;
+}
+
+int main(void) {
+  unsigned state = 1, sum = 0;
+  for (long i = 0; i < $NUM_CALLS; i++) {
+    state = step(state);
+    sum += (state >> 16) & 1 ? odd(state) : even(state);
+  }
+  printf("%u\n", sum);
+  return 0;
+}
+EOT
+}
+
+# === time_runs ===============================================================
+#
+# Runs the input command NUM_RUNS times and prints the average wall time (ms)
+# =============================================================================
+time_runs()
+{
+  local start end
+  start=$(date +%s%N)
+  for ((i = 0; i < NUM_RUNS; i++)); do
+    "$@" > /dev/null
+  done
+  end=$(date +%s%N)
+  echo $(( (end - start) / NUM_RUNS / 1000000 ))
+}
+
+# === main ====================================================================
+#
+# Entry point for this script
+# =============================================================================
+main()
+{
+  parse_args "$@"
+
+  local -r work_dir=$(mktemp -d)
+  trap 'rm -rf "$work_dir"' EXIT
+
+  local shlibext="so"
+  if [ "$(uname)" == "Darwin" ]; then
+    shlibext="dylib"
+  fi
+  local -r lib_dir="$LLVM_TUTOR_BUILD_DIR/lib"
+  local -r plugin="$lib_dir/libDynamicCallCounter.$shlibext"
+
+  generate_input "$work_dir/calls.c"
+  "$LLVM_DIR/bin/clang" -O1 -Xclang -disable-llvm-passes -emit-llvm -c \
+    "$work_dir/calls.c" -o "$work_dir/calls.bc"
+  "$LLVM_DIR/bin/clang" -O2 "$work_dir/calls.bc" -o "$work_dir/calls.none.bin"
+
+  printf "  %-36s %8s ms\n" "no instrumentation" \
+    "$(time_runs "$work_dir/calls.none.bin")"
+
+  for mode in $MODES; do
+    local pass="dynamic-cc<$mode>"
+    "$LLVM_DIR/bin/opt" -load-pass-plugin "$plugin" -passes="$pass" \
+      "$work_dir/calls.bc" -o "$work_dir/instrumented.bc"
+    "$LLVM_DIR/bin/clang" -O2 "$work_dir/instrumented.bc" -L"$lib_dir" \
+      -llt_rt -Wl,-rpath,"$lib_dir" -o "$work_dir/instrumented.bin"
+    rm -f "$work_dir/prof.ltprof"
+    printf "  %-36s %8s ms %8s bytes\n" "$pass" \
+      "$(LT_PROFILE_FILE="$work_dir/prof.ltprof" \
+         time_runs "$work_dir/instrumented.bin")" \
+      "$(wc -c < "$work_dir/prof.ltprof")"
+  done
+}
+
+main "$@"
@@ -0,0 +1,145 @@
+#! /bin/env bash
+# === benchmark_dcc_output.sh =================================================
+#  Compare the cost of the two DynamicCallCounter output paths
+#
+#  DESCRIPTION:
+#   This script generates a synthetic C file with a large number of functions
+#   (every function is called once from `main`), instruments it with
+#   DynamicCallCounter twice:
+#     * `dynamic-cc`         - results are printed via `printf_wrapper`
+#     * `dynamic-cc<binary>` - results are written to a binary profile
+#   and then times both binaries and the uninstrumented one. As the program
+#   itself does almost nothing, the difference from the uninstrumented binary
+#   is the time spent reporting the results at exit (the dump time). The
+#   output of the `printf` variant is measured twice: redirected to /dev/null
+#   (the best case for that path) and to a file.
+#
+#  USAGE:
+#    export LLVM_DIR=<installation/dir/of/llvm/22>
+#    cd <llvm-tutor/source/dir>
+#    bash utils/benchmark_dcc_output.sh --build_dir <llvm-tutor/build/dir> `\`
+#      [--num_functions 20000] [--num_runs 100]
+#
+# =============================================================================
+set -euo pipefail
+
+# The location of the llvm-tutor build directory
+LLVM_TUTOR_BUILD_DIR=""
+# The number of functions in the generated input file
+NUM_FUNCTIONS=20000
+# The number of times every binary is run
+NUM_RUNS=100
+
+usage()
+{
+    echo "usage: benchmark_dcc_output -b build_dir [-n num_functions] [-r num_runs] | [-h]"
+}
+
+parse_args()
+{
+  while [ "${1:-}" != "" ]; do
+      case $1 in
+          -b | --build_dir )          shift
+                                      LLVM_TUTOR_BUILD_DIR=$1
+                                      ;;
+          -n | --num_functions )      shift
+                                      NUM_FUNCTIONS=$1
+                                      ;;
+          -r | --num_runs )           shift
+                                      NUM_RUNS=$1
+                                      ;;
+          -h | --help )               usage
+                                      exit
+                                      ;;
+          * )                         usage
+                                      exit 1
+      esac
+      shift
+  done
+
+  if [ -z "$LLVM_TUTOR_BUILD_DIR" ]; then
+    usage
+    exit 1
+  fi
+}
+
+# === generate_input ==========================================================
+#
+# Generates a C file with NUM_FUNCTIONS functions, all called from main
+# =============================================================================
+generate_input()
+{
+  local -r out=$1
+
+  {
+    for ((i = 0; i < NUM_FUNCTIONS; i++)); do
+      echo "void func_$i(void) {}"
+    done
+    echo "int main(void) {"
+    for ((i = 0; i < NUM_FUNCTIONS; i++)); do
+      echo "  func_$i();"
+    done
+    echo "  return 0;"
+    echo "}"
+  } > "$out"
+}
+
+# === time_runs ===============================================================
+#
+# Runs the input command NUM_RUNS times and prints the average wall time (us).
+# The dump itself only takes a few milliseconds, so ms would be too coarse.
+# =============================================================================
+time_runs()
+{
+  local start end
+  start=$(date +%s%N)
+  for ((i = 0; i < NUM_RUNS; i++)); do
+    "$@"
+  done
+  end=$(date +%s%N)
+  echo $(( (end - start) / NUM_RUNS / 1000 ))
+}
+
+# === main ====================================================================
+#
+# Entry point for this script
+# =============================================================================
+main()
+{
+  parse_args "$@"
+
+  local -r work_dir=$(mktemp -d)
+  trap 'rm -rf "$work_dir"' EXIT
+
+  local shlibext="so"
+  if [ "$(uname)" == "Darwin" ]; then
+    shlibext="dylib"
+  fi
+  local -r plugin="$LLVM_TUTOR_BUILD_DIR/lib/libDynamicCallCounter.$shlibext"
+
+  generate_input "$work_dir/input.c"
+  "$LLVM_DIR/bin/clang" -O1 -emit-llvm -c "$work_dir/input.c" -o "$work_dir/input.bc"
+  "$LLVM_DIR/bin/clang" -O1 "$work_dir/input.bc" -o "$work_dir/none.bin"
+
+  for mode in "dynamic-cc" "dynamic-cc<binary>"; do
+    "$LLVM_DIR/bin/opt" -load-pass-plugin "$plugin" -passes="$mode" \
+      "$work_dir/input.bc" -o "$work_dir/instrumented.bc"
+    "$LLVM_DIR/bin/clang" -O1 "$work_dir/instrumented.bc" -o "$work_dir/$mode.bin"
+  done
+
+  # Every run appends a record to the profile - the file isn't removed between
+  # the runs, so that the timed command doesn't start another process
+  export LT_PROFILE_FILE="$work_dir/prof.ltprof"
+  none_us=$(time_runs sh -c "\"$work_dir/none.bin\" > /dev/null")
+  printf_us=$(time_runs sh -c "\"$work_dir/dynamic-cc.bin\" > /dev/null")
+  file_us=$(time_runs sh -c "\"$work_dir/dynamic-cc.bin\" > \"$work_dir/out.txt\"")
+  binary_us=$(time_runs sh -c "\"$work_dir/dynamic-cc<binary>.bin\"")
+
+  echo "Functions:               $NUM_FUNCTIONS"
+  echo "no instrumentation:      $none_us us"
+  echo "dynamic-cc (/dev/null):  $printf_us us (dump: $((printf_us - none_us)) us)"
+  echo "dynamic-cc (file):       $file_us us (dump: $((file_us - none_us)) us)"
+  echo "dynamic-cc<binary>:      $binary_us us (dump: $((binary_us - none_us)) us)"
+}
+
+main "$@"
@@ -0,0 +1,175 @@
+#! /bin/env bash
+# === benchmark_dcc_promotion.sh ==============================================
+#  Measure the effect of promoting DynamicCallCounter's counters out of loops
+#
+#  DESCRIPTION:
+#   This script generates a loop-heavy input (a hot loop over an array with a
+#   data-dependent branch and a call, repeated NUM_REPEATS times) and
+#   instruments it with DynamicCallCounter in the following modes:
+#     * no instrumentation (the baseline)
+#     * `dynamic-cc<blocks=all>`, `dynamic-cc<blocks>` and `dynamic-cc<edges>`,
+#       each with and without `no-promote`
+#   For every mode it prints the average wall time. The instrumented binaries
+#   are built with -O2, so that the effect of promotion on vectorisation is
+#   included.
+#
+#  USAGE:
+#    export LLVM_DIR=<installation/dir/of/llvm/22>
+#    cd <llvm-tutor/source/dir>
+#    bash utils/benchmark_dcc_promotion.sh --build_dir <llvm-tutor/build/dir> `\`
+#      [--array_size 4096] [--num_repeats 200000] [--num_runs 5]
+#
+# =============================================================================
+set -euo pipefail
+
+# The location of the llvm-tutor build directory
+LLVM_TUTOR_BUILD_DIR=""
+# The number of elements in the array traversed by the hot loop
+ARRAY_SIZE=4096
+# The number of times the hot loop is run
+NUM_REPEATS=200000
+# The number of times every binary is run
+NUM_RUNS=5
+# The modes to evaluate
+MODES="blocks=all blocks edges"
+
+usage()
+{
+    echo "usage: benchmark_dcc_promotion -b build_dir [-s array_size] [-i num_repeats] [-r num_runs] | [-h]"
+}
+
+parse_args()
+{
+  while [ "${1:-}" != "" ]; do
+      case $1 in
+          -b | --build_dir )          shift
+                                      LLVM_TUTOR_BUILD_DIR=$1
+                                      ;;
+          -s | --array_size )         shift
+                                      ARRAY_SIZE=$1
+                                      ;;
+          -i | --num_repeats )        shift
+                                      NUM_REPEATS=$1
+                                      ;;
+          -r | --num_runs )           shift
+                                      NUM_RUNS=$1
+                                      ;;
+          -h | --help )               usage
+                                      exit
+                                      ;;
+          * )                         usage
+                                      exit 1
+      esac
+      shift
+  done
+
+  if [ -z "$LLVM_TUTOR_BUILD_DIR" ]; then
+    usage
+    exit 1
+  fi
+}
+
+# === generate_input ==========================================================
+#
+# Generates a C file with a hot loop over an array of ARRAY_SIZE pseudo-random
+# integers. The loop contains a data-dependent (i.e. poorly predicted) branch,
+# so that it only runs fast once the branch is if-converted and vectorised.
+# `accumulate` is run NUM_REPEATS times from a loop that also contains a call.
+# =============================================================================
+generate_input()
+{
+  local -r out=$1
+
+  cat > "$out" <<EOT
+#include <stdio.h>
+
+static int data[$ARRAY_SIZE];
+
+__attribute__((noinline)) long accumulate(const int *a, long n) {
+  long sum = 0;
+  for (long i = 0; i < n; i++) {
+    if (a[i] & 1)
+      sum += a[i];
+    else
+      sum -= 1;
+  }
+  return sum;
+}
+
+__attribute__((noinline)) void init(int *a, long n) {
+  for (long i = 0; i < n; i++)
+    a[i] = (int)(((unsigned)i * 2654435761u) >> 7);
+}
+
+int main(void) {
+  long total = 0;
+  init(data, $ARRAY_SIZE);
+  for (long r = 0; r < $NUM_REPEATS; r++) {
+    // Modify the array (without changing the outcome of the branch), so that
+    // the call isn't loop-invariant - otherwise it is hoisted out of this loop
+    // in the uninstrumented binary
+    data[r % $ARRAY_SIZE] += 2;
+    total += accumulate(data, $ARRAY_SIZE);
+  }
+  printf("%ld\n", total);
+  return 0;
+}
+EOT
+}
+
+# === time_runs ===============================================================
+#
+# Runs the input command NUM_RUNS times and prints the average wall time (ms)
+# =============================================================================
+time_runs()
+{
+  local start end
+  start=$(date +%s%N)
+  for ((i = 0; i < NUM_RUNS; i++)); do
+    "$@" > /dev/null
+  done
+  end=$(date +%s%N)
+  echo $(( (end - start) / NUM_RUNS / 1000000 ))
+}
+
+# === main ====================================================================
+#
+# Entry point for this script
+# =============================================================================
+main()
+{
+  parse_args "$@"
+
+  local -r work_dir=$(mktemp -d)
+  trap 'rm -rf "$work_dir"' EXIT
+
+  local shlibext="so"
+  if [ "$(uname)" == "Darwin" ]; then
+    shlibext="dylib"
+  fi
+  local -r lib_dir="$LLVM_TUTOR_BUILD_DIR/lib"
+  local -r plugin="$lib_dir/libDynamicCallCounter.$shlibext"
+
+  generate_input "$work_dir/loops.c"
+  "$LLVM_DIR/bin/clang" -O1 -Xclang -disable-llvm-passes -emit-llvm -c \
+    "$work_dir/loops.c" -o "$work_dir/loops.bc"
+  "$LLVM_DIR/bin/clang" -O2 "$work_dir/loops.bc" -o "$work_dir/loops.none.bin"
+
+  printf "  %-36s %8s ms\n" "no instrumentation" \
+    "$(time_runs "$work_dir/loops.none.bin")"
+
+  for mode in $MODES; do
+    for promote in "" ";no-promote"; do
+      local pass="dynamic-cc<$mode$promote>"
+      "$LLVM_DIR/bin/opt" -load-pass-plugin "$plugin" -passes="$pass" \
+        "$work_dir/loops.bc" -o "$work_dir/instrumented.bc"
+      "$LLVM_DIR/bin/clang" -O2 "$work_dir/instrumented.bc" -L"$lib_dir" \
+        -llt_rt -Wl,-rpath,"$lib_dir" -o "$work_dir/instrumented.bin"
+      printf "  %-36s %8s ms\n" "$pass" \
+        "$(LT_PROFILE_FILE="$work_dir/prof.ltprof" \
+           time_runs "$work_dir/instrumented.bin")"
+    done
+  done
+}
+
+main "$@"
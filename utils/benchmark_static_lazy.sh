@@ -0,0 +1,140 @@
+#! /bin/env bash
+# === benchmark_static_lazy.sh ================================================
+#  Compare lazy and eager bitcode loading in `static`
+#
+#  DESCRIPTION:
+#   This script generates a large input (NUM_FUNCTIONS functions, each making
+#   a few calls), compiles it to bitcode (with debug info, which makes up a
+#   large part of real-world bitcode) and runs `static` on it:
+#     * with the default lazy loading (one function body at a time)
+#     * with `--eager` (the whole module is parsed up front)
+#   For both it prints the size of the bitcode file, the average wall time and
+#   the peak RSS. The peak RSS is measured with GNU time (`/usr/bin/time`), so
+#   this script is Linux-only.
+#
+#  USAGE:
+#    export LLVM_DIR=<installation/dir/of/llvm/22>
+#    cd <llvm-tutor/source/dir>
+#    bash utils/benchmark_static_lazy.sh --build_dir <llvm-tutor/build/dir> `\`
+#      [--num_functions 50000] [--num_runs 5]
+#
+# =============================================================================
+set -euo pipefail
+
+# The location of the llvm-tutor build directory
+LLVM_TUTOR_BUILD_DIR=""
+# The number of functions in the generated input
+NUM_FUNCTIONS=50000
+# The number of times `static` is run in every mode
+NUM_RUNS=5
+
+usage()
+{
+    echo "usage: benchmark_static_lazy -b build_dir [-f num_functions] [-r num_runs] | [-h]"
+}
+
+parse_args()
+{
+  while [ "${1:-}" != "" ]; do
+      case $1 in
+          -b | --build_dir )          shift
+                                      LLVM_TUTOR_BUILD_DIR=$1
+                                      ;;
+          -f | --num_functions )      shift
+                                      NUM_FUNCTIONS=$1
+                                      ;;
+          -r | --num_runs )           shift
+                                      NUM_RUNS=$1
+                                      ;;
+          -h | --help )               usage
+                                      exit
+                                      ;;
+          * )                         usage
+                                      exit 1
+      esac
+      shift
+  done
+
+  if [ -z "$LLVM_TUTOR_BUILD_DIR" ]; then
+    usage
+    exit 1
+  fi
+}
+
+# === generate_input ==========================================================
+#
+# Generates a C file with NUM_FUNCTIONS functions. Every function makes a
+# couple of direct calls (to its predecessors and to `printf`) and contains
+# some arithmetic, so that the function bodies dominate the size of the
+# bitcode.
+# =============================================================================
+generate_input()
+{
+  local -r out=$1
+
+  {
+    echo "#include <stdio.h>"
+    echo "int f0(int x) { return x; }"
+    for ((i = 1; i < NUM_FUNCTIONS; i++)); do
+      cat <<EOT
+int f$i(int x) {
+  int y = x * $i + 7;
+  if (y % 3)
+    y = f$((i - 1))(y) ^ (y >> 2);
+  else
+    y = f$((i / 2))(y + 1) - $i;
+  for (int k = 0; k < 4; k++)
+    y += k * x;
+  printf("%d\n", y);
+  return y;
+}
+EOT
+    done
+    echo "int main(void) { return f$((NUM_FUNCTIONS - 1))(1); }"
+  } > "$out"
+}
+
+# === measure_runs ============================================================
+#
+# Runs the input command NUM_RUNS times and prints the average wall time (ms)
+# and the peak RSS (KB, the maximum over all runs)
+# =============================================================================
+measure_runs()
+{
+  local total_ms=0 max_rss=0 seconds rss
+  for ((i = 0; i < NUM_RUNS; i++)); do
+    read -r seconds rss < <(/usr/bin/time -f "%e %M" "$@" 2>&1 > /dev/null \
+      | tail -n 1)
+    total_ms=$(( total_ms + $(awk "BEGIN { print int($seconds * 1000) }") ))
+    if (( rss > max_rss )); then
+      max_rss=$rss
+    fi
+  done
+  echo "$(( total_ms / NUM_RUNS )) ms $max_rss KB"
+}
+
+# === main ====================================================================
+#
+# Entry point for this script
+# =============================================================================
+main()
+{
+  parse_args "$@"
+
+  local -r work_dir=$(mktemp -d)
+  trap 'rm -rf "$work_dir"' EXIT
+
+  local -r static="$LLVM_TUTOR_BUILD_DIR/bin/static"
+
+  generate_input "$work_dir/big.c"
+  "$LLVM_DIR/bin/clang" -O0 -g -emit-llvm -c "$work_dir/big.c" \
+    -o "$work_dir/big.bc"
+  echo "  bitcode size: $(wc -c < "$work_dir/big.bc") bytes"
+
+  printf "  %-36s %s\n" "static (lazy)" \
+    "$(measure_runs "$static" "$work_dir/big.bc")"
+  printf "  %-36s %s\n" "static --eager" \
+    "$(measure_runs "$static" --eager "$work_dir/big.bc")"
+}
+
+main "$@"